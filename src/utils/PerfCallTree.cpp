@@ -0,0 +1,233 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "PerfCallTree.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+const uint64_t PerfCallTree::sNoScope;
+
+namespace
+{
+    /// Works out the self times and sorts the children
+    void finishNode(PerfCallTree::Node& ioNode)
+    {
+        uint64_t children = 0;
+        for (PerfCallTree::Node& child : ioNode.children)
+        {
+            finishNode(child);
+            children += child.inclusive;
+        }
+        
+        // Children measured on their own clock reads may add up to a little more than their parent
+        //
+        ioNode.self = ioNode.inclusive > children ? ioNode.inclusive - children : 0;
+        
+        std::stable_sort(ioNode.children.begin(), ioNode.children.end(), [](const PerfCallTree::Node& iA, const PerfCallTree::Node& iB)
+        {
+            return iA.inclusive > iB.inclusive;
+        });
+    }
+    
+    void writeTextNode(std::ostream& oStream, const PerfCallTree::Node& iNode, int iDepth)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "%12.3f %12.3f %10llu  %*s"
+                 , iNode.inclusive / 1000.0
+                 , iNode.self / 1000.0
+                 , static_cast<unsigned long long>(iNode.calls)
+                 , iDepth * 2, ""
+                 );
+        oStream << line << iNode.label << "\n";
+        
+        for (const PerfCallTree::Node& child : iNode.children)
+            writeTextNode(oStream, child, iDepth + 1);
+    }
+    
+    void writeFoldedNode(std::ostream& oStream, const PerfCallTree::Node& iNode, std::string& ioPath)
+    {
+        size_t length = ioPath.length();
+        
+        if (length)
+            ioPath += ';';
+        
+        // ; separates the frames and the last space the count, neither can be part of a frame
+        //
+        for (char c : iNode.label)
+            ioPath += (c == ';' || c == ' ' || c == '\n') ? '_' : c;
+        
+        if (iNode.self)
+            oStream << ioPath << " " << iNode.self << "\n";
+        
+        for (const PerfCallTree::Node& child : iNode.children)
+            writeFoldedNode(oStream, child, ioPath);
+        
+        ioPath.resize(length);
+    }
+}
+
+void PerfCallTree::start()
+{
+    profiling_.store(false, std::memory_order_relaxed);
+    
+    // Every thread clears its tree the next time it enters a scope
+    //
+    generation_.fetch_add(1, std::memory_order_relaxed);
+    shards_.forEach([](Shard&) {}, true);
+    
+    profiling_.store(true, std::memory_order_relaxed);
+}
+
+uint64_t PerfCallTree::enterScope(const char* iLabel)
+{
+    if (!iLabel)
+        iLabel = "";
+    
+    uint32_t generation = generation_.load(std::memory_order_relaxed);
+    uint64_t hash = perfLabelHash(iLabel);
+    Shard& shard = shards_.local();
+    
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    if (shard.generation != generation)
+    {
+        shard.nodes.clear();
+        shard.nodes.push_back(ThreadNode{0, std::string(), 0, 0, 0, std::vector<uint32_t>()});
+        shard.current = 0;
+        shard.generation = generation;
+    }
+    
+    uint32_t parent = shard.current;
+    uint32_t node = 0;
+    
+    for (uint32_t child : shard.nodes[parent].children)
+    {
+        if (shard.nodes[child].hash == hash && shard.nodes[child].label == iLabel)
+        {
+            node = child;
+            break;
+        }
+    }
+    
+    if (!node)
+    {
+        node = static_cast<uint32_t>(shard.nodes.size());
+        shard.nodes.push_back(ThreadNode{hash, iLabel, parent, 0, 0, std::vector<uint32_t>()});
+        shard.nodes[parent].children.push_back(node);
+    }
+    
+    shard.current = node;
+    
+    return (static_cast<uint64_t>(generation) << 32) | node;
+}
+
+void PerfCallTree::exitScope(uint64_t iScope, uint64_t iDuration)
+{
+    uint32_t generation = static_cast<uint32_t>(iScope >> 32);
+    uint32_t node = static_cast<uint32_t>(iScope);
+    Shard& shard = shards_.local();
+    
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    // Entered before the tree was cleared
+    //
+    if (shard.generation != generation || node >= shard.nodes.size())
+        return;
+    
+    ThreadNode& target = shard.nodes[node];
+    target.calls++;
+    target.inclusive += iDuration;
+    
+    shard.current = target.parent;
+}
+
+void PerfCallTree::merge(const std::vector<ThreadNode>& iNodes, uint32_t iIndex, Node& ioTarget)
+{
+    for (uint32_t index : iNodes[iIndex].children)
+    {
+        const ThreadNode& source = iNodes[index];
+        
+        Node* target = nullptr;
+        for (Node& child : ioTarget.children)
+        {
+            if (child.label == source.label)
+            {
+                target = &child;
+                break;
+            }
+        }
+        
+        if (!target)
+        {
+            ioTarget.children.push_back(Node());
+            target = &ioTarget.children.back();
+            target->label = source.label;
+        }
+        
+        target->calls += source.calls;
+        target->inclusive += source.inclusive;
+        
+        merge(iNodes, index, *target);
+    }
+}
+
+PerfCallTree::Node PerfCallTree::snapshot()
+{
+    uint32_t generation = generation_.load(std::memory_order_relaxed);
+    Node root;
+    
+    shards_.forEach([&root, generation](Shard& ioShard)
+    {
+        std::lock_guard<std::mutex> lock(ioShard.mutex);
+        
+        if (ioShard.generation == generation && ioShard.nodes.size())
+            merge(ioShard.nodes, 0, root);
+    });
+    
+    for (const Node& child : root.children)
+    {
+        root.calls += child.calls;
+        root.inclusive += child.inclusive;
+    }
+    
+    finishNode(root);
+    
+    return root;
+}
+
+void PerfCallTree::writeText(std::ostream& oStream)
+{
+    Node root = snapshot();
+    
+    oStream << "Call tree, times in microseconds\n";
+    oStream << "   inclusive         self      calls  scope\n";
+    
+    for (const Node& child : root.children)
+        writeTextNode(oStream, child, 0);
+}
+
+void PerfCallTree::writeFolded(std::ostream& oStream)
+{
+    Node root = snapshot();
+    std::string path;
+    
+    for (const Node& child : root.children)
+        writeFoldedNode(oStream, child, path);
+}
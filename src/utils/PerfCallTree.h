@@ -0,0 +1,184 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+#include "Singleton.h"
+#include "PerfThreadShards.h"
+
+///
+/// \brief Call tree profiler built from nested PerfLogger scopes.
+///
+/// While profiling, every PerfLogger enters a node under the scope of the same thread
+/// that encloses it, so nested scopes are told apart from independent ones. Each thread
+/// builds its own tree, counting the calls and the inclusive time of every node.
+/// snapshot merges the trees of all of the threads by call path and works out the self
+/// time of every node, its inclusive time minus the inclusive time of its children.
+///
+/// The merged tree is written as text:
+///
+///       Call tree, times in microseconds
+///          inclusive         self      calls  scope
+///           1234.567      200.000        100  Frame
+///           1034.567     1034.567        100    Mix
+///
+/// or in the folded format of flame graph tools, the self time in nanoseconds of every call path:
+///
+///       Frame 200000
+///       Frame;Mix 1034567
+///
+/// Scopes still open are not counted. Scopes are expected to be nested,
+/// a PerfLogger moved to another thread or outliving its parent confuses the tree.
+///
+class PerfCallTree : public Singleton<PerfCallTree>
+{
+public:
+    
+    /// Returned by enter when not profiling
+    static const uint64_t sNoScope{UINT64_MAX};
+    
+    /// A scope of the merged tree
+    struct Node
+    {
+        std::string label;
+        uint64_t calls{0};
+        
+        /// Time in the scope in nanoseconds, including its children
+        uint64_t inclusive{0};
+        
+        /// Time in the scope in nanoseconds, excluding its children
+        uint64_t self{0};
+        
+        /// Sorted by inclusive time, longest first
+        std::vector<Node> children;
+    };
+    
+    PerfCallTree() {}
+    
+    virtual ~PerfCallTree() {}
+    
+    /**
+     * @return true while scopes are added to the tree
+     */
+    bool profiling() const
+    {
+        return profiling_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * Forgets the previous trees and starts profiling.
+     */
+    void start();
+    
+    /**
+     * Stops profiling, the trees are kept until the next start.
+     */
+    void stop()
+    {
+        profiling_.store(false, std::memory_order_relaxed);
+    }
+    
+    /**
+     * Enters a scope under the current scope of the calling thread.
+     *
+     * @param[in] iLabel label of the scope
+     *
+     * @return the scope to pass to exit, sNoScope when not profiling
+     */
+    uint64_t enter(const char* iLabel)
+    {
+        return profiling() ? enterScope(iLabel) : sNoScope;
+    }
+    
+    /**
+     * Leaves a scope, its parent becomes the current scope of the calling thread.
+     *
+     * @param[in] iScope the scope returned by enter
+     * @param[in] iDuration time spent in the scope in nanoseconds
+     */
+    void exit(uint64_t iScope, uint64_t iDuration)
+    {
+        if (iScope != sNoScope)
+            exitScope(iScope, iDuration);
+    }
+    
+    /**
+     * @return the trees of all of the threads merged under an unnamed root
+     */
+    Node snapshot();
+    
+    /**
+     * Writes the merged tree as text, see above.
+     */
+    void writeText(std::ostream& oStream);
+    
+    /**
+     * Writes the merged tree in the folded format, see above.
+     */
+    void writeFolded(std::ostream& oStream);
+    
+private:
+    
+    /// A scope of the tree of a thread
+    struct ThreadNode
+    {
+        uint64_t hash;
+        std::string label;
+        uint32_t parent;
+        uint64_t calls;
+        uint64_t inclusive;
+        std::vector<uint32_t> children;
+    };
+    
+    /// Tree of a thread
+    struct Shard
+    {
+        /// Guards everything below, taken by the owning thread for every scope
+        std::mutex mutex;
+        
+        /// nodes[0] is the root
+        std::vector<ThreadNode> nodes;
+        uint32_t current{0};
+        
+        /// The tree is cleared when this falls behind generation_
+        uint32_t generation{0};
+    };
+    
+    uint64_t enterScope(const char* iLabel);
+    
+    void exitScope(uint64_t iScope, uint64_t iDuration);
+    
+    /// Adds the children of iNodes[iIndex] to the children of ioTarget, matching them by label
+    static void merge(const std::vector<ThreadNode>& iNodes, uint32_t iIndex, Node& ioTarget);
+    
+    std::atomic<bool> profiling_{false};
+    
+    /// Incremented by start
+    std::atomic<uint32_t> generation_{1};
+    
+    PerfThreadShards<Shard> shards_;
+};
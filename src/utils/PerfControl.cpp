@@ -0,0 +1,160 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "PerfControl.h"
+#include "Trace.h"
+#include "TraceSinkRegistry.h"
+
+#include <mutex>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+    std::string trim(const std::string& iText)
+    {
+        size_t first = iText.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            return std::string();
+        
+        return iText.substr(first, iText.find_last_not_of(" \t\r\n") - first + 1);
+    }
+    
+    /// Compares the labels without building a std::string from the label of the scope
+    struct LabelLess
+    {
+        bool operator()(const std::string& iA, const char* iB) const
+        {
+            return strcmp(iA.c_str(), iB) < 0;
+        }
+        
+        bool operator()(const char* iA, const std::string& iB) const
+        {
+            return strcmp(iA, iB.c_str()) < 0;
+        }
+    };
+    
+    /// No sink is ever added, the scopes only read the filter in its read-side
+    /// critical sections so publish can wait for them before deleting a filter
+    TraceSinkRegistry& filterReaders()
+    {
+        static TraceSinkRegistry sReaders;
+        return sReaders;
+    }
+}
+
+#ifdef PERF_ENABLED
+std::atomic<uint32_t> PerfControl::state_{kState_On};
+#else
+std::atomic<uint32_t> PerfControl::state_{kState_Off};
+#endif
+
+std::atomic<const PerfControl::Filter*> PerfControl::filter_{nullptr};
+
+void PerfControl::setEnabled(bool iEnabled)
+{
+    publish(iEnabled ? kState_On : kState_Off, nullptr);
+}
+
+bool PerfControl::configure(const std::string& iSpecification)
+{
+    static const std::string sCategoryPrefix("kCategory_");
+    
+    std::string specification = trim(iSpecification);
+    
+    if (specification == "on" || specification == "off" || specification.empty())
+    {
+        setEnabled(specification == "on");
+        return true;
+    }
+    
+    std::unique_ptr<Filter> filter(new Filter());
+    bool valid = true;
+    
+    std::stringstream ss(specification);
+    std::string entry;
+    while (std::getline(ss, entry, ','))
+    {
+        entry = trim(entry);
+        if (entry.empty())
+            continue;
+        
+        if (entry.compare(0, sCategoryPrefix.length(), sCategoryPrefix) != 0)
+        {
+            filter->labels.push_back(entry);
+            continue;
+        }
+        
+        Trace::Category category = Trace::stringToCategory(entry);
+        if (category == Trace::kCategory_Off)
+        {
+            valid = false;
+            continue;
+        }
+        
+        filter->categories.push_back(category);
+    }
+    
+    std::sort(filter->labels.begin(), filter->labels.end());
+    
+    publish(kState_Filtered, filter.release());
+    
+    return valid;
+}
+
+bool PerfControl::filtered(const char* iLabel, uint64_t iCategory)
+{
+    // The filter stays valid until the reader is gone, see publish
+    //
+    TraceSinkRegistry::Reader reader(filterReaders());
+    const Filter* filter = filter_.load(std::memory_order_seq_cst);
+    if (!filter)
+        return false;
+    
+    for (uint64_t category : filter->categories)
+    {
+        if (category == iCategory)
+            return true;
+    }
+    
+    if (!iLabel)
+        return false;
+    
+    return std::binary_search(filter->labels.begin(), filter->labels.end(), iLabel, LabelLess());
+}
+
+void PerfControl::publish(State iState, const Filter* iFilter)
+{
+    static std::mutex sMutex;
+    
+    std::lock_guard<std::mutex> lock(sMutex);
+    
+    // The filter first, so a scope seeing kState_Filtered finds it
+    //
+    std::unique_ptr<const Filter> previous(filter_.exchange(iFilter, std::memory_order_seq_cst));
+    state_.store(iState, std::memory_order_release);
+    
+    // Wait for the scopes still reading the previous filter before deleting it
+    //
+    if (previous)
+        filterReaders().synchronize();
+}
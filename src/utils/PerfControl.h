@@ -0,0 +1,116 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+///
+/// \brief Runtime switch of PerfLogger.
+///
+/// PerfLogger is compiled in unless PERF_DISABLED is defined, every scope then asks
+/// PerfControl whether it is enabled. A disabled scope costs a load and a branch, it reads
+/// no clock and copies no label. Scopes are enabled all together, or by label or category:
+///
+///       on                          every scope
+///       off                         no scope, the default
+///       Frame,Mix,kCategory_UI      the scopes labelled Frame or Mix, and the scopes of kCategory_UI
+///
+/// The specification is set with configure, by the perf option of the trace configuration,
+/// or from a StartupOptions file with an option declared by the application:
+///
+///       StartupOptionString perfScopes("PerfScopes", "off");
+///       ...
+///       PerfControl::configure(perfScopes);
+///
+/// Builds defining PERF_ENABLED, which used to compile PerfLogger in, start with every scope enabled.
+///
+/// Note - a scope is enabled, or not, when it starts. Changing the configuration
+///        does not affect the scopes already started.
+///
+class PerfControl
+{
+public:
+    
+    enum State
+    {
+          kState_Off        ///< No scope is enabled
+        , kState_On         ///< Every scope is enabled
+        , kState_Filtered   ///< Only the labels and categories configured are enabled
+    };
+    
+    /**
+     * @param[in] iLabel label of the scope
+     * @param[in] iCategory Trace::Category of the scope
+     *
+     * @return true if the scope is to be measured
+     */
+    static bool enabled(const char* iLabel, uint64_t iCategory)
+    {
+        uint32_t state = state_.load(std::memory_order_relaxed);
+        if (state == kState_Off)
+            return false;
+        
+        return state == kState_On || filtered(iLabel, iCategory);
+    }
+    
+    /**
+     * Enables or disables every scope, forgetting the labels and categories configured.
+     */
+    static void setEnabled(bool iEnabled);
+    
+    /**
+     * Enables the scopes described by a specification, see above.
+     *
+     * @param[in] iSpecification on, off, or a comma separated list of labels and categories
+     *
+     * @return false if the specification names an unknown category, which is ignored
+     */
+    static bool configure(const std::string& iSpecification);
+    
+    /**
+     * @return the current State
+     */
+    static State state()
+    {
+        return static_cast<State>(state_.load(std::memory_order_relaxed));
+    }
+    
+private:
+    
+    /// Labels and categories of kState_Filtered, never changed once published
+    struct Filter
+    {
+        /// Sorted
+        std::vector<std::string> labels;
+        std::vector<uint64_t> categories;
+    };
+    
+    static bool filtered(const char* iLabel, uint64_t iCategory);
+    
+    /// Replaces the filter, the previous one is deleted once no scope is reading it
+    static void publish(State iState, const Filter* iFilter);
+    
+    static std::atomic<uint32_t> state_;
+    static std::atomic<const Filter*> filter_;
+};
@@ -0,0 +1,159 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "PerfHistogram.h"
+
+#include <math.h>
+#include <algorithm>
+
+const uint32_t PerfHistogram::sSubBuckets;
+const uint64_t PerfHistogram::sMaxValue;
+
+namespace
+{
+    /// log2 of PerfHistogram::sSubBuckets
+    const uint32_t sSubBucketBits{5};
+    
+    static_assert((1u << sSubBucketBits) == PerfHistogram::sSubBuckets, "sSubBucketBits does not match sSubBuckets!");
+    
+    /**
+     * @return the index of the most significant bit set in iValue, which is not 0
+     */
+    uint32_t highestBit(uint64_t iValue)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - static_cast<uint32_t>(__builtin_clzll(iValue));
+#else
+        uint32_t result = 0;
+        for (uint32_t step = 32; step; step >>= 1)
+        {
+            if (iValue >> step)
+            {
+                iValue >>= step;
+                result += step;
+            }
+        }
+        return result;
+#endif
+    }
+}
+
+PerfHistogram::PerfHistogram()
+: counts_(bucketCount(), 0)
+{
+}
+
+void PerfHistogram::merge(const PerfHistogram& iOther)
+{
+    if (!iOther.count_)
+        return;
+    
+    for (size_t i = 0; i < counts_.size(); i++)
+        counts_[i] += iOther.counts_[i];
+    
+    count_ += iOther.count_;
+    min_ = std::min(min_, iOther.min_);
+    max_ = std::max(max_, iOther.max_);
+}
+
+void PerfHistogram::clear()
+{
+    if (!count_)
+        return;
+    
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+}
+
+uint64_t PerfHistogram::percentile(double iPercentile) const
+{
+    if (!count_)
+        return 0;
+    
+    // Rank of the value, 1 based, at least the first one
+    //
+    double fraction = std::min(std::max(iPercentile, 0.0), 100.0) / 100.0;
+    uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(ceil(fraction * static_cast<double>(count_))), 1);
+    
+    // The extremes are known exactly
+    //
+    if (rank == 1)
+        return min_;
+    if (rank >= count_)
+        return max_;
+    
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < counts_.size(); i++)
+    {
+        seen += counts_[i];
+        if (seen >= rank)
+        {
+            uint64_t low = bucketLow(i);
+            uint64_t value = low + ((bucketHigh(i) - low) / 2);
+            
+            return std::min(std::max(value, min_), max_);
+        }
+    }
+    
+    return max_;
+}
+
+uint32_t PerfHistogram::bucket(uint64_t iValue)
+{
+    if (iValue > sMaxValue)
+        iValue = sMaxValue;
+    
+    // Exact below two full ranges of sub buckets
+    //
+    if (iValue < 2 * sSubBuckets)
+        return static_cast<uint32_t>(iValue);
+    
+    uint32_t shift = highestBit(iValue) - sSubBucketBits;
+    
+    return ((shift + 1) * sSubBuckets) + static_cast<uint32_t>((iValue >> shift) - sSubBuckets);
+}
+
+uint64_t PerfHistogram::bucketLow(uint32_t iBucket)
+{
+    if (iBucket < 2 * sSubBuckets)
+        return iBucket;
+    
+    uint32_t shift = (iBucket / sSubBuckets) - 1;
+    uint64_t sub = (iBucket % sSubBuckets) + sSubBuckets;
+    
+    return sub << shift;
+}
+
+uint64_t PerfHistogram::bucketHigh(uint32_t iBucket)
+{
+    if (iBucket < 2 * sSubBuckets)
+        return iBucket;
+    
+    uint32_t shift = (iBucket / sSubBuckets) - 1;
+    uint64_t sub = (iBucket % sSubBuckets) + sSubBuckets;
+    
+    return ((sub + 1) << shift) - 1;
+}
+
+uint32_t PerfHistogram::bucketCount()
+{
+    return bucket(sMaxValue) + 1;
+}
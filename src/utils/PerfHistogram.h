@@ -0,0 +1,133 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+///
+/// \brief Log bucketed histogram of durations, in the style of HdrHistogram.
+///
+/// Values below 2 * sSubBuckets are counted exactly. Above that every power of two
+/// is split into sSubBuckets linear buckets, so a value is known to within
+/// 1 / sSubBuckets, about 3%, whatever its magnitude. Values are in nanoseconds
+/// and clamped to sMaxValue, min and max are tracked exactly.
+///
+/// Recording is a few shifts and an increment. Not thread safe, see PerfStats
+/// for the per thread shards.
+///
+class PerfHistogram
+{
+public:
+    
+    /// Linear buckets per power of two
+    static const uint32_t sSubBuckets{32};
+    
+    /// Largest value told apart from the others, about 4.9 hours in nanoseconds
+    static const uint64_t sMaxValue{(1ull << 44) - 1};
+    
+    PerfHistogram();
+    
+    /**
+     * Counts a value.
+     *
+     * @param[in] iValue the value, a duration in nanoseconds
+     */
+    void record(uint64_t iValue)
+    {
+        counts_[bucket(iValue)]++;
+        count_++;
+        
+        if (iValue < min_)
+            min_ = iValue;
+        if (iValue > max_)
+            max_ = iValue;
+    }
+    
+    /**
+     * Adds the values counted by another histogram.
+     */
+    void merge(const PerfHistogram& iOther);
+    
+    /**
+     * Forgets every value.
+     */
+    void clear();
+    
+    /**
+     * @return the number of values counted
+     */
+    uint64_t count() const
+    {
+        return count_;
+    }
+    
+    /**
+     * @return the smallest value counted, 0 when there is none
+     */
+    uint64_t min() const
+    {
+        return count_ ? min_ : 0;
+    }
+    
+    /**
+     * @return the largest value counted, 0 when there is none
+     */
+    uint64_t max() const
+    {
+        return max_;
+    }
+    
+    /**
+     * @param[in] iPercentile between 0 and 100, 99.9 for example
+     *
+     * @return the value below which iPercentile percent of the values fall,
+     *         the middle of its bucket. 0 when there is no value.
+     */
+    uint64_t percentile(double iPercentile) const;
+    
+    /**
+     * @return the bucket counting iValue
+     */
+    static uint32_t bucket(uint64_t iValue);
+    
+    /**
+     * @return the smallest value counted by bucket iBucket
+     */
+    static uint64_t bucketLow(uint32_t iBucket);
+    
+    /**
+     * @return the largest value counted by bucket iBucket
+     */
+    static uint64_t bucketHigh(uint32_t iBucket);
+    
+    /**
+     * @return the number of buckets
+     */
+    static uint32_t bucketCount();
+    
+private:
+    
+    std::vector<uint64_t> counts_;
+    uint64_t count_{0};
+    uint64_t min_{UINT64_MAX};
+    uint64_t max_{0};
+};
@@ -5,47 +5,113 @@
 #include <cstring>
 #include <string.h>
 
-#include <chrono>
 #include "Trace.h"
+#include "TraceClock.h"
+#include "PerfStats.h"
+#include "PerfTimeline.h"
+#include "PerfCallTree.h"
+#include "PerfControl.h"
 
-//#define PERF_ENABLED
+//#define PERF_DISABLED
 
+/**
+ * \brief Measures the duration of a scope, and of the checkpoints within it.
+ *
+ * Every scope and checkpoint is written as a kCategory_Perf trace statement,
+ * or, while PerfStats is aggregating, recorded in the histogram of its label.
+ * While PerfTimeline is capturing they are also recorded as timeline events.
+ * While PerfCallTree is profiling every scope is also added under the enclosing scope of its thread.
+ * Checkpoints are recorded under "<label> checkpoint <tag>".
+ *
+ * Times are read from TraceClock, the same clock as the trace timestamps.
+ *
+ * Scopes are only measured while PerfControl enables their label or category,
+ * a disabled scope reads no clock. Defining PERF_DISABLED compiles PerfLogger out.
+ */
 class PerfLogger
 {
 public:
-    PerfLogger(const char* iLabel)
+    /**
+     * @param[in] iLabel label of the scope
+     * @param[in] iCategory category of the scope, to enable it with PerfControl.
+     *            The statements are written under kCategory_Perf whatever the category.
+     */
+    PerfLogger(const char* iLabel, Trace::Category iCategory = Trace::kCategory_Perf)
     {
-#ifdef PERF_ENABLED
+#ifndef PERF_DISABLED
+        enabled_ = PerfControl::enabled(iLabel, iCategory);
+        if (!enabled_)
+            return;
+        
+        label_[0] = 0;
         if (iLabel)
         {
-            memset(label_, 0, sizeof(labelLen_));
-            if (iLabel)
-                strncpy(label_, iLabel, labelLen_);
+            strncpy(label_, iLabel, labelLen_ - 1);
+            label_[labelLen_ - 1] = 0;
         }
-        start_ = std::chrono::high_resolution_clock::now();
+        scope_ = PerfCallTree::instance().enter(label_);
+        start_ = TraceClock::monotonic();
         lastCheckPointTime_ = start_;
 #endif
     }
     
     ~PerfLogger()
     {
-#ifdef PERF_ENABLED
-        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - start_);
+#ifndef PERF_DISABLED
+        if (!enabled_)
+            return;
+        
+        uint64_t t2 = TraceClock::monotonic();
+        uint64_t duration = t2 > start_ ? t2 - start_ : 0;
+        
+        PerfCallTree::instance().exit(scope_, duration);
+        
+        if (PerfTimeline::instance().capturing())
+            PerfTimeline::instance().record(label_, TraceClock::toTime(start_), duration);
+        
+        if (PerfStats::instance().aggregating())
+        {
+            PerfStats::instance().record(label_, duration);
+            return;
+        }
         
         BBC_TRACE_R(Trace::kPriority_Medium | Trace::kCategory_Perf
                   , "PerfLogger - %s %f"
                   , label_
-                  , time_span.count()
+                  , duration / 1e9
                   );
 #endif
     }
     
     void checkPoint(const char* iTag)
     {
-#ifdef PERF_ENABLED
-        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - lastCheckPointTime_);
+#ifndef PERF_DISABLED
+        if (!enabled_)
+            return;
+        
+        uint64_t t2 = TraceClock::monotonic();
+        uint64_t duration = t2 > lastCheckPointTime_ ? t2 - lastCheckPointTime_ : 0;
+        
+        const bool capturing = PerfTimeline::instance().capturing();
+        const bool aggregating = PerfStats::instance().aggregating();
+        
+        if (capturing || aggregating)
+        {
+            char label[labelLen_ + 64];
+            snprintf(label, sizeof(label), "%s checkpoint %s", label_, iTag ? iTag : "none");
+            
+            if (capturing)
+                PerfTimeline::instance().record(label, TraceClock::toTime(lastCheckPointTime_), duration);
+            
+            if (aggregating)
+            {
+                PerfStats::instance().record(label, duration);
+                lastCheckPointTime_ = t2;
+                checkpoint_++;
+                return;
+            }
+        }
+        
         lastCheckPointTime_ = t2;
         
         BBC_TRACE_R(Trace::kPriority_Medium | Trace::kCategory_Perf
@@ -53,20 +119,25 @@ public:
                     , label_
                     , checkpoint_++
                     , iTag ? iTag : "none"
-                    , time_span.count()
+                    , duration / 1e9
                     );
 
 #endif
     }
     
 private:
-#ifdef PERF_ENABLED
+#ifndef PERF_DISABLED
+    /// Decided by PerfControl when the scope starts
+    bool enabled_;
     int32_t checkpoint_ = 0;
     // 128 plus a null terminator
     //
     static constexpr int32_t labelLen_ = 129;
     char label_[labelLen_];
-    std::chrono::high_resolution_clock::time_point start_;
-    std::chrono::high_resolution_clock::time_point lastCheckPointTime_;
+    /// Returned by PerfCallTree::enter
+    uint64_t scope_;
+    /// Readings of TraceClock::monotonic, durations stay consistent across a change of source
+    uint64_t start_;
+    uint64_t lastCheckPointTime_;
 #endif
 };
@@ -0,0 +1,146 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "PerfStats.h"
+#include "Trace.h"
+
+#include <map>
+#include <string.h>
+
+const int64_t PerfStats::sDefaultReportIntervalMs;
+
+void PerfStats::record(const char* iLabel, uint64_t iDuration)
+{
+    if (!iLabel)
+        iLabel = "";
+    
+    Shard& target = shards_.local();
+    uint64_t hash = perfLabelHash(iLabel);
+    
+    std::lock_guard<std::mutex> lock(target.mutex);
+    
+    std::unique_ptr<Entry>* slot = &target.entries[hash];
+    while (*slot && (*slot)->label != iLabel)
+        slot = &(*slot)->next;
+    
+    if (!*slot)
+    {
+        slot->reset(new Entry());
+        (*slot)->label = iLabel;
+    }
+    
+    (*slot)->histogram.record(iDuration);
+}
+
+std::vector<PerfStats::Summary> PerfStats::snapshot(bool iReset)
+{
+    std::map<std::string, PerfHistogram> merged;
+    
+    // Everything the exited threads recorded is reported by a reset
+    //
+    shards_.forEach([&merged, iReset](Shard& ioShard)
+    {
+        std::lock_guard<std::mutex> lock(ioShard.mutex);
+        
+        for (const auto& bucket : ioShard.entries)
+        {
+            for (Entry* entry = bucket.second.get(); entry; entry = entry->next.get())
+            {
+                if (!entry->histogram.count())
+                    continue;
+                
+                merged[entry->label].merge(entry->histogram);
+                
+                if (iReset)
+                    entry->histogram.clear();
+            }
+        }
+    }, iReset);
+    
+    std::vector<Summary> summaries;
+    summaries.reserve(merged.size());
+    
+    for (auto& label : merged)
+    {
+        summaries.push_back(Summary());
+        summaries.back().label = label.first;
+        summaries.back().histogram = std::move(label.second);
+    }
+    
+    return summaries;
+}
+
+void PerfStats::report(bool iReset)
+{
+    for (const Summary& summary : snapshot(iReset))
+    {
+        const PerfHistogram& histogram = summary.histogram;
+        
+        BBC_TRACE_R(Trace::kPriority_Medium | Trace::kCategory_Perf
+                    , "PerfStats - %s count %llu min %llu p50 %llu p90 %llu p99 %llu p999 %llu max %llu ns"
+                    , summary.label.c_str()
+                    , static_cast<unsigned long long>(histogram.count())
+                    , static_cast<unsigned long long>(histogram.min())
+                    , static_cast<unsigned long long>(histogram.percentile(50.0))
+                    , static_cast<unsigned long long>(histogram.percentile(90.0))
+                    , static_cast<unsigned long long>(histogram.percentile(99.0))
+                    , static_cast<unsigned long long>(histogram.percentile(99.9))
+                    , static_cast<unsigned long long>(histogram.max())
+                    );
+    }
+}
+
+void PerfStats::start(std::chrono::milliseconds iInterval)
+{
+    stop();
+    
+    stop_ = false;
+    setAggregating(true);
+    
+    reporter_ = std::thread(&PerfStats::run, this, iInterval);
+}
+
+void PerfStats::stop()
+{
+    if (!reporter_.joinable())
+        return;
+    
+    {
+        std::lock_guard<std::mutex> lock(reporterMutex_);
+        stop_ = true;
+    }
+    
+    wake_.notify_one();
+    reporter_.join();
+    
+    setAggregating(false);
+    report(true);
+}
+
+void PerfStats::run(std::chrono::milliseconds iInterval)
+{
+    std::unique_lock<std::mutex> lock(reporterMutex_);
+    
+    while (!wake_.wait_for(lock, iInterval, [this]() { return stop_; }))
+    {
+        lock.unlock();
+        report(true);
+        lock.lock();
+    }
+}
@@ -0,0 +1,156 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "Singleton.h"
+#include "PerfHistogram.h"
+#include "PerfThreadShards.h"
+
+///
+/// \brief Aggregates PerfLogger durations into a histogram per label.
+///
+/// While aggregating, PerfLogger records the duration of every scope and checkpoint
+/// here instead of writing a trace statement for each. Every thread records into its
+/// own shard, a PerfHistogram per label guarded by a mutex only contended while a
+/// report is being taken. Reports merge the shards of all of the threads.
+///
+/// start runs a reporter thread writing, every interval, a kCategory_Perf statement per label:
+///
+///       PerfStats - <label> count N min N p50 N p90 N p99 N p999 N max N ns
+///
+/// Each report covers the durations recorded since the previous one.
+/// The shards of threads that exited are removed once reported.
+///
+class PerfStats : public Singleton<PerfStats>
+{
+public:
+    
+    /// Default time between two reports, in milliseconds
+    static const int64_t sDefaultReportIntervalMs{10000};
+    
+    /// Durations of a label merged across the threads
+    struct Summary
+    {
+        std::string label;
+        PerfHistogram histogram;
+    };
+    
+    PerfStats() {}
+    
+    virtual ~PerfStats()
+    {
+        stop();
+    }
+    
+    /**
+     * @return true when PerfLogger records into the histograms instead of tracing
+     */
+    bool aggregating() const
+    {
+        return aggregating_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * Makes PerfLogger record into the histograms, or trace every scope again.
+     * Does not start the reporter, see start.
+     */
+    void setAggregating(bool iAggregating)
+    {
+        aggregating_.store(iAggregating, std::memory_order_relaxed);
+    }
+    
+    /**
+     * Records a duration in the shard of the calling thread.
+     *
+     * @param[in] iLabel label of the histogram, copied the first time it is seen
+     * @param[in] iDuration the duration in nanoseconds
+     */
+    void record(const char* iLabel, uint64_t iDuration);
+    
+    /**
+     * Merges the shards of all of the threads.
+     *
+     * @param[in] iReset true to start over, the next snapshot only holds later durations
+     *
+     * @return a summary per label with at least one duration, sorted by label
+     */
+    std::vector<Summary> snapshot(bool iReset);
+    
+    /**
+     * Writes a kCategory_Perf statement per label, see above.
+     *
+     * @param[in] iReset true to start over once written
+     */
+    void report(bool iReset = true);
+    
+    /**
+     * Starts aggregating and the reporter thread.
+     *
+     * @param[in] iInterval time between two reports
+     */
+    void start(std::chrono::milliseconds iInterval = std::chrono::milliseconds(sDefaultReportIntervalMs));
+    
+    /**
+     * Stops the reporter thread, after a last report, and aggregating.
+     */
+    void stop();
+    
+private:
+    
+    /// Histogram of a label, chained with the other labels of the same hash
+    struct Entry
+    {
+        std::string label;
+        PerfHistogram histogram;
+        std::unique_ptr<Entry> next;
+    };
+    
+    /// Histograms recorded by a thread
+    struct Shard
+    {
+        /// Guards entries, taken by the owning thread for every record
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::unique_ptr<Entry>> entries;
+    };
+    
+    /// Reporter thread
+    void run(std::chrono::milliseconds iInterval);
+    
+    std::atomic<bool> aggregating_{false};
+    
+    PerfThreadShards<Shard> shards_;
+    
+    /// Guards stop_
+    std::mutex reporterMutex_;
+    std::condition_variable wake_;
+    bool stop_{false};
+    std::thread reporter_;
+};
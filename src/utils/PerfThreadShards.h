@@ -0,0 +1,158 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+///
+/// \brief Per thread instances of Shard, for the Perf collectors.
+///
+/// Every thread gets its own Shard the first time it calls local, so recording never
+/// contends with the other threads. forEach visits the shards of all of the threads,
+/// including the ones that exited, which it removes on request once the collector
+/// has taken what they recorded.
+///
+/// A thread caches the shard of the PerfThreadShards it last used. Alternating between
+/// two of the same Shard type gives the thread a new shard each time.
+///
+template <class Shard>
+class PerfThreadShards
+{
+public:
+    
+    PerfThreadShards()
+    : id_(nextId().fetch_add(1, std::memory_order_relaxed))
+    {
+    }
+    
+    PerfThreadShards(const PerfThreadShards&) = delete;
+    PerfThreadShards& operator=(const PerfThreadShards&) = delete;
+    
+    /**
+     * @return the shard of the calling thread, created on first use
+     */
+    Shard& local()
+    {
+        thread_local Holder holder;
+        
+        if (holder.id != id_)
+        {
+            // The previous shard belongs to another PerfThreadShards
+            //
+            if (holder.slot)
+                holder.slot->retired.store(true, std::memory_order_release);
+            
+            std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slots_.push_back(slot);
+            }
+            
+            holder.id = id_;
+            holder.slot = slot;
+        }
+        
+        return holder.slot->shard;
+    }
+    
+    /**
+     * Calls iFunction with every shard, while no shard is added or removed.
+     *
+     * @param[in] iFunction called with a Shard&
+     * @param[in] iRemoveRetired true to then remove the shards of the threads that had exited,
+     *            once the collector took what they recorded
+     */
+    template <class Function>
+    void forEach(Function iFunction, bool iRemoveRetired = false)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        size_t kept = 0;
+        for (size_t i = 0; i < slots_.size(); i++)
+        {
+            // Read first, a thread still recording after iFunction keeps its shard
+            //
+            bool retired = slots_[i]->retired.load(std::memory_order_acquire);
+            
+            iFunction(slots_[i]->shard);
+            
+            if (!iRemoveRetired || !retired)
+                slots_[kept++] = slots_[i];
+        }
+        
+        slots_.resize(kept);
+    }
+    
+private:
+    
+    struct Slot
+    {
+        Shard shard;
+        
+        /// Set once no thread records into the shard anymore
+        std::atomic<bool> retired{false};
+    };
+    
+    /// Shard of the calling thread, retired when the thread exits
+    struct Holder
+    {
+        uint64_t id{0};
+        std::shared_ptr<Slot> slot;
+        
+        ~Holder()
+        {
+            if (slot)
+                slot->retired.store(true, std::memory_order_release);
+        }
+    };
+    
+    static std::atomic<uint64_t>& nextId()
+    {
+        static std::atomic<uint64_t> sNextId{1};
+        return sNextId;
+    }
+    
+    /// Identifies this PerfThreadShards in the per thread cache
+    uint64_t id_;
+    
+    /// Guards slots_
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Slot>> slots_;
+};
+
+/**
+ * @return the FNV-1a hash of a label, to find it in a shard without building a std::string
+ */
+inline uint64_t perfLabelHash(const char* iLabel)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* c = iLabel; *c; c++)
+    {
+        hash ^= static_cast<uint8_t>(*c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,210 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "PerfTimeline.h"
+#include "TraceContentFilter.h"
+
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+const size_t PerfTimeline::sDefaultMaxEvents;
+
+namespace
+{
+    /**
+     * Writes iText as a JSON string, with its quotes.
+     */
+    void writeString(std::ostream& oStream, const std::string& iText)
+    {
+        oStream << '"';
+        
+        for (char c : iText)
+        {
+            switch (c)
+            {
+                case '"':  oStream << "\\\""; break;
+                case '\\': oStream << "\\\\"; break;
+                case '\n': oStream << "\\n"; break;
+                case '\r': oStream << "\\r"; break;
+                case '\t': oStream << "\\t"; break;
+                    
+                default:
+                    if (static_cast<uint8_t>(c) < 0x20)
+                    {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                        oStream << escaped;
+                    }
+                    else
+                    {
+                        oStream << c;
+                    }
+                    break;
+            }
+        }
+        
+        oStream << '"';
+    }
+    
+    /**
+     * Writes nanoseconds as microseconds with three decimals.
+     */
+    void writeMicroseconds(std::ostream& oStream, uint64_t iNanoseconds)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%llu.%03llu"
+                 , static_cast<unsigned long long>(iNanoseconds / 1000)
+                 , static_cast<unsigned long long>(iNanoseconds % 1000)
+                 );
+        oStream << text;
+    }
+}
+
+void PerfTimeline::start(size_t iMaxEvents)
+{
+    capturing_.store(false, std::memory_order_relaxed);
+    
+    // The shards of the exited threads only held the previous capture
+    //
+    shards_.forEach([](Shard& ioShard)
+    {
+        std::lock_guard<std::mutex> lock(ioShard.mutex);
+        ioShard.events.clear();
+    }, true);
+    
+    drops_.store(0, std::memory_order_relaxed);
+    maxEvents_.store(iMaxEvents, std::memory_order_relaxed);
+    capturing_.store(true, std::memory_order_relaxed);
+}
+
+void PerfTimeline::record(const char* iLabel, uint64_t iStart, uint64_t iDuration)
+{
+    if (!iLabel)
+        iLabel = "";
+    
+    Shard& target = shards_.local();
+    uint64_t hash = perfLabelHash(iLabel);
+    const char* threadName = TraceThreadName::get();
+    
+    std::lock_guard<std::mutex> lock(target.mutex);
+    
+    if (target.events.size() >= maxEvents_.load(std::memory_order_relaxed))
+    {
+        drops_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    if (!target.tid)
+        target.tid = nextTid_.fetch_add(1, std::memory_order_relaxed);
+    
+    if (threadName && target.threadName != threadName)
+        target.threadName = threadName;
+    
+    std::vector<uint32_t>& indexes = target.nameIndexes[hash];
+    
+    uint32_t name = UINT32_MAX;
+    for (uint32_t index : indexes)
+    {
+        if (target.names[index] == iLabel)
+        {
+            name = index;
+            break;
+        }
+    }
+    
+    if (name == UINT32_MAX)
+    {
+        name = static_cast<uint32_t>(target.names.size());
+        target.names.push_back(iLabel);
+        indexes.push_back(name);
+    }
+    
+    target.events.push_back(Event{iStart, iDuration, name});
+}
+
+void PerfTimeline::write(std::ostream& oStream)
+{
+    const long pid = static_cast<long>(getpid());
+    bool first = true;
+    
+    oStream << "{\"traceEvents\":[";
+    
+    shards_.forEach([&oStream, &first, pid](Shard& ioShard)
+    {
+        std::lock_guard<std::mutex> lock(ioShard.mutex);
+        
+        if (ioShard.events.empty())
+            return;
+        
+        std::string threadName = ioShard.threadName;
+        if (threadName.empty())
+            threadName = "Thread " + std::to_string(ioShard.tid);
+        
+        oStream << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ioShard.tid << ",\"args\":{\"name\":";
+        writeString(oStream, threadName);
+        oStream << "}}";
+        first = false;
+        
+        for (const Event& event : ioShard.events)
+        {
+            oStream << ",\n{\"name\":";
+            writeString(oStream, ioShard.names[event.name]);
+            oStream << ",\"cat\":\"perf\",\"ph\":\"X\",\"ts\":";
+            writeMicroseconds(oStream, event.start);
+            oStream << ",\"dur\":";
+            writeMicroseconds(oStream, event.duration);
+            oStream << ",\"pid\":" << pid << ",\"tid\":" << ioShard.tid << "}";
+        }
+    });
+    
+    oStream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+bool PerfTimeline::write(const std::string& iPath)
+{
+    std::ofstream file(iPath, std::ios::out | std::ios::trunc);
+    if (!file)
+        return false;
+    
+    write(file);
+    file.close();
+    
+    return !file.fail();
+}
+
+uint64_t PerfTimeline::eventCount()
+{
+    uint64_t count = 0;
+    
+    shards_.forEach([&count](Shard& ioShard)
+    {
+        std::lock_guard<std::mutex> lock(ioShard.mutex);
+        count += ioShard.events.size();
+    });
+    
+    return count;
+}
@@ -0,0 +1,163 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "Singleton.h"
+#include "PerfThreadShards.h"
+
+///
+/// \brief Captures PerfLogger scopes on a timeline, exported as Chrome Trace Event JSON.
+///
+/// While capturing, every PerfLogger scope and checkpoint is recorded as a complete
+/// event with its label, start and duration in a buffer of the thread that ran it.
+/// The capture is started and stopped at runtime, start forgets the previous one.
+///
+/// write produces the JSON object format of the Chrome Trace Event specification,
+/// which loads in ui.perfetto.dev and chrome://tracing:
+///
+///       {"traceEvents":[
+///       {"name":"thread_name","ph":"M","pid":1234,"tid":1,"args":{"name":"audio"}},
+///       {"name":"Frame","cat":"perf","ph":"X","ts":1700000000123456.789,"dur":42.125,"pid":1234,"tid":1},
+///       ...
+///       ],"displayTimeUnit":"ns"}
+///
+/// Timestamps are in microseconds since the epoch of the PerfLogger clock. Threads
+/// are numbered in the order they first recorded, named after setThreadName when set.
+/// A thread records at most the maximum passed to start, later events are dropped,
+/// see dropCount.
+///
+class PerfTimeline : public Singleton<PerfTimeline>
+{
+public:
+    
+    /// Default most events recorded per thread
+    static const size_t sDefaultMaxEvents{1024 * 1024};
+    
+    PerfTimeline() {}
+    
+    virtual ~PerfTimeline() {}
+    
+    /**
+     * @return true while scopes are being recorded
+     */
+    bool capturing() const
+    {
+        return capturing_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * Forgets the previous capture and starts recording.
+     *
+     * @param[in] iMaxEvents most events recorded per thread
+     */
+    void start(size_t iMaxEvents = sDefaultMaxEvents);
+    
+    /**
+     * Stops recording, the capture is kept until the next start.
+     */
+    void stop()
+    {
+        capturing_.store(false, std::memory_order_relaxed);
+    }
+    
+    /**
+     * Records a complete event in the buffer of the calling thread.
+     *
+     * @param[in] iLabel name of the event, copied the first time it is seen
+     * @param[in] iStart start of the event, nanoseconds since the clock epoch
+     * @param[in] iDuration duration of the event in nanoseconds
+     */
+    void record(const char* iLabel, uint64_t iStart, uint64_t iDuration);
+    
+    /**
+     * Writes the capture as Chrome Trace Event JSON.
+     *
+     * @param[out] oStream receives the JSON
+     */
+    void write(std::ostream& oStream);
+    
+    /**
+     * Writes the capture to a file as Chrome Trace Event JSON.
+     *
+     * @param[in] iPath path of the file, replaced if it exists
+     *
+     * @return true if the file was written
+     */
+    bool write(const std::string& iPath);
+    
+    /**
+     * @return the number of events recorded in the capture
+     */
+    uint64_t eventCount();
+    
+    /**
+     * @return the number of events dropped because a thread buffer was full
+     */
+    uint64_t dropCount() const
+    {
+        return drops_.load(std::memory_order_relaxed);
+    }
+    
+private:
+    
+    struct Event
+    {
+        uint64_t start;
+        uint64_t duration;
+        
+        /// Index in Shard::names
+        uint32_t name;
+    };
+    
+    /// Events recorded by a thread
+    struct Shard
+    {
+        /// Guards everything below, taken by the owning thread for every record
+        std::mutex mutex;
+        std::vector<Event> events;
+        
+        /// Labels of the events, and their indexes by hash
+        std::vector<std::string> names;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> nameIndexes;
+        
+        /// Numbered in the order the threads first recorded, 0 until then
+        uint32_t tid{0};
+        
+        /// See TraceThreadName, the last name seen by record
+        std::string threadName;
+    };
+    
+    std::atomic<bool> capturing_{false};
+    std::atomic<uint64_t> drops_{0};
+    std::atomic<size_t> maxEvents_{sDefaultMaxEvents};
+    
+    PerfThreadShards<Shard> shards_;
+    std::atomic<uint32_t> nextTid_{1};
+};
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <memory>
+
 /**
  * \brief Templated Singleton class
  *
@@ -18,171 +18,171 @@
  THE SOFTWARE.
  */
 #include "Trace.h"
+#include "TraceLazyBackend.h"
 
-#ifdef BBC_USE_SPDLOG
-#include "spdlog/spdlog.h"
-#include "spdlog/sinks/basic_file_sink.h"
-#include "spdlog/async.h"
-#endif
-
-void Trace::externalLoggerCallback(const char* iMessage)
-{
-#ifdef BBC_USE_BOOST
-    BOOST_LOG_TRIVIAL(error) << iMessage << std::endl;
-#endif
-#ifdef BBC_USE_SPDLOG
-    SPDLOG_CRITICAL(iMessage);
-#endif
-}
+std::atomic<uint32_t> Trace::nextGeneration_{1};
 
 void Trace::reset()
 {
-#ifdef BBC_USE_BOOST
-    boost::log::core::get()->remove_all_sinks();
-    externalLoggerCallback_ = nullptr;
-#endif
-
-#ifdef BBC_USE_SPDLOG
-    spdlog::shutdown();
-#endif
+    // Retire the outputs, once the grace period is over no statement is written to them
+    //
+    std::unique_ptr<const Outputs> outputs(outputs_.exchange(nullptr, std::memory_order_acq_rel));
+    configChanged();
+    sinks_.synchronize();
     
-    externalLoggerCallback_ = nullptr;
-    initalized_ = false;
+    if (outputs)
+    {
+        if (outputs->backend)
+            outputs->backend->close();
+        
+        for (const auto& route : outputs->routes)
+            route.backend->close();
+    }
     
-    traceAll_ = false;
-    masks_.clear();
+    outputs.reset();
+    pending_.reset();
     
-    callback_ = nullptr;
-}
-
-#ifdef BBC_USE_SPDLOG
-
-/*
- spdlog sink used for writing to the clients callback
- on the spdlog log writting thread.
- Note that the callback installed by the client installed will be called
- on the spdlog write thread thread.
- */
-template<typename Mutex>
-class client_callback_sink final : public spdlog::sinks::base_sink<Mutex>
-{
-public:
-    explicit client_callback_sink();
+    for (const auto& sink : sinks_.clear())
+        sink->flush();
     
-protected:
-    void sink_it_(const spdlog::details::log_msg &msg) override;
-    void flush_() override;
+    options_.clear();
     
-private:
-};
-
-template<typename Factory = spdlog::synchronous_factory>
-inline std::shared_ptr<spdlog::logger> client_callback_sink_mt(const std::string &logger_name)
-{
-    return Factory::template create<client_callback_sink<std::mutex>>(logger_name);
+    configChanged();
 }
 
-template<typename Mutex>
-SPDLOG_INLINE client_callback_sink<Mutex>::client_callback_sink()
+bool Trace::initExternalLogger(const std::string& iLogFilePath, TraceCallback iCallback, const std::string& iEcho)
 {
-}
-
-template<typename Mutex>
-SPDLOG_INLINE void client_callback_sink<Mutex>::sink_it_(const spdlog::details::log_msg &msg)
-{
-    spdlog::memory_buf_t formatted;
-    spdlog::sinks::base_sink<Mutex>::formatter_->format(msg, formatted);
+    std::string name = option("backend", TraceBackend::defaultName());
     
-    if (Trace::instance().externalLoggerCallback_)
+    std::unique_ptr<TraceBackend>& primary = pending_->backend;
+    primary = TraceBackend::create(name);
+    if (!primary)
     {
-        Trace::instance().externalLoggerCallback_(fmt::to_string(formatted).c_str());
+        std::cout << iEcho << std::flush;
+        std::cerr << "Unknown trace backend " << name << std::endl;
+        return false;
     }
-}
-
-template<typename Mutex>
-SPDLOG_INLINE void client_callback_sink<Mutex>::flush_()
-{
-}
-#endif // BBC_USE_SPDLOG
-
-bool Trace::initExternalLogger(const std::string& iLogFilePath, bool iUseClientCallback)
-{
-#ifdef BBC_USE_BOOST
-    if (iLogFilePath.length())
+    
+    // Options named route.<category> send the category to its own file
+    //
+    static const std::string sRoutePrefix("route.");
+    
+    std::map<TraceMask, std::string> routes;
+    for (const auto& option : options_)
     {
-        logging::add_file_log
-        (
-         //keywords::file_name = "sample_%N.log",                                        /*< file name pattern >*/
-         keywords::file_name = iLogFilePath,                                        /*< file name pattern >*/
-         keywords::rotation_size = 10 * 1024 * 1024,                                   /*< rotate files every 10 MiB... >*/
-         keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0), /*< ...or at midnight >*/
-         keywords::auto_flush = true,
-         keywords::format = "%Message%"                                 /*< log record format >*/
-         );
+        if (option.first.compare(0, sRoutePrefix.length(), sRoutePrefix) != 0)
+            continue;
+        
+        Category category = stringToCategory(option.first.substr(sRoutePrefix.length()));
+        if (category == kCategory_Off || option.second.empty())
+        {
+            std::cerr << "Invalid trace route " << option.first << "=" << option.second << std::endl;
+            continue;
+        }
+        
+        routes[category] = option.second;
     }
-    else
+    
+    // Options named filter.<category> and filterThread.<category> drop statements by content
+    //
+    static const std::string sFilterPrefix("filter.");
+    static const std::string sFilterThreadPrefix("filterThread.");
+    
+    std::shared_ptr<TraceContentFilter> filter = std::make_shared<TraceContentFilter>();
+    for (const auto& option : options_)
     {
-        struct Sink: public sinks::basic_formatted_sink_backend<char, sinks::concurrent_feeding>
-        {
-            void consume (const boost::log::record_view& rec, const std::string& str)
-            {
-                if (Trace::instance().externalLoggerCallback_)
-                {
-                    Trace::instance().externalLoggerCallback_(str.c_str());
-                }
-            }
-        };
+        bool thread = option.first.compare(0, sFilterThreadPrefix.length(), sFilterThreadPrefix) == 0;
+        if (!thread && option.first.compare(0, sFilterPrefix.length(), sFilterPrefix) != 0)
+            continue;
         
-        typedef sinks::asynchronous_sink<Sink> sink_t;
-        boost::shared_ptr<sink_t> sink (new sink_t());
-        boost::log::core::get()->add_sink (sink);
+        Category category = stringToCategory(option.first.substr(thread ? sFilterThreadPrefix.length() : sFilterPrefix.length()));
+        bool valid = category != kCategory_Off
+                     && (thread ? filter->addThread(category, option.second) : filter->addContent(category, option.second));
+        
+        if (!valid)
+            std::cerr << "Invalid trace filter " << option.first << "=" << option.second << std::endl;
     }
     
-    logging::core::get()->set_filter
-    (
-     logging::trivial::severity >= logging::trivial::info
-     );
+    TraceBackendConfig config;
+    config.logFilePath = iLogFilePath;
+    config.callback = iCallback;
+    config.coalesceWindow = static_cast<uint64_t>(std::max<int64_t>(optionInt("coalesceWindowMs"), 0)) * 1000000;
+    config.preciseTimestamps = !routes.empty();
+    config.preallocate = static_cast<uint64_t>(std::max<int64_t>(optionInt("filePreallocateMb"), 0)) * 1024 * 1024;
+    config.directIO = option("fileDirectIO") == "on";
+    
+    std::string buffering = option("buffering");
+    if (buffering == "thread")
+        config.buffering = TraceBackendConfig::kBuffering_Thread;
+    else if (buffering == "cpu")
+        config.buffering = TraceBackendConfig::kBuffering_Cpu;
     
-    logging::add_common_attributes();
+    config.mergeWindow = static_cast<uint64_t>(std::max<int64_t>(optionInt("mergeWindowMs", static_cast<int64_t>(config.mergeWindow / 1000000)), 0)) * 1000000;
     
-    // For a trace to make sure the file is created
+    if (!filter->empty())
+        config.filter = filter;
+    
+    // Options named consumer<Setting> tune the thread writing the statements out
     //
-    try
-    {
-        BOOST_LOG_TRIVIAL(error) << std::endl;
-    }
-    catch (...)
-    {
-        std::cerr << "Failed to create boost log file!\n";
-        return false;
-    }
+    TraceThreadTuning& consumer = config.consumer;
     
-    return true;
-#endif
-#ifdef BBC_USE_SPDLOG
-
-    spdlog::drop("async_logger");
-    async_file = nullptr;
-    spdlog::init_thread_pool(32768, 1); // queue with max 32k items 1 backing thread.
-    std::string logFile = iLogFilePath;
+    std::string cpus = option("consumerCpus");
+    if (cpus.length() && !TraceThreadTuning::parseCpus(cpus, consumer.cpus))
+        std::cerr << "Invalid trace option consumerCpus=" << cpus << std::endl;
+    
+    std::string policy = option("consumerPolicy");
+    if (policy.length() && !TraceThreadTuning::parsePolicy(policy, consumer.policy))
+        std::cerr << "Invalid trace option consumerPolicy=" << policy << std::endl;
     
-    if (iLogFilePath.length() == 0)
-        logFile = "default.log";
+    consumer.priority = static_cast<int>(optionInt("consumerPriority", consumer.priority));
     
-    if (iUseClientCallback)
+    if (option("consumerNice").length())
     {
-        async_file = client_callback_sink_mt<spdlog::async_factory_nonblock>("async_logger");
+        consumer.setNice = true;
+        consumer.nice = static_cast<int>(optionInt("consumerNice"));
     }
+    
+    std::string wakeup = option("consumerWakeup");
+    if (wakeup.length() && !TraceThreadTuning::parseWakeup(wakeup, consumer.wakeup))
+        std::cerr << "Invalid trace option consumerWakeup=" << wakeup << std::endl;
+    
+    consumer.spinUs = static_cast<uint32_t>(std::max<int64_t>(optionInt("consumerSpinUs", consumer.spinUs), 0));
+    consumer.batchSize = static_cast<uint32_t>(std::max<int64_t>(optionInt("consumerBatch", consumer.batchSize), 1));
+    consumer.intervalUs = static_cast<uint32_t>(std::max<int64_t>(optionInt("consumerIntervalUs", consumer.intervalUs), 1));
+    
+    // Lazy backends are opened later, which also echoes the configuration
+    //
+    std::string startup = option("startup", "eager");
+    bool lazy = startup == "lazy" || startup == "background";
+    TraceLazyBackend::Start start = startup == "lazy" ? TraceLazyBackend::kStart_FirstWrite : TraceLazyBackend::kStart_Background;
+    
+    if (lazy)
+        primary.reset(new TraceLazyBackend(std::move(primary), start, [iEcho]() { std::cout << iEcho << std::flush; }));
     else
+        std::cout << iEcho << std::flush;
+    
+    if (!primary->open(config))
     {
-        async_file = spdlog::basic_logger_mt<spdlog::async_factory_nonblock>("async_logger", logFile);
+        primary.reset();
+        return false;
     }
     
-    spdlog::set_pattern("[%H:%M:%S.%eZ] %v", spdlog::pattern_time_type::utc);
-    spdlog::set_default_logger(async_file);
-    spdlog::flush_on(spdlog::level::critical);
+    for (const auto& route : routes)
+    {
+        TraceBackendConfig routeConfig = config;
+        routeConfig.logFilePath = route.second;
+        routeConfig.callback = nullptr;
+        routeConfig.threaded = option("routeThreads") != "off";
+        
+        std::unique_ptr<TraceBackend> backend = TraceBackend::create("native");
+        if (lazy)
+            backend.reset(new TraceLazyBackend(std::move(backend), start));
+        
+        if (!backend->open(routeConfig))
+            continue;
+        
+        pending_->routes.push_back(Route{route.first, std::move(backend)});
+    }
     
-#endif
     return true;
 }
-
@@ -20,50 +20,50 @@
 
 #pragma once
 
-#include <regex>
 #include <fstream>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <atomic>
 
 #include "BBCAssert.h"
 #include "BBCMacros.h"
 #include "Singleton.h"
+#include "TraceSink.h"
+#include "TraceSinkRegistry.h"
+#include "TraceBatcher.h"
+#include "TraceBackend.h"
+#include "TraceTail.h"
+#include "TraceStore.h"
+#include "TraceConsoleSink.h"
+#include "TraceFormat.h"
+#include "TraceClock.h"
+#include "PerfControl.h"
 
-//static_assert(BBC_USE_BOOST && BBC_USE_SPDLOG, "Trace only allows a single external logger!");
-
-#ifdef BBC_USE_BOOST
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/expressions.hpp>
-#include <boost/log/sinks/text_file_backend.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/sources/severity_logger.hpp>
-#include <boost/log/sources/record_ostream.hpp>
-#include <boost/log/sinks/async_frontend.hpp>
-
-namespace logging = boost::log;
-namespace src = boost::log::sources;
-namespace sinks = boost::log::sinks;
-namespace keywords = boost::log::keywords;
-#else
-
-#ifdef BBC_USE_SPDLOG
-#include "spdlog/spdlog.h"
-#include "spdlog/sinks/basic_file_sink.h"
-#include "spdlog/async.h"
-#endif
-
-#endif
+/// Runs call when mask is enabled for logger, the decision is cached per call site, see TraceSiteCache.
+/// Note - The mask of a call site is expected to be constant.
+#define BBC_TRACE_SITE_TO(logger, mask, call) BBC_MACRO_BLOCK(static TraceSiteCache sBBCTraceSite; if (sBBCTraceSite.enabled(logger, mask)) call;)
+#define BBC_TRACE_SITE(mask, call) BBC_TRACE_SITE_TO(Trace::instance(), mask, call)
 
 #ifdef BBC_DEBUG
-#define BBC_TRACE(mask, ...) BBC_MACRO_BLOCK(Trace::instance().writeTrace(mask, __VA_ARGS__);)
-#define BBC_TRACE_MEM(mask, ...) BBC_MACRO_BLOCK(Trace::instance().writeMemory(mask, __VA_ARGS__);)
+#define BBC_TRACE(mask, ...) BBC_TRACE_SITE(mask, Trace::instance().writeTrace(Trace::MaskTested(), mask, __VA_ARGS__))
+#define BBC_TRACE_MEM(mask, ...) BBC_TRACE_SITE(mask, Trace::instance().writeMemory(Trace::MaskTested(), mask, __VA_ARGS__))
+#define BBC_TRACE_TO(logger, mask, ...) BBC_TRACE_SITE_TO(logger, mask, (logger).writeTrace(Trace::MaskTested(), mask, __VA_ARGS__))
+#define BBC_TRACE_MEM_TO(logger, mask, ...) BBC_TRACE_SITE_TO(logger, mask, (logger).writeMemory(Trace::MaskTested(), mask, __VA_ARGS__))
 #else
 #define BBC_TRACE(...)
 #define BBC_TRACE_MEM(...)
+#define BBC_TRACE_TO(...)
+#define BBC_TRACE_MEM_TO(...)
 #endif
 
 /*
@@ -78,8 +78,10 @@ namespace keywords = boost::log::keywords;
 #endif
 */
 
-#define BBC_TRACE_R(mask, ...) BBC_MACRO_BLOCK(Trace::instance().writeTrace(mask, __VA_ARGS__);)
-#define BBC_TRACE_MEM_R(mask, ...) BBC_MACRO_BLOCK(Trace::instance().writeMemory(mask, __VA_ARGS__);)
+#define BBC_TRACE_R(mask, ...) BBC_TRACE_SITE(mask, Trace::instance().writeTrace(Trace::MaskTested(), mask, __VA_ARGS__))
+#define BBC_TRACE_MEM_R(mask, ...) BBC_TRACE_SITE(mask, Trace::instance().writeMemory(Trace::MaskTested(), mask, __VA_ARGS__))
+#define BBC_TRACE_TO_R(logger, mask, ...) BBC_TRACE_SITE_TO(logger, mask, (logger).writeTrace(Trace::MaskTested(), mask, __VA_ARGS__))
+#define BBC_TRACE_MEM_TO_R(logger, mask, ...) BBC_TRACE_SITE_TO(logger, mask, (logger).writeMemory(Trace::MaskTested(), mask, __VA_ARGS__))
 
 #define BBC_BOOL_TO_STRING(x) x ? "true" : "false"
 
@@ -87,14 +89,6 @@ namespace keywords = boost::log::keywords;
 // 0x%jx or 0x%jX or %#018lllx or %#018lllX
 //
 
-#ifdef BBC_USE_SPDLOG
-namespace spdlog
-{
-    class logger;
-}
-#endif
-
-
 ///
 /// \brief Trace is a utility class for logging information in runtime code.
 ///
@@ -102,12 +96,87 @@ namespace spdlog
 /// pairs of categories and priotities separated by a @ symbol.
 /// The pairs can be disabled by adding a # as the first character of the line.
 ///
+/// Options are set with name=value lines:
+///
+///       backend             logger the statements are written to: native, spdlog or boost,
+///                           see TraceBackend. Defaults to the external logger compiled in.
+///       coalesceWindowMs    identical statements from the same call site within
+///                           this many milliseconds are written once followed by a
+///                           "last message repeated N times" summary. 0 (default) disables.
+///       batchSize           statements per batch for initializeBatchedWithBuffer, default 256
+///       batchIntervalMs     longest time a statement waits for its batch, default 50
+///       tailThreshold       enabled statements with a priority below this one, kPriority_High for example,
+///                           are kept in memory instead of being written. A statement at or above
+///                           it first writes the kept statements, see TraceTail.
+///       tailSize            statements kept per thread, default 64
+///       tailScope           thread (default) writes the kept statements of the same thread,
+///                           all writes those of all threads
+///       storeSizeMb         keeps the most recent statements, up to this many megabytes,
+///                           in memory for Trace::query, see TraceStore. 0 (default) disables.
+///       clock               source of the timestamps of Trace and PerfLogger: tsc, tscp, monotonic_raw,
+///                           steady or system. Defaults to tsc when invariant, see TraceClock.
+///       perf                PerfLogger scopes measured: on, off, or the labels and categories
+///                           to measure, perf=Frame,kCategory_UI for example. See PerfControl.
+///                           clock and perf are shared by the whole process, they are only
+///                           accepted by Trace::instance() and ignored with a warning by the others.
+///       console             on also writes the statements to stdout, see TraceConsoleSink
+///       consoleFlushMs      longest time a statement waits before being written to stdout,
+///                           default 100, 0 writes every statement right away
+///       route.<category>    file the statements of the category are written to instead of the
+///                           log file or callback, route.kCategory_Network=network.log for example.
+///                           Every routed file has its own native backend. All of the outputs then
+///                           prefix the statements with nanosecond timestamps so they can be merged
+///                           back in time order, except the boost backend which has no timestamps.
+///       routeThreads        on (default) gives every routed file its own writer thread,
+///                           off writes them from the tracing thread through a file buffer
+///       filePreallocateMb   the native backend reserves its log files this many megabytes at a time
+///                           and writes them in aligned blocks, see TraceFileWriter. 0 (default) uses stdio.
+///       fileDirectIO        on writes the native log files with O_DIRECT, bypassing the page cache
+///       buffering           shared (default) queues the statements of all of the threads together,
+///                           thread gives every thread its own buffer in the native backend, merged
+///                           back in time order by its writer thread, see TraceNativeBackend.
+///                           cpu does the same with a buffer per processor, for many short lived threads.
+///       mergeWindowMs       how long buffering=thread or cpu holds the statements back to put them in
+///                           time order, default 5. The reorder statistics are written on reset.
+///       startup             eager (default) starts the backends, and echoes the configuration,
+///                           while initializing. lazy starts them with the first enabled statement,
+///                           background on a thread of their own. Meanwhile the statements are
+///                           kept in memory, see TraceLazyBackend.
+///       consumerCpus        processors the thread writing the statements out may run on, 2,3 or 4-7,
+///                           see TraceThreadTuning. Applies to the writer threads of the native backend,
+///                           including the routed files, the spdlog thread pool and the Boost.Log sink.
+///       consumerPolicy      scheduling policy of that thread: other, batch, idle, fifo or rr
+///       consumerPriority    real time priority of consumerPolicy=fifo or rr, default 1
+///       consumerNice        nice level of that thread
+///       consumerWakeup      notify (default) wakes it with the first statement written, spin has it spin
+///                           for consumerSpinUs, default 50, before waiting, batch wakes it once consumerBatch
+///                           statements, default 64, are pending or every consumerIntervalUs, default 1000,
+///                           poll never wakes it, it takes the statements every consumerIntervalUs
+///       filter.<category>   only writes the statements of the category containing some text,
+///                           contains:10.0.0.7, or matching a regular expression, regex:peer [0-9]+.
+///                           Evaluated by the backend writer thread, see TraceContentFilter.
+///       filterThread.<category>
+///                           only writes the statements of the category from threads whose name,
+///                           see setThreadName, matches the regular expression
+///
+/// Trace::instance() is the logger of the BBC_TRACE macros. Subsystems that need their own
+/// masks, options, sinks and backend threads create a Trace of their own and trace to it
+/// with the BBC_TRACE_TO macros:
+///
+///       Trace engineTrace;
+///       engineTrace.initializeWithBuffer("kCategory_Dante@kPriority_Low", "engine.log");
+///       BBC_TRACE_TO(engineTrace, Trace::kCategory_Dante | Trace::kPriority_Low, "Flows %d", count);
+///
+/// The logger expression is evaluated twice and should not have side effects.
+/// A Trace closes its backends and sinks when destroyed.
+///
 /// See unit tests for examples of different use cases.
 ///
 /// Example:
 ///
 ///       kCategory_Basic@kPriority_Low
 ///       #kCategory_Always@kPriority_Low
+///       coalesceWindowMs=1000
 ///
 class Trace : public Singleton<Trace>
 {
@@ -122,6 +191,20 @@ public:
      * \brief Prototype for the callback the client can install to receive trace statements.
      */
     typedef void (*TraceCallback)(const char* iMessage);
+    
+    /**
+     * \brief Selects the writeTrace and writeMemory overloads that skip testing the mask,
+     * the trace macros call them once TraceSiteCache found the call site enabled.
+     */
+    struct MaskTested {};
+    
+    /// Size of the trace buffer to write to
+    /// Any trace statement, including arguments, longer than this will be truncated.
+    static const int32_t sTraceMessageSize{2048};
+    
+    /// Largest memory buffer writeMemory will print.
+    /// Each byte takes 3 characters ("FF "), the trailing space becomes the terminating character.
+    static const int32_t sTraceMemoryMaxBytes{sTraceMessageSize / 3};
 
     /**
      * Priority for the trace statements.
@@ -317,24 +400,6 @@ if (0 == strcmp(iStr.c_str(), STRINGIFY(iVal))) \
         return kCategory_Off;
     }
 
-private:
-    
-    ///
-    /// Specialized callback for hooking into the Boost Logger layer.
-    ///
-    /// This callback is set to callback_ when Trace is configured to use
-    /// the Boost Logger layer.
-    ///
-    /// When the client calls writeTrace, this callback is triggered
-    /// and the trace statement is written to the Boost Logger layer.
-    /// When the Boost Logger Sink::consume layer is triggered,
-    /// the callback installed into externalLoggerCallback_ is triggered.
-    /// This is typically the callback installed by the client.
-    ///
-    /// @param[in] iMessage is the message to be written
-    ///
-    static void externalLoggerCallback(const char* iMessage);
-
 public:
     
     /**
@@ -398,13 +463,230 @@ public:
         return initializeWithBuffer(iTraceConfig, nullptr, iLogFilePath);
     }
     
+    /**
+     * Initializes Trace using a string containing the initilization parameters,
+     * delivering the trace statements to iCallback in batches.
+     *
+     * The batches are delivered on a thread owned by Trace, see TraceBatcher.
+     * The external logger is not used.
+     *
+     * @param[in] iTraceConfig is the configuration information
+     * @param[in] iCallback the client callback receiving the batches of trace statements
+     *
+     * @return bool true when successfully initialized, false with initalization failed.
+     */
+    bool initializeBatchedWithBuffer(const std::string& iTraceConfig
+                                     , TraceBatchCallback iCallback
+                                     )
+    {
+        if (initialized())
+            return true;
+        
+        std::cout << processConfig(iTraceConfig) << std::flush;
+        
+        int64_t batchSize = optionInt("batchSize", TraceBatcher::sDefaultBatchSize);
+        int64_t batchInterval = optionInt("batchIntervalMs", TraceBatcher::sDefaultIntervalMs);
+        
+        addSink(std::make_shared<TraceBatcher>(iCallback
+                                               , static_cast<size_t>(batchSize > 0 ? batchSize : 1)
+                                               , std::chrono::milliseconds(batchInterval > 0 ? batchInterval : 1)
+                                               ));
+        
+        publish();
+        
+        return true;
+    }
+    
+    /**
+     * Initializes Trace using a file containing the initilization parameters,
+     * delivering the trace statements to iCallback in batches.
+     *
+     * @param[in] iTraceConfigFile is path to the file containing configuration information
+     * @param[in] iCallback the client callback receiving the batches of trace statements
+     *
+     * @return bool true when successfully initialized, false with initalization failed.
+     */
+    bool initializeBatchedWithFile(const std::string& iTraceConfigFile
+                                   , TraceBatchCallback iCallback
+                                   )
+    {
+        if (initialized())
+            return true;
+        
+        std::ifstream fileStream;
+        fileStream.open(iTraceConfigFile);
+        
+        // See if the file exists
+        //
+        if (!fileStream.is_open())
+            return false;
+        
+        std::stringstream buffer;
+        buffer << fileStream.rdbuf();
+        
+        return initializeBatchedWithBuffer(buffer.str(), iCallback);
+    }
+    
+    virtual ~Trace()
+    {
+        delete outputs_.load(std::memory_order_relaxed);
+    }
+    
     /**
      * Resets the Trace class.
      *
-     * Clears all callbacks and configuration information.
+     * Clears all callbacks, sinks and configuration information.
+     * Statements written by other threads meanwhile are either delivered
+     * to the previous outputs or dropped, reset waits for the ones being written.
      */
     void reset();
     
+    /**
+     * Returns an option set in the configuration as name=value.
+     *
+     * @param[in] iName name of the option
+     * @param[in] iDefault value returned when the option is not set
+     *
+     * @return std::string containing the value of the option
+     */
+    std::string option(const std::string& iName, const std::string& iDefault = "") const
+    {
+        auto it = options_.find(iName);
+        return it == options_.end() ? iDefault : it->second;
+    }
+    
+    /**
+     * Returns an integer option set in the configuration as name=value.
+     *
+     * @param[in] iName name of the option
+     * @param[in] iDefault value returned when the option is not set or not a number
+     *
+     * @return the value of the option
+     */
+    int64_t optionInt(const std::string& iName, int64_t iDefault = 0) const
+    {
+        std::string value = option(iName);
+        
+        char* end = nullptr;
+        long long result = strtoll(value.c_str(), &end, 0);
+        
+        return (value.empty() || *end != 0) ? iDefault : result;
+    }
+    
+    /**
+     * Names the calling thread for the filterThread option.
+     *
+     * @param[in] iName name of the thread
+     */
+    static void setThreadName(const std::string& iName)
+    {
+        TraceThreadName::set(iName);
+    }
+    
+    /**
+     * Generation of the configuration, changes whenever the result of
+     * testTraceMask may have changed. See TraceSiteCache.
+     * No two Trace instances share a generation.
+     *
+     * @return the current generation
+     */
+    uint32_t generation() const
+    {
+        return generation_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * Installs an additional output for trace statements.
+     * Can be called from any thread while statements are written, see TraceSinkRegistry.
+     *
+     * @param[in] iSink the sink to install
+     */
+    void addSink(const std::shared_ptr<TraceSink>& iSink)
+    {
+        sinks_.add(iSink);
+    }
+    
+    /**
+     * Subscribes a client callback to the trace statements, in addition to the callback
+     * or log file Trace was initialized with. Any number of callbacks can be subscribed,
+     * from any thread. The callbacks are called on the thread writing the statement
+     * with the message only, see TraceCallbackSink.
+     *
+     * @param[in] iCallback the callback
+     *
+     * @return the subscription, to be handed to unsubscribe
+     */
+    std::shared_ptr<TraceSink> subscribe(TraceCallback iCallback)
+    {
+        std::shared_ptr<TraceSink> sink = std::make_shared<TraceCallbackSink>(iCallback);
+        addSink(sink);
+        
+        return sink;
+    }
+    
+    /**
+     * Removes a callback subscribed with subscribe.
+     * Once this returns the callback is not called anymore.
+     *
+     * @param[in] iSubscription returned by subscribe
+     */
+    void unsubscribe(const std::shared_ptr<TraceSink>& iSubscription)
+    {
+        removeSink(iSubscription);
+    }
+    
+    /**
+     * Finds recent statements kept by the storeSizeMb option.
+     *
+     * @param[in] iFrom oldest timestamp, nanoseconds since the epoch (UTC), inclusive
+     * @param[in] iTo newest timestamp, inclusive
+     * @param[in] iCategoryMask category of the statements, kCategory_Always for any.
+     *            A priority in the top bits only returns statements at or above it.
+     * @param[in] iLimit maximum number of statements, the most recent ones are returned
+     *
+     * @return the matching statements, oldest first. Empty when the option is not set.
+     */
+    std::vector<TraceStoreRecord> query(uint64_t iFrom, uint64_t iTo, TraceMask iCategoryMask, size_t iLimit) const
+    {
+        std::vector<TraceStoreRecord> result;
+        
+        // Hold on to the store, reset may retire the outputs while it is queried
+        //
+        std::shared_ptr<TraceStore> store;
+        
+        {
+            TraceSinkRegistry::Reader reader(sinks_);
+            const Outputs* outputs = outputs_.load(std::memory_order_acquire);
+            
+            if (outputs)
+                store = outputs->store;
+        }
+        
+        if (store)
+        {
+            TraceStoreQuery query;
+            query.from = iFrom;
+            query.to = iTo;
+            query.mask = iCategoryMask;
+            query.limit = iLimit;
+            
+            store->query(query, result);
+        }
+        
+        return result;
+    }
+    
+    /**
+     * Removes a sink installed with addSink.
+     * Once this returns no statement is written to it anymore.
+     *
+     * @param[in] iSink the sink to remove
+     */
+    void removeSink(const std::shared_ptr<TraceSink>& iSink)
+    {
+        sinks_.remove(iSink);
+    }
+    
     /**
      * Writes a statement to Trace
      *
@@ -412,15 +694,188 @@ public:
      */
     void writeMemory(TraceMask iMask, void* iBuffer, int32_t iLength) const
     {
-        if (!testTraceMask(iMask))
+        // The outputs stay valid until the reader is gone, see reset
+        //
+        TraceSinkRegistry::Reader reader(sinks_);
+        const Outputs* outputs = outputs_.load(std::memory_order_acquire);
+        
+        if (!testTraceMask(outputs, iMask))
+            return;
+        
+        writeMemory(reader, outputs, iMask, iBuffer, iLength);
+    }
+    
+    /**
+     * Writes a statement to Trace, the caller already tested iMask, see MaskTested.
+     *
+     * @param[in] iMask the masking information for the statement to be traced
+     */
+    void writeMemory(MaskTested, TraceMask iMask, void* iBuffer, int32_t iLength) const
+    {
+        TraceSinkRegistry::Reader reader(sinks_);
+        writeMemory(reader, outputs_.load(std::memory_order_acquire), iMask, iBuffer, iLength);
+    }
+    
+    /**
+     * Writes a statement to Trace
+     *
+     * @param[in] iMask the masking information for the statement to be traced
+     * @param[in] iArgs arguments to be traced, printf style.
+     */
+    void writeMemory(TraceMask iMask, void* iBuffer, int32_t iLength, const char* iArgs...) const
+    {
+        TraceSinkRegistry::Reader reader(sinks_);
+        const Outputs* outputs = outputs_.load(std::memory_order_acquire);
+        
+        if (!testTraceMask(outputs, iMask))
             return;
         
+        va_list argList;
+        va_start(argList, iArgs);
+        
+        writeMemory(reader, outputs, iMask, iBuffer, iLength, iArgs, argList);
+        
+        va_end(argList);
+    }
+    
+    /**
+     * Writes a statement to Trace, the caller already tested iMask, see MaskTested.
+     *
+     * @param[in] iMask the masking information for the statement to be traced
+     * @param[in] iArgs arguments to be traced, printf style.
+     */
+    void writeMemory(MaskTested, TraceMask iMask, void* iBuffer, int32_t iLength, const char* iArgs...) const
+    {
+        TraceSinkRegistry::Reader reader(sinks_);
+        
+        va_list argList;
+        va_start(argList, iArgs);
+        
+        writeMemory(reader, outputs_.load(std::memory_order_acquire), iMask, iBuffer, iLength, iArgs, argList);
+        
+        va_end(argList);
+    }
+
+    /**
+     * Writes a statement to Trace
+     *
+     * @param[in] iMask the masking information for the statement to be traced
+     * @param[in] iArgs arguments to be traced, printf style.
+     */
+    void writeTrace(TraceMask iMask, const char* iArgs...) const
+    {
+        TraceSinkRegistry::Reader reader(sinks_);
+        const Outputs* outputs = outputs_.load(std::memory_order_acquire);
+        
+        if (!testTraceMask(outputs, iMask))
+            return;
+       
+        va_list argList;
+        va_start(argList, iArgs);
+        
+        writeTrace(reader, outputs, iMask, iArgs, argList);
+        
+        va_end(argList);
+    }
+    
+    /**
+     * Writes a statement to Trace, the caller already tested iMask, see MaskTested.
+     *
+     * @param[in] iMask the masking information for the statement to be traced
+     * @param[in] iArgs arguments to be traced, printf style.
+     */
+    void writeTrace(MaskTested, TraceMask iMask, const char* iArgs...) const
+    {
+        TraceSinkRegistry::Reader reader(sinks_);
+        
+        va_list argList;
+        va_start(argList, iArgs);
+        
+        writeTrace(reader, outputs_.load(std::memory_order_acquire), iMask, iArgs, argList);
+        
+        va_end(argList);
+    }
+    
+private:
+    
+    /// A category written to its own file, see the route option
+    struct Route
+    {
+        TraceMask category;
+        std::unique_ptr<TraceBackend> backend;
+    };
+    
+    /// What the configuration sets up for the writing threads, see outputs_
+    struct Outputs
+    {
+        /// Specialized flag to indicate all tracing is enabled
+        /// This is an optimization to prevent from processing
+        /// the masks std::vector to determine if a TraceMask is set
+        bool traceAll{false};
+        
+        /// Specialized flag to indicate all tracing priority is enabled
+        /// This is an optimization to prevent from processing
+        /// the masks std::vector to determine if a TraceMask is set
+        Priority traceAllPriority{kPriority_Off};
+        
+        /// List is registered TraceMasks
+        /// Used to determine if a trace statement should be written
+        std::vector<TraceMask> masks;
+        
+        /// Logger the statements are written to, see TraceBackend.
+        /// nullptr when the statements are only delivered to the sinks.
+        std::unique_ptr<TraceBackend> backend;
+        
+        /// Categories written to their own files instead of backend
+        std::vector<Route> routes;
+        
+        /// Holds back the statements below the tailThreshold option, see TraceTail.
+        /// nullptr when the option is not set.
+        std::unique_ptr<TraceTail> tail;
+        
+        /// Keeps the statements for query, also installed as a sink.
+        /// nullptr when the storeSizeMb option is not set.
+        std::shared_ptr<TraceStore> store;
+    };
+    
+    /**
+     * Formats a statement and delivers it, within the read-side critical section of the writer.
+     *
+     * @param[in] iReader the read-side critical section iOutputs was read in
+     * @param[in] iOutputs the published outputs, nullptr when not initialized
+     * @param[in] iMask the masking information for the statement
+     * @param[in] iFormat the format string, printf style
+     * @param[in] iArgs the arguments of the format
+     */
+    void writeTrace(const TraceSinkRegistry::Reader& iReader, const Outputs* iOutputs, TraceMask iMask, const char* iFormat, va_list iArgs) const
+    {
+        // Buffer to print the message to,
+        // must include terminiating character
+        //
+        char traceMessage[sTraceMessageSize];
+        memset(traceMessage, 0, sTraceMessageSize);
+        
+        formatMessage(traceMessage, iFormat, iArgs);
+        
+        writeMessage(iReader, iOutputs, iMask, iFormat, traceMessage);
+    }
+    
+    /**
+     * Prints a memory buffer in hex and delivers it, see writeTrace.
+     */
+    void writeMemory(const TraceSinkRegistry::Reader& iReader, const Outputs* iOutputs, TraceMask iMask, void* iBuffer, int32_t iLength) const
+    {
         // Print the memory buffer in hex
         // must include terminiating character
         //
         char traceMessage[sTraceMessageSize];
         memset(traceMessage, 0, sTraceMessageSize);
         
+        // Anything that doesn't fit in the trace buffer is truncated
+        //
+        if (iLength > sTraceMemoryMaxBytes)
+            iLength = sTraceMemoryMaxBytes;
+        
         for (int i = 0; i < iLength; i++)
         {
             char tmp = static_cast<char*>(iBuffer)[i];
@@ -439,32 +894,25 @@ public:
             memset(traceMessage + (len - 1), 0x0, 1);
         }
         
-        if (callback_)
-        {
-            callback_(traceMessage);
-        }
-        else
-        {
-            std::cout << traceMessage << std::endl;
-        }
+        writeMessage(iReader, iOutputs, iMask, nullptr, traceMessage);
     }
+    
     /**
-     * Writes a statement to Trace
-     *
-     * @param[in] iMask the masking information for the statement to be traced
-     * @param[in] iArgs arguments to be traced, printf style.
+     * Prints a memory buffer in hex after a formatted message and delivers it, see writeTrace.
      */
-    void writeMemory(TraceMask iMask, void* iBuffer, int32_t iLength, const char* iArgs...) const
+    void writeMemory(const TraceSinkRegistry::Reader& iReader, const Outputs* iOutputs, TraceMask iMask, void* iBuffer, int32_t iLength, const char* iFormat, va_list iArgs) const
     {
-        if (!testTraceMask(iMask))
-            return;
-        
         // Print the memory buffer in hex
         // must include terminiating character
         //
         char memBuffer[sTraceMessageSize];
         memset(memBuffer, 0, sTraceMessageSize);
         
+        // Anything that doesn't fit in the trace buffer is truncated
+        //
+        if (iLength > sTraceMemoryMaxBytes)
+            iLength = sTraceMemoryMaxBytes;
+        
         for (int i = 0; i < iLength; i++)
         {
             char tmp = static_cast<char*>(iBuffer)[i];
@@ -483,12 +931,7 @@ public:
 
         // Print the message
         //
-        va_list argList;
-        va_start(argList, iArgs);
-        
-        vsnprintf(traceMessage, sTraceMessageSize, iArgs, argList);
-        
-        va_end(argList);
+        formatMessage(traceMessage, iFormat, iArgs);
         
         // Copy over the memory printout
         // Note - don't copy over the last character which is a trailing space
@@ -505,53 +948,128 @@ public:
             len = strlen(traceMessage);
         }
         
-        memcpy(traceMessage + len, memBuffer, (iLength*3) - 1);
+        // Leave room for the terminating character
+        //
+        size_t memLen = iLength > 0 ? (iLength*3) - 1 : 0;
+        memLen = std::min(memLen, sTraceMessageSize - 1 - len);
+        memcpy(traceMessage + len, memBuffer, memLen);
         
-        if (callback_)
+        writeMessage(iReader, iOutputs, iMask, iFormat, traceMessage);
+    }
+    
+    /**
+     * Formats a statement, with the compiled format of the call site when there is one.
+     *
+     * @param[out] oMessage receives the statement, sTraceMessageSize bytes
+     * @param[in] iFormat the format string, printf style
+     * @param[in] iArgs the arguments of the format
+     */
+    static void formatMessage(char* oMessage, const char* iFormat, va_list iArgs)
+    {
+        const TraceFormat* format = TraceFormat::find(iFormat);
+        
+        if (format)
+            format->format(oMessage, sTraceMessageSize, iArgs);
+        else
+            vsnprintf(oMessage, sTraceMessageSize, iFormat, iArgs);
+    }
+    
+    /**
+     * Delivers a formatted statement to the installed sinks and the callback.
+     *
+     * @param[in] iReader the read-side critical section iOutputs was read in
+     * @param[in] iOutputs the published outputs, nullptr when not initialized
+     * @param[in] iMask the masking information for the statement
+     * @param[in] iSite the call site of the statement, see TraceRecord::site
+     * @param[in] iMessage the formatted statement
+     */
+    void writeMessage(const TraceSinkRegistry::Reader& iReader, const Outputs* iOutputs, TraceMask iMask, const void* iSite, const char* iMessage) const
+    {
+        TraceTail* tail = iOutputs ? iOutputs->tail.get() : nullptr;
+        
+        if (!sinks_.empty() || tail)
         {
-            callback_(traceMessage);
+            TraceRecord record;
+            record.mask = iMask;
+            record.timestamp = currentTimestamp();
+            record.threadId = currentThreadId();
+            record.site = iSite;
+            record.message = iMessage;
+            record.length = static_cast<uint32_t>(strlen(iMessage));
+            
+            if (tail)
+            {
+                if (tail->capture(record))
+                    return;
+                
+                // Write the context leading up to this statement first
+                //
+                tail->dump([this, &iReader, iOutputs](const TraceRecord& iRecord) { writeRecord(iReader, iOutputs, iRecord); });
+            }
+            
+            writeRecord(iReader, iOutputs, record);
+            return;
         }
-        else
+        
+        if (TraceBackend* backend = backendFor(iOutputs, iMask))
         {
-            std::cout << traceMessage << std::endl;
+            backend->write(iMask, iSite, iMessage);
         }
     }
-
+    
     /**
-     * Writes a statement to Trace
+     * Delivers a statement to the installed sinks and the callback.
      *
-     * @param[in] iMask the masking information for the statement to be traced
-     * @param[in] iArgs arguments to be traced, printf style.
+     * @param[in] iReader the read-side critical section outputs was read in
+     * @param[in] iOutputs the published outputs, nullptr when not initialized
+     * @param[in] iRecord the statement
      */
-    void writeTrace(TraceMask iMask, const char* iArgs...) const
+    void writeRecord(const TraceSinkRegistry::Reader& iReader, const Outputs* iOutputs, const TraceRecord& iRecord) const
     {
-        if (!testTraceMask(iMask))
-            return;
-       
-        va_list argList;
-        va_start(argList, iArgs);
+        sinks_.forEach(iReader, [&iRecord](TraceSink& iSink) { iSink.write(iRecord); });
         
-        // Buffer to print the message to,
-        // must include terminiating character
-        //
-        char traceMessage[sTraceMessageSize];
-        memset(traceMessage, 0, sTraceMessageSize);
-        
-        vsnprintf(traceMessage, sTraceMessageSize, iArgs, argList);
-        
-        va_end(argList);
-
-        if (callback_)
+        if (TraceBackend* backend = backendFor(iOutputs, iRecord.mask))
         {
-            callback_(traceMessage);
+            backend->write(iRecord.mask, iRecord.site, iRecord.message, iRecord.timestamp);
         }
-        else
+    }
+    
+    /**
+     * @param[in] iOutputs the published outputs, nullptr when not initialized
+     * @param[in] iMask the masking information for the statement
+     *
+     * @return the backend of the category of iMask when it is routed, the backend of iOutputs otherwise
+     */
+    static TraceBackend* backendFor(const Outputs* iOutputs, TraceMask iMask)
+    {
+        if (!iOutputs)
+            return nullptr;
+        
+        for (const auto& route : iOutputs->routes)
         {
-            std::cout << traceMessage << std::endl;
+            if (route.category == (iMask & kCategory_Always))
+                return route.backend.get();
         }
+        
+        return iOutputs->backend.get();
     }
     
-private:
+    /**
+     * @return the current time in nanoseconds since the epoch (UTC)
+     */
+    static uint64_t currentTimestamp()
+    {
+        return TraceClock::now();
+    }
+    
+    /**
+     * @return an identifier for the calling thread
+     */
+    static uint64_t currentThreadId()
+    {
+        static thread_local uint64_t threadId = std::hash<std::thread::id>()(std::this_thread::get_id());
+        return threadId;
+    }
     
     /**
      * Initializes Trace using a string containing the initilization parameters
@@ -567,15 +1085,13 @@ private:
                               , const std::string& iLogFilePath
                               )
     {
-        if (initalized_)
+        if (initialized())
             return true;
         
-        processConfig(iTraceConfig);
+        std::string echo = processConfig(iTraceConfig);
         
-        callback_ = externalLoggerCallback;
-        externalLoggerCallback_ = iCallback;
-        bool useClientInstalledCallback = iCallback != nullptr;
-        initalized_ = initExternalLogger(iLogFilePath, useClientInstalledCallback);
+        if (initExternalLogger(iLogFilePath, iCallback, echo))
+            publish();
         
         return true;
     }
@@ -594,7 +1110,7 @@ private:
                             , const std::string& iLogFilePath
                             )
     {
-        if (initalized_)
+        if (initialized())
             return true;
         
         std::ifstream fileStream;
@@ -607,18 +1123,42 @@ private:
         
         std::stringstream buffer;
         buffer << fileStream.rdbuf();
-        processConfig(buffer.str());
+        std::string echo = processConfig(buffer.str());
         
         fileStream.close();
         
-        callback_ = externalLoggerCallback;
-        externalLoggerCallback_ = iCallback;
-        bool useClientInstalledCallback = iCallback != nullptr;
-        initalized_ = initExternalLogger(iLogFilePath, useClientInstalledCallback);
+        if (initExternalLogger(iLogFilePath, iCallback, echo))
+            publish();
 
         return true;
     }
 
+    /**
+     * @return true once the outputs are published
+     */
+    bool initialized() const
+    {
+        return outputs_.load(std::memory_order_acquire) != nullptr;
+    }
+    
+    /**
+     * Makes the outputs configured by processConfig and initExternalLogger
+     * visible to the writing threads.
+     */
+    void publish()
+    {
+        outputs_.store(pending_.release(), std::memory_order_release);
+        configChanged();
+    }
+    
+    /**
+     * Invalidates every TraceSiteCache of this instance.
+     */
+    void configChanged()
+    {
+        generation_.store(nextGeneration_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    
     /**
      * Determines if the iMask has been enabled for tracing.
      *
@@ -628,7 +1168,22 @@ private:
      */
     bool testTraceMask(TraceMask iMask) const
     {
-        if (!initalized_)
+        TraceSinkRegistry::Reader reader(sinks_);
+        return testTraceMask(outputs_.load(std::memory_order_acquire), iMask);
+    }
+    
+    /**
+     * Determines if the iMask has been enabled for tracing, within the
+     * read-side critical section of the caller.
+     *
+     * @param[in] iOutputs the published outputs, nullptr when not initialized
+     * @param[in] iMask mask to test
+     *
+     * @return true the iMask is enabled for tracing. false otherwise.
+     */
+    static bool testTraceMask(const Outputs* iOutputs, TraceMask iMask)
+    {
+        if (!iOutputs)
             return false;
         
         const uint64_t priorityMask = 0xF000000000000000;
@@ -644,15 +1199,15 @@ private:
         
         // Check for the all flag being enabled
         //
-        if (traceAll_)
+        if (iOutputs->traceAll)
         {
-            if (traceAllPriority_ == kPriority_Off)
+            if (iOutputs->traceAllPriority == kPriority_Off)
                 return false;
             
-            if (kPriority_Always == traceAllPriority_)
+            if (kPriority_Always == iOutputs->traceAllPriority)
                 doTrace = true;
             
-            if (iMask >= traceAllPriority_)
+            if (iMask >= iOutputs->traceAllPriority)
                 doTrace = true;
         }
         
@@ -661,7 +1216,7 @@ private:
         //
         if (!doTrace)
         {
-            for (const auto& mask : masks_)
+            for (const auto& mask : iOutputs->masks)
             {
                 // Check the category
                 //
@@ -687,27 +1242,78 @@ private:
         return doTrace;
     }
     
+    /**
+     * Removes the leading and trailing spaces of iText.
+     *
+     * @param[in] iText text to trim
+     * @param[in] iCollapse true to also replace runs of spaces inside iText by a single space
+     *
+     * @return the trimmed text
+     */
+    static std::string trimSpaces(const std::string& iText, bool iCollapse)
+    {
+        size_t first = iText.find_first_not_of(' ');
+        if (first == std::string::npos)
+            return std::string();
+        
+        size_t last = iText.find_last_not_of(' ');
+        
+        if (!iCollapse)
+            return iText.substr(first, last + 1 - first);
+        
+        std::string result;
+        result.reserve(last + 1 - first);
+        
+        for (size_t i = first; i <= last; i++)
+        {
+            if (iText[i] != ' ' || iText[i - 1] != ' ')
+                result.push_back(iText[i]);
+        }
+        
+        return result;
+    }
+    
     /**
      * Processes the configuration information.
      *
      * @param[in] iTraceConfig config string to be processed
+     *
+     * @return the accepted lines, echoed to the console once the backend starts
      */
-    void processConfig(const std::string& iTraceConfig)
+    std::string processConfig(const std::string& iTraceConfig)
     {
+        std::string echo;
+        
+        pending_.reset(new Outputs());
+        Outputs& outputs = *pending_;
+        
         std::stringstream ss(iTraceConfig);
         std::string line;
         while (std::getline(ss, line))
         {
             // Trim leading and trailing spaces
-            // Fancy regex trimming
             //
-            line = std::regex_replace(line, std::regex("^ +| +$|( ) +"), "$1");
+            line = trimSpaces(line, true);
 
             // Check for # indicating a commented out value
             //
             if ((line.length() == 0) || (line.length() && line[0] == '#'))
                 continue;
             
+            // Options are name=value pairs
+            //
+            size_t equals = line.find("=");
+            if (equals != std::string::npos)
+            {
+                std::string name = trimSpaces(line.substr(0, equals), false);
+                std::string value = trimSpaces(line.substr(equals + 1), false);
+                
+                options_[name] = value;
+                
+                echo += line + "\n";
+                continue;
+            }
+            
             // Split at the @
             //
             std::string categoryStr = line.substr(0, line.find("@"));
@@ -715,8 +1321,8 @@ private:
 
             // Trim leading and trailing spaces
             //
-            categoryStr = std::regex_replace(categoryStr, std::regex("^ +| +$|( ) +"), "$1");
-            priorityStr = std::regex_replace(priorityStr, std::regex("^ +| +$|( ) +"), "$1");
+            categoryStr = trimSpaces(categoryStr, true);
+            priorityStr = trimSpaces(priorityStr, true);
 
             Category category = stringToCategory(categoryStr);
             Priority priority = stringToPriority(priorityStr);
@@ -730,7 +1336,7 @@ private:
             
             // Filter duplicates
             //
-            if (std::find (masks_.begin(), masks_.end(), mask) != masks_.end())
+            if (std::find (outputs.masks.begin(), outputs.masks.end(), mask) != outputs.masks.end())
                 continue;
             
             // Record the all category and associated priority
@@ -738,61 +1344,156 @@ private:
             //
             if (category == kCategory_Always)
             {
-                traceAll_ = true;
-                traceAllPriority_ = priority;
+                outputs.traceAll = true;
+                outputs.traceAllPriority = priority;
             }
             
             // Finally add the entry to the list
             //
-            masks_.push_back(mask);
+            outputs.masks.push_back(mask);
             
-            std::cout << line << std::endl;
+            echo += line + "\n";
         }
+        
+        std::string tailThreshold = option("tailThreshold");
+        if (tailThreshold.length())
+        {
+            int64_t tailSize = optionInt("tailSize", TraceTail::sDefaultSize);
+            
+            outputs.tail.reset(new TraceTail(stringToPriority(tailThreshold)
+                                      , static_cast<size_t>(tailSize > 0 ? tailSize : 1)
+                                      , option("tailScope") == "all"
+                                      ));
+        }
+        
+        int64_t storeSize = optionInt("storeSizeMb");
+        if (storeSize > 0)
+        {
+            outputs.store = std::make_shared<TraceStore>(static_cast<size_t>(storeSize) * 1024 * 1024);
+            addSink(outputs.store);
+        }
+        
+        // The clock and PerfControl are process wide, only the logger of the macros sets them
+        //
+        const bool global = this == &instance();
+        
+        std::string clock = option("clock");
+        if (clock.length() && !global)
+        {
+            std::cerr << "Trace option clock=" << clock << " ignored, only accepted by Trace::instance()" << std::endl;
+        }
+        else if (clock.length())
+        {
+            TraceClock::Source source = TraceClock::kSource_Auto;
+            if (!TraceClock::parseSource(clock, source) || !TraceClock::select(source))
+                std::cerr << "Invalid trace option clock=" << clock << std::endl;
+        }
+        
+        auto perf = options_.find("perf");
+        if (perf != options_.end() && !global)
+            std::cerr << "Trace option perf=" << perf->second << " ignored, only accepted by Trace::instance()" << std::endl;
+        else if (perf != options_.end() && !PerfControl::configure(perf->second))
+            std::cerr << "Invalid trace option perf=" << perf->second << std::endl;
+        
+        if (option("console") == "on")
+        {
+            int64_t flushInterval = optionInt("consoleFlushMs", TraceConsoleSink::sDefaultFlushIntervalMs);
+            
+            addSink(std::make_shared<TraceConsoleSink>(stdout, std::chrono::milliseconds(std::max<int64_t>(flushInterval, 0))));
+        }
+        
+        return echo;
     }
     
     /**
-     * Initializes the Boost Logger or spdlog layer
+     * Creates and opens the backend selected with the backend option,
+     * or only creates it with the startup option, see TraceLazyBackend.
      *
      * @param[in] iLogFilePath is path for the output file if used.
+     * @param[in] iCallback the client callback, nullptr to write to iLogFilePath
+     * @param[in] iEcho the accepted configuration lines, echoed to the console when the backend starts
      *
      * @return true if initialized properly, false if there was a problem initializing
      */
-    bool initExternalLogger(const std::string& iLogFilePath, bool iUseInstalledCallback);
-
-    /// Size of the trace buffer to write to
-    /// Any trace statement, including arguments, longer than this will be truncated.
-    static const int32_t sTraceMessageSize{2048};
+    bool initExternalLogger(const std::string& iLogFilePath, TraceCallback iCallback, const std::string& iEcho);
     
-    /// The initialization state of Trace
-    bool initalized_{false};
+    /// Options set in the configuration as name=value
+    std::map<std::string, std::string> options_;
     
-    /// Specialized flag to indicate all tracing is enabled
-    /// This is an optimization to prevent from processing
-    /// the masks_ std::vector to determine if a TraceMask is set
-    bool traceAll_{false};
+    /// Additional outputs installed with addSink
+    TraceSinkRegistry sinks_;
     
-    /// Specialized flag to indicate all tracing priority is enabled
-    /// This is an optimization to prevent from processing
-    /// the masks_ std::vector to determine if a TraceMask is set
-    Priority traceAllPriority_{kPriority_Off};
-
-    /// List is registered TraceMasks
-    /// Used to determine if a trace statement should be written
-    std::vector<TraceMask> masks_;
+    /// Everything the writing threads read besides the sinks.
+    /// Never changed once published, reset retires it after a grace period of sinks_.
+    std::atomic<const Outputs*> outputs_{nullptr};
     
-    /// Pointer to the client callback.
-    /// See note in externalLoggerCallback
-    TraceCallback callback_{nullptr};
+    /// Outputs being configured, until published
+    std::unique_ptr<Outputs> pending_;
     
-    /// Pointer to the External Logger callback.
-    /// See note in externalLoggerCallback
-    TraceCallback externalLoggerCallback_{nullptr};
-
-#ifdef BBC_USE_SPDLOG
-    template<typename Mutex>
-    friend class client_callback_sink;
+    /// Source of the generations of all of the instances
+    static std::atomic<uint32_t> nextGeneration_;
+    
+    /// See generation
+    std::atomic<uint32_t> generation_{nextGeneration_.fetch_add(1, std::memory_order_relaxed)};
+    
+    friend class TraceSiteCache;
+};
 
-    std::shared_ptr<spdlog::logger> async_file{nullptr};
-#endif
+/**
+ * \brief Caches the enable decision of a single trace call site.
+ *
+ * The trace macros hold one in a function local static per call site.
+ * Once computed, checking a call site is a single relaxed load compared against
+ * Trace::generation, testTraceMask only runs again after the configuration changed.
+ * As the generations of the Trace instances differ, a call site tracing to
+ * another instance recomputes instead of reusing the decision of the previous one.
+ *
+ * The state packs the generation in the upper 32 bits, a 31 bit hash of the mask
+ * in bits 1 to 31 and the decision in bit 0. The hash makes a call site with a
+ * changing mask recompute instead of reusing the decision of another mask.
+ */
+class TraceSiteCache
+{
+public:
+    
+    constexpr TraceSiteCache() {}
+    
+    /**
+     * @param[in] iTrace the instance traced to
+     * @param[in] iMask mask of the call site
+     *
+     * @return true if iMask is enabled for tracing
+     */
+    bool enabled(const Trace& iTrace, Trace::TraceMask iMask)
+    {
+        const uint64_t key = (static_cast<uint64_t>(iTrace.generation()) << 32) | maskHash(iMask);
+        const uint64_t state = state_.load(std::memory_order_relaxed);
+        
+        if ((state & ~1ull) == key)
+            return (state & 1) != 0;
+        
+        return refresh(iTrace, iMask, key);
+    }
+    
+private:
+    
+    bool refresh(const Trace& iTrace, Trace::TraceMask iMask, uint64_t iKey)
+    {
+        // The generation in iKey was read before the decision is computed,
+        // a configuration change in between only causes another refresh
+        //
+        bool enabled = iTrace.testTraceMask(iMask);
+        state_.store(iKey | (enabled ? 1 : 0), std::memory_order_relaxed);
+        
+        return enabled;
+    }
+    
+    static uint64_t maskHash(Trace::TraceMask iMask)
+    {
+        return (((iMask ^ (iMask >> 32)) * 0x9E3779B97F4A7C15ull) >> 32) & 0xFFFFFFFEull;
+    }
+    
+    /// 0 until computed, the generation starts at 1
+    std::atomic<uint64_t> state_{0};
 };
 
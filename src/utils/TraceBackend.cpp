@@ -0,0 +1,71 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceBackend.h"
+#include "TraceNativeBackend.h"
+#include "TraceSpdlogBackend.h"
+#include "TraceBoostBackend.h"
+
+const uint64_t TraceBackend::sNow;
+
+std::unique_ptr<TraceBackend> TraceBackend::create(const std::string& iName)
+{
+    if (iName == "native")
+        return std::unique_ptr<TraceBackend>(new TraceNativeBackend());
+    
+#ifdef BBC_USE_SPDLOG
+    if (iName == "spdlog")
+        return std::unique_ptr<TraceBackend>(new TraceSpdlogBackend());
+#endif
+    
+#ifdef BBC_USE_BOOST
+    if (iName == "boost")
+        return std::unique_ptr<TraceBackend>(new TraceBoostBackend());
+#endif
+    
+    return nullptr;
+}
+
+std::string TraceBackend::defaultName()
+{
+#if defined(BBC_USE_SPDLOG)
+    return "spdlog";
+#elif defined(BBC_USE_BOOST)
+    return "boost";
+#else
+    return "native";
+#endif
+}
+
+std::vector<std::string> TraceBackend::available()
+{
+    std::vector<std::string> result;
+    result.push_back("native");
+    
+#ifdef BBC_USE_SPDLOG
+    result.push_back("spdlog");
+#endif
+    
+#ifdef BBC_USE_BOOST
+    result.push_back("boost");
+#endif
+    
+    return result;
+}
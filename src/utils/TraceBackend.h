@@ -0,0 +1,166 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#include "TraceContentFilter.h"
+#include "TraceThreadTuning.h"
+
+/**
+ * \brief Prototype for the client callback a backend delivers the statements to.
+ *
+ * Same signature as Trace::TraceCallback.
+ */
+typedef void (*TraceBackendCallback)(const char* iMessage);
+
+/**
+ * \brief Settings handed to TraceBackend::open.
+ */
+struct TraceBackendConfig
+{
+    /// How the writing threads hand their statements to the writer thread
+    enum Buffering
+    {
+          kBuffering_Shared     ///< One queue shared by all of the writing threads
+        , kBuffering_Thread     ///< A buffer per writing thread, merged back in time order
+        , kBuffering_Cpu        ///< A buffer per processor, merged back in time order
+    };
+    
+    /// File to write to, used when there is no callback
+    std::string logFilePath;
+    
+    /// Client callback receiving the statements, nullptr to write to logFilePath
+    TraceBackendCallback callback{nullptr};
+    
+    /// Coalescing window in nanoseconds, see TraceCoalescer. 0 disables coalescing.
+    uint64_t coalesceWindow{0};
+    
+    /// Prefix the statements with the date and the time to the nanosecond,
+    /// "[YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ]", so files can be merged in time order.
+    /// Only supported by native and spdlog.
+    bool preciseTimestamps{false};
+    
+    /// Preallocate the log file this many bytes at a time and write it in aligned blocks,
+    /// see TraceFileWriter. 0 appends with stdio. Only supported by native.
+    uint64_t preallocate{0};
+    
+    /// Bypass the page cache with O_DIRECT when writing with TraceFileWriter
+    bool directIO{false};
+    
+    /// Content filter applied by the writer thread, see TraceContentFilter.
+    /// nullptr writes every statement. Only supported by native and spdlog.
+    std::shared_ptr<const TraceContentFilter> filter;
+    
+    /// Write from a thread owned by the backend. When false the writing thread
+    /// formats and buffers the statement itself. Only supported by native.
+    bool threaded{true};
+    
+    /// Statement buffering of the writing threads, see TraceNativeBackend. Only supported by native.
+    Buffering buffering{kBuffering_Shared};
+    
+    /// How long kBuffering_Thread and kBuffering_Cpu hold the statements back to put them in time order, in nanoseconds
+    uint64_t mergeWindow{5000000};
+    
+    /// Affinity, scheduling and wakeups of the thread writing the statements out, see TraceThreadTuning
+    TraceThreadTuning consumer;
+};
+
+///
+/// \brief Interface for the loggers Trace writes its statements to.
+///
+/// Trace owns a single backend, selected when it is initialized with the backend option:
+///
+///       native      built-in asynchronous file writer without external dependencies, see TraceNativeBackend
+///       spdlog      spdlog asynchronous logger, requires BBC_USE_SPDLOG
+///       boost       Boost.Log, requires BBC_USE_BOOST
+///
+/// write is only called for statements that passed the trace masks,
+/// filtered statements never pay for the virtual call.
+///
+/// Note - write is called from many threads at once.
+///
+class TraceBackend
+{
+public:
+    
+    /// Timestamp asking write to take the time itself
+    static const uint64_t sNow{0};
+    
+    virtual ~TraceBackend() {}
+    
+    /**
+     * Starts the backend.
+     *
+     * @param[in] iConfig settings of the backend
+     *
+     * @return true if the backend is ready to write
+     */
+    virtual bool open(const TraceBackendConfig& iConfig) = 0;
+    
+    /**
+     * Writes a statement.
+     *
+     * @param[in] iMask TraceMask of the statement
+     * @param[in] iSite call site of the statement, see TraceRecord::site
+     * @param[in] iMessage formatted statement
+     * @param[in] iTimestamp when the statement was written, nanoseconds since the epoch (UTC)
+     *            from TraceClock, sNow to timestamp it on the call.
+     *            Statements held back, by TraceTail for instance, keep their time this way.
+     */
+    virtual void write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp) = 0;
+    
+    /**
+     * Writes a statement timestamped on the call.
+     */
+    void write(uint64_t iMask, const void* iSite, const char* iMessage)
+    {
+        write(iMask, iSite, iMessage, sNow);
+    }
+    
+    /**
+     * Writes everything still pending and stops the backend.
+     */
+    virtual void close() = 0;
+    
+    /**
+     * Creates a backend.
+     *
+     * @param[in] iName name of the backend, see above
+     *
+     * @return the backend, nullptr if iName is unknown or not compiled in
+     */
+    static std::unique_ptr<TraceBackend> create(const std::string& iName);
+    
+    /**
+     * @return the name of the backend used when none is configured,
+     *         the external logger compiled in, native when there is none
+     */
+    static std::string defaultName();
+    
+    /**
+     * @return the names of all of the backends compiled in
+     */
+    static std::vector<std::string> available();
+};
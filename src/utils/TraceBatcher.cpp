@@ -0,0 +1,127 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceBatcher.h"
+
+const size_t TraceBatcher::sDefaultBatchSize;
+const int64_t TraceBatcher::sDefaultIntervalMs;
+const size_t TraceBatcher::sMaxPendingBatches;
+
+TraceBatcher::TraceBatcher(TraceBatchCallback iCallback
+                           , size_t iBatchSize
+                           , std::chrono::milliseconds iInterval
+                           )
+: callback_(iCallback)
+, batchSize_(iBatchSize ? iBatchSize : 1)
+, interval_(iInterval.count() > 0 ? iInterval : std::chrono::milliseconds(1))
+{
+    pending_.records.reserve(batchSize_);
+    delivering_.records.reserve(batchSize_);
+    
+    thread_ = std::thread(&TraceBatcher::run, this);
+}
+
+TraceBatcher::~TraceBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    
+    wake_.notify_one();
+    thread_.join();
+    
+    deliver();
+}
+
+void TraceBatcher::write(const TraceRecord& iRecord)
+{
+    bool full = false;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        if (pending_.records.size() >= batchSize_ * sMaxPendingBatches)
+        {
+            drops_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        
+        pending_.records.push_back(iRecord);
+        pending_.records.back().message = nullptr;
+        pending_.text.insert(pending_.text.end(), iRecord.message, iRecord.message + iRecord.length);
+        pending_.text.push_back(0);
+        
+        full = pending_.records.size() == batchSize_;
+    }
+    
+    // Only the statement completing the batch wakes the delivery thread
+    //
+    if (full)
+        wake_.notify_one();
+}
+
+void TraceBatcher::flush()
+{
+    deliver();
+}
+
+void TraceBatcher::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (!stop_)
+    {
+        wake_.wait_for(lock, interval_, [this] { return stop_ || pending_.records.size() >= batchSize_; });
+        
+        if (pending_.records.empty())
+            continue;
+        
+        lock.unlock();
+        deliver();
+        lock.lock();
+    }
+}
+
+void TraceBatcher::deliver()
+{
+    std::lock_guard<std::mutex> deliverLock(deliverMutex_);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(pending_, delivering_);
+    }
+    
+    if (delivering_.records.empty())
+        return;
+    
+    const char* message = delivering_.text.data();
+    for (auto& record : delivering_.records)
+    {
+        record.message = message;
+        message += record.length + 1;
+    }
+    
+    if (callback_)
+        callback_(delivering_.records.data(), delivering_.records.size());
+    
+    delivering_.records.clear();
+    delivering_.text.clear();
+}
@@ -0,0 +1,136 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "TraceSink.h"
+
+/**
+ * \brief Prototype for a client callback receiving trace statements in batches.
+ *
+ * iRecords is a contiguous array of iCount statements, oldest first.
+ * The records and their messages are only valid for the duration of the call.
+ */
+typedef void (*TraceBatchCallback)(const TraceRecord* iRecords, size_t iCount);
+
+///
+/// \brief TraceSink delivering trace statements to a client callback in batches.
+///
+/// Statements are copied into a pending batch by the writing thread.
+/// A delivery thread hands the batch to the callback once it holds batchSize
+/// statements, or every interval when it holds fewer.
+/// The messages of a batch are stored back to back in a single buffer,
+/// the callback is never called concurrently and never with an empty batch.
+///
+/// When the callback falls behind by more than sMaxPendingBatches batches
+/// further statements are dropped, see dropCount.
+///
+class TraceBatcher : public TraceSink
+{
+public:
+    
+    /// Default number of statements that triggers a delivery
+    static const size_t sDefaultBatchSize{256};
+    
+    /// Default longest time a statement waits for delivery, in milliseconds
+    static const int64_t sDefaultIntervalMs{50};
+    
+    /// Batches that may be pending before statements are dropped
+    static const size_t sMaxPendingBatches{64};
+    
+    /**
+     * Starts the delivery thread.
+     *
+     * @param[in] iCallback the client callback receiving the batches
+     * @param[in] iBatchSize number of statements that triggers a delivery
+     * @param[in] iInterval longest time a statement waits for delivery
+     */
+    TraceBatcher(TraceBatchCallback iCallback
+                 , size_t iBatchSize = sDefaultBatchSize
+                 , std::chrono::milliseconds iInterval = std::chrono::milliseconds(sDefaultIntervalMs)
+                 );
+    
+    /**
+     * Delivers the pending statements and stops the delivery thread.
+     */
+    virtual ~TraceBatcher();
+    
+    /**
+     * Copies a statement into the pending batch.
+     *
+     * @param[in] iRecord the statement to be written
+     */
+    void write(const TraceRecord& iRecord) override;
+    
+    /**
+     * Delivers the pending statements on the calling thread.
+     */
+    void flush() override;
+    
+    /**
+     * @return the number of statements dropped because the callback fell behind
+     */
+    uint64_t dropCount() const
+    {
+        return drops_.load(std::memory_order_relaxed);
+    }
+    
+private:
+    
+    /**
+     * Statements with their messages stored back to back, each null terminated.
+     * The message pointers of the records are set right before delivery
+     * as text may move while the batch grows.
+     */
+    struct Batch
+    {
+        std::vector<TraceRecord> records;
+        std::vector<char> text;
+    };
+    
+    void run();
+    
+    void deliver();
+    
+    TraceBatchCallback callback_;
+    size_t batchSize_;
+    std::chrono::milliseconds interval_;
+    
+    /// Guards pending_ and stop_
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    Batch pending_;
+    bool stop_{false};
+    
+    /// Serializes the deliveries, guards delivering_
+    std::mutex deliverMutex_;
+    Batch delivering_;
+    
+    std::atomic<uint64_t> drops_{0};
+    
+    std::thread thread_;
+};
@@ -0,0 +1,316 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceBoostBackend.h"
+
+#ifdef BBC_USE_BOOST
+
+#include "TraceCoalescer.h"
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/make_shared.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/utility/setup/file.hpp>
+#include <boost/log/utility/setup/common_attributes.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/log/attributes/value_extraction.hpp>
+#include <boost/log/utility/manipulators/add_value.hpp>
+
+namespace logging = boost::log;
+namespace sinks = boost::log::sinks;
+namespace keywords = boost::log::keywords;
+
+namespace
+{
+    /*
+     Boost sink backend used for writing to the clients callback.
+     */
+    class CallbackSink : public sinks::basic_formatted_sink_backend<char, sinks::concurrent_feeding>
+    {
+    public:
+        explicit CallbackSink(TraceBackendCallback iCallback)
+        : callback_(iCallback)
+        {
+        }
+        
+        void consume(const logging::record_view& iRecord, const std::string& iMessage)
+        {
+            if (callback_)
+            {
+                callback_(iMessage.c_str());
+            }
+        }
+        
+    private:
+        TraceBackendCallback callback_;
+    };
+    
+    /*
+     Boost sink backend coalescing duplicate trace statements, see TraceCoalescer.
+     Statements that are not coalesced, and the summaries, are written to
+     the wrapped file backend, or to the clients callback when there is no file.
+     */
+    class CoalescingSink : public sinks::basic_formatted_sink_backend<char, sinks::combine_requirements<sinks::synchronized_feeding, sinks::flushing>::type>
+    {
+    public:
+        CoalescingSink(boost::shared_ptr<sinks::text_file_backend> iFile, TraceBackendCallback iCallback, uint64_t iWindow)
+        : file_(iFile)
+        , callback_(iCallback)
+        , coalescer_(iWindow)
+        {
+        }
+        
+        void consume(const logging::record_view& iRecord, const std::string& iMessage)
+        {
+            last_ = iRecord;
+            
+            const void* site = nullptr;
+            if (auto value = logging::extract<const void*>("TraceSite", iRecord))
+                site = *value;
+            
+            uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            
+            if (coalescer_.process(site, iMessage.data(), iMessage.length(), timestamp, [this](const void* iSite, const std::string& iSummary) { write(iSummary); }))
+                write(iMessage);
+        }
+        
+        void flush()
+        {
+            coalescer_.flush([this](const void* iSite, const std::string& iSummary) { write(iSummary); });
+            
+            if (file_)
+                file_->flush();
+        }
+        
+    private:
+        void write(const std::string& iMessage)
+        {
+            if (file_)
+            {
+                file_->consume(last_, iMessage);
+            }
+            else if (callback_)
+            {
+                callback_(iMessage.c_str());
+            }
+        }
+        
+        boost::shared_ptr<sinks::text_file_backend> file_;
+        TraceBackendCallback callback_;
+        TraceCoalescer coalescer_;
+        
+        /// Most recent record, the file backend needs one to write a summary
+        logging::record_view last_;
+    };
+    
+    /*
+     Adds an asynchronous sink. Without consumer tuning the sink starts its own feeding thread,
+     otherwise oFeeder runs the feeding loop after applying the tuning.
+     */
+    template <class Backend>
+    void addAsynchronousSink(const boost::shared_ptr<Backend>& iBackend
+                             , const TraceThreadTuning& iConsumer
+                             , std::thread& oFeeder
+                             , std::function<void()>& oStopFeeder
+                             )
+    {
+        typedef sinks::asynchronous_sink<Backend> sink_t;
+        
+        const bool polls = iConsumer.wakeup == TraceThreadTuning::kWakeup_Batch || iConsumer.wakeup == TraceThreadTuning::kWakeup_Poll;
+        
+        if (iConsumer.wakeup == TraceThreadTuning::kWakeup_Spin)
+            std::cerr << "Trace consumer spinning is not supported by the boost backend, waking for every statement" << std::endl;
+        
+        if (!iConsumer.tunesThread() && !polls)
+        {
+            boost::shared_ptr<sink_t> sink(new sink_t(iBackend));
+            logging::core::get()->add_sink(sink);
+            return;
+        }
+        
+        boost::shared_ptr<sink_t> sink(new sink_t(iBackend, false));
+        
+        std::shared_ptr<std::atomic<bool>> stop = std::make_shared<std::atomic<bool>>(false);
+        std::shared_ptr<std::atomic<bool>> done = std::make_shared<std::atomic<bool>>(false);
+        
+        oFeeder = std::thread([sink, iConsumer, polls, stop, done]()
+        {
+            iConsumer.apply();
+            
+            const std::chrono::microseconds interval(std::max<uint32_t>(iConsumer.intervalUs, 1));
+            
+            while (!stop->load(std::memory_order_acquire))
+            {
+                if (polls)
+                {
+                    sink->feed_records();
+                    std::this_thread::sleep_for(interval);
+                }
+                else
+                {
+                    sink->run();
+                }
+            }
+            
+            done->store(true, std::memory_order_release);
+        });
+        
+        // stop does nothing until the feeding loop has started, keep asking until it is over
+        //
+        oStopFeeder = [sink, stop, done]()
+        {
+            stop->store(true, std::memory_order_release);
+            
+            while (!done->load(std::memory_order_acquire))
+            {
+                sink->stop();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+        
+        logging::core::get()->add_sink(sink);
+    }
+}
+
+bool TraceBoostBackend::open(const TraceBackendConfig& iConfig)
+{
+    close();
+    
+    // Boost.Log filters run on the writing thread, content filters are not supported
+    //
+    if (iConfig.filter)
+        std::cerr << "Trace content filters are not supported by the boost backend, writing every statement" << std::endl;
+    
+    if (iConfig.coalesceWindow)
+    {
+        boost::shared_ptr<sinks::text_file_backend> file;
+        
+        if (iConfig.logFilePath.length())
+        {
+            file = boost::make_shared<sinks::text_file_backend>
+            (
+             keywords::file_name = iConfig.logFilePath,
+             keywords::rotation_size = 10 * 1024 * 1024,
+             keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0),
+             keywords::auto_flush = true
+             );
+        }
+        
+        boost::shared_ptr<CoalescingSink> backend = boost::make_shared<CoalescingSink>(file, iConfig.callback, iConfig.coalesceWindow);
+        
+        // Files keep being written synchronously as with add_file_log
+        //
+        if (file)
+        {
+            typedef sinks::synchronous_sink<CoalescingSink> sink_t;
+            boost::shared_ptr<sink_t> sink(new sink_t(backend));
+            sink->set_formatter(logging::expressions::stream << logging::expressions::smessage);
+            logging::core::get()->add_sink(sink);
+        }
+        else
+        {
+            addAsynchronousSink(backend, iConfig.consumer, feeder_, stopFeeder_);
+        }
+    }
+    else if (iConfig.logFilePath.length())
+    {
+        logging::add_file_log
+        (
+         //keywords::file_name = "sample_%N.log",                                        /*< file name pattern >*/
+         keywords::file_name = iConfig.logFilePath,                                    /*< file name pattern >*/
+         keywords::rotation_size = 10 * 1024 * 1024,                                   /*< rotate files every 10 MiB... >*/
+         keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0), /*< ...or at midnight >*/
+         keywords::auto_flush = true,
+         keywords::format = "%Message%"                                 /*< log record format >*/
+         );
+    }
+    else
+    {
+        addAsynchronousSink(boost::make_shared<CallbackSink>(iConfig.callback), iConfig.consumer, feeder_, stopFeeder_);
+    }
+    
+    logging::core::get()->set_filter
+    (
+     logging::trivial::severity >= logging::trivial::info
+     );
+    
+    logging::add_common_attributes();
+    
+    open_ = true;
+    
+    // For a trace to make sure the file is created
+    // Only needed for the file, the client callback should not receive it
+    //
+    if (iConfig.logFilePath.length())
+    {
+        try
+        {
+            BOOST_LOG_TRIVIAL(error) << std::endl;
+        }
+        catch (...)
+        {
+            std::cerr << "Failed to create boost log file!\n";
+            close();
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void TraceBoostBackend::write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp)
+{
+    // The statements are written without timestamps, iTimestamp has no use
+    //
+    BOOST_LOG_TRIVIAL(error) << logging::add_value("TraceSite", iSite) << iMessage << std::endl;
+}
+
+void TraceBoostBackend::close()
+{
+    if (!open_)
+        return;
+    
+    // Drain the asynchronous sinks before removing them
+    // so pending trace statements are not lost.
+    // Without its feeding thread a sink is drained by the flush.
+    //
+    if (stopFeeder_)
+    {
+        stopFeeder_();
+        feeder_.join();
+        stopFeeder_ = nullptr;
+    }
+    
+    logging::core::get()->flush();
+    logging::core::get()->remove_all_sinks();
+    
+    open_ = false;
+}
+
+#endif // BBC_USE_BOOST
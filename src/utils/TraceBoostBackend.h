@@ -0,0 +1,71 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifdef BBC_USE_BOOST
+
+#include <thread>
+#include <functional>
+
+#include "TraceBackend.h"
+
+///
+/// \brief Backend writing to Boost.Log.
+///
+/// Files are written synchronously with rotation every 10 MiB or at midnight,
+/// the client callback is called from an asynchronous sink.
+///
+/// With TraceBackendConfig::consumer the asynchronous sink is fed by a thread of the
+/// backend, which applies the affinity and scheduling and, with kWakeup_Batch or
+/// kWakeup_Poll, takes the statements every intervalUs instead of waiting for each.
+///
+/// Note - Boost.Log has a single logging core per process,
+///        only one TraceBoostBackend can be open at a time.
+///
+class TraceBoostBackend : public TraceBackend
+{
+public:
+    
+    TraceBoostBackend() {}
+    
+    virtual ~TraceBoostBackend()
+    {
+        close();
+    }
+    
+    bool open(const TraceBackendConfig& iConfig) override;
+    
+    using TraceBackend::write;
+    
+    void write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp) override;
+    
+    void close() override;
+    
+private:
+    
+    bool open_{false};
+    
+    /// Feeding thread of the asynchronous sink when the consumer is tuned
+    std::thread feeder_;
+    std::function<void()> stopFeeder_;
+};
+
+#endif // BBC_USE_BOOST
@@ -0,0 +1,324 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceClock.h"
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+#if defined(TRACE_CLOCK_HAS_TSC) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+const uint32_t TraceClock::sCalibrationMs;
+const uint32_t TraceClock::sUpdateMs;
+
+TraceClock::Published TraceClock::published_;
+
+namespace
+{
+    /// Guards the writes to the published state and the calibration below
+    std::mutex sSelectMutex;
+    
+    /// TSC switched to by the next update once calibrated, kSource_Auto when none
+    TraceClock::Source sPending{TraceClock::kSource_Auto};
+    
+    /// Start of the calibration of the TSC, a TSC reading and the monotonic clock time of it
+    uint64_t sCalibrationTicks{0};
+    uint64_t sCalibrationTime{0};
+    
+    uint64_t wallClock()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    
+    /**
+     * @return the clock the TSC is calibrated against, in nanoseconds
+     */
+    uint64_t monotonicRaw()
+    {
+#ifdef __linux__
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+        return (static_cast<uint64_t>(time.tv_sec) * 1000000000) + static_cast<uint64_t>(time.tv_nsec);
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    
+    bool isTsc(TraceClock::Source iSource)
+    {
+        return iSource == TraceClock::kSource_Tsc || iSource == TraceClock::kSource_Tscp;
+    }
+    
+#ifdef TRACE_CLOCK_HAS_TSC
+    /**
+     * Reads the TSC and the monotonic clock at the same time, the TSC reading
+     * is paired with the middle of two monotonic readings.
+     */
+    void readPair(uint64_t& oTicks, uint64_t& oTime)
+    {
+        uint64_t before = monotonicRaw();
+        oTicks = __rdtsc();
+        oTime = (before + monotonicRaw()) / 2;
+    }
+#endif
+    
+    /**
+     * @return the nanoseconds per tick of the TSC measured since the start of the calibration, 0 if unusable
+     */
+    double measureTsc()
+    {
+#ifdef TRACE_CLOCK_HAS_TSC
+        uint64_t ticks = 0;
+        uint64_t time = 0;
+        readPair(ticks, time);
+        
+        if (ticks <= sCalibrationTicks || time <= sCalibrationTime)
+            return 0.0;
+        
+        return static_cast<double>(time - sCalibrationTime) / static_cast<double>(ticks - sCalibrationTicks);
+#else
+        return 0.0;
+#endif
+    }
+    
+    void startCalibration()
+    {
+#ifdef TRACE_CLOCK_HAS_TSC
+        readPair(sCalibrationTicks, sCalibrationTime);
+#endif
+    }
+    
+    TraceClock::Source monotonicSource()
+    {
+#ifdef __linux__
+        return TraceClock::kSource_MonotonicRaw;
+#else
+        return TraceClock::kSource_Steady;
+#endif
+    }
+}
+
+uint64_t TraceClock::readSource(Source iSource)
+{
+    switch (iSource)
+    {
+#ifdef __linux__
+        case kSource_MonotonicRaw:
+            return monotonicRaw();
+#endif
+            
+        case kSource_System:
+            return wallClock();
+            
+        default:
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+void TraceClock::initialize()
+{
+    std::lock_guard<std::mutex> lock(sSelectMutex);
+    
+    if (published_.source.load(std::memory_order_relaxed) != kSource_Auto)
+        return;
+    
+    // The TSC is measured while the monotonic clock is read
+    //
+    if (invariantTsc())
+    {
+        sPending = kSource_Tsc;
+        startCalibration();
+        publish(monotonicSource(), 1.0, sCalibrationMs * 1000000ull);
+    }
+    else
+    {
+        publish(monotonicSource(), 1.0, sUpdateMs * 1000000ull);
+    }
+}
+
+void TraceClock::update(const State& iState)
+{
+    std::unique_lock<std::mutex> lock(sSelectMutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+    
+    // Already done by another thread
+    //
+    if (published_.nextUpdate.load(std::memory_order_relaxed) != iState.nextUpdate
+        || published_.source.load(std::memory_order_relaxed) != iState.source)
+        return;
+    
+    Source source = iState.source;
+    double nanosecondsPerTick = iState.nanosecondsPerTick;
+    
+    if (sPending != kSource_Auto)
+    {
+        source = sPending;
+        sPending = kSource_Auto;
+    }
+    
+    // The longer the TSC is measured the more precise its rate
+    //
+    if (isTsc(source))
+    {
+        double measured = measureTsc();
+        
+        if (measured > 0.0)
+            nanosecondsPerTick = measured;
+        else
+            source = iState.source;
+    }
+    
+    publish(source, isTsc(source) ? nanosecondsPerTick : 1.0, sUpdateMs * 1000000ull);
+}
+
+void TraceClock::publish(Source iSource, double iNanosecondsPerTick, uint64_t iUpdateNs)
+{
+    // Only written under the mutex, the fields can be read directly
+    //
+    State current;
+    current.source = static_cast<Source>(published_.source.load(std::memory_order_relaxed));
+    current.nanosecondsPerTick = published_.nanosecondsPerTick.load(std::memory_order_relaxed);
+    current.anchorTicks = published_.anchorTicks.load(std::memory_order_relaxed);
+    current.anchorMonotonic = published_.anchorMonotonic.load(std::memory_order_relaxed);
+    
+    const uint64_t ticks = read(iSource);
+    
+    // monotonic carries on from the current source
+    //
+    uint64_t monotonicTime = monotonicRaw();
+    if (current.source != kSource_Auto)
+        monotonicTime = current.anchorMonotonic + static_cast<uint64_t>(sinceAnchor(current, read(current.source)));
+    
+    const uint64_t wallTime = iSource == kSource_System ? ticks : wallClock();
+    const uint64_t updateTicks = static_cast<uint64_t>(static_cast<double>(iUpdateNs) / iNanosecondsPerTick);
+    
+    const uint32_t sequence = published_.sequence.load(std::memory_order_relaxed);
+    published_.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    published_.source.store(iSource, std::memory_order_relaxed);
+    published_.nanosecondsPerTick.store(iNanosecondsPerTick, std::memory_order_relaxed);
+    published_.anchorTicks.store(ticks, std::memory_order_relaxed);
+    published_.anchorMonotonic.store(monotonicTime, std::memory_order_relaxed);
+    published_.anchorWall.store(wallTime, std::memory_order_relaxed);
+    published_.nextUpdate.store(ticks + updateTicks, std::memory_order_relaxed);
+    
+    published_.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool TraceClock::select(Source iSource)
+{
+    if (iSource == kSource_Auto)
+        iSource = invariantTsc() ? kSource_Tsc : monotonicSource();
+    
+#ifndef TRACE_CLOCK_HAS_TSC
+    if (isTsc(iSource))
+        return false;
+#endif
+    
+#ifndef __linux__
+    if (iSource == kSource_MonotonicRaw)
+        return false;
+#endif
+    
+    std::lock_guard<std::mutex> lock(sSelectMutex);
+    
+    double nanosecondsPerTick = 1.0;
+    
+    if (isTsc(iSource))
+    {
+        startCalibration();
+        std::this_thread::sleep_for(std::chrono::milliseconds(sCalibrationMs));
+        
+        nanosecondsPerTick = measureTsc();
+        if (nanosecondsPerTick <= 0.0)
+            return false;
+    }
+    
+    sPending = kSource_Auto;
+    publish(iSource, nanosecondsPerTick, sUpdateMs * 1000000ull);
+    
+    return true;
+}
+
+bool TraceClock::invariantTsc()
+{
+#ifdef TRACE_CLOCK_HAS_TSC
+    // CPUID.80000007H:EDX[8]
+    //
+#ifdef _MSC_VER
+    int registers[4] = {};
+    __cpuid(registers, 0x80000000);
+    if (static_cast<unsigned int>(registers[0]) < 0x80000007)
+        return false;
+    
+    __cpuid(registers, 0x80000007);
+    return (registers[3] & (1 << 8)) != 0;
+#else
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return false;
+    
+    return (edx & (1u << 8)) != 0;
+#endif
+#else
+    return false;
+#endif
+}
+
+const char* TraceClock::sourceName(Source iSource)
+{
+    switch (iSource)
+    {
+        case kSource_Auto:         return "auto";
+        case kSource_Tsc:          return "tsc";
+        case kSource_Tscp:         return "tscp";
+        case kSource_MonotonicRaw: return "monotonic_raw";
+        case kSource_Steady:       return "steady";
+        case kSource_System:       return "system";
+    }
+    
+    return "unknown";
+}
+
+bool TraceClock::parseSource(const std::string& iName, Source& oSource)
+{
+    for (Source source : {kSource_Auto, kSource_Tsc, kSource_Tscp, kSource_MonotonicRaw, kSource_Steady, kSource_System})
+    {
+        if (iName == sourceName(source))
+        {
+            oSource = source;
+            return true;
+        }
+    }
+    
+    return false;
+}
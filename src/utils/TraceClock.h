@@ -0,0 +1,285 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TRACE_CLOCK_HAS_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+///
+/// \brief Cheap clock for trace timestamps and PerfLogger.
+///
+/// std::chrono::system_clock, which high_resolution_clock is on libstdc++, jumps with NTP
+/// and costs a vDSO call per reading. TraceClock reads one of these sources instead:
+///
+///       kSource_Tsc             rdtsc, a few cycles, needs an invariant TSC
+///       kSource_Tscp            rdtscp, waits for the previous instructions to complete
+///       kSource_MonotonicRaw    clock_gettime(CLOCK_MONOTONIC_RAW), Linux only, never slewed by NTP
+///       kSource_Steady          std::chrono::steady_clock
+///       kSource_System          std::chrono::system_clock, the wall clock as before
+///
+/// The source is selected on first use, kSource_Tsc when the processor reports an invariant TSC,
+/// otherwise kSource_MonotonicRaw on Linux and kSource_Steady elsewhere. The first reading never
+/// waits for the TSC: the monotonic clock is read until the TSC has been measured against it for
+/// sCalibrationMs, then the reading crossing that point switches to the TSC. select calibrates
+/// the TSC right away instead, sleeping sCalibrationMs.
+///
+/// Every sUpdateMs the reading crossing that point re-anchors the clock: it takes the wall clock
+/// time again, and refines the rate of the TSC against the monotonic clock over the time since
+/// calibration. now follows the wall clock that way, within the drift of one period, but may step
+/// by that drift, or by a change of the wall clock, when re-anchored. monotonic is only carried
+/// over from one anchor to the next, it never steps and is the one to measure durations with,
+/// also across a change of source.
+///
+/// The source and its anchors are published with a sequence lock, readers never wait
+/// for the thread re-anchoring the clock, which only tries to take a mutex.
+///
+class TraceClock
+{
+public:
+    
+    enum Source
+    {
+          kSource_Auto
+        , kSource_Tsc
+        , kSource_Tscp
+        , kSource_MonotonicRaw
+        , kSource_Steady
+        , kSource_System
+    };
+    
+    /// Time the TSC is measured against the monotonic clock before it is used
+    static const uint32_t sCalibrationMs{10};
+    
+    /// Time between two anchorings to the wall clock
+    static const uint32_t sUpdateMs{1000};
+    
+    /**
+     * @return the current time, nanoseconds since the epoch (UTC)
+     */
+    static uint64_t now()
+    {
+        const State state = load();
+        const int64_t elapsed = sinceAnchor(state, read(state));
+        
+        return state.anchorWall + static_cast<uint64_t>(elapsed);
+    }
+    
+    /**
+     * @return the current time on a timeline that never steps, in nanoseconds.
+     *         Only differences of readings are meaningful.
+     */
+    static uint64_t monotonic()
+    {
+        const State state = load();
+        const int64_t elapsed = sinceAnchor(state, read(state));
+        
+        return state.anchorMonotonic + static_cast<uint64_t>(elapsed);
+    }
+    
+    /**
+     * @param[in] iMonotonic a reading returned by monotonic
+     *
+     * @return the time of the reading, nanoseconds since the epoch (UTC), as of the current anchor
+     */
+    static uint64_t toTime(uint64_t iMonotonic)
+    {
+        const State state = load();
+        return iMonotonic + (state.anchorWall - state.anchorMonotonic);
+    }
+    
+    /**
+     * Selects, and calibrates, the source.
+     * monotonic carries on from the previous source, now is anchored to the wall clock again.
+     *
+     * @param[in] iSource the source, kSource_Auto for the default described above
+     *
+     * @return false if the source is not available, the selection is unchanged
+     */
+    static bool select(Source iSource);
+    
+    /**
+     * @return the source read, with kSource_Auto it is kSource_Tsc only once calibrated
+     */
+    static Source source()
+    {
+        return load().source;
+    }
+    
+    /**
+     * @return nanoseconds per tick of the source read, 1 except for the TSC
+     */
+    static double nanosecondsPerTick()
+    {
+        return load().nanosecondsPerTick;
+    }
+    
+    /**
+     * @return true when the processor has a TSC ticking at a constant rate in every power state
+     */
+    static bool invariantTsc();
+    
+    /**
+     * @return the name of iSource, auto, tsc, tscp, monotonic_raw, steady or system
+     */
+    static const char* sourceName(Source iSource);
+    
+    /**
+     * @param[in] iName one of the names of sourceName
+     * @param[out] oSource receives the source
+     *
+     * @return true if iName is known
+     */
+    static bool parseSource(const std::string& iName, Source& oSource);
+    
+private:
+    
+    /// A consistent copy of the published source and anchors
+    struct State
+    {
+        Source source;
+        double nanosecondsPerTick;
+        
+        /// Reading of the source, and the times it stands for, when anchored
+        uint64_t anchorTicks;
+        uint64_t anchorMonotonic;
+        uint64_t anchorWall;
+        
+        /// Reading of the source from which the clock is anchored again
+        uint64_t nextUpdate;
+    };
+    
+    /// The published State, written under the sequence lock
+    struct Published
+    {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<int> source{kSource_Auto};
+        std::atomic<double> nanosecondsPerTick{1.0};
+        std::atomic<uint64_t> anchorTicks{0};
+        std::atomic<uint64_t> anchorMonotonic{0};
+        std::atomic<uint64_t> anchorWall{0};
+        std::atomic<uint64_t> nextUpdate{0};
+    };
+    
+    /**
+     * @return the published State, selecting kSource_Auto on first use
+     */
+    static State load()
+    {
+        for (;;)
+        {
+            const uint32_t sequence = published_.sequence.load(std::memory_order_acquire);
+            
+            State state;
+            state.source = static_cast<Source>(published_.source.load(std::memory_order_relaxed));
+            state.nanosecondsPerTick = published_.nanosecondsPerTick.load(std::memory_order_relaxed);
+            state.anchorTicks = published_.anchorTicks.load(std::memory_order_relaxed);
+            state.anchorMonotonic = published_.anchorMonotonic.load(std::memory_order_relaxed);
+            state.anchorWall = published_.anchorWall.load(std::memory_order_relaxed);
+            state.nextUpdate = published_.nextUpdate.load(std::memory_order_relaxed);
+            
+            std::atomic_thread_fence(std::memory_order_acquire);
+            
+            if ((sequence & 1) || published_.sequence.load(std::memory_order_relaxed) != sequence)
+                continue;
+            
+            if (state.source == kSource_Auto)
+            {
+                initialize();
+                continue;
+            }
+            
+            return state;
+        }
+    }
+    
+    static uint64_t read(Source iSource)
+    {
+#ifdef TRACE_CLOCK_HAS_TSC
+        if (iSource == kSource_Tsc)
+            return __rdtsc();
+        
+        if (iSource == kSource_Tscp)
+        {
+            unsigned int processor;
+            return __rdtscp(&processor);
+        }
+#endif
+        return readSource(iSource);
+    }
+    
+    /**
+     * Reads the source of iState, anchoring the clock again when it is time to.
+     */
+    static uint64_t read(const State& iState)
+    {
+        const uint64_t ticks = read(iState.source);
+        
+        if (static_cast<int64_t>(ticks - iState.nextUpdate) >= 0)
+            update(iState);
+        
+        return ticks;
+    }
+    
+    /**
+     * @return the nanoseconds from the anchor of iState to iTicks, negative for a reading from before it
+     */
+    static int64_t sinceAnchor(const State& iState, uint64_t iTicks)
+    {
+        const int64_t ticks = static_cast<int64_t>(iTicks - iState.anchorTicks);
+        return iState.nanosecondsPerTick == 1.0 ? ticks : static_cast<int64_t>(static_cast<double>(ticks) * iState.nanosecondsPerTick);
+    }
+    
+    /**
+     * Reads the sources other than the TSC.
+     */
+    static uint64_t readSource(Source iSource);
+    
+    /**
+     * Selects kSource_Auto on first use, without waiting for the calibration of the TSC.
+     */
+    static void initialize();
+    
+    /**
+     * Anchors the clock again, and switches to the TSC once calibrated,
+     * unless another thread is already at it.
+     *
+     * @param[in] iState the state the reading was taken with
+     */
+    static void update(const State& iState);
+    
+    /**
+     * Publishes iSource with its rate, carrying monotonic over from the current state.
+     * Called with the select mutex held.
+     */
+    static void publish(Source iSource, double iNanosecondsPerTick, uint64_t iUpdateNs);
+    
+    static Published published_;
+};
@@ -0,0 +1,225 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+
+///
+/// \brief Collapses bursts of identical trace statements.
+///
+/// Used by the external logger backends on their writing thread.
+/// A statement is identified by its call site plus a hash of its formatted payload.
+/// The first occurrence within the window is written, further occurrences are counted
+/// and replaced by a single summary once the window has ended:
+///
+///       Connection lost
+///       last message repeated 4711 times: Connection lost
+///
+/// Summaries are produced when the same statement is written again after the window,
+/// when the table is swept, which happens at most once per window,
+/// or when the coalescer is flushed.
+///
+/// Note - Not thread safe, the backends serialize the calls.
+///
+class TraceCoalescer
+{
+public:
+    
+    /// Default maximum number of distinct statements tracked at once
+    static const size_t sDefaultMaxEntries{1024};
+    
+    /**
+     * @param[in] iWindow length of the window in nanoseconds, 0 disables coalescing
+     * @param[in] iMaxEntries maximum number of distinct statements tracked at once
+     */
+    explicit TraceCoalescer(uint64_t iWindow, size_t iMaxEntries = sDefaultMaxEntries)
+    : window_(iWindow)
+    , maxEntries_(iMaxEntries ? iMaxEntries : 1)
+    {
+    }
+    
+    /**
+     * Processes a statement.
+     *
+     * @param[in] iSite call site of the statement, see TraceRecord::site
+     * @param[in] iMessage formatted statement
+     * @param[in] iLength length of iMessage
+     * @param[in] iTimestamp time of the statement in nanoseconds
+     * @param[in] iEmit called as iEmit(site, summary) for every summary that is due,
+     *            before the statement itself is written
+     *
+     * @return true if the statement should be written, false if it was coalesced
+     */
+    template<typename Emit>
+    bool process(const void* iSite, const char* iMessage, size_t iLength, uint64_t iTimestamp, Emit iEmit)
+    {
+        if (window_ == 0)
+            return true;
+        
+        if (ended(lastSweep_, iTimestamp))
+            sweep(iTimestamp, iEmit);
+        
+        uint64_t key = hash(iSite, iMessage, iLength);
+        auto it = entries_.find(key);
+        
+        if (it != entries_.end())
+        {
+            Entry& entry = it->second;
+            bool same = entry.site == iSite && entry.message.compare(0, std::string::npos, iMessage, iLength) == 0;
+            
+            if (same && !ended(entry.start, iTimestamp))
+            {
+                entry.repeated++;
+                return false;
+            }
+            
+            // Window ended or hash collision, start over with this statement
+            //
+            summarize(entry, iEmit);
+            entry.site = iSite;
+            entry.message.assign(iMessage, iLength);
+            entry.start = iTimestamp;
+            entry.repeated = 0;
+            return true;
+        }
+        
+        if (entries_.size() >= maxEntries_)
+        {
+            sweep(iTimestamp, iEmit);
+            
+            if (entries_.size() >= maxEntries_)
+                flush(iEmit);
+        }
+        
+        Entry& entry = entries_[key];
+        entry.site = iSite;
+        entry.message.assign(iMessage, iLength);
+        entry.start = iTimestamp;
+        
+        return true;
+    }
+    
+    /**
+     * Emits the summaries of every pending statement and forgets them.
+     *
+     * @param[in] iEmit called as iEmit(site, summary)
+     */
+    template<typename Emit>
+    void flush(Emit iEmit)
+    {
+        for (auto& it : entries_)
+            summarize(it.second, iEmit);
+        
+        entries_.clear();
+    }
+    
+    /**
+     * @return the number of statements currently tracked
+     */
+    size_t size() const
+    {
+        return entries_.size();
+    }
+    
+private:
+    
+    struct Entry
+    {
+        const void* site{nullptr};
+        std::string message;
+        uint64_t start{0};
+        uint64_t repeated{0};
+    };
+    
+    /**
+     * @return true if the window started at iStart ended by iTimestamp.
+     *         Timestamps arrive slightly out of order, an earlier one is within the window.
+     */
+    bool ended(uint64_t iStart, uint64_t iTimestamp) const
+    {
+        return iTimestamp > iStart && iTimestamp - iStart >= window_;
+    }
+    
+    /**
+     * Emits summaries for, and forgets, the statements whose window ended.
+     */
+    template<typename Emit>
+    void sweep(uint64_t iTimestamp, Emit& iEmit)
+    {
+        lastSweep_ = iTimestamp;
+        
+        for (auto it = entries_.begin(); it != entries_.end(); )
+        {
+            if (ended(it->second.start, iTimestamp))
+            {
+                summarize(it->second, iEmit);
+                it = entries_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    
+    template<typename Emit>
+    static void summarize(Entry& iEntry, Emit& iEmit)
+    {
+        if (iEntry.repeated == 0)
+            return;
+        
+        std::string summary = "last message repeated " + std::to_string(iEntry.repeated) + " times: " + iEntry.message;
+        iEntry.repeated = 0;
+        
+        iEmit(iEntry.site, summary);
+    }
+    
+    /**
+     * FNV-1a of the payload seeded with the call site.
+     */
+    static uint64_t hash(const void* iSite, const char* iMessage, size_t iLength)
+    {
+        uint64_t result = 0xcbf29ce484222325ull ^ reinterpret_cast<uintptr_t>(iSite);
+        
+        for (size_t i = 0; i < iLength; i++)
+        {
+            result ^= static_cast<unsigned char>(iMessage[i]);
+            result *= 0x100000001b3ull;
+        }
+        
+        return result;
+    }
+    
+    /// Length of the window in nanoseconds
+    uint64_t window_;
+    
+    /// Maximum number of entries_
+    size_t maxEntries_;
+    
+    /// Time of the last sweep
+    uint64_t lastSweep_{0};
+    
+    /// Statements seen within their window, by hash
+    std::unordered_map<uint64_t, Entry> entries_;
+};
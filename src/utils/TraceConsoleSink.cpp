@@ -0,0 +1,108 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceConsoleSink.h"
+
+const int64_t TraceConsoleSink::sDefaultFlushIntervalMs;
+const size_t TraceConsoleSink::sDefaultBufferSize;
+
+TraceConsoleSink::TraceConsoleSink(FILE* iStream
+                                   , std::chrono::milliseconds iFlushInterval
+                                   , size_t iBufferSize
+                                   )
+: stream_(iStream ? iStream : stdout)
+, flushInterval_(iFlushInterval.count() > 0 ? iFlushInterval : std::chrono::milliseconds(0))
+, bufferSize_(iBufferSize ? iBufferSize : 1)
+{
+    buffer_.reserve(bufferSize_);
+    writing_.reserve(bufferSize_);
+    
+    if (flushInterval_.count())
+        thread_ = std::thread(&TraceConsoleSink::run, this);
+}
+
+TraceConsoleSink::~TraceConsoleSink()
+{
+    if (thread_.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        
+        wake_.notify_one();
+        thread_.join();
+    }
+    
+    flush();
+}
+
+void TraceConsoleSink::write(const TraceRecord& iRecord)
+{
+    bool full = false;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        buffer_.append(iRecord.message, iRecord.length);
+        buffer_.push_back('\n');
+        
+        full = !flushInterval_.count() || buffer_.size() >= bufferSize_;
+    }
+    
+    // Write outside of the buffer lock so other threads keep appending
+    //
+    if (full)
+        flush();
+}
+
+void TraceConsoleSink::flush()
+{
+    std::lock_guard<std::mutex> writeLock(writeMutex_);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer_.swap(writing_);
+    }
+    
+    if (writing_.empty())
+        return;
+    
+    fwrite(writing_.data(), 1, writing_.size(), stream_);
+    fflush(stream_);
+    
+    writing_.clear();
+}
+
+void TraceConsoleSink::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (!stop_)
+    {
+        wake_.wait_for(lock, flushInterval_);
+        
+        if (stop_ || buffer_.empty())
+            continue;
+        
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <stdio.h>
+#include <condition_variable>
+
+#include "TraceSink.h"
+
+///
+/// \brief TraceSink writing trace statements to the console, one per line.
+///
+/// Statements are appended to a buffer by the writing thread, each with its
+/// terminating newline, and the buffer is written with a single fwrite.
+/// Lines of different threads never interleave and the console is only
+/// flushed once per write instead of once per statement.
+///
+/// The buffer is written when it reaches bufferSize bytes, or every flushInterval
+/// by a thread owned by the sink. A flushInterval of 0 writes every statement
+/// right away, still without std::endl.
+///
+class TraceConsoleSink : public TraceSink
+{
+public:
+    
+    /// Default longest time a statement waits in the buffer, in milliseconds
+    static const int64_t sDefaultFlushIntervalMs{100};
+    
+    /// Default size of the buffer that triggers a write
+    static const size_t sDefaultBufferSize{64 * 1024};
+    
+    /**
+     * Starts the flush thread.
+     *
+     * @param[in] iStream the stream the statements are written to, stdout for the console
+     * @param[in] iFlushInterval longest time a statement waits in the buffer, 0 for no buffering
+     * @param[in] iBufferSize size of the buffer that triggers a write
+     */
+    explicit TraceConsoleSink(FILE* iStream = stdout
+                              , std::chrono::milliseconds iFlushInterval = std::chrono::milliseconds(sDefaultFlushIntervalMs)
+                              , size_t iBufferSize = sDefaultBufferSize
+                              );
+    
+    /**
+     * Writes the buffered statements and stops the flush thread.
+     */
+    virtual ~TraceConsoleSink();
+    
+    /**
+     * Appends a statement and its newline to the buffer.
+     *
+     * @param[in] iRecord the statement to be written
+     */
+    void write(const TraceRecord& iRecord) override;
+    
+    /**
+     * Writes the buffered statements on the calling thread.
+     */
+    void flush() override;
+    
+private:
+    
+    void run();
+    
+    FILE* stream_;
+    std::chrono::milliseconds flushInterval_;
+    size_t bufferSize_;
+    
+    /// Guards buffer_ and stop_
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::string buffer_;
+    bool stop_{false};
+    
+    /// Serializes the writes to stream_ so buffers go out in order, guards writing_
+    std::mutex writeMutex_;
+    std::string writing_;
+    
+    std::thread thread_;
+};
@@ -0,0 +1,116 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceContentFilter.h"
+
+#include <set>
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+
+thread_local const char* TraceThreadName::current_{nullptr};
+
+namespace
+{
+    const uint64_t sCategoryBits{0x0FFFFFFFFFFFFFFFull};
+    
+    const std::string sContainsPrefix("contains:");
+    const std::string sRegexPrefix("regex:");
+}
+
+bool TraceContentFilter::addContent(uint64_t iCategory, const std::string& iSpec)
+{
+    if (iSpec.compare(0, sRegexPrefix.length(), sRegexPrefix) == 0)
+        return add(iCategory, kKind_Regex, iSpec.substr(sRegexPrefix.length()));
+    
+    if (iSpec.compare(0, sContainsPrefix.length(), sContainsPrefix) == 0)
+        return add(iCategory, kKind_Contains, iSpec.substr(sContainsPrefix.length()));
+    
+    return add(iCategory, kKind_Contains, iSpec);
+}
+
+bool TraceContentFilter::addThread(uint64_t iCategory, const std::string& iPattern)
+{
+    return add(iCategory, kKind_Thread, iPattern);
+}
+
+bool TraceContentFilter::add(uint64_t iCategory, Kind iKind, const std::string& iText)
+{
+    Rule rule;
+    rule.category = iCategory & sCategoryBits;
+    rule.kind = iKind;
+    rule.text = iText;
+    
+    if (iKind != kKind_Contains)
+    {
+        try
+        {
+            rule.regex = std::regex(iText, std::regex::ECMAScript | std::regex::optimize);
+        }
+        catch (const std::regex_error&)
+        {
+            return false;
+        }
+    }
+    
+    usesThreadNames_ = usesThreadNames_ || iKind == kKind_Thread;
+    rules_.push_back(std::move(rule));
+    
+    return true;
+}
+
+bool TraceContentFilter::pass(uint64_t iMask, const char* iThreadName, const char* iMessage, size_t iLength) const
+{
+    const uint64_t category = iMask & sCategoryBits;
+    
+    for (const Rule& rule : rules_)
+    {
+        if (rule.category != sCategoryBits && rule.category != category)
+            continue;
+        
+        switch (rule.kind)
+        {
+            case kKind_Contains:
+                if (std::search(iMessage, iMessage + iLength, rule.text.begin(), rule.text.end()) == iMessage + iLength)
+                    return false;
+                break;
+                
+            case kKind_Regex:
+                if (!std::regex_search(iMessage, iMessage + iLength, rule.regex))
+                    return false;
+                break;
+                
+            case kKind_Thread:
+                if (!std::regex_match(iThreadName ? iThreadName : "", rule.regex))
+                    return false;
+                break;
+        }
+    }
+    
+    return true;
+}
+
+void TraceThreadName::set(const std::string& iName)
+{
+    static std::mutex sMutex;
+    static std::set<std::string> sNames;
+    
+    std::lock_guard<std::mutex> lock(sMutex);
+    current_ = sNames.insert(iName).first->c_str();
+}
@@ -0,0 +1,145 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <regex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+///
+/// \brief Drops trace statements by their content, on the thread writing the backend output.
+///
+/// Rules are set per category, or for every category, from the configuration:
+///
+///       filter.kCategory_Network=contains:10.0.0.7      statements containing the text
+///       filter.kCategory_Network=regex:peer [0-9]+      statements matching the regular expression
+///       filterThread.kCategory_Network=net.*            statements of threads whose name matches,
+///                                                       see TraceThreadName
+///
+/// kCategory_Always applies a rule to every category. A statement is written
+/// when it matches every rule that applies to its category.
+///
+/// The rules are compiled once, when the configuration is loaded, and are only
+/// evaluated by the backend writer thread, after the statement was formatted.
+///
+class TraceContentFilter
+{
+public:
+    
+    /**
+     * Adds a content rule.
+     *
+     * @param[in] iCategory category the rule applies to, kCategory_Always for all of them
+     * @param[in] iSpec "contains:text", "regex:expression", or text to be contained
+     *
+     * @return false if the regular expression is invalid
+     */
+    bool addContent(uint64_t iCategory, const std::string& iSpec);
+    
+    /**
+     * Adds a thread name rule.
+     *
+     * @param[in] iCategory category the rule applies to, kCategory_Always for all of them
+     * @param[in] iPattern regular expression the whole thread name must match
+     *
+     * @return false if the regular expression is invalid
+     */
+    bool addThread(uint64_t iCategory, const std::string& iPattern);
+    
+    /**
+     * @param[in] iMask TraceMask of the statement
+     * @param[in] iThreadName name of the thread that wrote it, nullptr when unnamed
+     * @param[in] iMessage the formatted statement
+     * @param[in] iLength length of the statement
+     *
+     * @return true if the statement is to be written
+     */
+    bool pass(uint64_t iMask, const char* iThreadName, const char* iMessage, size_t iLength) const;
+    
+    /**
+     * @return true if there are no rules
+     */
+    bool empty() const
+    {
+        return rules_.empty();
+    }
+    
+    /**
+     * @return true if a rule needs the name of the writing thread
+     */
+    bool usesThreadNames() const
+    {
+        return usesThreadNames_;
+    }
+    
+private:
+    
+    enum Kind
+    {
+          kKind_Contains
+        , kKind_Regex
+        , kKind_Thread
+    };
+    
+    struct Rule
+    {
+        uint64_t category;
+        Kind kind;
+        std::string text;
+        std::regex regex;
+    };
+    
+    bool add(uint64_t iCategory, Kind iKind, const std::string& iText);
+    
+    std::vector<Rule> rules_;
+    bool usesThreadNames_{false};
+};
+
+///
+/// \brief Names the calling thread for the filterThread rules of TraceContentFilter.
+///
+/// Names are kept for the life of the process so the backend writer thread can
+/// still read them after the named thread exited.
+///
+class TraceThreadName
+{
+public:
+    
+    /**
+     * Names the calling thread.
+     *
+     * @param[in] iName name of the thread
+     */
+    static void set(const std::string& iName);
+    
+    /**
+     * @return the name of the calling thread, nullptr when it was not named
+     */
+    static const char* get()
+    {
+        return current_;
+    }
+    
+private:
+    
+    static thread_local const char* current_;
+};
@@ -0,0 +1,242 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceFileWriter.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+const size_t TraceFileWriter::sBlockSize;
+const size_t TraceFileWriter::sBufferSize;
+
+namespace
+{
+    uint64_t roundUp(uint64_t iValue, uint64_t iMultiple)
+    {
+        return ((iValue + iMultiple - 1) / iMultiple) * iMultiple;
+    }
+}
+
+bool TraceFileWriter::open(const std::string& iPath, uint64_t iExtent, bool iDirect)
+{
+    close();
+    
+    int flags = O_RDWR | O_CREAT;
+    
+#ifdef O_DIRECT
+    if (iDirect)
+    {
+        fd_ = ::open(iPath.c_str(), flags | O_DIRECT, 0644);
+        direct_ = fd_ >= 0;
+    }
+#endif
+    
+    // Not every file system supports O_DIRECT
+    //
+    if (fd_ < 0)
+        fd_ = ::open(iPath.c_str(), flags, 0644);
+    
+    if (fd_ < 0)
+        return false;
+    
+    struct stat info;
+    if (fstat(fd_, &info) != 0 || posix_memalign(reinterpret_cast<void**>(&buffer_), sBlockSize, sBufferSize) != 0)
+    {
+        buffer_ = nullptr;
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    
+    extent_ = roundUp(iExtent, sBlockSize);
+    allocated_ = dataEnd(static_cast<uint64_t>(info.st_size));
+    
+    // A file that was not closed, after a crash for instance, can end with the
+    // zero padding of flush. Statements never contain zeros, drop it.
+    //
+    if (allocated_ < static_cast<uint64_t>(info.st_size) && ftruncate(fd_, static_cast<off_t>(allocated_)) != 0)
+    {
+        close();
+        return false;
+    }
+    
+    // Continue from the last partial block of the file
+    //
+    offset_ = allocated_ - (allocated_ % sBlockSize);
+    used_ = static_cast<size_t>(allocated_ - offset_);
+    
+    if (used_ && pread(fd_, buffer_, sBlockSize, static_cast<off_t>(offset_)) != static_cast<ssize_t>(used_))
+    {
+        close();
+        return false;
+    }
+    
+    return true;
+}
+
+void TraceFileWriter::write(const char* iData, size_t iLength)
+{
+    if (fd_ < 0)
+        return;
+    
+    while (iLength)
+    {
+        size_t count = std::min(iLength, sBufferSize - used_);
+        memcpy(buffer_ + used_, iData, count);
+        
+        used_ += count;
+        iData += count;
+        iLength -= count;
+        
+        if (used_ == sBufferSize)
+        {
+            writeBlocks(sBufferSize);
+            offset_ += sBufferSize;
+            used_ = 0;
+        }
+    }
+}
+
+void TraceFileWriter::flush()
+{
+    if (fd_ < 0 || !used_)
+        return;
+    
+    // O_DIRECT only writes whole blocks, the padding is written over by what follows
+    //
+    size_t length = used_;
+    if (direct_)
+    {
+        length = static_cast<size_t>(roundUp(used_, sBlockSize));
+        memset(buffer_ + used_, 0, length - used_);
+    }
+    
+    writeBlocks(length);
+    
+    // Only keep the partial block, it is written again with what follows
+    //
+    size_t complete = used_ - (used_ % sBlockSize);
+    if (complete)
+    {
+        memmove(buffer_, buffer_ + complete, used_ - complete);
+        offset_ += complete;
+        used_ -= complete;
+    }
+}
+
+void TraceFileWriter::close()
+{
+    if (fd_ >= 0)
+    {
+        flush();
+        
+        if (ftruncate(fd_, static_cast<off_t>(size())) != 0)
+        {
+            // The file keeps its zero padding
+        }
+        
+        ::close(fd_);
+    }
+    
+    free(buffer_);
+    
+    fd_ = -1;
+    direct_ = false;
+    buffer_ = nullptr;
+    used_ = 0;
+    offset_ = 0;
+    allocated_ = 0;
+}
+
+void TraceFileWriter::writeBlocks(size_t iLength)
+{
+    reserve(offset_ + iLength);
+    
+    size_t written = 0;
+    while (written < iLength)
+    {
+        ssize_t result = pwrite(fd_, buffer_ + written, iLength - written, static_cast<off_t>(offset_ + written));
+        if (result <= 0)
+            return;
+        
+        written += static_cast<size_t>(result);
+    }
+}
+
+void TraceFileWriter::reserve(uint64_t iEnd)
+{
+    if (iEnd <= allocated_)
+        return;
+    
+    if (!extent_)
+    {
+        allocated_ = iEnd;
+        return;
+    }
+    
+    uint64_t end = roundUp(iEnd, extent_);
+    
+    // The size of the file stays the end of what was written, readers and the
+    // next open never see the reserved space. Without fallocate nothing is reserved.
+    //
+#ifdef __linux__
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(allocated_), static_cast<off_t>(end - allocated_)) == 0)
+    {
+        allocated_ = end;
+        return;
+    }
+#endif
+    
+    allocated_ = iEnd;
+}
+
+uint64_t TraceFileWriter::dataEnd(uint64_t iSize)
+{
+    // Walk back a block at a time, reads are aligned for O_DIRECT
+    //
+    uint64_t end = iSize;
+    
+    while (end)
+    {
+        const uint64_t block = (end - 1) - ((end - 1) % sBlockSize);
+        
+        ssize_t count = pread(fd_, buffer_, sBlockSize, static_cast<off_t>(block));
+        if (count <= 0)
+            break;
+        
+        size_t length = static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(count), end - block));
+        while (length && !buffer_[length - 1])
+            length--;
+        
+        end = block + length;
+        
+        if (length)
+            break;
+    }
+    
+    return end;
+}
+
+#endif // _WIN32
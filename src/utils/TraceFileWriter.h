@@ -0,0 +1,146 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <string>
+#include <stdint.h>
+
+///
+/// \brief Log file writer that preallocates the file and writes whole blocks.
+///
+/// Appending with stdio extends the file on nearly every write, and each extension
+/// allocates blocks, a metadata update that can stall behind other disk I/O.
+/// TraceFileWriter instead reserves the file in extents with fallocate, keeping the
+/// size of the file at the end of what was written, and writes block aligned buffers
+/// with pwrite, optionally with O_DIRECT to bypass the page cache.
+///
+/// Statements are collected in an aligned buffer written out once it is full.
+/// With O_DIRECT flush writes the partial block at the end padded with zeros, the
+/// padding is overwritten by the next write. close trims the file back to what was
+/// written, and open drops the padding left by a writer that was never closed.
+///
+/// Note - Not thread safe.
+///
+class TraceFileWriter
+{
+public:
+    
+    /// Alignment of the writes, the buffer and the file offsets
+    static const size_t sBlockSize{4096};
+    
+    /// Size of the buffer, written once full
+    static const size_t sBufferSize{256 * 1024};
+    
+    TraceFileWriter() {}
+    
+    ~TraceFileWriter()
+    {
+        close();
+    }
+    
+    TraceFileWriter(const TraceFileWriter&) = delete;
+    TraceFileWriter& operator=(const TraceFileWriter&) = delete;
+    
+    /**
+     * Opens the file for appending.
+     *
+     * @param[in] iPath path of the file, created if needed
+     * @param[in] iExtent bytes reserved at a time, rounded up to sBlockSize. 0 does not preallocate.
+     * @param[in] iDirect true to bypass the page cache with O_DIRECT when the file system supports it
+     *
+     * @return true if the file is open
+     */
+    bool open(const std::string& iPath, uint64_t iExtent, bool iDirect);
+    
+    /**
+     * Appends to the file.
+     *
+     * @param[in] iData bytes to be written
+     * @param[in] iLength number of bytes
+     */
+    void write(const char* iData, size_t iLength);
+    
+    /**
+     * Writes everything appended so far.
+     */
+    void flush();
+    
+    /**
+     * Flushes, trims the preallocated space and closes the file.
+     */
+    void close();
+    
+    bool isOpen() const
+    {
+        return fd_ >= 0;
+    }
+    
+    /**
+     * @return true if the file was opened with O_DIRECT
+     */
+    bool direct() const
+    {
+        return direct_;
+    }
+    
+    /**
+     * @return the number of bytes in the file, excluding the preallocated space
+     */
+    uint64_t size() const
+    {
+        return offset_ + used_;
+    }
+    
+private:
+    
+    /**
+     * Writes the first iLength bytes of buffer_ at offset_, iLength is a multiple of sBlockSize with O_DIRECT.
+     */
+    void writeBlocks(size_t iLength);
+    
+    /**
+     * Makes sure the file is allocated up to iEnd.
+     */
+    void reserve(uint64_t iEnd);
+    
+    /**
+     * @param[in] iSize size of the file
+     *
+     * @return the end of the statements in the file, before the zero padding of flush
+     */
+    uint64_t dataEnd(uint64_t iSize);
+    
+    int fd_{-1};
+    bool direct_{false};
+    uint64_t extent_{0};
+    
+    /// Aligned buffer, starts at the file offset offset_
+    char* buffer_{nullptr};
+    size_t used_{0};
+    uint64_t offset_{0};
+    
+    /// Bytes of the file already allocated
+    uint64_t allocated_{0};
+};
+
+#endif // _WIN32
@@ -0,0 +1,607 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceFormat.h"
+#include "TraceNumber.h"
+
+#include <math.h>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <link.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#include <mach-o/getsect.h>
+#endif
+
+const size_t TraceFormat::sMaxFormats;
+const size_t TraceFormat::sMaxProbes;
+
+namespace
+{
+    /// Compiled formats by the address of their format string, open addressing
+    struct Slot
+    {
+        std::atomic<const char*> key;
+        std::atomic<const TraceFormat*> format;
+    };
+    
+    Slot sSlots[TraceFormat::sMaxFormats];
+    
+    /// Largest width or precision compiled
+    const int32_t sMaxWidth{4096};
+    
+#if defined(__linux__) || defined(__APPLE__)
+    /// Address range of read-only data, [first, second)
+    typedef std::pair<uintptr_t, uintptr_t> Range;
+    
+    /**
+     * @return the read-only segments of the images loaded, sorted
+     */
+    std::vector<Range> readOnlyRanges()
+    {
+        std::vector<Range> ranges;
+        
+#if defined(__linux__)
+        dl_iterate_phdr([](struct dl_phdr_info* iInfo, size_t, void* ioRanges)
+        {
+            for (ElfW(Half) i = 0; i < iInfo->dlpi_phnum; i++)
+            {
+                const ElfW(Phdr)& header = iInfo->dlpi_phdr[i];
+                
+                if (header.p_type == PT_LOAD && !(header.p_flags & PF_W))
+                {
+                    uintptr_t start = static_cast<uintptr_t>(iInfo->dlpi_addr + header.p_vaddr);
+                    static_cast<std::vector<Range>*>(ioRanges)->push_back(Range(start, start + header.p_memsz));
+                }
+            }
+            
+            return 0;
+        }, &ranges);
+#else
+        for (uint32_t i = 0; i < _dyld_image_count(); i++)
+        {
+            unsigned long size = 0;
+            const uint8_t* data = getsegmentdata(reinterpret_cast<const struct mach_header_64*>(_dyld_get_image_header(i)), "__TEXT", &size);
+            
+            if (data)
+                ranges.push_back(Range(reinterpret_cast<uintptr_t>(data), reinterpret_cast<uintptr_t>(data) + size));
+        }
+#endif
+        
+        std::sort(ranges.begin(), ranges.end());
+        return ranges;
+    }
+#endif
+}
+
+struct TraceFormat::Output
+{
+    char* cursor;
+    char* end;
+    size_t total;
+    
+    void append(const char* iText, size_t iLength)
+    {
+        total += iLength;
+        
+        size_t room = static_cast<size_t>(end - cursor);
+        if (iLength > room)
+            iLength = room;
+        
+        memcpy(cursor, iText, iLength);
+        cursor += iLength;
+    }
+    
+    void fill(char iCharacter, size_t iCount)
+    {
+        total += iCount;
+        
+        size_t room = static_cast<size_t>(end - cursor);
+        if (iCount > room)
+            iCount = room;
+        
+        memset(cursor, iCharacter, iCount);
+        cursor += iCount;
+    }
+};
+
+const TraceFormat* TraceFormat::find(const char* iFormat)
+{
+    if (!iFormat)
+        return nullptr;
+    
+    size_t hash = static_cast<size_t>((reinterpret_cast<uintptr_t>(iFormat) * 0x9E3779B97F4A7C15ull) >> 32);
+    
+    // A full table, or a crowded neighbourhood, falls back to vsnprintf
+    //
+    for (size_t probe = 0; probe < sMaxProbes; probe++)
+    {
+        Slot& slot = sSlots[(hash + probe) % sMaxFormats];
+        const char* key = slot.key.load(std::memory_order_acquire);
+        
+        if (!key)
+        {
+            // Only string literals cannot change behind the compiled format
+            //
+            if (!isLiteral(iFormat))
+                return nullptr;
+            
+            if (!slot.key.compare_exchange_strong(key, iFormat, std::memory_order_acq_rel))
+            {
+                if (key != iFormat)
+                    continue;
+                
+                // Another thread is compiling it
+                //
+                return nullptr;
+            }
+            
+            TraceFormat* format = new TraceFormat(iFormat);
+            slot.format.store(format, std::memory_order_release);
+            
+            return format->valid() ? format : nullptr;
+        }
+        
+        if (key != iFormat)
+            continue;
+        
+        const TraceFormat* format = slot.format.load(std::memory_order_acquire);
+        return format && format->valid() ? format : nullptr;
+    }
+    
+    return nullptr;
+}
+
+bool TraceFormat::isLiteral(const char* iText)
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(iText);
+    
+#if defined(__linux__) || defined(__APPLE__)
+    static const std::vector<Range> sRanges = readOnlyRanges();
+    
+    auto range = std::upper_bound(sRanges.begin(), sRanges.end(), Range(address, UINTPTR_MAX));
+    return range != sRanges.begin() && address < (range - 1)->second;
+#elif defined(_WIN32)
+    MEMORY_BASIC_INFORMATION info;
+    if (!VirtualQuery(iText, &info, sizeof(info)))
+        return false;
+    
+    return info.Type == MEM_IMAGE && (info.Protect == PAGE_READONLY || info.Protect == PAGE_EXECUTE_READ);
+#else
+    (void)address;
+    return false;
+#endif
+}
+
+TraceFormat::TraceFormat(const char* iFormat)
+: text_(iFormat)
+{
+    valid_ = parse();
+    
+    if (!valid_)
+        ops_.clear();
+}
+
+bool TraceFormat::parse()
+{
+    const size_t length = text_.length();
+    size_t literal = 0;
+    size_t i = 0;
+    
+    auto addLiteral = [this](size_t iOffset, size_t iSize)
+    {
+        if (!iSize)
+            return;
+        
+        Op op = {};
+        op.kind = kKind_Literal;
+        op.offset = static_cast<uint32_t>(iOffset);
+        op.size = static_cast<uint32_t>(iSize);
+        ops_.push_back(op);
+    };
+    
+    auto parseNumber = [this, length](size_t& ioIndex, int32_t& oValue)
+    {
+        oValue = 0;
+        while (ioIndex < length && text_[ioIndex] >= '0' && text_[ioIndex] <= '9')
+        {
+            oValue = (oValue * 10) + (text_[ioIndex] - '0');
+            if (oValue > sMaxWidth)
+                return false;
+            
+            ioIndex++;
+        }
+        
+        return true;
+    };
+    
+    while (i < length)
+    {
+        if (text_[i] != '%')
+        {
+            i++;
+            continue;
+        }
+        
+        addLiteral(literal, i - literal);
+        
+        const size_t start = i++;
+        
+        if (i < length && text_[i] == '%')
+        {
+            addLiteral(i, 1);
+            literal = ++i;
+            continue;
+        }
+        
+        Op op = {};
+        op.precision = -1;
+        
+        // Flags
+        //
+        for (bool more = true; more && i < length; )
+        {
+            switch (text_[i])
+            {
+                case '-': op.flags |= kFlag_Minus; i++; break;
+                case '+': op.flags |= kFlag_Plus; i++; break;
+                case ' ': op.flags |= kFlag_Space; i++; break;
+                case '#': op.flags |= kFlag_Hash; i++; break;
+                case '0': op.flags |= kFlag_Zero; i++; break;
+                default: more = false; break;
+            }
+        }
+        
+        // Width and precision, * is not compiled
+        //
+        if (!parseNumber(i, op.width))
+            return false;
+        
+        if (i < length && text_[i] == '.')
+        {
+            i++;
+            if (!parseNumber(i, op.precision))
+                return false;
+        }
+        
+        // Length modifier
+        //
+        op.length = kLength_Int;
+        if (i < length)
+        {
+            switch (text_[i])
+            {
+                case 'h':
+                    op.length = (i + 1 < length && text_[i + 1] == 'h') ? kLength_Char : kLength_Short;
+                    i += op.length == kLength_Char ? 2 : 1;
+                    break;
+                case 'l':
+                    op.length = (i + 1 < length && text_[i + 1] == 'l') ? kLength_LongLong : kLength_Long;
+                    i += op.length == kLength_LongLong ? 2 : 1;
+                    break;
+                case 'z': op.length = kLength_Size; i++; break;
+                case 'j': op.length = kLength_Max; i++; break;
+                case 't': op.length = kLength_PtrDiff; i++; break;
+                default: break;
+            }
+        }
+        
+        if (i >= length)
+            return false;
+        
+        // Conversion, anything with an undefined or unusual combination is left to vsnprintf
+        //
+        const bool plain = !(op.flags & (kFlag_Hash | kFlag_Zero | kFlag_Plus | kFlag_Space));
+        
+        switch (text_[i])
+        {
+            case 'd':
+            case 'i':
+                if (op.flags & kFlag_Hash)
+                    return false;
+                op.kind = kKind_Signed;
+                break;
+            case 'u':
+                if (op.flags & kFlag_Hash)
+                    return false;
+                op.kind = kKind_Unsigned;
+                break;
+            case 'X':
+                op.flags |= kFlag_Upper;
+                op.kind = kKind_Hex;
+                break;
+            case 'x':
+                op.kind = kKind_Hex;
+                break;
+            case 'f':
+            case 'F':
+                if (op.length != kLength_Int && op.length != kLength_Long)
+                    return false;
+                op.kind = kKind_Float;
+                op.offset = static_cast<uint32_t>(start);
+                op.size = static_cast<uint32_t>(i + 1 - start);
+                break;
+            case 'c':
+                if (!plain || op.length != kLength_Int || op.precision >= 0)
+                    return false;
+                op.kind = kKind_Char;
+                break;
+            case 's':
+                if (!plain || op.length != kLength_Int)
+                    return false;
+                op.kind = kKind_String;
+                break;
+            default:
+                return false;
+        }
+        
+        ops_.push_back(op);
+        literal = ++i;
+    }
+    
+    addLiteral(literal, length - literal);
+    
+    return true;
+}
+
+int TraceFormat::format(char* oBuffer, size_t iSize, va_list iArgs) const
+{
+    va_list args;
+    va_copy(args, iArgs);
+    
+    Output output;
+    output.cursor = oBuffer;
+    output.end = iSize ? oBuffer + iSize - 1 : oBuffer;
+    output.total = 0;
+    
+    bool fallback = false;
+    
+    for (const Op& op : ops_)
+    {
+        switch (op.kind)
+        {
+            case kKind_Literal:
+                output.append(text_.data() + op.offset, op.size);
+                break;
+                
+            case kKind_Signed:
+            {
+                int64_t value = 0;
+                switch (op.length)
+                {
+                    case kLength_Int:       value = va_arg(args, int); break;
+                    case kLength_Char:      value = static_cast<signed char>(va_arg(args, int)); break;
+                    case kLength_Short:     value = static_cast<short>(va_arg(args, int)); break;
+                    case kLength_Long:      value = va_arg(args, long); break;
+                    case kLength_LongLong:  value = va_arg(args, long long); break;
+                    case kLength_Size:      value = va_arg(args, std::make_signed<size_t>::type); break;
+                    case kLength_Max:       value = va_arg(args, intmax_t); break;
+                    case kLength_PtrDiff:   value = va_arg(args, ptrdiff_t); break;
+                }
+                
+                uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+                formatInteger(output, op, magnitude, value < 0);
+                break;
+            }
+                
+            case kKind_Unsigned:
+            case kKind_Hex:
+            {
+                uint64_t value = 0;
+                switch (op.length)
+                {
+                    case kLength_Int:       value = va_arg(args, unsigned int); break;
+                    case kLength_Char:      value = static_cast<unsigned char>(va_arg(args, unsigned int)); break;
+                    case kLength_Short:     value = static_cast<unsigned short>(va_arg(args, unsigned int)); break;
+                    case kLength_Long:      value = va_arg(args, unsigned long); break;
+                    case kLength_LongLong:  value = va_arg(args, unsigned long long); break;
+                    case kLength_Size:      value = va_arg(args, size_t); break;
+                    case kLength_Max:       value = va_arg(args, uintmax_t); break;
+                    case kLength_PtrDiff:   value = static_cast<std::make_unsigned<ptrdiff_t>::type>(va_arg(args, ptrdiff_t)); break;
+                }
+                
+                formatInteger(output, op, value, false);
+                break;
+            }
+                
+            case kKind_Float:
+            {
+                double value = va_arg(args, double);
+                
+                char digits[TraceNumber::sFixedBufferSize];
+                size_t count = TraceNumber::formatFixed(value, op.precision < 0 ? 6 : op.precision, (op.flags & kFlag_Hash) != 0, digits);
+                
+                if (count)
+                {
+                    char prefix = signbit(value) ? '-' : ((op.flags & kFlag_Plus) ? '+' : ((op.flags & kFlag_Space) ? ' ' : 0));
+                    formatField(output, op, &prefix, prefix ? 1 : 0, 0, digits, count, (op.flags & kFlag_Zero) != 0);
+                    break;
+                }
+                
+                // Infinities, NaN and values too large for formatFixed
+                //
+                char specification[64];
+                char converted[512];
+                
+                memcpy(specification, text_.data() + op.offset, op.size);
+                specification[op.size] = 0;
+                
+                int convertedCount = snprintf(converted, sizeof(converted), specification, value);
+                if (convertedCount < 0 || static_cast<size_t>(convertedCount) >= sizeof(converted))
+                {
+                    fallback = true;
+                    break;
+                }
+                
+                output.append(converted, static_cast<size_t>(convertedCount));
+                break;
+            }
+                
+            case kKind_Char:
+            {
+                char value = static_cast<char>(va_arg(args, int));
+                size_t pad = op.width > 1 ? static_cast<size_t>(op.width - 1) : 0;
+                
+                if (!(op.flags & kFlag_Minus))
+                    output.fill(' ', pad);
+                
+                output.append(&value, 1);
+                
+                if (op.flags & kFlag_Minus)
+                    output.fill(' ', pad);
+                break;
+            }
+                
+            case kKind_String:
+            {
+                const char* value = va_arg(args, const char*);
+                
+                // How a null string prints is up to the C library
+                //
+                if (!value)
+                {
+                    fallback = true;
+                    break;
+                }
+                
+                size_t length = op.precision >= 0 ? strnlen(value, static_cast<size_t>(op.precision)) : strlen(value);
+                size_t pad = static_cast<size_t>(op.width) > length ? static_cast<size_t>(op.width) - length : 0;
+                
+                if (!(op.flags & kFlag_Minus))
+                    output.fill(' ', pad);
+                
+                output.append(value, length);
+                
+                if (op.flags & kFlag_Minus)
+                    output.fill(' ', pad);
+                break;
+            }
+        }
+        
+        if (fallback)
+            break;
+    }
+    
+    va_end(args);
+    
+    if (fallback)
+        return vsnprintf(oBuffer, iSize, text_.c_str(), iArgs);
+    
+    if (iSize)
+        *output.cursor = 0;
+    
+    return static_cast<int>(output.total);
+}
+
+void TraceFormat::formatInteger(Output& ioOutput, const Op& iOp, uint64_t iMagnitude, bool iNegative)
+{
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* first = end;
+    
+    if (iOp.kind == kKind_Hex)
+    {
+        const char* table = (iOp.flags & kFlag_Upper) ? "0123456789ABCDEF" : "0123456789abcdef";
+        
+        for (uint64_t value = iMagnitude; value; value >>= 4)
+            *--first = table[value & 0xF];
+        
+        if (first == end)
+            *--first = '0';
+    }
+    else
+    {
+        first = TraceNumber::formatDecimal(iMagnitude, end);
+    }
+    
+    // Zero prints nothing with a precision of 0
+    //
+    if (!iMagnitude && iOp.precision == 0)
+        first = end;
+    
+    const size_t count = static_cast<size_t>(end - first);
+    
+    char prefix[2];
+    size_t prefixLength = 0;
+    
+    if (iOp.kind == kKind_Signed)
+    {
+        if (iNegative)
+            prefix[prefixLength++] = '-';
+        else if (iOp.flags & kFlag_Plus)
+            prefix[prefixLength++] = '+';
+        else if (iOp.flags & kFlag_Space)
+            prefix[prefixLength++] = ' ';
+    }
+    else if (iOp.kind == kKind_Hex && (iOp.flags & kFlag_Hash) && iMagnitude)
+    {
+        prefix[prefixLength++] = '0';
+        prefix[prefixLength++] = (iOp.flags & kFlag_Upper) ? 'X' : 'x';
+    }
+    
+    size_t zeros = iOp.precision >= 0 && static_cast<size_t>(iOp.precision) > count ? static_cast<size_t>(iOp.precision) - count : 0;
+    
+    // The 0 flag is ignored when there is a precision
+    //
+    formatField(ioOutput, iOp, prefix, prefixLength, zeros, first, count, (iOp.flags & kFlag_Zero) && iOp.precision < 0);
+}
+
+void TraceFormat::formatField(Output& ioOutput
+                              , const Op& iOp
+                              , const char* iPrefix
+                              , size_t iPrefixLength
+                              , size_t iZeros
+                              , const char* iDigits
+                              , size_t iCount
+                              , bool iZeroPad
+                              )
+{
+    size_t body = iPrefixLength + iZeros + iCount;
+    size_t pad = static_cast<size_t>(iOp.width) > body ? static_cast<size_t>(iOp.width) - body : 0;
+    
+    if (iOp.flags & kFlag_Minus)
+    {
+        ioOutput.append(iPrefix, iPrefixLength);
+        ioOutput.fill('0', iZeros);
+        ioOutput.append(iDigits, iCount);
+        ioOutput.fill(' ', pad);
+    }
+    else if (iZeroPad)
+    {
+        ioOutput.append(iPrefix, iPrefixLength);
+        ioOutput.fill('0', iZeros + pad);
+        ioOutput.append(iDigits, iCount);
+    }
+    else
+    {
+        ioOutput.fill(' ', pad);
+        ioOutput.append(iPrefix, iPrefixLength);
+        ioOutput.fill('0', iZeros);
+        ioOutput.append(iDigits, iCount);
+    }
+}
@@ -0,0 +1,177 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdarg.h>
+#include <stdint.h>
+
+///
+/// \brief printf format string parsed once into a list of operations.
+///
+/// vsnprintf parses the format string on every call although the format of
+/// a trace statement never changes. TraceFormat parses it once, into runs of
+/// literal text and conversions, and formats the arguments by running the list.
+/// Integers, strings and fixed point floating point values are converted directly,
+/// see TraceNumber. Infinities, NaN and huge floating point values are handed
+/// to snprintf with their own specification.
+///
+/// The output is identical to vsnprintf. Formats using anything else than
+/// the flags -+ #0, a width, a precision, the length modifiers hh h l ll z j t
+/// and the conversions d i u x X f F c s % are not compiled and keep using vsnprintf.
+///
+/// Formats are found by the address of the format string, see find,
+/// and are kept for the life of the process. Only string literals are compiled,
+/// a format string in writable memory may change and keeps using vsnprintf.
+///
+class TraceFormat
+{
+public:
+    
+    /// Number of formats that can be compiled, later ones keep using vsnprintf
+    static const size_t sMaxFormats{4096};
+    
+    /// Slots of the table looked at before a format string is left to vsnprintf
+    static const size_t sMaxProbes{16};
+    
+    /**
+     * Finds the compiled format of a format string, compiling it the first time.
+     * Only the address of iFormat is compared, format strings that are not
+     * string literals, found with isLiteral, are never compiled.
+     *
+     * @param[in] iFormat the format string
+     *
+     * @return the compiled format, nullptr if it has to be formatted with vsnprintf
+     */
+    static const TraceFormat* find(const char* iFormat);
+    
+    /**
+     * @param[in] iText a string
+     *
+     * @return true if iText is in the read-only data of the executable or of a library
+     *         loaded before the first call, false when it cannot be told
+     */
+    static bool isLiteral(const char* iText);
+    
+    /**
+     * Parses a format string.
+     *
+     * @param[in] iFormat the format string
+     */
+    explicit TraceFormat(const char* iFormat);
+    
+    /**
+     * @return true if the format could be compiled
+     */
+    bool valid() const
+    {
+        return valid_;
+    }
+    
+    /**
+     * Formats the arguments, same as vsnprintf.
+     *
+     * @param[out] oBuffer receives the output, always null terminated when iSize is not 0
+     * @param[in] iSize size of oBuffer
+     * @param[in] iArgs the arguments
+     *
+     * @return the length of the complete output, excluding the terminating character
+     */
+    int format(char* oBuffer, size_t iSize, va_list iArgs) const;
+    
+private:
+    
+    enum Kind : uint8_t
+    {
+          kKind_Literal
+        , kKind_Signed
+        , kKind_Unsigned
+        , kKind_Hex
+        , kKind_Float
+        , kKind_Char
+        , kKind_String
+    };
+    
+    enum Length : uint8_t
+    {
+          kLength_Int
+        , kLength_Char
+        , kLength_Short
+        , kLength_Long
+        , kLength_LongLong
+        , kLength_Size
+        , kLength_Max
+        , kLength_PtrDiff
+    };
+    
+    enum Flag : uint8_t
+    {
+          kFlag_Minus   = 0x01
+        , kFlag_Plus    = 0x02
+        , kFlag_Space   = 0x04
+        , kFlag_Hash    = 0x08
+        , kFlag_Zero    = 0x10
+        , kFlag_Upper   = 0x20
+    };
+    
+    struct Op
+    {
+        Kind kind;
+        Length length;
+        uint8_t flags;
+        int32_t width;
+        
+        /// -1 when there is none
+        int32_t precision;
+        
+        /// Literal text, or the conversion specification for kKind_Float, in text_
+        uint32_t offset;
+        uint32_t size;
+    };
+    
+    /// Bounded output, counts what does not fit like vsnprintf
+    struct Output;
+    
+    bool parse();
+    
+    static void formatInteger(Output& ioOutput, const Op& iOp, uint64_t iMagnitude, bool iNegative);
+    
+    /**
+     * Writes a converted value with its width: prefix (sign or 0x), iZeros zeros, then the digits.
+     * iZeroPad pads with zeros after the prefix instead of spaces before it.
+     */
+    static void formatField(Output& ioOutput
+                            , const Op& iOp
+                            , const char* iPrefix
+                            , size_t iPrefixLength
+                            , size_t iZeros
+                            , const char* iDigits
+                            , size_t iCount
+                            , bool iZeroPad
+                            );
+    
+    /// Copy of the format string
+    std::string text_;
+    
+    std::vector<Op> ops_;
+    bool valid_{false};
+};
@@ -0,0 +1,139 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceLazyBackend.h"
+#include "TraceClock.h"
+
+const size_t TraceLazyBackend::sMaxEarly;
+
+TraceLazyBackend::TraceLazyBackend(std::unique_ptr<TraceBackend> iBackend
+                                   , Start iStart
+                                   , std::function<void()> iOnStart
+                                   )
+: backend_(std::move(iBackend))
+, start_(iStart)
+, onStart_(iOnStart)
+{
+}
+
+bool TraceLazyBackend::open(const TraceBackendConfig& iConfig)
+{
+    close();
+    
+    config_ = iConfig;
+    state_.store(kState_Closed, std::memory_order_release);
+    
+    if (start_ == kStart_Background)
+    {
+        state_.store(kState_Starting, std::memory_order_release);
+        thread_ = std::thread(&TraceLazyBackend::start, this);
+    }
+    
+    return true;
+}
+
+void TraceLazyBackend::write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp)
+{
+    int state = state_.load(std::memory_order_acquire);
+    
+    if (state == kState_Open)
+    {
+        backend_->write(iMask, iSite, iMessage, iTimestamp);
+        return;
+    }
+    
+    if (state == kState_Failed)
+    {
+        drops_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    bool starting = false;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        // start hands early_ to the backend under the mutex
+        //
+        state = state_.load(std::memory_order_relaxed);
+        
+        if (state == kState_Closed)
+        {
+            state_.store(kState_Starting, std::memory_order_relaxed);
+            starting = true;
+        }
+        else if (state != kState_Starting)
+        {
+            if (state == kState_Open)
+                backend_->write(iMask, iSite, iMessage, iTimestamp);
+            else
+                drops_.fetch_add(1, std::memory_order_relaxed);
+            
+            return;
+        }
+        
+        if (early_.size() < sMaxEarly)
+            early_.push_back(Early{iMask, iSite, iMessage, iTimestamp != sNow ? iTimestamp : TraceClock::now()});
+        else
+            drops_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    if (starting)
+        start();
+}
+
+void TraceLazyBackend::close()
+{
+    if (thread_.joinable())
+        thread_.join();
+    
+    int state = state_.exchange(kState_Closed, std::memory_order_acq_rel);
+    
+    if (state == kState_Open)
+        backend_->close();
+    
+    early_.clear();
+}
+
+void TraceLazyBackend::start()
+{
+    if (onStart_)
+        onStart_();
+    
+    // Statements keep going to early_ while the backend is opened
+    //
+    bool opened = backend_->open(config_);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (opened)
+    {
+        for (const Early& early : early_)
+            backend_->write(early.mask, early.site, early.message.c_str(), early.timestamp);
+    }
+    else
+    {
+        drops_.fetch_add(early_.size(), std::memory_order_relaxed);
+    }
+    
+    early_.clear();
+    early_.shrink_to_fit();
+    
+    state_.store(opened ? kState_Open : kState_Failed, std::memory_order_release);
+}
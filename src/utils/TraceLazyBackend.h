@@ -0,0 +1,147 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "TraceBackend.h"
+
+///
+/// \brief TraceBackend opening another backend after Trace is initialized.
+///
+/// Opening a backend starts threads, creates files and registers sinks.
+/// TraceLazyBackend keeps that off the startup path: open only stores the
+/// configuration, the wrapped backend is opened on the first statement
+/// (kStart_FirstWrite) or on a thread started by open (kStart_Background).
+///
+/// Statements written while the backend is being opened are copied and
+/// written once it is open, with the time they were written at.
+/// Beyond sMaxEarly of them further statements are dropped, see dropCount.
+/// If the backend fails to open every statement is dropped as well.
+///
+class TraceLazyBackend : public TraceBackend
+{
+public:
+    
+    /// When the wrapped backend is opened
+    enum Start
+    {
+          kStart_FirstWrite     ///< By the thread writing the first statement
+        , kStart_Background     ///< By a thread started by open
+    };
+    
+    /// Statements kept while the backend is being opened
+    static const size_t sMaxEarly{4096};
+    
+    /**
+     * @param[in] iBackend the backend to open
+     * @param[in] iStart when to open it
+     * @param[in] iOnStart called right before the backend is opened, on the thread opening it
+     */
+    TraceLazyBackend(std::unique_ptr<TraceBackend> iBackend
+                     , Start iStart
+                     , std::function<void()> iOnStart = nullptr
+                     );
+    
+    virtual ~TraceLazyBackend()
+    {
+        close();
+    }
+    
+    /**
+     * Stores the configuration, and with kStart_Background starts opening the backend.
+     *
+     * @return true, failures to open the backend are only reported on the console
+     */
+    bool open(const TraceBackendConfig& iConfig) override;
+    
+    using TraceBackend::write;
+    
+    void write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp) override;
+    
+    /**
+     * Waits for the backend to be opened, when it is being opened, and closes it.
+     * A backend that was never written to is never opened.
+     */
+    void close() override;
+    
+    /**
+     * @return true once the backend is open
+     */
+    bool started() const
+    {
+        return state_.load(std::memory_order_acquire) == kState_Open;
+    }
+    
+    /**
+     * @return the number of statements dropped while the backend was being opened,
+     *         or because it failed to open
+     */
+    uint64_t dropCount() const
+    {
+        return drops_.load(std::memory_order_relaxed);
+    }
+    
+private:
+    
+    enum State
+    {
+          kState_Closed     ///< Not opened yet
+        , kState_Starting   ///< Being opened, statements are kept in early_
+        , kState_Open       ///< Statements go straight to the backend
+        , kState_Failed     ///< Statements are dropped
+    };
+    
+    /// A statement written while the backend was being opened
+    struct Early
+    {
+        uint64_t mask;
+        const void* site;
+        std::string message;
+        uint64_t timestamp;
+    };
+    
+    /**
+     * Opens the backend and writes the statements kept meanwhile.
+     * Only called once, after moving to kState_Starting.
+     */
+    void start();
+    
+    std::unique_ptr<TraceBackend> backend_;
+    Start start_;
+    std::function<void()> onStart_;
+    TraceBackendConfig config_;
+    
+    std::atomic<int> state_{kState_Closed};
+    
+    /// Guards early_ and the transitions out of kState_Closed and kState_Starting
+    std::mutex mutex_;
+    std::vector<Early> early_;
+    
+    std::atomic<uint64_t> drops_{0};
+    
+    std::thread thread_;
+};
@@ -0,0 +1,631 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceNativeBackend.h"
+#include "TraceClock.h"
+
+#include <time.h>
+#include <string.h>
+#include <tuple>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+const size_t TraceNativeBackend::sMaxPending;
+const size_t TraceNativeBackend::sFileBufferSize;
+
+namespace
+{
+    std::atomic<uint64_t> sNextBackendId{1};
+    
+    /// Producers of kBuffering_Thread most recently used by the calling thread, by backend id
+    struct ProducerCache
+    {
+        uint64_t id;
+        void* producer;
+    };
+    
+    thread_local ProducerCache sProducerCache[4];
+    
+    uint64_t now()
+    {
+        return TraceClock::now();
+    }
+}
+
+bool TraceNativeBackend::open(const TraceBackendConfig& iConfig)
+{
+    close();
+    
+    config_ = iConfig;
+    
+    if (!config_.callback)
+    {
+        std::string logFile = config_.logFilePath.length() ? config_.logFilePath : "default.log";
+        
+#ifndef _WIN32
+        if (config_.preallocate || config_.directIO)
+        {
+            writer_.reset(new TraceFileWriter());
+            if (!writer_->open(logFile, config_.preallocate, config_.directIO))
+            {
+                writer_.reset();
+                std::cerr << "Failed to open trace log file " << logFile << std::endl;
+                return false;
+            }
+        }
+#endif
+        
+        if (!hasFile())
+        {
+            file_ = fopen(logFile.c_str(), "a");
+            if (!file_)
+            {
+                std::cerr << "Failed to open trace log file " << logFile << std::endl;
+                return false;
+            }
+            
+            // Without a writer thread the file is only written when its buffer fills up
+            //
+            if (!config_.threaded)
+                setvbuf(file_, nullptr, _IOFBF, sFileBufferSize);
+        }
+    }
+    
+    coalescer_.reset(new TraceCoalescer(config_.coalesceWindow));
+    
+    stop_ = false;
+    idle_ = false;
+    queued_.store(0, std::memory_order_relaxed);
+    wakeups_.store(0, std::memory_order_relaxed);
+    
+    id_ = sNextBackendId.fetch_add(1, std::memory_order_relaxed);
+    merging_ = MergeStats();
+    mergeStats_ = MergeStats();
+    lastMerged_ = 0;
+    
+    if (config_.buffering == TraceBackendConfig::kBuffering_Cpu)
+    {
+        uint32_t processors = std::max(std::thread::hardware_concurrency(), 1u);
+        
+        for (uint32_t i = 0; i < processors; i++)
+        {
+            producers_.emplace_back(new Producer());
+            producers_.back()->index = i;
+        }
+    }
+    
+    if (config_.threaded)
+        thread_ = std::thread(config_.buffering == TraceBackendConfig::kBuffering_Shared ? &TraceNativeBackend::run : &TraceNativeBackend::runMerge, this);
+    
+    return true;
+}
+
+void TraceNativeBackend::write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp)
+{
+    Entry entry;
+    entry.mask = iMask;
+    entry.site = iSite;
+    entry.threadName = config_.filter && config_.filter->usesThreadNames() ? TraceThreadName::get() : nullptr;
+    entry.sequence = 0;
+    entry.length = static_cast<uint32_t>(strlen(iMessage));
+    
+    if (!config_.threaded)
+    {
+        entry.timestamp = iTimestamp != sNow ? iTimestamp : now();
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        emit(entry, iMessage);
+        return;
+    }
+    
+    if (config_.buffering != TraceBackendConfig::kBuffering_Shared)
+    {
+        // The writer polls the buffers, it is never woken
+        //
+        Producer* target = producer();
+        if (!target)
+            return;
+        
+        std::lock_guard<std::mutex> lock(target->mutex);
+        
+        if (target->pending.entries.size() >= sMaxPending)
+        {
+            drops_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        
+        // Under the mutex, a buffer shared by threads stays in time order
+        //
+        entry.timestamp = iTimestamp != sNow ? iTimestamp : now();
+        entry.sequence = target->sequence++;
+        target->pending.entries.push_back(entry);
+        target->pending.text.insert(target->pending.text.end(), iMessage, iMessage + entry.length);
+        return;
+    }
+    
+    entry.timestamp = iTimestamp != sNow ? iTimestamp : now();
+    bool wake = false;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        if (pending_.entries.size() >= sMaxPending)
+        {
+            drops_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        
+        pending_.entries.push_back(entry);
+        pending_.text.insert(pending_.text.end(), iMessage, iMessage + entry.length);
+        queued_.store(pending_.entries.size(), std::memory_order_relaxed);
+        
+        switch (config_.consumer.wakeup)
+        {
+            case TraceThreadTuning::kWakeup_Batch:
+                wake = idle_ && pending_.entries.size() >= config_.consumer.batchSize;
+                break;
+                
+            case TraceThreadTuning::kWakeup_Poll:
+                break;
+                
+            default:
+                wake = idle_;
+                break;
+        }
+        
+        if (wake)
+            idle_ = false;
+    }
+    
+    // Only wake the writer when it is waiting, it takes everything pending at once
+    //
+    if (wake)
+    {
+        wakeups_.fetch_add(1, std::memory_order_relaxed);
+        wake_.notify_one();
+    }
+}
+
+void TraceNativeBackend::close()
+{
+    if (thread_.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        
+        wake_.notify_one();
+        thread_.join();
+    }
+    else if (coalescer_)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        uint64_t timestamp = now();
+        coalescer_->flush([this, timestamp](const void*, const std::string& iSummary) { output(timestamp, iSummary.c_str(), iSummary.length()); });
+    }
+    
+    coalescer_.reset();
+    producers_.clear();
+    
+    if (file_)
+    {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    
+#ifndef _WIN32
+    writer_.reset();
+#endif
+}
+
+void TraceNativeBackend::run()
+{
+    config_.consumer.apply();
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (true)
+    {
+        while (pending_.entries.empty() && !stop_)
+            waitForStatements(lock);
+        
+        idle_ = false;
+        
+        if (pending_.entries.empty() && stop_)
+            break;
+        
+        std::swap(pending_, writing_);
+        queued_.store(0, std::memory_order_relaxed);
+        lock.unlock();
+        
+        const char* message = writing_.text.data();
+        for (const Entry& entry : writing_.entries)
+        {
+            emit(entry, message);
+            message += entry.length;
+        }
+        
+        flushFile();
+        
+        writing_.entries.clear();
+        writing_.text.clear();
+        
+        lock.lock();
+    }
+    
+    lock.unlock();
+    
+    uint64_t timestamp = now();
+    coalescer_->flush([this, timestamp](const void*, const std::string& iSummary) { output(timestamp, iSummary.c_str(), iSummary.length()); });
+    
+    flushFile();
+}
+
+void TraceNativeBackend::waitForStatements(std::unique_lock<std::mutex>& ioLock)
+{
+    const TraceThreadTuning& tuning = config_.consumer;
+    const std::chrono::microseconds interval(std::max<uint32_t>(tuning.intervalUs, 1));
+    
+    switch (tuning.wakeup)
+    {
+        case TraceThreadTuning::kWakeup_Spin:
+        {
+            // Statements written while spinning are taken without a wakeup,
+            // close is seen once the spin is over
+            //
+            ioLock.unlock();
+            
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(tuning.spinUs);
+            while (!queued_.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::yield();
+            
+            ioLock.lock();
+            
+            if (!pending_.entries.empty() || stop_)
+                return;
+            
+            idle_ = true;
+            wake_.wait(ioLock);
+            break;
+        }
+            
+        case TraceThreadTuning::kWakeup_Batch:
+            idle_ = true;
+            wake_.wait_for(ioLock, interval);
+            break;
+            
+        case TraceThreadTuning::kWakeup_Poll:
+            wake_.wait_for(ioLock, interval, [this]() { return stop_; });
+            break;
+            
+        default:
+            idle_ = true;
+            wake_.wait(ioLock);
+            break;
+    }
+}
+
+void TraceNativeBackend::runMerge()
+{
+    config_.consumer.apply();
+    
+    const std::chrono::nanoseconds poll = std::max<std::chrono::nanoseconds>(std::chrono::nanoseconds(config_.mergeWindow / 2), std::chrono::milliseconds(1));
+    std::vector<Producer*> producers;
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    while (true)
+    {
+        // Everything written before close is collected by the last pass
+        //
+        const bool stopping = stop_;
+        lock.unlock();
+        
+        collect(producers);
+        
+        uint64_t timestamp = now();
+        merge(producers, stopping ? UINT64_MAX : (timestamp > config_.mergeWindow ? timestamp - config_.mergeWindow : 0));
+        flushFile();
+        
+        lock.lock();
+        mergeStats_ = merging_;
+        
+        if (stopping)
+            break;
+        
+        wake_.wait_for(lock, poll, [this]() { return stop_; });
+    }
+    
+    lock.unlock();
+    
+    uint64_t timestamp = now();
+    coalescer_->flush([this, timestamp](const void*, const std::string& iSummary) { output(timestamp, iSummary.c_str(), iSummary.length()); });
+    
+    if (merging_.statements)
+    {
+        char summary[256];
+        int length = snprintf(summary, sizeof(summary)
+                              , "Trace merge: %llu statements from %u buffers, %llu late, window %llu us, reorder delay mean %llu us max %llu us, peak %llu bytes held"
+                              , static_cast<unsigned long long>(merging_.statements)
+                              , merging_.buffers
+                              , static_cast<unsigned long long>(merging_.late)
+                              , static_cast<unsigned long long>(config_.mergeWindow / 1000)
+                              , static_cast<unsigned long long>(merging_.totalDelay / merging_.statements / 1000)
+                              , static_cast<unsigned long long>(merging_.maxDelay / 1000)
+                              , static_cast<unsigned long long>(merging_.peakBytes)
+                              );
+        
+        output(timestamp, summary, static_cast<size_t>(length));
+    }
+    
+    flushFile();
+}
+
+void TraceNativeBackend::collect(std::vector<Producer*>& oProducers)
+{
+    {
+        std::lock_guard<std::mutex> lock(producersMutex_);
+        
+        oProducers.clear();
+        for (const auto& producer : producers_)
+            oProducers.push_back(producer.get());
+    }
+    
+    merging_.buffers = static_cast<uint32_t>(oProducers.size());
+    
+    for (Producer* producer : oProducers)
+    {
+        std::lock_guard<std::mutex> lock(producer->mutex);
+        
+        if (producer->pending.entries.empty())
+            continue;
+        
+        if (producer->held.entries.empty())
+        {
+            std::swap(producer->pending, producer->held);
+            continue;
+        }
+        
+        producer->held.entries.insert(producer->held.entries.end(), producer->pending.entries.begin(), producer->pending.entries.end());
+        producer->held.text.insert(producer->held.text.end(), producer->pending.text.begin(), producer->pending.text.end());
+        producer->pending.entries.clear();
+        producer->pending.text.clear();
+    }
+}
+
+void TraceNativeBackend::merge(const std::vector<Producer*>& iProducers, uint64_t iCutoff)
+{
+    // The oldest statement of every producer, the earliest on top
+    //
+    struct Head
+    {
+        uint64_t timestamp;
+        uint32_t index;
+        uint64_t sequence;
+        Producer* producer;
+    };
+    
+    auto later = [](const Head& iLeft, const Head& iRight)
+    {
+        return std::tie(iLeft.timestamp, iLeft.index, iLeft.sequence) > std::tie(iRight.timestamp, iRight.index, iRight.sequence);
+    };
+    
+    std::vector<Head> heads;
+    heads.reserve(iProducers.size());
+    
+    uint64_t held = 0;
+    
+    for (Producer* producer : iProducers)
+    {
+        held += ((producer->held.entries.size() - producer->next) * sizeof(Entry)) + (producer->held.text.size() - producer->nextText);
+        
+        if (producer->next < producer->held.entries.size() && producer->held.entries[producer->next].timestamp <= iCutoff)
+        {
+            const Entry& entry = producer->held.entries[producer->next];
+            heads.push_back(Head{entry.timestamp, producer->index, entry.sequence, producer});
+        }
+    }
+    
+    merging_.peakBytes = std::max(merging_.peakBytes, held);
+    std::make_heap(heads.begin(), heads.end(), later);
+    
+    const uint64_t timestamp = now();
+    
+    while (!heads.empty())
+    {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        Producer* producer = heads.back().producer;
+        heads.pop_back();
+        
+        const Entry& entry = producer->held.entries[producer->next];
+        
+        merging_.statements++;
+        if (entry.timestamp < lastMerged_)
+            merging_.late++;
+        else
+            lastMerged_ = entry.timestamp;
+        
+        uint64_t delay = timestamp > entry.timestamp ? timestamp - entry.timestamp : 0;
+        merging_.totalDelay += delay;
+        merging_.maxDelay = std::max(merging_.maxDelay, delay);
+        
+        emit(entry, producer->held.text.data() + producer->nextText);
+        
+        producer->next++;
+        producer->nextText += entry.length;
+        
+        if (producer->next < producer->held.entries.size() && producer->held.entries[producer->next].timestamp <= iCutoff)
+        {
+            const Entry& next = producer->held.entries[producer->next];
+            heads.push_back(Head{next.timestamp, producer->index, next.sequence, producer});
+            std::push_heap(heads.begin(), heads.end(), later);
+        }
+    }
+    
+    // Drop what was written
+    //
+    for (Producer* producer : iProducers)
+    {
+        producer->held.entries.erase(producer->held.entries.begin(), producer->held.entries.begin() + producer->next);
+        producer->held.text.erase(producer->held.text.begin(), producer->held.text.begin() + producer->nextText);
+        producer->next = 0;
+        producer->nextText = 0;
+    }
+}
+
+TraceNativeBackend::Producer* TraceNativeBackend::producer()
+{
+    if (config_.buffering == TraceBackendConfig::kBuffering_Cpu)
+    {
+        // Fixed once opened, no need for producersMutex_
+        //
+        if (producers_.empty())
+            return nullptr;
+        
+#ifdef __linux__
+        int cpu = sched_getcpu();
+        if (cpu >= 0)
+            return producers_[static_cast<size_t>(cpu) % producers_.size()].get();
+#endif
+        
+        return producers_[std::hash<std::thread::id>()(std::this_thread::get_id()) % producers_.size()].get();
+    }
+    
+    ProducerCache& cached = sProducerCache[id_ % 4];
+    if (cached.id == id_)
+        return static_cast<Producer*>(cached.producer);
+    
+    std::lock_guard<std::mutex> lock(producersMutex_);
+    
+    const std::thread::id thread = std::this_thread::get_id();
+    Producer* found = nullptr;
+    
+    for (const auto& producer : producers_)
+    {
+        if (producer->thread == thread)
+        {
+            found = producer.get();
+            break;
+        }
+    }
+    
+    if (!found)
+    {
+        producers_.emplace_back(new Producer());
+        found = producers_.back().get();
+        found->thread = thread;
+        found->index = static_cast<uint32_t>(producers_.size() - 1);
+    }
+    
+    cached.id = id_;
+    cached.producer = found;
+    
+    return found;
+}
+
+TraceNativeBackend::MergeStats TraceNativeBackend::mergeStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mergeStats_;
+}
+
+void TraceNativeBackend::emit(const Entry& iEntry, const char* iMessage)
+{
+    if (config_.filter && !config_.filter->pass(iEntry.mask, iEntry.threadName, iMessage, iEntry.length))
+        return;
+    
+    const uint64_t timestamp = iEntry.timestamp;
+    auto summary = [this, timestamp](const void*, const std::string& iSummary)
+    {
+        output(timestamp, iSummary.c_str(), iSummary.length());
+    };
+    
+    if (coalescer_->process(iEntry.site, iMessage, iEntry.length, timestamp, summary))
+        output(timestamp, iMessage, iEntry.length);
+}
+
+void TraceNativeBackend::output(uint64_t iTimestamp, const char* iMessage, size_t iLength)
+{
+    time_t seconds = static_cast<time_t>(iTimestamp / 1000000000);
+    uint32_t milliseconds = static_cast<uint32_t>((iTimestamp / 1000000) % 1000);
+    
+    struct tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    
+    char prefix[48];
+    int prefixLength = 0;
+    
+    if (config_.preciseTimestamps)
+    {
+        prefixLength = snprintf(prefix, sizeof(prefix), "[%04d-%02d-%02dT%02d:%02d:%02d.%09uZ] "
+                                , utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday
+                                , utc.tm_hour, utc.tm_min, utc.tm_sec
+                                , static_cast<uint32_t>(iTimestamp % 1000000000));
+    }
+    else
+    {
+        prefixLength = snprintf(prefix, sizeof(prefix), "[%02d:%02d:%02d.%03uZ] ", utc.tm_hour, utc.tm_min, utc.tm_sec, milliseconds);
+    }
+    
+    line_.assign(prefix, prefixLength);
+    line_.append(iMessage, iLength);
+    
+    if (hasFile())
+    {
+        line_.push_back('\n');
+        
+#ifndef _WIN32
+        if (writer_)
+        {
+            writer_->write(line_.data(), line_.length());
+            return;
+        }
+#endif
+        
+        fwrite(line_.data(), 1, line_.length(), file_);
+    }
+    else if (config_.callback)
+    {
+        config_.callback(line_.c_str());
+    }
+}
+
+void TraceNativeBackend::flushFile()
+{
+#ifndef _WIN32
+    if (writer_)
+        writer_->flush();
+#endif
+    
+    if (file_)
+        fflush(file_);
+}
@@ -0,0 +1,282 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <stdio.h>
+#include <condition_variable>
+
+#include "TraceBackend.h"
+#include "TraceCoalescer.h"
+#include "TraceFileWriter.h"
+
+///
+/// \brief Built-in asynchronous backend without external dependencies.
+///
+/// Statements are copied into a pending queue by the writing thread and
+/// written by a single writer thread, either to the log file or to the client callback.
+/// The writer takes the whole queue at once and flushes the file once per batch.
+///
+/// Statements are written as "[HH:MM:SS.mmmZ] message", the same as the spdlog backend,
+/// or with TraceBackendConfig::preciseTimestamps as "[YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ] message".
+///
+/// With TraceBackendConfig::preallocate or TraceBackendConfig::directIO the file
+/// is written with a TraceFileWriter instead of stdio, except on Windows.
+///
+/// Without TraceBackendConfig::threaded there is no writer thread, the writing thread
+/// formats the statement into the stdio buffer of the file under the queue mutex.
+///
+/// When the writer falls behind by more than sMaxPending statements
+/// further statements are dropped, see dropCount.
+///
+/// With TraceBackendConfig::kBuffering_Thread every writing thread queues its
+/// statements in its own buffer, stamped with a per thread sequence number, so the
+/// writing threads never contend with each other. The writer polls the buffers and
+/// merges them in time order, ordered by timestamp, then thread, then sequence.
+/// A statement is held back until it is TraceBackendConfig::mergeWindow old, so a
+/// statement that reaches its buffer later than that is written out of order,
+/// see MergeStats::late, as is a statement written with an earlier timestamp, like the
+/// ones TraceTail holds back. The writer adds a summary of MergeStats to the output when closed.
+/// Buffers live until the backend is closed, even when their thread exits.
+///
+/// TraceBackendConfig::kBuffering_Cpu merges the same way, but with a buffer per processor
+/// created when the backend is opened. A thread writes to the buffer of the processor it runs
+/// on, found with sched_getcpu on Linux, or of its thread id elsewhere. Short lived threads
+/// then cost nothing and the memory is bounded by the number of processors. A buffer is only
+/// shared when threads move or run on the same processor, and its timestamps are taken
+/// under its mutex so they stay in order.
+///
+/// The writer thread applies TraceBackendConfig::consumer when it starts. With kBuffering_Shared
+/// the writing threads wake it according to TraceThreadTuning::wakeup, see wakeupCount.
+/// The merge writer of the other bufferings always polls.
+///
+class TraceNativeBackend : public TraceBackend
+{
+public:
+    
+    /// Statements that may be pending before statements are dropped
+    static const size_t sMaxPending{32768};
+    
+    /// stdio buffer of the file when there is no writer thread
+    static const size_t sFileBufferSize{64 * 1024};
+    
+    /// Statistics of the merge of kBuffering_Thread
+    struct MergeStats
+    {
+        /// Statements merged
+        uint64_t statements{0};
+        
+        /// Statements written after a more recent one, they reached their buffer after the window
+        uint64_t late{0};
+        
+        /// Time from writing a statement to merging it, the reorder latency
+        uint64_t totalDelay{0};
+        uint64_t maxDelay{0};
+        
+        /// Most memory held by statements waiting to be merged, in bytes
+        uint64_t peakBytes{0};
+        
+        /// Buffers merged, one per thread or per processor
+        uint32_t buffers{0};
+    };
+    
+    TraceNativeBackend() {}
+    
+    virtual ~TraceNativeBackend()
+    {
+        close();
+    }
+    
+    bool open(const TraceBackendConfig& iConfig) override;
+    
+    using TraceBackend::write;
+    
+    void write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp) override;
+    
+    void close() override;
+    
+    /**
+     * @return the number of statements dropped because the writer fell behind
+     */
+    uint64_t dropCount() const
+    {
+        return drops_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * @return the number of times a writing thread woke the writer thread
+     */
+    uint64_t wakeupCount() const
+    {
+        return wakeups_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * @return the statistics of the merge, all 0 with kBuffering_Shared
+     */
+    MergeStats mergeStats();
+    
+private:
+    
+    /// A pending statement, its message is stored in Queue::text
+    struct Entry
+    {
+        uint64_t timestamp;
+        uint64_t mask;
+        const void* site;
+        
+        /// See TraceThreadName, only set when the filter uses it
+        const char* threadName;
+        
+        /// Sequence number within its buffer, not set with kBuffering_Shared
+        uint64_t sequence;
+        
+        uint32_t length;
+    };
+    
+    /// Statements with their messages stored back to back
+    struct Queue
+    {
+        std::vector<Entry> entries;
+        std::vector<char> text;
+    };
+    
+    /// Buffer of a writing thread with kBuffering_Thread, or of a processor with kBuffering_Cpu
+    struct Producer
+    {
+        /// Guards pending and sequence, mostly contended by the writer taking pending
+        std::mutex mutex;
+        Queue pending;
+        uint64_t sequence{0};
+        
+        std::thread::id thread;
+        uint32_t index{0};
+        
+        /// Owned by the writer thread, statements taken from pending not merged yet
+        Queue held;
+        size_t next{0};
+        size_t nextText{0};
+    };
+    
+    void run();
+    
+    /**
+     * Waits for statements to be pending according to TraceThreadTuning::wakeup.
+     * May return early, the caller checks pending_ again.
+     */
+    void waitForStatements(std::unique_lock<std::mutex>& ioLock);
+    
+    /**
+     * Writer thread of kBuffering_Thread and kBuffering_Cpu.
+     */
+    void runMerge();
+    
+    /**
+     * Moves the statements of every producer to its held queue.
+     */
+    void collect(std::vector<Producer*>& oProducers);
+    
+    /**
+     * Writes the held statements older than iCutoff in time order.
+     */
+    void merge(const std::vector<Producer*>& iProducers, uint64_t iCutoff);
+    
+    /**
+     * @return the buffer of the calling thread, created on first use,
+     *         or of the processor it runs on
+     */
+    Producer* producer();
+    
+    /**
+     * Filters, coalesces and writes a single statement, on the writer thread
+     * or under mutex_ when there is none.
+     */
+    void emit(const Entry& iEntry, const char* iMessage);
+    
+    /**
+     * Formats and writes a single statement.
+     */
+    void output(uint64_t iTimestamp, const char* iMessage, size_t iLength);
+    
+    /**
+     * Writes what is buffered for the file.
+     */
+    void flushFile();
+    
+    /**
+     * @return true when writing to a file, with stdio or TraceFileWriter
+     */
+    bool hasFile() const
+    {
+#ifndef _WIN32
+        if (writer_)
+            return true;
+#endif
+        return file_ != nullptr;
+    }
+    
+    TraceBackendConfig config_;
+    FILE* file_{nullptr};
+    
+#ifndef _WIN32
+    /// Used instead of file_ when preallocating
+    std::unique_ptr<TraceFileWriter> writer_;
+#endif
+    
+    /// Guards pending_, stop_ and idle_
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    Queue pending_;
+    bool stop_{false};
+    
+    /// True while the writer waits for statements
+    bool idle_{false};
+    
+    /// Statements in pending_, read by the writer without mutex_ while it spins
+    std::atomic<size_t> queued_{0};
+    
+    std::atomic<uint64_t> wakeups_{0};
+    
+    /// Owned by the writer thread
+    Queue writing_;
+    std::string line_;
+    std::unique_ptr<TraceCoalescer> coalescer_;
+    
+    std::atomic<uint64_t> drops_{0};
+    
+    /// Identifies this opening of the backend in the per thread producer cache
+    uint64_t id_{0};
+    
+    /// Guards producers_, which only changes with kBuffering_Thread
+    std::mutex producersMutex_;
+    std::vector<std::unique_ptr<Producer>> producers_;
+    
+    /// Owned by the writer thread, copied to mergeStats_ under mutex_
+    MergeStats merging_;
+    MergeStats mergeStats_;
+    uint64_t lastMerged_{0};
+    
+    std::thread thread_;
+};
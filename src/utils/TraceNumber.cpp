@@ -0,0 +1,175 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceNumber.h"
+
+#include <math.h>
+#include <string.h>
+
+const int32_t TraceNumber::sMaxFixedPrecision;
+const size_t TraceNumber::sFixedBufferSize;
+
+namespace
+{
+    const char sDigitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    
+    const uint64_t sPowersOf10[] =
+    {
+          1ull
+        , 10ull
+        , 100ull
+        , 1000ull
+        , 10000ull
+        , 100000ull
+        , 1000000ull
+        , 10000000ull
+        , 100000000ull
+        , 1000000000ull
+        , 10000000000ull
+        , 100000000000ull
+        , 1000000000000ull
+        , 10000000000000ull
+        , 100000000000000ull
+        , 1000000000000000ull
+        , 10000000000000000ull
+        , 100000000000000000ull
+        , 1000000000000000000ull
+        , 10000000000000000000ull
+    };
+}
+
+char* TraceNumber::formatDecimal(uint64_t iValue, char* oEnd)
+{
+    char* first = oEnd;
+    
+    while (iValue >= 100)
+    {
+        const char* pair = sDigitPairs + ((iValue % 100) * 2);
+        iValue /= 100;
+        *--first = pair[1];
+        *--first = pair[0];
+    }
+    
+    if (iValue >= 10)
+    {
+        const char* pair = sDigitPairs + (iValue * 2);
+        *--first = pair[1];
+        *--first = pair[0];
+    }
+    else
+    {
+        *--first = static_cast<char>('0' + iValue);
+    }
+    
+    return first;
+}
+
+size_t TraceNumber::formatFixed(double iValue, int32_t iPrecision, bool iPoint, char* oBuffer)
+{
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 uint128;
+    
+    if (iPrecision < 0 || iPrecision > sMaxFixedPrecision || !isfinite(iValue))
+        return 0;
+    
+    // value = mantissa * 2^exponent exactly, with a 53-bit mantissa
+    //
+    int exponent = 0;
+    double fraction = frexp(fabs(iValue), &exponent);
+    uint64_t mantissa = static_cast<uint64_t>(ldexp(fraction, 53));
+    exponent -= 53;
+    
+    const uint64_t scale = sPowersOf10[iPrecision];
+    uint64_t integer = 0;
+    uint64_t decimals = 0;
+    
+    if (exponent >= 0)
+    {
+        // Whole numbers, as long as they fit in 64 bits
+        //
+        if (exponent > 64 - 53)
+            return 0;
+        
+        integer = mantissa << exponent;
+    }
+    else
+    {
+        // mantissa * 10^precision < 2^117, the shift keeps the exact remainder
+        //
+        uint128 scaled = static_cast<uint128>(mantissa) * scale;
+        uint128 quotient = 0;
+        const int shift = -exponent;
+        
+        if (shift < 128)
+        {
+            quotient = scaled >> shift;
+            
+            uint128 remainder = scaled - (quotient << shift);
+            uint128 half = static_cast<uint128>(1) << (shift - 1);
+            
+            if (remainder > half || (remainder == half && (quotient & 1)))
+                quotient++;
+        }
+        
+        integer = static_cast<uint64_t>(quotient / scale);
+        decimals = static_cast<uint64_t>(quotient % scale);
+    }
+    
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* first = formatDecimal(integer, end);
+    
+    size_t length = static_cast<size_t>(end - first);
+    memcpy(oBuffer, first, length);
+    
+    if (iPrecision || iPoint)
+        oBuffer[length++] = '.';
+    
+    if (iPrecision)
+    {
+        // Decimals with their leading zeros
+        //
+        first = formatDecimal(decimals, end);
+        size_t count = static_cast<size_t>(end - first);
+        
+        memset(oBuffer + length, '0', static_cast<size_t>(iPrecision) - count);
+        memcpy(oBuffer + length + (iPrecision - count), first, count);
+        length += static_cast<size_t>(iPrecision);
+    }
+    
+    return length;
+#else
+    (void)iValue;
+    (void)iPrecision;
+    (void)iPoint;
+    (void)oBuffer;
+    
+    return 0;
+#endif
+}
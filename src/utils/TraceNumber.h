@@ -0,0 +1,69 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+///
+/// \brief Locale independent number conversions used by TraceFormat.
+///
+/// formatDecimal converts two digits at a time from a lookup table.
+///
+/// formatFixed is the %.Nf conversion of printf without the C library:
+/// a double is an integer mantissa times a power of two, so for the values
+/// measurements and counters take it scales the mantissa by 10^N in 128-bit
+/// integers and rounds the exact remainder half to even, like glibc does.
+/// The digits are the same as printf, values it cannot convert exactly are
+/// left to the caller.
+///
+class TraceNumber
+{
+public:
+    
+    /// Largest precision formatFixed converts
+    static const int32_t sMaxFixedPrecision{19};
+    
+    /// Buffer size that holds any output of formatFixed
+    static const size_t sFixedBufferSize{64};
+    
+    /**
+     * Writes the decimal digits of a value, backwards from oEnd.
+     *
+     * @param[in] iValue the value
+     * @param[in] oEnd end of the buffer, at least 20 characters are available before it
+     *
+     * @return the first digit written, 0 writes "0"
+     */
+    static char* formatDecimal(uint64_t iValue, char* oEnd);
+    
+    /**
+     * Converts the magnitude of a value like %.Nf, without the sign.
+     *
+     * @param[in] iValue the value, its sign is ignored
+     * @param[in] iPrecision number of decimals, 0 to sMaxFixedPrecision
+     * @param[in] iPoint true to write the decimal point even without decimals, like %#.0f
+     * @param[out] oBuffer receives the digits, sFixedBufferSize characters, not null terminated
+     *
+     * @return the number of characters written, 0 when the value has to be converted by printf
+     */
+    static size_t formatFixed(double iValue, int32_t iPrecision, bool iPoint, char* oBuffer);
+};
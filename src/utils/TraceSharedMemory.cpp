@@ -0,0 +1,327 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceSharedMemory.h"
+
+#ifndef _WIN32
+
+#include <new>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace
+{
+    uint32_t roundUpToPowerOfTwo(uint32_t iValue)
+    {
+        uint32_t result = 1;
+        while (result < iValue)
+            result <<= 1;
+
+        return result;
+    }
+}
+
+bool TraceSharedMemorySink::create(const std::string& iName
+                                   , uint32_t iSlotSize
+                                   , uint32_t iSlotCount
+                                   )
+{
+    close();
+
+    slotSize_ = roundUpToPowerOfTwo(iSlotSize < 64 ? 64 : iSlotSize);
+    uint32_t slotCount = roundUpToPowerOfTwo(iSlotCount ? iSlotCount : 1);
+    slotMask_ = slotCount - 1;
+    size_ = sTraceSharedMemoryHeaderSize + (static_cast<size_t>(slotSize_) * slotCount);
+
+    // Start from a clean object so readers never see a stale ring
+    //
+    shm_unlink(iName.c_str());
+
+    int fd = shm_open(iName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+
+    if (ftruncate(fd, size_) != 0)
+    {
+        ::close(fd);
+        shm_unlink(iName.c_str());
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        shm_unlink(iName.c_str());
+        return false;
+    }
+
+    name_ = iName;
+    base_ = static_cast<uint8_t*>(mapping);
+
+    // ftruncate zero fills, which is also the initial state of the atomics
+    //
+    header_ = new (base_) TraceSharedMemoryHeader;
+    header_->version = sTraceSharedMemoryVersion;
+    header_->headerSize = sTraceSharedMemoryHeaderSize;
+    header_->slotSize = slotSize_;
+    header_->slotCount = slotCount;
+    header_->writeIndex.store(0, std::memory_order_relaxed);
+    header_->dropCount.store(0, std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < slotCount; i++)
+        new (&slot(i)->sequence) std::atomic<uint64_t>(0);
+
+    // Publish the ring
+    //
+    header_->magic.store(sTraceSharedMemoryMagic, std::memory_order_release);
+
+    return true;
+}
+
+void TraceSharedMemorySink::close()
+{
+    if (base_)
+    {
+        munmap(base_, size_);
+        shm_unlink(name_.c_str());
+    }
+
+    base_ = nullptr;
+    header_ = nullptr;
+    size_ = 0;
+    name_.clear();
+}
+
+void TraceSharedMemorySink::write(const TraceRecord& iRecord)
+{
+    if (!header_)
+        return;
+
+    uint64_t index = header_->writeIndex.fetch_add(1, std::memory_order_relaxed);
+    TraceSharedMemorySlot* target = slot(index);
+
+    // Claim the slot
+    // It can only be busy if a producer a full lap behind is still writing it,
+    // drop the statement rather than wait for it.
+    //
+    const uint64_t writing = (2 * index) + 1;
+    uint64_t current = target->sequence.load(std::memory_order_relaxed);
+
+    if ((current & 1) || current >= writing
+        || !target->sequence.compare_exchange_strong(current, writing, std::memory_order_acquire, std::memory_order_relaxed))
+    {
+        header_->dropCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Make sure the claim is visible before any of the payload
+    //
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint32_t capacity = slotSize_ - sTraceSharedMemorySlotMessageOffset - 1;
+    uint32_t length = iRecord.length;
+    uint32_t flags = 0;
+
+    if (length > capacity)
+    {
+        length = capacity;
+        flags |= sTraceSharedMemoryFlagTruncated;
+    }
+
+    target->timestamp = iRecord.timestamp;
+    target->mask = iRecord.mask;
+    target->threadId = iRecord.threadId;
+    target->length = length;
+    target->flags = flags;
+    memcpy(target->message, iRecord.message, length);
+    target->message[length] = 0;
+
+    // Publish the statement
+    //
+    target->sequence.store(writing + 1, std::memory_order_release);
+}
+
+bool TraceSharedMemoryReader::open(const std::string& iName, bool iFromOldest)
+{
+    close();
+
+    int fd = shm_open(iName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sTraceSharedMemoryHeaderSize)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    base_ = static_cast<const uint8_t*>(mapping);
+    header_ = reinterpret_cast<const TraceSharedMemoryHeader*>(base_);
+    size_ = size;
+
+    // Validate the layout before trusting any of the sizes
+    //
+    bool valid = header_->magic.load(std::memory_order_acquire) == sTraceSharedMemoryMagic
+                 && header_->version == sTraceSharedMemoryVersion
+                 && header_->headerSize >= sTraceSharedMemoryHeaderSize
+                 && header_->slotSize > sTraceSharedMemorySlotMessageOffset
+                 && (header_->slotSize & (header_->slotSize - 1)) == 0
+                 && header_->slotCount
+                 && (header_->slotCount & (header_->slotCount - 1)) == 0
+                 && header_->headerSize + (static_cast<size_t>(header_->slotSize) * header_->slotCount) <= size_;
+
+    if (!valid)
+    {
+        close();
+        return false;
+    }
+
+    slotSize_ = header_->slotSize;
+    slotCount_ = header_->slotCount;
+    slotMask_ = slotCount_ - 1;
+
+    uint64_t writeIndex = header_->writeIndex.load(std::memory_order_acquire);
+    readIndex_ = writeIndex;
+
+    if (iFromOldest)
+        readIndex_ = writeIndex > slotCount_ ? writeIndex - slotCount_ : 0;
+
+    lost_ = 0;
+    stalled_ = false;
+
+    return true;
+}
+
+void TraceSharedMemoryReader::close()
+{
+    if (base_)
+        munmap(const_cast<uint8_t*>(base_), size_);
+
+    base_ = nullptr;
+    header_ = nullptr;
+    size_ = 0;
+}
+
+TraceSharedMemoryReader::Result TraceSharedMemoryReader::next(TraceSharedMemoryRecord& oRecord)
+{
+    if (!header_)
+        return kResult_Closed;
+
+    while (true)
+    {
+        uint64_t writeIndex = header_->writeIndex.load(std::memory_order_acquire);
+
+        if (readIndex_ >= writeIndex)
+            return kResult_Empty;
+
+        // Skip anything the producers have already lapped
+        //
+        if (writeIndex - readIndex_ > slotCount_)
+        {
+            lost_ += (writeIndex - slotCount_) - readIndex_;
+            readIndex_ = writeIndex - slotCount_;
+            stalled_ = false;
+        }
+
+        const TraceSharedMemorySlot* source = slot(readIndex_);
+        const uint64_t complete = (2 * readIndex_) + 2;
+        uint64_t sequence = source->sequence.load(std::memory_order_acquire);
+
+        if (sequence == complete)
+        {
+            uint32_t capacity = slotSize_ - sTraceSharedMemorySlotMessageOffset - 1;
+
+            oRecord.sequence = sequence;
+            oRecord.timestamp = source->timestamp;
+            oRecord.mask = source->mask;
+            oRecord.threadId = source->threadId;
+            oRecord.length = source->length < capacity ? source->length : capacity;
+            oRecord.truncated = (source->flags & sTraceSharedMemoryFlagTruncated) != 0;
+            oRecord.message = source->message;
+
+            readIndex_++;
+            stalled_ = false;
+
+            if (!valid(oRecord))
+            {
+                lost_++;
+                continue;
+            }
+
+            return kResult_Record;
+        }
+
+        if (sequence > complete)
+        {
+            // Overwritten by a newer lap
+            //
+            lost_++;
+            readIndex_++;
+            stalled_ = false;
+            continue;
+        }
+
+        // The statement is still being written, or the producer dropped it.
+        // Give it a moment before moving on.
+        //
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!stalled_)
+        {
+            stalled_ = true;
+            stallStart_ = now;
+        }
+
+        if (now - stallStart_ < stallTimeout_)
+            return kResult_Empty;
+
+        lost_++;
+        readIndex_++;
+        stalled_ = false;
+    }
+}
+
+bool TraceSharedMemoryReader::valid(const TraceSharedMemoryRecord& iRecord) const
+{
+    if (!header_)
+        return false;
+
+    uint64_t index = (iRecord.sequence - 2) / 2;
+
+    // Order the reads of the statement before the second read of the sequence
+    //
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot(index)->sequence.load(std::memory_order_relaxed) == iRecord.sequence;
+}
+
+#endif // _WIN32
@@ -0,0 +1,359 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <stdint.h>
+
+#include "TraceSink.h"
+
+///
+/// \brief Shared memory transport for trace statements.
+///
+/// TraceSharedMemorySink writes every trace statement into a POSIX shared memory
+/// ring buffer. A viewer in another process on the same machine attaches with
+/// TraceSharedMemoryReader and reads the statements in place, without any file
+/// system access or parsing.
+///
+/// Producers never wait for the viewer. When the ring wraps the oldest
+/// statements are overwritten, a viewer that falls behind detects this and
+/// skips ahead.
+///
+/// Layout of the shared memory object, all values are little endian
+/// and all offsets are in bytes:
+///
+///       Header (sTraceSharedMemoryHeaderSize bytes)
+///           0   uint64  magic        sTraceSharedMemoryMagic, written last when the ring is ready
+///           8   uint32  version      sTraceSharedMemoryVersion
+///          12   uint32  headerSize   offset of the first slot
+///          16   uint32  slotSize     size of a slot, power of two
+///          20   uint32  slotCount    number of slots, power of two
+///          64   uint64  writeIndex   (atomic) index of the next slot to be claimed by a producer
+///          72   uint64  dropCount    (atomic) statements dropped because their slot was still being written
+///
+///       Slot n, at headerSize + (n * slotSize)
+///           0   uint64  sequence     (atomic) 0 when never written,
+///                                    2 * index + 1 while statement index is being written,
+///                                    2 * index + 2 once statement index is complete
+///           8   uint64  timestamp    nanoseconds since the epoch (UTC)
+///          16   uint64  mask         TraceMask of the statement
+///          24   uint64  threadId     identifier of the writing thread
+///          32   uint32  length       length of the message excluding the terminating character
+///          36   uint32  flags        sTraceSharedMemoryFlagTruncated when the message did not fit
+///          40   char[]  message      null terminated, up to slotSize - 40 bytes
+///
+/// Statement index i always lives in slot (i % slotCount).
+/// A reader validates a slot by checking the sequence before and after reading it,
+/// if the sequence changed the statement was overwritten while being read.
+///
+
+/// Identifies a trace shared memory object, "BBCTRACE" in ASCII
+static const uint64_t sTraceSharedMemoryMagic{0x4543415254434242ull};
+
+/// Version of the layout described above
+static const uint32_t sTraceSharedMemoryVersion{1};
+
+/// Size of the header, the first slot starts here
+static const uint32_t sTraceSharedMemoryHeaderSize{128};
+
+/// Slot flag set when the message was truncated to fit in the slot
+static const uint32_t sTraceSharedMemoryFlagTruncated{0x1};
+
+/// Default name of the shared memory object
+#define TRACE_SHARED_MEMORY_DEFAULT_NAME "/BBCTrace"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "TraceSharedMemory requires lock free 64-bit atomics!");
+
+/**
+ * Header of the shared memory object.
+ * See the layout description above.
+ */
+struct TraceSharedMemoryHeader
+{
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t slotSize;
+    uint32_t slotCount;
+    uint8_t reserved0[40];
+
+    /// Kept on its own cache line as every producer writes it
+    std::atomic<uint64_t> writeIndex;
+    std::atomic<uint64_t> dropCount;
+    uint8_t reserved1[48];
+};
+
+static_assert(sizeof(TraceSharedMemoryHeader) == sTraceSharedMemoryHeaderSize, "TraceSharedMemoryHeader does not match the documented layout!");
+
+/**
+ * Fixed part of a slot.
+ * See the layout description above.
+ */
+struct TraceSharedMemorySlot
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t timestamp;
+    uint64_t mask;
+    uint64_t threadId;
+    uint32_t length;
+    uint32_t flags;
+    char message[1];
+};
+
+/// Offset of the message within a slot
+static const uint32_t sTraceSharedMemorySlotMessageOffset{40};
+
+/**
+ * \brief TraceSink writing trace statements into a shared memory ring buffer.
+ *
+ * Create it and install it with Trace::addSink:
+ *
+ *       auto sink = std::make_shared<TraceSharedMemorySink>();
+ *       if (sink->create(TRACE_SHARED_MEMORY_DEFAULT_NAME))
+ *           Trace::instance().addSink(sink);
+ */
+class TraceSharedMemorySink : public TraceSink
+{
+public:
+
+    /// Default size of a slot, messages longer than this are truncated
+    static const uint32_t sDefaultSlotSize{512};
+
+    /// Default number of slots
+    static const uint32_t sDefaultSlotCount{4096};
+
+    TraceSharedMemorySink() {}
+
+    virtual ~TraceSharedMemorySink()
+    {
+        close();
+    }
+
+    /**
+     * Creates, or recreates, the shared memory object and initializes the ring.
+     *
+     * @param[in] iName name of the shared memory object, must start with a /
+     * @param[in] iSlotSize size of each slot in bytes, rounded up to a power of two, at least 64
+     * @param[in] iSlotCount number of slots, rounded up to a power of two
+     *
+     * @return true if the shared memory was created and mapped
+     */
+    bool create(const std::string& iName
+                , uint32_t iSlotSize = sDefaultSlotSize
+                , uint32_t iSlotCount = sDefaultSlotCount
+                );
+
+    /**
+     * Unmaps and removes the shared memory object.
+     * Readers that are still attached keep their mapping.
+     */
+    void close();
+
+    /**
+     * Writes a statement into the next slot of the ring.
+     * Never blocks, the statement is dropped if its slot is still being written.
+     *
+     * @param[in] iRecord the statement to be written
+     */
+    void write(const TraceRecord& iRecord) override;
+
+    /**
+     * @return the number of statements dropped because their slot was busy
+     */
+    uint64_t dropCount() const
+    {
+        return header_ ? header_->dropCount.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+
+    TraceSharedMemorySlot* slot(uint64_t iIndex) const
+    {
+        return reinterpret_cast<TraceSharedMemorySlot*>(base_ + sTraceSharedMemoryHeaderSize + ((iIndex & slotMask_) * slotSize_));
+    }
+
+    /// Name of the shared memory object
+    std::string name_;
+
+    /// Start of the mapping
+    uint8_t* base_{nullptr};
+
+    /// Header at the start of the mapping
+    TraceSharedMemoryHeader* header_{nullptr};
+
+    /// Size of the mapping in bytes
+    size_t size_{0};
+
+    uint32_t slotSize_{0};
+    uint64_t slotMask_{0};
+};
+
+/**
+ * \brief A trace statement read from shared memory.
+ *
+ * The message points directly into the shared memory.
+ * It may be overwritten by a producer at any time,
+ * use TraceSharedMemoryReader::valid once done with it.
+ */
+struct TraceSharedMemoryRecord
+{
+    uint64_t sequence{0};
+    uint64_t timestamp{0};
+    uint64_t mask{0};
+    uint64_t threadId{0};
+    const char* message{nullptr};
+    uint32_t length{0};
+    bool truncated{false};
+};
+
+/**
+ * \brief Reference consumer for the shared memory written by TraceSharedMemorySink.
+ *
+ * Example:
+ *
+ *       TraceSharedMemoryReader reader;
+ *       reader.open(TRACE_SHARED_MEMORY_DEFAULT_NAME);
+ *
+ *       TraceSharedMemoryRecord record;
+ *       while (reader.next(record) == TraceSharedMemoryReader::kResult_Record)
+ *       {
+ *           std::string message(record.message, record.length);
+ *           if (reader.valid(record))
+ *               std::cout << message << std::endl;
+ *       }
+ */
+class TraceSharedMemoryReader
+{
+public:
+
+    enum Result
+    {
+          kResult_Record    ///< A statement was read
+        , kResult_Empty     ///< No statement is ready yet
+        , kResult_Closed    ///< The reader is not attached
+    };
+
+    TraceSharedMemoryReader() {}
+
+    ~TraceSharedMemoryReader()
+    {
+        close();
+    }
+
+    /**
+     * Attaches to the shared memory object.
+     *
+     * @param[in] iName name of the shared memory object
+     * @param[in] iFromOldest true to start with the oldest statement still in the ring,
+     *            false to only read statements written from now on
+     *
+     * @return true if attached to a valid trace ring
+     */
+    bool open(const std::string& iName, bool iFromOldest = false);
+
+    /**
+     * Detaches from the shared memory object.
+     */
+    void close();
+
+    /**
+     * Reads the next statement.
+     *
+     * @param[out] oRecord receives the statement, pointing into the shared memory
+     *
+     * @return kResult_Record when oRecord was filled in
+     */
+    Result next(TraceSharedMemoryRecord& oRecord);
+
+    /**
+     * Checks that a statement was not overwritten while it was being used.
+     *
+     * @param[in] iRecord a statement returned by next
+     *
+     * @return true if everything read from iRecord is intact
+     */
+    bool valid(const TraceSharedMemoryRecord& iRecord) const;
+
+    /**
+     * @return the number of statements skipped because they were overwritten
+     *         before they could be read, or were never completed
+     */
+    uint64_t lostCount() const
+    {
+        return lost_;
+    }
+
+    /**
+     * @return the number of statements the producers dropped
+     */
+    uint64_t dropCount() const
+    {
+        return header_ ? header_->dropCount.load(std::memory_order_relaxed) : 0;
+    }
+
+    /**
+     * Time to wait for a claimed slot to be completed before it is skipped.
+     * A producer may have been preempted or the statement dropped.
+     */
+    void setStallTimeout(std::chrono::microseconds iTimeout)
+    {
+        stallTimeout_ = iTimeout;
+    }
+
+private:
+
+    const TraceSharedMemorySlot* slot(uint64_t iIndex) const
+    {
+        return reinterpret_cast<const TraceSharedMemorySlot*>(base_ + header_->headerSize + ((iIndex & slotMask_) * slotSize_));
+    }
+
+    /// Start of the mapping
+    const uint8_t* base_{nullptr};
+
+    /// Header at the start of the mapping
+    const TraceSharedMemoryHeader* header_{nullptr};
+
+    /// Size of the mapping in bytes
+    size_t size_{0};
+
+    uint32_t slotSize_{0};
+    uint64_t slotCount_{0};
+    uint64_t slotMask_{0};
+
+    /// Index of the next statement to read
+    uint64_t readIndex_{0};
+
+    /// Statements skipped
+    uint64_t lost_{0};
+
+    /// See setStallTimeout
+    std::chrono::microseconds stallTimeout_{10000};
+
+    /// When the reader started waiting on readIndex_
+    bool stalled_{false};
+    std::chrono::steady_clock::time_point stallStart_;
+};
+
+#endif // _WIN32
@@ -0,0 +1,109 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * \brief A single formatted trace statement handed to a TraceSink.
+ *
+ * The message is only valid for the duration of the TraceSink::write call.
+ * Sinks that keep the message around must copy it.
+ */
+struct TraceRecord
+{
+    /// TraceMask (category and priority) of the statement
+    uint64_t mask{0};
+
+    /// Time the statement was written, nanoseconds since the epoch (UTC)
+    uint64_t timestamp{0};
+
+    /// Identifier of the thread that wrote the statement
+    uint64_t threadId{0};
+
+    /// Call site of the statement, the address of its format string.
+    /// nullptr when the statement has no format string.
+    const void* site{nullptr};
+
+    /// Formatted message, null terminated
+    const char* message{nullptr};
+
+    /// Length of the message excluding the terminating character
+    uint32_t length{0};
+};
+
+/**
+ * \brief Interface for additional outputs of Trace.
+ *
+ * Sinks are installed with Trace::addSink and receive every statement
+ * that passes the trace masks, in addition to the client callback or
+ * the external logger.
+ *
+ * Note - write is called on the thread that wrote the statement,
+ *        possibly from many threads at once.
+ *        Implementations must be thread safe and must not block.
+ */
+class TraceSink
+{
+public:
+
+    virtual ~TraceSink() {}
+
+    /**
+     * Writes a statement to the sink.
+     *
+     * @param[in] iRecord the statement to be written
+     */
+    virtual void write(const TraceRecord& iRecord) = 0;
+
+    /**
+     * Flushes anything buffered by the sink.
+     */
+    virtual void flush() {}
+};
+
+/**
+ * \brief TraceSink handing the message of every statement to a client callback.
+ *
+ * Installed by Trace::subscribe. The message has no timestamp prefix,
+ * the callback is called on the thread that wrote the statement.
+ */
+class TraceCallbackSink : public TraceSink
+{
+public:
+    
+    /// Same signature as Trace::TraceCallback
+    typedef void (*Callback)(const char* iMessage);
+    
+    explicit TraceCallbackSink(Callback iCallback)
+    : callback_(iCallback)
+    {
+    }
+    
+    void write(const TraceRecord& iRecord) override
+    {
+        callback_(iRecord.message);
+    }
+    
+private:
+    
+    Callback callback_;
+};
@@ -0,0 +1,113 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceSinkRegistry.h"
+
+#include <algorithm>
+
+const size_t TraceSinkRegistry::sReaderStripes;
+
+TraceSinkRegistry::TraceSinkRegistry()
+: current_(new List())
+{
+}
+
+TraceSinkRegistry::~TraceSinkRegistry()
+{
+    delete current_.load(std::memory_order_relaxed);
+}
+
+bool TraceSinkRegistry::add(const std::shared_ptr<TraceSink>& iSink)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    const List* current = current_.load(std::memory_order_relaxed);
+    if (!iSink || std::find(current->begin(), current->end(), iSink) != current->end())
+        return false;
+    
+    List* list = new List(*current);
+    list->push_back(iSink);
+    publish(list);
+    
+    return true;
+}
+
+bool TraceSinkRegistry::remove(const std::shared_ptr<TraceSink>& iSink)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    const List* current = current_.load(std::memory_order_relaxed);
+    if (std::find(current->begin(), current->end(), iSink) == current->end())
+        return false;
+    
+    List* list = new List(*current);
+    list->erase(std::remove(list->begin(), list->end(), iSink), list->end());
+    publish(list);
+    
+    return true;
+}
+
+TraceSinkRegistry::List TraceSinkRegistry::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    List removed = *current_.load(std::memory_order_relaxed);
+    if (!removed.empty())
+        publish(new List());
+    
+    return removed;
+}
+
+void TraceSinkRegistry::publish(List* iList)
+{
+    const List* previous = current_.exchange(iList, std::memory_order_seq_cst);
+    count_.store(iList->size(), std::memory_order_relaxed);
+    
+    waitForGracePeriod();
+    
+    delete previous;
+}
+
+void TraceSinkRegistry::synchronize()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    waitForGracePeriod();
+}
+
+void TraceSinkRegistry::waitForGracePeriod()
+{
+    // A reader that read the epoch before the previous change may have
+    // counted itself in the other parity after that change was waited for
+    //
+    const uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+    waitForReaders((epoch + 1) & 1);
+    
+    epoch_.store(epoch + 1, std::memory_order_seq_cst);
+    waitForReaders(epoch & 1);
+}
+
+void TraceSinkRegistry::waitForReaders(uint64_t iIndex) const
+{
+    for (const Stripe& stripe : readers_[iIndex])
+    {
+        while (stripe.count.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,206 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <functional>
+
+#include "TraceSink.h"
+
+///
+/// \brief The sinks of a Trace, changed from any thread while statements are written.
+///
+/// Writers of statements iterate the sinks in a read-side critical section that
+/// never blocks: it bumps a reader counter of the current epoch, reads the
+/// published list, and drops the counter again. The counters are striped over
+/// sReaderStripes cache lines so the writing threads do not share one.
+///
+/// Adding or removing a sink publishes a new copy of the list, advances the epoch
+/// and waits until no reader of the previous epoch is left before deleting the
+/// old list. As in SRCU, the readers left over from the epoch before are waited
+/// for first, so a reader that raced with the previous change is never missed.
+/// Changes are serialized and only the thread making them waits.
+///
+/// Trace also reads its other outputs within a Reader, and retires them
+/// with synchronize, so they are never destroyed while a statement is written.
+///
+/// Note - add, remove and clear must not be called from within TraceSink::write,
+///        they would wait for themselves.
+///
+class TraceSinkRegistry
+{
+public:
+    
+    typedef std::vector<std::shared_ptr<TraceSink>> List;
+    
+    /// Reader counters per epoch
+    static const size_t sReaderStripes{64};
+    
+    TraceSinkRegistry();
+    
+    ~TraceSinkRegistry();
+    
+    /**
+     * Adds a sink, unless it is already there.
+     *
+     * @param[in] iSink the sink to add
+     *
+     * @return true if added
+     */
+    bool add(const std::shared_ptr<TraceSink>& iSink);
+    
+    /**
+     * Removes a sink. Once this returns no thread is writing to it anymore.
+     *
+     * @param[in] iSink the sink to remove
+     *
+     * @return true if removed
+     */
+    bool remove(const std::shared_ptr<TraceSink>& iSink);
+    
+    /**
+     * Removes all of the sinks.
+     *
+     * @return the sinks removed
+     */
+    List clear();
+    
+    /**
+     * @return true when there are no sinks, without entering a critical section
+     */
+    bool empty() const
+    {
+        return count_.load(std::memory_order_relaxed) == 0;
+    }
+    
+    /**
+     * Calls iFunction with every sink, within a read-side critical section.
+     *
+     * @param[in] iFunction called as iFunction(TraceSink&)
+     */
+    template <typename Function>
+    void forEach(Function&& iFunction) const
+    {
+        Reader reader(*this);
+        
+        forEach(reader, iFunction);
+    }
+    
+    class Reader;
+    
+    /**
+     * Calls iFunction with every sink, within a read-side critical section already entered.
+     *
+     * @param[in] iReader the critical section, of this registry
+     * @param[in] iFunction called as iFunction(TraceSink&)
+     */
+    template <typename Function>
+    void forEach(const Reader& iReader, Function&& iFunction) const
+    {
+        (void)iReader;
+        
+        for (const auto& sink : *current_.load(std::memory_order_seq_cst))
+            iFunction(*sink);
+    }
+    
+    /**
+     * Waits for a grace period: once this returns, every read-side critical
+     * section entered before the call has been left.
+     */
+    void synchronize();
+    
+private:
+    
+    /// Reader counter on a cache line of its own
+    struct Stripe
+    {
+        std::atomic<uint64_t> count{0};
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    
+public:
+    
+    /// Read-side critical section, never blocks
+    class Reader
+    {
+    public:
+        
+        explicit Reader(const TraceSinkRegistry& iRegistry)
+        : stripe_(iRegistry.readers_[iRegistry.epoch_.load(std::memory_order_seq_cst) & 1][stripeIndex()])
+        {
+            stripe_.count.fetch_add(1, std::memory_order_seq_cst);
+        }
+        
+        ~Reader()
+        {
+            stripe_.count.fetch_sub(1, std::memory_order_release);
+        }
+        
+    private:
+        
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        
+        Stripe& stripe_;
+    };
+    
+private:
+    
+    /**
+     * @return the reader counter of the calling thread within an epoch
+     */
+    static size_t stripeIndex()
+    {
+        static thread_local size_t sStripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % sReaderStripes;
+        return sStripe;
+    }
+    
+    /**
+     * Publishes iList and deletes the previous list once no reader uses it.
+     * Called under mutex_.
+     */
+    void publish(List* iList);
+    
+    /**
+     * Waits for a grace period, see synchronize. Called under mutex_.
+     */
+    void waitForGracePeriod();
+    
+    /**
+     * Waits until the readers counted by the epochs with parity iIndex are gone.
+     */
+    void waitForReaders(uint64_t iIndex) const;
+    
+    /// Mutable so readers can count themselves in a const registry
+    mutable Stripe readers_[2][sReaderStripes];
+    
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<const List*> current_;
+    std::atomic<size_t> count_{0};
+    
+    /// Serializes the changes
+    std::mutex mutex_;
+};
@@ -0,0 +1,283 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceSpdlogBackend.h"
+
+#ifdef BBC_USE_SPDLOG
+
+#include "TraceCoalescer.h"
+
+#include <iostream>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/basic_file_sink.h"
+#include "spdlog/async.h"
+
+/*
+ spdlog sink used for writing to the clients callback
+ on the spdlog log writting thread.
+ Note that the callback installed by the client installed will be called
+ on the spdlog write thread thread.
+ */
+template<typename Mutex>
+class client_callback_sink final : public spdlog::sinks::base_sink<Mutex>
+{
+public:
+    explicit client_callback_sink(TraceBackendCallback iCallback);
+    
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override;
+    void flush_() override;
+    
+private:
+    TraceBackendCallback callback_;
+};
+
+template<typename Mutex>
+SPDLOG_INLINE client_callback_sink<Mutex>::client_callback_sink(TraceBackendCallback iCallback)
+: callback_(iCallback)
+{
+}
+
+template<typename Mutex>
+SPDLOG_INLINE void client_callback_sink<Mutex>::sink_it_(const spdlog::details::log_msg &msg)
+{
+    spdlog::memory_buf_t formatted;
+    spdlog::sinks::base_sink<Mutex>::formatter_->format(msg, formatted);
+    
+    if (callback_)
+    {
+        callback_(fmt::to_string(formatted).c_str());
+    }
+}
+
+template<typename Mutex>
+SPDLOG_INLINE void client_callback_sink<Mutex>::flush_()
+{
+}
+
+/*
+ spdlog sink coalescing duplicate trace statements, see TraceCoalescer.
+ Statements that are not coalesced, and the summaries, are written to the wrapped sink.
+ */
+template<typename Mutex>
+class coalescing_sink final : public spdlog::sinks::base_sink<Mutex>
+{
+public:
+    coalescing_sink(std::shared_ptr<spdlog::sinks::sink> iSink, uint64_t iWindow)
+    : sink_(std::move(iSink))
+    , coalescer_(iWindow)
+    {
+    }
+    
+    ~coalescing_sink()
+    {
+        std::lock_guard<Mutex> lock(spdlog::sinks::base_sink<Mutex>::mutex_);
+        coalescer_.flush([this](const void* iSite, const std::string& iSummary) { emit(iSite, iSummary); });
+        sink_->flush();
+    }
+    
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override
+    {
+        uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch()).count();
+        
+        if (coalescer_.process(msg.source.filename, msg.payload.data(), msg.payload.size(), timestamp, [this](const void* iSite, const std::string& iSummary) { emit(iSite, iSummary); }))
+            sink_->log(msg);
+    }
+    
+    void flush_() override
+    {
+        sink_->flush();
+    }
+    
+    void set_pattern_(const std::string &pattern) override
+    {
+        sink_->set_pattern(pattern);
+    }
+    
+    void set_formatter_(std::unique_ptr<spdlog::formatter> sink_formatter) override
+    {
+        sink_->set_formatter(std::move(sink_formatter));
+    }
+    
+private:
+    void emit(const void* iSite, const std::string& iSummary)
+    {
+        spdlog::details::log_msg summary(spdlog::source_loc{static_cast<const char*>(iSite), 0, nullptr}, spdlog::string_view_t(), spdlog::level::critical, spdlog::string_view_t(iSummary));
+        sink_->log(summary);
+    }
+    
+    std::shared_ptr<spdlog::sinks::sink> sink_;
+    TraceCoalescer coalescer_;
+};
+
+/*
+ spdlog sink dropping the statements rejected by a TraceContentFilter,
+ on the spdlog writing thread. The category travels in the source line
+ and the thread name in the source function, see TraceSpdlogBackend::write.
+ */
+template<typename Mutex>
+class filtering_sink final : public spdlog::sinks::base_sink<Mutex>
+{
+public:
+    filtering_sink(std::shared_ptr<spdlog::sinks::sink> iSink, std::shared_ptr<const TraceContentFilter> iFilter)
+    : sink_(std::move(iSink))
+    , filter_(std::move(iFilter))
+    {
+    }
+    
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override
+    {
+        uint64_t category = static_cast<uint32_t>(msg.source.line);
+        if (category == UINT32_MAX)
+            category = sCategoryBits;
+        
+        if (filter_->pass(category, msg.source.funcname, msg.payload.data(), msg.payload.size()))
+            sink_->log(msg);
+    }
+    
+    void flush_() override
+    {
+        sink_->flush();
+    }
+    
+    void set_pattern_(const std::string &pattern) override
+    {
+        sink_->set_pattern(pattern);
+    }
+    
+    void set_formatter_(std::unique_ptr<spdlog::formatter> sink_formatter) override
+    {
+        sink_->set_formatter(std::move(sink_formatter));
+    }
+    
+private:
+    static const uint64_t sCategoryBits{0x0FFFFFFFFFFFFFFFull};
+    
+    std::shared_ptr<spdlog::sinks::sink> sink_;
+    std::shared_ptr<const TraceContentFilter> filter_;
+};
+
+bool TraceSpdlogBackend::open(const TraceBackendConfig& iConfig)
+{
+    close();
+    
+    std::string logFile = iConfig.logFilePath;
+    
+    if (iConfig.logFilePath.length() == 0)
+        logFile = "default.log";
+    
+    std::shared_ptr<spdlog::sinks::sink> sink;
+    
+    try
+    {
+        if (iConfig.coalesceWindow)
+        {
+            // The coalescer sits between the async queue and the output
+            //
+            std::shared_ptr<spdlog::sinks::sink> output;
+            
+            if (iConfig.callback)
+                output = std::make_shared<client_callback_sink<spdlog::details::null_mutex>>(iConfig.callback);
+            else
+                output = std::make_shared<spdlog::sinks::basic_file_sink_st>(logFile);
+            
+            sink = std::make_shared<coalescing_sink<std::mutex>>(output, iConfig.coalesceWindow);
+        }
+        else if (iConfig.callback)
+        {
+            sink = std::make_shared<client_callback_sink<std::mutex>>(iConfig.callback);
+        }
+        else
+        {
+            sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(logFile);
+        }
+    }
+    catch (const spdlog::spdlog_ex& iException)
+    {
+        std::cerr << "Failed to create spdlog sink: " << iException.what() << std::endl;
+        return false;
+    }
+    
+    // The filter runs before the coalescer so dropped statements are never counted
+    //
+    if (iConfig.filter)
+        sink = std::make_shared<filtering_sink<std::mutex>>(sink, iConfig.filter);
+    
+    filter_ = iConfig.filter;
+    
+    // The queue wakes its thread for every statement, only the thread settings apply
+    //
+    if (iConfig.consumer.wakeup != TraceThreadTuning::kWakeup_Notify)
+        std::cerr << "Trace consumer wakeups are not supported by the spdlog backend, waking for every statement" << std::endl;
+    
+    TraceThreadTuning consumer = iConfig.consumer;
+    threadPool_ = std::make_shared<spdlog::details::thread_pool>(32768, 1, [consumer]() { consumer.apply(); }); // queue with max 32k items 1 backing thread.
+    logger_ = std::make_shared<spdlog::async_logger>("async_logger", sink, threadPool_, spdlog::async_overflow_policy::overrun_oldest);
+    
+    logger_->set_pattern(iConfig.preciseTimestamps ? "[%Y-%m-%dT%H:%M:%S.%FZ] %v" : "[%H:%M:%S.%eZ] %v", spdlog::pattern_time_type::utc);
+    logger_->flush_on(spdlog::level::critical);
+    
+    return true;
+}
+
+void TraceSpdlogBackend::write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp)
+{
+    // The call site travels to the writing thread in the source location.
+    // The message is passed as is, it is not a format string.
+    //
+    // With a filter the category and the thread name travel with it too
+    //
+    int line = 0;
+    const char* threadName = nullptr;
+    
+    if (filter_)
+    {
+        line = static_cast<int>(static_cast<uint32_t>(iMask & 0x0FFFFFFFFFFFFFFFull));
+        threadName = filter_->usesThreadNames() ? TraceThreadName::get() : nullptr;
+    }
+    
+    const spdlog::source_loc site{static_cast<const char*>(iSite), line, threadName};
+    
+    if (iTimestamp != sNow)
+    {
+        const spdlog::log_clock::time_point time(std::chrono::duration_cast<spdlog::log_clock::duration>(std::chrono::nanoseconds(iTimestamp)));
+        logger_->log(time, site, spdlog::level::critical, spdlog::string_view_t(iMessage));
+    }
+    else
+    {
+        logger_->log(site, spdlog::level::critical, spdlog::string_view_t(iMessage));
+    }
+}
+
+void TraceSpdlogBackend::close()
+{
+    // Destroying the thread pool drains the queue,
+    // releasing the logger afterwards lets the sinks write what they still hold
+    //
+    std::shared_ptr<spdlog::logger> logger = std::move(logger_);
+    threadPool_.reset();
+    logger.reset();
+    filter_.reset();
+}
+
+#endif // BBC_USE_SPDLOG
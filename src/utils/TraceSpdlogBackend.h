@@ -0,0 +1,72 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifdef BBC_USE_SPDLOG
+
+#include <memory>
+
+#include "TraceBackend.h"
+
+namespace spdlog
+{
+    class logger;
+    
+    namespace details
+    {
+        class thread_pool;
+    }
+}
+
+///
+/// \brief Backend writing to an spdlog asynchronous logger.
+///
+/// The logger owns its thread pool, a queue of 32k statements with a single
+/// writing thread, and overwrites the oldest statements when the queue is full.
+/// The writing thread applies the affinity and scheduling of TraceBackendConfig::consumer.
+///
+class TraceSpdlogBackend : public TraceBackend
+{
+public:
+    
+    TraceSpdlogBackend() {}
+    
+    virtual ~TraceSpdlogBackend()
+    {
+        close();
+    }
+    
+    bool open(const TraceBackendConfig& iConfig) override;
+    
+    using TraceBackend::write;
+    
+    void write(uint64_t iMask, const void* iSite, const char* iMessage, uint64_t iTimestamp) override;
+    
+    void close() override;
+    
+private:
+    
+    std::shared_ptr<spdlog::details::thread_pool> threadPool_;
+    std::shared_ptr<spdlog::logger> logger_;
+    std::shared_ptr<const TraceContentFilter> filter_;
+};
+
+#endif // BBC_USE_SPDLOG
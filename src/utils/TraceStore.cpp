@@ -0,0 +1,276 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceStore.h"
+
+#include <algorithm>
+#include <string.h>
+
+const size_t TraceStore::sTextPercent;
+const size_t TraceStore::sBytesPerRecord;
+
+namespace
+{
+    const uint64_t sCategoryBits{0x0FFFFFFFFFFFFFFFull};
+    const uint64_t sPriorityShift{60};
+    const uint64_t sPriorityCount{16};
+}
+
+TraceStore::TraceStore(size_t iBytes)
+{
+    size_t textBytes = std::max<size_t>(iBytes / 100 * sTextPercent, 4096);
+    
+    capacity_ = std::max<size_t>((iBytes - std::min(iBytes, textBytes)) / sBytesPerRecord, 64);
+    
+    timestamps_.resize(capacity_);
+    masks_.resize(capacity_);
+    threadIds_.resize(capacity_);
+    textStarts_.resize(capacity_);
+    textLengths_.resize(capacity_);
+    text_.resize(textBytes);
+}
+
+void TraceStore::write(const TraceRecord& iRecord)
+{
+    const uint64_t textSize = text_.size();
+    uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(iRecord.length, textSize));
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Make room in both rings
+    //
+    if (next_ - first_ == capacity_)
+        evict();
+    
+    while (first_ != next_ && textStarts_[slot(first_)] + textSize < textEnd_ + length)
+        evict();
+    
+    // The indexes rely on the timestamps being in order, statements from other
+    // threads may have been stamped a little earlier than the last one stored.
+    //
+    uint64_t timestamp = std::max(iRecord.timestamp, lastTimestamp_);
+    lastTimestamp_ = timestamp;
+    
+    const size_t target = slot(next_);
+    timestamps_[target] = timestamp;
+    masks_[target] = iRecord.mask;
+    threadIds_[target] = iRecord.threadId;
+    textStarts_[target] = textEnd_;
+    textLengths_[target] = length;
+    
+    size_t offset = static_cast<size_t>(textEnd_ % textSize);
+    size_t head = std::min<size_t>(length, textSize - offset);
+    memcpy(&text_[offset], iRecord.message, head);
+    memcpy(&text_[0], iRecord.message + head, length - head);
+    textEnd_ += length;
+    
+    categories_[iRecord.mask & sCategoryBits].push_back(next_);
+    priorities_[iRecord.mask >> sPriorityShift].push_back(next_);
+    threads_[iRecord.threadId].push_back(next_);
+    
+    next_++;
+}
+
+void TraceStore::evict()
+{
+    const size_t oldest = slot(first_);
+    
+    popIndex(categories_, masks_[oldest] & sCategoryBits);
+    popIndex(priorities_, masks_[oldest] >> sPriorityShift);
+    popIndex(threads_, threadIds_[oldest]);
+    
+    first_++;
+}
+
+void TraceStore::popIndex(std::unordered_map<uint64_t, Index>& ioIndexes, uint64_t iKey)
+{
+    auto it = ioIndexes.find(iKey);
+    if (it == ioIndexes.end())
+        return;
+    
+    it->second.pop_front();
+    
+    // Thread identifiers come and go, do not keep their empty indexes around
+    //
+    if (it->second.empty())
+        ioIndexes.erase(it);
+}
+
+size_t TraceStore::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<size_t>(next_ - first_);
+}
+
+const TraceStore::Index* TraceStore::selectIndex(const TraceStoreQuery& iQuery) const
+{
+    static const Index sEmpty;
+    const Index* result = nullptr;
+    
+    auto consider = [&result](const std::unordered_map<uint64_t, Index>& iIndexes, uint64_t iKey)
+    {
+        auto it = iIndexes.find(iKey);
+        const Index* index = it == iIndexes.end() ? &sEmpty : &it->second;
+        
+        if (!result || index->size() < result->size())
+            result = index;
+    };
+    
+    if ((iQuery.mask & sCategoryBits) != sCategoryBits)
+        consider(categories_, iQuery.mask & sCategoryBits);
+    
+    if (iQuery.filterThread)
+        consider(threads_, iQuery.threadId);
+    
+    // A minimum priority matches several priorities, only use their index
+    // when a single one of them has statements
+    //
+    uint64_t minimum = iQuery.mask >> sPriorityShift;
+    if (minimum)
+    {
+        size_t used = 0;
+        uint64_t key = 0;
+        
+        for (uint64_t priority = minimum; priority < sPriorityCount; priority++)
+        {
+            if (priorities_.count(priority))
+            {
+                used++;
+                key = priority;
+            }
+        }
+        
+        if (used <= 1)
+            consider(priorities_, key);
+    }
+    
+    return result;
+}
+
+bool TraceStore::matches(const TraceStoreQuery& iQuery, uint64_t iSequence) const
+{
+    const size_t source = slot(iSequence);
+    const uint64_t mask = masks_[source];
+    
+    if ((iQuery.mask & sCategoryBits) != sCategoryBits && (mask & sCategoryBits) != (iQuery.mask & sCategoryBits))
+        return false;
+    
+    if ((mask >> sPriorityShift) < (iQuery.mask >> sPriorityShift))
+        return false;
+    
+    return !iQuery.filterThread || threadIds_[source] == iQuery.threadId;
+}
+
+size_t TraceStore::query(const TraceStoreQuery& iQuery, std::vector<TraceStoreRecord>& oRecords) const
+{
+    // A statement found, its message is at offset in text
+    //
+    struct Found
+    {
+        uint64_t mask;
+        uint64_t timestamp;
+        uint64_t threadId;
+        uint64_t textStart;
+        uint32_t length;
+        size_t offset;
+    };
+    
+    std::vector<Found> found;
+    found.reserve(std::min<size_t>(iQuery.limit, 1024));
+    
+    std::vector<char> text;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        if (iQuery.limit && iQuery.from <= iQuery.to)
+        {
+            // Walk either an index or every stored statement, newest first
+            //
+            const Index* index = selectIndex(iQuery);
+            const size_t count = index ? index->size() : static_cast<size_t>(next_ - first_);
+            
+            auto sequence = [this, index](size_t iPosition)
+            {
+                return index ? (*index)[iPosition] : first_ + iPosition;
+            };
+            
+            // First position past the end of the range
+            //
+            size_t low = 0;
+            size_t high = count;
+            while (low < high)
+            {
+                size_t middle = low + ((high - low) / 2);
+                if (timestamps_[slot(sequence(middle))] <= iQuery.to)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            
+            size_t textLength = 0;
+            
+            for (size_t position = low; position-- > 0 && found.size() < iQuery.limit; )
+            {
+                uint64_t current = sequence(position);
+                const size_t source = slot(current);
+                
+                if (timestamps_[source] < iQuery.from)
+                    break;
+                
+                if (matches(iQuery, current))
+                {
+                    found.push_back(Found{masks_[source], timestamps_[source], threadIds_[source], textStarts_[source], textLengths_[source], textLength});
+                    textLength += textLengths_[source];
+                }
+            }
+            
+            // The byte ring is reused once the mutex is released, take the messages along
+            //
+            text.resize(textLength);
+            
+            const uint64_t textSize = text_.size();
+            for (const Found& statement : found)
+            {
+                size_t offset = static_cast<size_t>(statement.textStart % textSize);
+                size_t head = std::min<size_t>(statement.length, textSize - offset);
+                
+                memcpy(text.data() + statement.offset, text_.data() + offset, head);
+                memcpy(text.data() + statement.offset + head, text_.data(), statement.length - head);
+            }
+        }
+    }
+    
+    // Build the results, oldest first
+    //
+    oRecords.resize(found.size());
+    
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        const Found& statement = found[found.size() - 1 - i];
+        TraceStoreRecord& target = oRecords[i];
+        
+        target.mask = statement.mask;
+        target.timestamp = statement.timestamp;
+        target.threadId = statement.threadId;
+        target.message.assign(text.data() + statement.offset, statement.length);
+    }
+    
+    return found.size();
+}
@@ -0,0 +1,187 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "TraceSink.h"
+
+/**
+ * \brief A trace statement returned by TraceStore::query.
+ */
+struct TraceStoreRecord
+{
+    /// TraceMask (category and priority) of the statement
+    uint64_t mask{0};
+    
+    /// Time the statement was written, nanoseconds since the epoch (UTC)
+    uint64_t timestamp{0};
+    
+    /// Identifier of the thread that wrote the statement
+    uint64_t threadId{0};
+    
+    /// Formatted message
+    std::string message;
+};
+
+/**
+ * \brief Selects the statements returned by TraceStore::query.
+ */
+struct TraceStoreQuery
+{
+    /// Oldest timestamp, inclusive
+    uint64_t from{0};
+    
+    /// Newest timestamp, inclusive
+    uint64_t to{UINT64_MAX};
+    
+    /// Category in the low 60 bits, kCategory_Always for any category.
+    /// Minimum priority in the top 4 bits, kPriority_Off for any priority.
+    uint64_t mask{0x0FFFFFFFFFFFFFFFull};
+    
+    /// Only statements of this thread when set
+    bool filterThread{false};
+    uint64_t threadId{0};
+    
+    /// Maximum number of statements returned, the most recent ones are kept
+    size_t limit{1000};
+};
+
+///
+/// \brief TraceSink keeping the most recent trace statements in memory for queries.
+///
+/// The statements are stored column by column in a ring sized from a memory budget:
+/// timestamps, masks, threads and message positions in fixed arrays,
+/// the messages back to back in a separate byte ring.
+/// The oldest statements are evicted once either ring is full.
+///
+/// Statements are indexed by category, priority and thread. Every index lists
+/// the statements in the order they were written, which is also timestamp order,
+/// so a query binary searches the smallest matching index for the end of the
+/// time range and walks back until it has enough statements.
+///
+/// Writers and queries share a mutex. A writer holds it for the copy of a single
+/// statement, a query for the walk of the index and a flat copy of the bytes of the
+/// statements found. The results are built from that copy after releasing the mutex,
+/// so their allocations never hold back ingestion.
+///
+class TraceStore : public TraceSink
+{
+public:
+    
+    /// Share of the budget used for the messages, the rest holds the columns and indexes
+    static const size_t sTextPercent{75};
+    
+    /// Budgeted bytes per statement for the columns and indexes
+    static const size_t sBytesPerRecord{96};
+    
+    /**
+     * @param[in] iBytes memory budget of the store
+     */
+    explicit TraceStore(size_t iBytes);
+    
+    /**
+     * Stores a statement, evicting the oldest ones as needed.
+     *
+     * @param[in] iRecord the statement to be stored
+     */
+    void write(const TraceRecord& iRecord) override;
+    
+    /**
+     * Finds the statements matching iQuery.
+     *
+     * @param[in] iQuery the statements to find
+     * @param[out] oRecords receives the most recent matching statements, oldest first.
+     *             Existing elements are reused.
+     *
+     * @return the number of statements written to oRecords
+     */
+    size_t query(const TraceStoreQuery& iQuery, std::vector<TraceStoreRecord>& oRecords) const;
+    
+    /**
+     * @return the number of statements currently stored
+     */
+    size_t size() const;
+    
+    /**
+     * @return the number of statements the store can hold
+     */
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+    
+private:
+    
+    /// Sequence numbers of the statements in an index, oldest first
+    typedef std::deque<uint64_t> Index;
+    
+    size_t slot(uint64_t iSequence) const
+    {
+        return static_cast<size_t>(iSequence % capacity_);
+    }
+    
+    /**
+     * Evicts the oldest statement.
+     */
+    void evict();
+    
+    static void popIndex(std::unordered_map<uint64_t, Index>& ioIndexes, uint64_t iKey);
+    
+    /**
+     * @return the index to walk for iQuery, nullptr when nothing can match
+     */
+    const Index* selectIndex(const TraceStoreQuery& iQuery) const;
+    
+    bool matches(const TraceStoreQuery& iQuery, uint64_t iSequence) const;
+    
+    mutable std::mutex mutex_;
+    
+    size_t capacity_;
+    
+    /// Columns, statement n is in slot n % capacity_
+    std::vector<uint64_t> timestamps_;
+    std::vector<uint64_t> masks_;
+    std::vector<uint64_t> threadIds_;
+    std::vector<uint64_t> textStarts_;
+    std::vector<uint32_t> textLengths_;
+    
+    /// Messages, byte n of the stream is at n % text_.size()
+    std::vector<char> text_;
+    uint64_t textEnd_{0};
+    
+    /// Sequence numbers of the oldest statement and of the next one
+    uint64_t first_{0};
+    uint64_t next_{0};
+    
+    /// Timestamps are clamped so they never go back in time
+    uint64_t lastTimestamp_{0};
+    
+    /// Statements by category, by priority and by thread
+    std::unordered_map<uint64_t, Index> categories_;
+    std::unordered_map<uint64_t, Index> priorities_;
+    std::unordered_map<uint64_t, Index> threads_;
+};
@@ -0,0 +1,192 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TraceTail.h"
+
+#include <algorithm>
+
+const size_t TraceTail::sDefaultSize;
+
+namespace
+{
+    /// Source of TraceTail::id_, never reused unlike the address of a TraceTail
+    std::atomic<uint64_t> sNextTailId{1};
+    
+    /**
+     * The rings of the calling thread, one per TraceTail,
+     * released when the thread exits.
+     */
+    template<typename Ring>
+    struct ThreadRings
+    {
+        ~ThreadRings()
+        {
+            for (const auto& entry : rings)
+                entry.second->inUse.store(false, std::memory_order_release);
+        }
+        
+        std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> rings;
+    };
+}
+
+TraceTail::TraceTail(uint64_t iThreshold, size_t iSize, bool iAllThreads)
+: threshold_(iThreshold)
+, size_(iSize ? iSize : 1)
+, allThreads_(iAllThreads)
+, id_(sNextTailId.fetch_add(1))
+{
+}
+
+TraceTail::~TraceTail()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    for (const auto& target : rings_)
+        target->closed.store(true, std::memory_order_release);
+}
+
+bool TraceTail::capture(const TraceRecord& iRecord)
+{
+    const uint64_t priorityMask = 0xF000000000000000;
+    
+    if ((iRecord.mask & priorityMask) >= threshold_)
+        return false;
+    
+    Ring& target = ring();
+    std::lock_guard<std::mutex> lock(target.mutex);
+    
+    // Overwrite the oldest entry, reusing the storage of its message
+    //
+    Entry& entry = target.entries[target.next];
+    entry.mask = iRecord.mask;
+    entry.timestamp = iRecord.timestamp;
+    entry.threadId = iRecord.threadId;
+    entry.site = iRecord.site;
+    entry.message.assign(iRecord.message, iRecord.length);
+    
+    target.next = (target.next + 1) % size_;
+    target.count = std::min(target.count + 1, size_);
+    
+    return true;
+}
+
+void TraceTail::dump(const std::function<void(const TraceRecord&)>& iDeliver)
+{
+    std::vector<Entry> entries;
+    
+    if (allThreads_)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        for (const auto& target : rings_)
+            take(*target, entries);
+        
+        // Interleave the threads
+        //
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& iLeft, const Entry& iRight)
+        {
+            return iLeft.timestamp < iRight.timestamp;
+        });
+    }
+    else
+    {
+        take(ring(), entries);
+    }
+    
+    for (const Entry& entry : entries)
+    {
+        TraceRecord record;
+        record.mask = entry.mask;
+        record.timestamp = entry.timestamp;
+        record.threadId = entry.threadId;
+        record.site = entry.site;
+        record.message = entry.message.c_str();
+        record.length = static_cast<uint32_t>(entry.message.length());
+        
+        iDeliver(record);
+    }
+}
+
+TraceTail::Ring& TraceTail::ring()
+{
+    static thread_local ThreadRings<Ring> current;
+    
+    for (const auto& entry : current.rings)
+    {
+        if (entry.first == id_)
+            return *entry.second;
+    }
+    
+    // Forget the rings of TraceTails that no longer exist
+    //
+    current.rings.erase(std::remove_if(current.rings.begin(), current.rings.end(), [](const std::pair<uint64_t, std::shared_ptr<Ring>>& iEntry)
+    {
+        return iEntry.second->closed.load(std::memory_order_acquire);
+    }), current.rings.end());
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Reuse the ring of a thread that exited.
+    // Its statements are only kept when they can still be dumped by another thread.
+    //
+    std::shared_ptr<Ring> result;
+    for (const auto& candidate : rings_)
+    {
+        if (candidate->inUse.load(std::memory_order_acquire))
+            continue;
+        
+        std::lock_guard<std::mutex> ringLock(candidate->mutex);
+        
+        if (allThreads_ && candidate->count)
+            continue;
+        
+        candidate->count = 0;
+        candidate->inUse.store(true, std::memory_order_relaxed);
+        result = candidate;
+        break;
+    }
+    
+    if (!result)
+    {
+        result = std::make_shared<Ring>();
+        result->entries.resize(size_);
+        rings_.push_back(result);
+    }
+    
+    current.rings.push_back(std::make_pair(id_, result));
+    
+    return *result;
+}
+
+void TraceTail::take(Ring& iRing, std::vector<Entry>& oEntries)
+{
+    std::lock_guard<std::mutex> lock(iRing.mutex);
+    
+    size_t size = iRing.entries.size();
+    size_t first = (iRing.next + size - iRing.count) % size;
+    
+    for (size_t i = 0; i < iRing.count; i++)
+    {
+        Entry& entry = iRing.entries[(first + i) % size];
+        oEntries.push_back(entry);
+    }
+    
+    iRing.count = 0;
+}
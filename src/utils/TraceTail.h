@@ -0,0 +1,127 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#include "TraceSink.h"
+
+///
+/// \brief Keeps low priority trace statements in memory until something goes wrong.
+///
+/// Statements with a priority below the threshold are captured into a ring
+/// of the most recent statements of the writing thread and are never written out.
+/// A statement at or above the threshold dumps the preceding statements,
+/// of its own thread or of all threads, before it is written itself.
+///
+/// Each thread gets its own ring the first time it captures a statement.
+/// The rings of threads that have exited are reused by new threads, when dumping
+/// all threads only once the statements they hold were dumped.
+/// The rings only allocate until their messages have reached their longest length.
+///
+class TraceTail
+{
+public:
+    
+    /// Default number of statements kept per thread
+    static const size_t sDefaultSize{64};
+    
+    /**
+     * @param[in] iThreshold priority at or above which statements are written and dump the rings,
+     *            in the format of the TraceMask priority bits
+     * @param[in] iSize number of statements kept per thread
+     * @param[in] iAllThreads true to dump the rings of all threads, false for the writing thread only
+     */
+    TraceTail(uint64_t iThreshold, size_t iSize, bool iAllThreads);
+    
+    ~TraceTail();
+    
+    /**
+     * Captures a statement below the threshold into the ring of the calling thread.
+     *
+     * @param[in] iRecord the statement
+     *
+     * @return true if the statement was captured, false if it is at or above the threshold
+     */
+    bool capture(const TraceRecord& iRecord);
+    
+    /**
+     * Delivers the captured statements, oldest first, and forgets them.
+     *
+     * @param[in] iDeliver called for each of the statements
+     */
+    void dump(const std::function<void(const TraceRecord&)>& iDeliver);
+    
+private:
+    
+    /// A captured statement
+    struct Entry
+    {
+        uint64_t mask{0};
+        uint64_t timestamp{0};
+        uint64_t threadId{0};
+        const void* site{nullptr};
+        std::string message;
+    };
+    
+    /// Most recent statements of a single thread
+    struct Ring
+    {
+        /// Guards the entries, only contended while dumping all of the threads
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        size_t next{0};
+        size_t count{0};
+        
+        /// False once the owning thread exited
+        std::atomic<bool> inUse{true};
+        
+        /// True once the TraceTail was destroyed
+        std::atomic<bool> closed{false};
+    };
+    
+    /**
+     * @return the ring of the calling thread
+     */
+    Ring& ring();
+    
+    /**
+     * Copies the entries of iRing, oldest first, to oEntries and empties iRing.
+     */
+    static void take(Ring& iRing, std::vector<Entry>& oEntries);
+    
+    uint64_t threshold_;
+    size_t size_;
+    bool allThreads_;
+    
+    /// Identifies this TraceTail in the thread local rings
+    uint64_t id_;
+    
+    /// Guards rings_
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+};
@@ -0,0 +1,176 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "TraceThreadTuning.h"
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+bool TraceThreadTuning::apply() const
+{
+    if (!tunesThread())
+        return true;
+    
+#ifdef __linux__
+    bool applied = true;
+    
+    if (!cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        
+        for (uint32_t cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error)
+        {
+            std::cerr << "Failed to set the trace consumer affinity: " << strerror(error) << std::endl;
+            applied = false;
+        }
+    }
+    
+    if (policy != kPolicy_Default)
+    {
+        int native = SCHED_OTHER;
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        
+        switch (policy)
+        {
+            case kPolicy_Batch:      native = SCHED_BATCH; break;
+            case kPolicy_Idle:       native = SCHED_IDLE; break;
+            case kPolicy_Fifo:       native = SCHED_FIFO; param.sched_priority = priority; break;
+            case kPolicy_RoundRobin: native = SCHED_RR; param.sched_priority = priority; break;
+            default: break;
+        }
+        
+        int error = pthread_setschedparam(pthread_self(), native, &param);
+        if (error)
+        {
+            std::cerr << "Failed to set the trace consumer scheduling policy: " << strerror(error) << std::endl;
+            applied = false;
+        }
+    }
+    
+    // The nice level of a Linux thread is set through its thread id
+    //
+    if (setNice && setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) != 0)
+    {
+        std::cerr << "Failed to set the trace consumer nice level: " << strerror(errno) << std::endl;
+        applied = false;
+    }
+    
+    return applied;
+#else
+    std::cerr << "Trace consumer affinity and scheduling are only supported on Linux" << std::endl;
+    return false;
+#endif
+}
+
+bool TraceThreadTuning::parseCpus(const std::string& iText, std::vector<uint32_t>& oCpus)
+{
+    oCpus.clear();
+    
+    const char* text = iText.c_str();
+    while (*text)
+    {
+        char* end = nullptr;
+        unsigned long first = strtoul(text, &end, 10);
+        if (end == text)
+            return false;
+        
+        unsigned long last = first;
+        text = end;
+        
+        if (*text == '-')
+        {
+            last = strtoul(++text, &end, 10);
+            if (end == text || last < first)
+                return false;
+            
+            text = end;
+        }
+        
+        if (last >= 1024)
+            return false;
+        
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            oCpus.push_back(static_cast<uint32_t>(cpu));
+        
+        if (*text == ',')
+        {
+            if (!*++text)
+                return false;
+        }
+        else if (*text)
+        {
+            return false;
+        }
+    }
+    
+    return !oCpus.empty();
+}
+
+bool TraceThreadTuning::parsePolicy(const std::string& iName, Policy& oPolicy)
+{
+    if (iName == "other")
+        oPolicy = kPolicy_Other;
+    else if (iName == "batch")
+        oPolicy = kPolicy_Batch;
+    else if (iName == "idle")
+        oPolicy = kPolicy_Idle;
+    else if (iName == "fifo")
+        oPolicy = kPolicy_Fifo;
+    else if (iName == "rr")
+        oPolicy = kPolicy_RoundRobin;
+    else
+        return false;
+    
+    return true;
+}
+
+bool TraceThreadTuning::parseWakeup(const std::string& iName, Wakeup& oWakeup)
+{
+    if (iName == "notify")
+        oWakeup = kWakeup_Notify;
+    else if (iName == "spin")
+        oWakeup = kWakeup_Spin;
+    else if (iName == "batch")
+        oWakeup = kWakeup_Batch;
+    else if (iName == "poll")
+        oWakeup = kWakeup_Poll;
+    else
+        return false;
+    
+    return true;
+}
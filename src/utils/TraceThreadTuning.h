@@ -0,0 +1,135 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+///
+/// \brief Scheduling and wakeup settings of a backend consumer thread.
+///
+/// The thread that writes the statements out, the writer thread of the native backend,
+/// the spdlog thread pool or the Boost.Log feeding thread, otherwise runs wherever the
+/// scheduler puts it and is woken for every statement. It can instead be pinned away
+/// from latency sensitive processors, given a lower scheduling class and woken less often.
+///
+/// The wakeup strategies, only supported by the native backend with kBuffering_Shared:
+///
+///       kWakeup_Notify      a waiting consumer is woken by the first statement written (default)
+///       kWakeup_Spin        the consumer spins for spinUs before waiting, statements written
+///                           meanwhile are picked up without waking it through the kernel
+///       kWakeup_Batch       a waiting consumer is woken once batchSize statements are pending,
+///                           and wakes itself every intervalUs to take fewer
+///       kWakeup_Poll        the consumer is never woken, it takes the statements every intervalUs
+///
+/// Boost.Log polls its queue every intervalUs with kWakeup_Batch and kWakeup_Poll.
+/// spdlog always wakes its thread for every statement.
+///
+/// The affinity, scheduling policy and nice level are only applied on Linux.
+///
+struct TraceThreadTuning
+{
+    /// Scheduling policy of the consumer
+    enum Policy
+    {
+          kPolicy_Default       ///< Inherited from the thread starting the backend
+        , kPolicy_Other         ///< SCHED_OTHER, time sharing
+        , kPolicy_Batch         ///< SCHED_BATCH, time sharing for throughput
+        , kPolicy_Idle          ///< SCHED_IDLE, only runs when nothing else wants the processor
+        , kPolicy_Fifo          ///< SCHED_FIFO at priority, usually needs privileges
+        , kPolicy_RoundRobin    ///< SCHED_RR at priority, usually needs privileges
+    };
+    
+    /// How writing threads wake the consumer, see above
+    enum Wakeup
+    {
+          kWakeup_Notify
+        , kWakeup_Spin
+        , kWakeup_Batch
+        , kWakeup_Poll
+    };
+    
+    /// Processors the consumer may run on, empty for any
+    std::vector<uint32_t> cpus;
+    
+    Policy policy{kPolicy_Default};
+    
+    /// Real time priority of kPolicy_Fifo and kPolicy_RoundRobin
+    int priority{1};
+    
+    /// Nice level of the consumer, only set when setNice
+    bool setNice{false};
+    int nice{0};
+    
+    Wakeup wakeup{kWakeup_Notify};
+    
+    /// How long kWakeup_Spin spins before waiting, in microseconds
+    uint32_t spinUs{50};
+    
+    /// Pending statements that wake the consumer with kWakeup_Batch
+    uint32_t batchSize{64};
+    
+    /// How often kWakeup_Batch and kWakeup_Poll take the statements, in microseconds
+    uint32_t intervalUs{1000};
+    
+    /**
+     * @return true when the thread settings differ from the defaults
+     */
+    bool tunesThread() const
+    {
+        return !cpus.empty() || policy != kPolicy_Default || setNice;
+    }
+    
+    /**
+     * Applies the affinity, scheduling policy and nice level to the calling thread.
+     * Failures are reported on stderr, the thread keeps running either way.
+     *
+     * @return true if every setting was applied
+     */
+    bool apply() const;
+    
+    /**
+     * Parses a list of processors, "2,3" or "4-7" or a mix of both.
+     *
+     * @param[in] iText the list
+     * @param[out] oCpus receives the processors
+     *
+     * @return true if iText is a valid list
+     */
+    static bool parseCpus(const std::string& iText, std::vector<uint32_t>& oCpus);
+    
+    /**
+     * @param[in] iName other, batch, idle, fifo or rr
+     * @param[out] oPolicy receives the policy
+     *
+     * @return true if iName is a known policy
+     */
+    static bool parsePolicy(const std::string& iName, Policy& oPolicy);
+    
+    /**
+     * @param[in] iName notify, spin, batch or poll
+     * @param[out] oWakeup receives the wakeup strategy
+     *
+     * @return true if iName is a known strategy
+     */
+    static bool parseWakeup(const std::string& iName, Wakeup& oWakeup);
+};
@@ -0,0 +1,763 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+///
+/// Throughput and latency benchmark for Trace.
+///
+/// Every result is written as a single JSON object per line (JSON Lines)
+/// so runs from different versions can be diffed or loaded into a script.
+/// Trace echoes its configuration to stdout, use --out to keep the results separate.
+/// The latency fields are null for the scenarios that only time the whole run.
+///
+/// Usage:
+///
+///       BBCBenchmark [--ops N] [--max-threads N] [--backend NAME] [--scenario NAME] [--log-dir DIR] [--out FILE]
+///
+/// Every scenario runs against every backend compiled in, see TraceBackend,
+/// unless --backend selects a single one.
+///
+/// Scenarios:
+///
+///       filtered  - trace statements rejected by the configured masks, decided by the per call site cache
+///       filtered_direct
+///                 - the same statements calling Trace::writeTrace directly, decided by testTraceMask
+///       callback  - enabled trace statements delivered to a client callback
+///       file      - enabled trace statements written to the external logger's file
+///       memory    - writeMemory with 16 byte buffers up to the largest it prints, Trace::sTraceMemoryMaxBytes,
+///                   delivered to a client callback
+///       batch     - enabled trace statements delivered to a client batch callback,
+///                   does not use a backend and runs once
+///       startup   - time to the first frame of an application: initializing Trace with a log file
+///                   and writing its first statement, with startup=eager, lazy and background.
+///                   Every run is one op, each backend runs --ops / 10000 times (at least 10)
+///       format    - a meter statement (levels and 64-bit sample counters) formatted by vsnprintf
+///                   and by the compiled TraceFormat, does not use a backend and runs once
+///       clock     - a timestamp read with std::chrono::system_clock and with every TraceClock
+///                   source available, does not use a backend and runs once
+///       perf      - a PerfLogger scope disabled with PerfControl, filtered out by label, and
+///                   measured into PerfStats, next to an empty operation for the cost of the
+///                   harness itself. Does not use a backend and runs once
+///
+
+#include "Trace.h"
+#include "TraceBackend.h"
+#include "TraceFormat.h"
+#include "TraceClock.h"
+#include "PerfLogger.h"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+    
+    /// Configuration shared by all of the scenarios
+    struct BenchmarkConfig
+    {
+        int64_t ops{200000};
+        int32_t maxThreads{64};
+        std::string backend;
+        std::string scenario;
+        std::string logDir{"."};
+        std::string outPath;
+    };
+    
+    /// Result of a single benchmark run
+    struct BenchmarkResult
+    {
+        std::string scenario;
+        int32_t threads{0};
+        int32_t payloadBytes{0};
+        int64_t ops{0};
+        int64_t elapsedNs{0};
+        int64_t expected{-1};
+        int64_t delivered{0};
+        std::vector<uint32_t> latencies;
+    };
+    
+    /// Number of benchmark messages received by the client callback
+    std::atomic<int64_t> sDelivered{0};
+    
+    void countingCallback(const char* iMessage)
+    {
+        // Ignore anything the external logger writes on its own
+        //
+        if (strstr(iMessage, "Benchmark"))
+            sDelivered.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void countingBatchCallback(const TraceRecord* iRecords, size_t iCount)
+    {
+        int64_t delivered = 0;
+        for (size_t i = 0; i < iCount; i++)
+        {
+            if (strstr(iRecords[i].message, "Benchmark"))
+                delivered++;
+        }
+        
+        sDelivered.fetch_add(delivered, std::memory_order_relaxed);
+    }
+    
+    /// The operation each producer thread runs, iIndex is the per thread operation count
+    typedef std::function<void(int64_t iIndex)> BenchmarkOp;
+    
+    /**
+     * Runs iOp iOps times split across iThreads producer threads.
+     * Every call is timed individually for the latency percentiles,
+     * unless iTimeEachOp is false for operations cheaper than reading the clock.
+     */
+    BenchmarkResult runProducers(int32_t iThreads, int64_t iOps, const BenchmarkOp& iOp, bool iTimeEachOp = true)
+    {
+        BenchmarkResult result;
+        result.threads = iThreads;
+        result.ops = (iOps / iThreads) * iThreads;
+        
+        const int64_t opsPerThread = iOps / iThreads;
+        std::vector<std::vector<uint32_t>> latencies(iThreads);
+        std::atomic<bool> start{false};
+        std::atomic<int32_t> ready{0};
+        std::vector<std::thread> producers;
+        
+        for (int32_t t = 0; t < iThreads; t++)
+        {
+            if (iTimeEachOp)
+                latencies[t].resize(opsPerThread);
+            
+            producers.emplace_back([&, t]()
+            {
+                std::vector<uint32_t>& samples = latencies[t];
+                
+                ready.fetch_add(1);
+                while (!start.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                
+                if (!iTimeEachOp)
+                {
+                    for (int64_t i = 0; i < opsPerThread; i++)
+                        iOp(i);
+                    
+                    return;
+                }
+                
+                for (int64_t i = 0; i < opsPerThread; i++)
+                {
+                    Clock::time_point t0 = Clock::now();
+                    iOp(i);
+                    Clock::time_point t1 = Clock::now();
+                    
+                    samples[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+                }
+            });
+        }
+        
+        while (ready.load() != iThreads)
+            std::this_thread::yield();
+        
+        Clock::time_point begin = Clock::now();
+        start.store(true, std::memory_order_release);
+        
+        for (auto& producer : producers)
+            producer.join();
+        
+        result.elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+        
+        result.latencies.reserve(result.ops);
+        for (const auto& samples : latencies)
+            result.latencies.insert(result.latencies.end(), samples.begin(), samples.end());
+        
+        return result;
+    }
+    
+    /// Returns the iPercentile (0.0 - 1.0) of the samples, iSamples is partially reordered
+    uint32_t percentile(std::vector<uint32_t>& iSamples, double iPercentile)
+    {
+        if (iSamples.empty())
+            return 0;
+        
+        size_t index = static_cast<size_t>(iPercentile * (iSamples.size() - 1));
+        std::nth_element(iSamples.begin(), iSamples.begin() + index, iSamples.end());
+        
+        return iSamples[index];
+    }
+    
+    /// Prints a latency into oField, null without samples
+    const char* latencyField(char* oField, size_t iSize, const std::vector<uint32_t>& iSamples, uint32_t iLatency)
+    {
+        if (iSamples.empty())
+            snprintf(oField, iSize, "null");
+        else
+            snprintf(oField, iSize, "%u", iLatency);
+        
+        return oField;
+    }
+    
+    /// Writes iResult as a single line of JSON
+    void report(FILE* iOut, const BenchmarkConfig& iConfig, BenchmarkResult& iResult)
+    {
+        double nsPerOp = iResult.ops ? static_cast<double>(iResult.elapsedNs) / iResult.ops : 0.0;
+        double msgsPerSec = iResult.elapsedNs ? (iResult.ops * 1e9) / iResult.elapsedNs : 0.0;
+        int64_t expected = iResult.expected < 0 ? iResult.ops : iResult.expected;
+        int64_t drops = std::max<int64_t>(expected - iResult.delivered, 0);
+        
+        uint32_t p50 = percentile(iResult.latencies, 0.50);
+        uint32_t p99 = percentile(iResult.latencies, 0.99);
+        uint32_t p999 = percentile(iResult.latencies, 0.999);
+        uint32_t max = iResult.latencies.empty() ? 0 : *std::max_element(iResult.latencies.begin(), iResult.latencies.end());
+        
+        char p50Field[16];
+        char p99Field[16];
+        char p999Field[16];
+        char maxField[16];
+        
+        fprintf(iOut
+                , "{\"benchmark\":\"Trace\",\"backend\":\"%s\",\"scenario\":\"%s\",\"threads\":%d,\"payload_bytes\":%d"
+                  ",\"ops\":%lld,\"ns_per_op\":%.2f,\"msgs_per_sec\":%.0f"
+                  ",\"p50_ns\":%s,\"p99_ns\":%s,\"p999_ns\":%s,\"max_ns\":%s"
+                  ",\"delivered\":%lld,\"drops\":%lld}\n"
+                , iConfig.backend.c_str()
+                , iResult.scenario.c_str()
+                , iResult.threads
+                , iResult.payloadBytes
+                , static_cast<long long>(iResult.ops)
+                , nsPerOp
+                , msgsPerSec
+                , latencyField(p50Field, sizeof(p50Field), iResult.latencies, p50)
+                , latencyField(p99Field, sizeof(p99Field), iResult.latencies, p99)
+                , latencyField(p999Field, sizeof(p999Field), iResult.latencies, p999)
+                , latencyField(maxField, sizeof(maxField), iResult.latencies, max)
+                , static_cast<long long>(iResult.delivered)
+                , static_cast<long long>(drops)
+                );
+        fflush(iOut);
+    }
+    
+    /// Counts the benchmark lines in the log file written by the external logger
+    int64_t countLogLines(const std::string& iLogFilePath)
+    {
+        std::ifstream log(iLogFilePath);
+        std::string line;
+        int64_t count = 0;
+        
+        while (std::getline(log, line))
+        {
+            if (line.find("Benchmark") != std::string::npos)
+                count++;
+        }
+        
+        return count;
+    }
+    
+    std::vector<int32_t> threadCounts(const BenchmarkConfig& iConfig)
+    {
+        std::vector<int32_t> counts;
+        for (int32_t threads = 1; threads <= iConfig.maxThreads; threads *= 2)
+            counts.push_back(threads);
+        
+        return counts;
+    }
+    
+    bool runScenario(const BenchmarkConfig& iConfig, const char* iScenario)
+    {
+        return iConfig.scenario.empty() || iConfig.scenario == iScenario;
+    }
+    
+    /// Trace configuration selecting the backend under test
+    std::string traceConfig(const BenchmarkConfig& iConfig, const char* iMasks)
+    {
+        return "backend=" + iConfig.backend + "\n" + iMasks;
+    }
+    
+    void benchmarkFiltered(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        for (int32_t threads : threadCounts(iConfig))
+        {
+            Trace::instance().initializeWithBuffer(traceConfig(iConfig, "kCategory_Basic@kPriority_High"), countingCallback);
+            sDelivered = 0;
+            
+            BenchmarkResult result = runProducers(threads, iConfig.ops, [](int64_t iIndex)
+            {
+                BBC_TRACE_R(Trace::kCategory_Network | Trace::kPriority_Low
+                            , "Benchmark %lld %s %f"
+                            , static_cast<long long>(iIndex)
+                            , "filtered"
+                            , 3.14
+                            );
+            }, false);
+            
+            Trace::instance().reset();
+            
+            // Nothing is expected to be delivered.
+            // Rejecting a statement is cheaper than timing it, only the throughput is measured.
+            //
+            result.scenario = "filtered";
+            result.expected = 0;
+            result.delivered = sDelivered.load();
+            report(iOut, iConfig, result);
+        }
+    }
+    
+    void benchmarkFilteredDirect(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        for (int32_t threads : threadCounts(iConfig))
+        {
+            Trace::instance().initializeWithBuffer(traceConfig(iConfig, "kCategory_Basic@kPriority_High"), countingCallback);
+            sDelivered = 0;
+            
+            BenchmarkResult result = runProducers(threads, iConfig.ops, [](int64_t iIndex)
+            {
+                Trace::instance().writeTrace(Trace::kCategory_Network | Trace::kPriority_Low
+                                             , "Benchmark %lld %s %f"
+                                             , static_cast<long long>(iIndex)
+                                             , "filtered"
+                                             , 3.14
+                                             );
+            }, false);
+            
+            Trace::instance().reset();
+            
+            result.scenario = "filtered_direct";
+            result.expected = 0;
+            result.delivered = sDelivered.load();
+            report(iOut, iConfig, result);
+        }
+    }
+    
+    void benchmarkCallback(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        for (int32_t threads : threadCounts(iConfig))
+        {
+            Trace::instance().initializeWithBuffer(traceConfig(iConfig, "kCategory_Basic@kPriority_Low"), countingCallback);
+            sDelivered = 0;
+            
+            BenchmarkResult result = runProducers(threads, iConfig.ops, [](int64_t iIndex)
+            {
+                BBC_TRACE_R(Trace::kCategory_Basic | Trace::kPriority_Medium
+                            , "Benchmark %lld %s %f"
+                            , static_cast<long long>(iIndex)
+                            , "callback"
+                            , 3.14
+                            );
+            });
+            
+            // Resetting drains the external logger
+            //
+            Trace::instance().reset();
+            
+            result.scenario = "callback";
+            result.delivered = sDelivered.load();
+            report(iOut, iConfig, result);
+        }
+    }
+    
+    void benchmarkFile(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        for (int32_t threads : threadCounts(iConfig))
+        {
+            std::string logFile = iConfig.logDir + "/Trace_Benchmark_" + iConfig.backend + ".log";
+            remove(logFile.c_str());
+            
+            Trace::instance().initializeWithBuffer(traceConfig(iConfig, "kCategory_Basic@kPriority_Low"), logFile);
+            
+            BenchmarkResult result = runProducers(threads, iConfig.ops, [](int64_t iIndex)
+            {
+                BBC_TRACE_R(Trace::kCategory_Basic | Trace::kPriority_Medium
+                            , "Benchmark %lld %s %f"
+                            , static_cast<long long>(iIndex)
+                            , "file"
+                            , 3.14
+                            );
+            });
+            
+            // Resetting drains the external logger and closes the file
+            //
+            Trace::instance().reset();
+            
+            result.scenario = "file";
+            result.delivered = countLogLines(logFile);
+            report(iOut, iConfig, result);
+            
+            remove(logFile.c_str());
+        }
+    }
+    
+    void benchmarkBatch(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        for (int32_t threads : threadCounts(iConfig))
+        {
+            Trace::instance().initializeBatchedWithBuffer("kCategory_Basic@kPriority_Low", countingBatchCallback);
+            sDelivered = 0;
+            
+            BenchmarkResult result = runProducers(threads, iConfig.ops, [](int64_t iIndex)
+            {
+                BBC_TRACE_R(Trace::kCategory_Basic | Trace::kPriority_Medium
+                            , "Benchmark %lld %s %f"
+                            , static_cast<long long>(iIndex)
+                            , "batch"
+                            , 3.14
+                            );
+            });
+            
+            // Resetting delivers the pending batch
+            //
+            Trace::instance().reset();
+            
+            result.scenario = "batch";
+            result.delivered = sDelivered.load();
+            report(iOut, iConfig, result);
+        }
+    }
+    
+    void benchmarkStartup(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        const char* modes[] = { "eager", "lazy", "background" };
+        const int64_t runs = std::max<int64_t>(iConfig.ops / 10000, 10);
+        const std::string logFile = iConfig.logDir + "/Trace_Benchmark_startup_" + iConfig.backend + ".log";
+        
+        for (const char* mode : modes)
+        {
+            BenchmarkResult result;
+            result.threads = 1;
+            result.ops = runs;
+            
+            std::string masks = std::string("kCategory_Basic@kPriority_Low\nstartup=") + mode;
+            
+            for (int64_t run = 0; run < runs; run++)
+            {
+                remove(logFile.c_str());
+                
+                Clock::time_point begin = Clock::now();
+                
+                Trace::instance().initializeWithBuffer(traceConfig(iConfig, masks.c_str()), logFile);
+                BBC_TRACE_R(Trace::kCategory_Basic | Trace::kPriority_Medium, "Benchmark %lld %s", static_cast<long long>(run), "startup");
+                
+                int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+                
+                Trace::instance().reset();
+                
+                result.elapsedNs += elapsed;
+                result.latencies.push_back(static_cast<uint32_t>(std::min<int64_t>(elapsed, UINT32_MAX)));
+                result.delivered += countLogLines(logFile);
+            }
+            
+            result.scenario = std::string("startup_") + mode;
+            report(iOut, iConfig, result);
+        }
+        
+        remove(logFile.c_str());
+    }
+    
+    /// Statement typical of a metering plug-in, mostly fixed point levels and counters
+    const char* sMeterFormat = "Meter %s ch %u peak %.2f rms %.1f dB lufs %+.1f samples %llu clipped %llu gain %.3f";
+    
+    int formatWithVsnprintf(char* oBuffer, size_t iSize, const char* iFormat, ...)
+    {
+        va_list args;
+        va_start(args, iFormat);
+        int count = vsnprintf(oBuffer, iSize, iFormat, args);
+        va_end(args);
+        
+        return count;
+    }
+    
+    int formatCompiled(const TraceFormat& iFormat, char* oBuffer, size_t iSize, ...)
+    {
+        va_list args;
+        va_start(args, iSize);
+        int count = iFormat.format(oBuffer, iSize, args);
+        va_end(args);
+        
+        return count;
+    }
+    
+    void benchmarkFormat(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        const TraceFormat* format = TraceFormat::find(sMeterFormat);
+        if (!format)
+            return;
+        
+        for (int compiled = 0; compiled < 2; compiled++)
+        {
+            int64_t delivered = 0;
+            
+            BenchmarkResult result = runProducers(1, iConfig.ops, [&](int64_t iIndex)
+            {
+                char buffer[256];
+                double level = -0.001 * static_cast<double>(iIndex % 60000);
+                unsigned long long samples = 48000ull * static_cast<unsigned long long>(iIndex);
+                
+                int count = compiled
+                    ? formatCompiled(*format, buffer, sizeof(buffer), "Main", static_cast<unsigned>(iIndex & 7), level, level - 3.01, level - 14.2, samples, samples >> 20, 0.7071)
+                    : formatWithVsnprintf(buffer, sizeof(buffer), sMeterFormat, "Main", static_cast<unsigned>(iIndex & 7), level, level - 3.01, level - 14.2, samples, samples >> 20, 0.7071);
+                
+                if (count > 0)
+                    delivered++;
+            });
+            
+            result.scenario = compiled ? "format_compiled" : "format_vsnprintf";
+            result.delivered = delivered;
+            report(iOut, iConfig, result);
+        }
+    }
+    
+    void benchmarkClock(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        // Reading a clock is cheaper than timing it, only the throughput is measured
+        //
+        uint64_t sum = 0;
+        
+        BenchmarkResult result = runProducers(1, iConfig.ops, [&sum](int64_t iIndex)
+        {
+            sum += std::chrono::system_clock::now().time_since_epoch().count();
+        }, false);
+        
+        result.scenario = "clock_chrono_system";
+        result.delivered = sum ? result.ops : 0;
+        report(iOut, iConfig, result);
+        
+        TraceClock::Source selected = TraceClock::source();
+        
+        for (TraceClock::Source source : {TraceClock::kSource_Tsc, TraceClock::kSource_Tscp, TraceClock::kSource_MonotonicRaw, TraceClock::kSource_Steady, TraceClock::kSource_System})
+        {
+            if (!TraceClock::select(source))
+                continue;
+            
+            sum = 0;
+            result = runProducers(1, iConfig.ops, [&sum](int64_t iIndex)
+            {
+                sum += TraceClock::now();
+            }, false);
+            
+            result.scenario = std::string("clock_") + TraceClock::sourceName(source);
+            result.delivered = sum ? result.ops : 0;
+            report(iOut, iConfig, result);
+        }
+        
+        TraceClock::select(selected);
+    }
+    
+    void benchmarkPerf(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        // Scopes are cheaper than timing them, only the throughput is measured
+        //
+        BenchmarkResult result = runProducers(1, iConfig.ops, [](int64_t iIndex)
+        {
+        }, false);
+        
+        result.scenario = "perf_baseline";
+        result.delivered = result.ops;
+        report(iOut, iConfig, result);
+        
+        PerfControl::setEnabled(false);
+        
+        result = runProducers(1, iConfig.ops, [](int64_t iIndex)
+        {
+            PerfLogger perf("Benchmark");
+        }, false);
+        
+        result.scenario = "perf_disabled";
+        result.delivered = result.ops;
+        report(iOut, iConfig, result);
+        
+        PerfControl::configure("Other,kCategory_UI");
+        
+        result = runProducers(1, iConfig.ops, [](int64_t iIndex)
+        {
+            PerfLogger perf("Benchmark");
+        }, false);
+        
+        result.scenario = "perf_filtered_out";
+        result.delivered = result.ops;
+        report(iOut, iConfig, result);
+        
+        PerfControl::setEnabled(true);
+        PerfStats::instance().setAggregating(true);
+        
+        result = runProducers(1, iConfig.ops, [](int64_t iIndex)
+        {
+            PerfLogger perf("Benchmark");
+        }, false);
+        
+        PerfStats::instance().setAggregating(false);
+        PerfControl::setEnabled(false);
+        
+        std::vector<PerfStats::Summary> summaries = PerfStats::instance().snapshot(true);
+        
+        result.scenario = "perf_aggregated";
+        result.delivered = summaries.empty() ? 0 : static_cast<int64_t>(summaries[0].histogram.count());
+        report(iOut, iConfig, result);
+    }
+    
+    void benchmarkMemory(FILE* iOut, const BenchmarkConfig& iConfig)
+    {
+        // Larger buffers are truncated to sTraceMemoryMaxBytes
+        //
+        for (int32_t bytes : { 16, 64, 256, Trace::sTraceMemoryMaxBytes })
+        {
+            std::vector<char> buffer(bytes);
+            for (int32_t i = 0; i < bytes; i++)
+                buffer[i] = static_cast<char>(i);
+            
+            Trace::instance().initializeWithBuffer(traceConfig(iConfig, "kCategory_Basic@kPriority_Low"), countingCallback);
+            sDelivered = 0;
+            
+            // Hex dumping is much more expensive than a plain trace statement
+            //
+            BenchmarkResult result = runProducers(1, std::max<int64_t>(iConfig.ops / 16, 1), [&buffer](int64_t iIndex)
+            {
+                BBC_TRACE_MEM_R(Trace::kCategory_Basic | Trace::kPriority_Medium
+                                , buffer.data()
+                                , static_cast<int32_t>(buffer.size())
+                                , "Benchmark %lld"
+                                , static_cast<long long>(iIndex)
+                                );
+            });
+            
+            Trace::instance().reset();
+            
+            result.scenario = "memory";
+            result.payloadBytes = bytes;
+            result.delivered = sDelivered.load();
+            report(iOut, iConfig, result);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkConfig config;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        
+        if (!value)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+        
+        if (arg == "--ops")
+            config.ops = std::max<int64_t>(atoll(value), 1);
+        else if (arg == "--max-threads")
+            config.maxThreads = std::max(atoi(value), 1);
+        else if (arg == "--backend")
+            config.backend = value;
+        else if (arg == "--scenario")
+            config.scenario = value;
+        else if (arg == "--log-dir")
+            config.logDir = value;
+        else if (arg == "--out")
+            config.outPath = value;
+        else
+        {
+            fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+        
+        i++;
+    }
+    
+    FILE* out = stdout;
+    if (config.outPath.length())
+    {
+        out = fopen(config.outPath.c_str(), "w");
+        if (!out)
+        {
+            fprintf(stderr, "Failed to open %s\n", config.outPath.c_str());
+            return 1;
+        }
+    }
+    
+    std::vector<std::string> backends = TraceBackend::available();
+    if (config.backend.length())
+    {
+        if (std::find(backends.begin(), backends.end(), config.backend) == backends.end())
+        {
+            fprintf(stderr, "Backend %s is not available\n", config.backend.c_str());
+            return 1;
+        }
+        
+        backends.assign(1, config.backend);
+    }
+    
+    for (const std::string& backend : backends)
+    {
+        config.backend = backend;
+        
+        if (runScenario(config, "filtered"))
+            benchmarkFiltered(out, config);
+        
+        if (runScenario(config, "filtered_direct"))
+            benchmarkFilteredDirect(out, config);
+        
+        if (runScenario(config, "callback"))
+            benchmarkCallback(out, config);
+        
+        if (runScenario(config, "file"))
+            benchmarkFile(out, config);
+        
+        if (runScenario(config, "memory"))
+            benchmarkMemory(out, config);
+        
+        if (runScenario(config, "startup"))
+            benchmarkStartup(out, config);
+    }
+    
+    if (runScenario(config, "batch"))
+    {
+        config.backend = "none";
+        benchmarkBatch(out, config);
+    }
+    
+    if (runScenario(config, "format"))
+    {
+        config.backend = "none";
+        benchmarkFormat(out, config);
+    }
+    
+    if (runScenario(config, "clock"))
+    {
+        config.backend = "none";
+        benchmarkClock(out, config);
+    }
+    
+    if (runScenario(config, "perf"))
+    {
+        config.backend = "none";
+        benchmarkPerf(out, config);
+    }
+    
+    if (out != stdout)
+        fclose(out);
+    
+    return 0;
+}
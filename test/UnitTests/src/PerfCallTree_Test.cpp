@@ -0,0 +1,163 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "PerfLogger.h"
+#include "PerfCallTree.h"
+
+#include <thread>
+#include <sstream>
+
+static void frame(PerfCallTree& ioTree, uint64_t iMix, uint64_t iMeter, uint64_t iSelf)
+{
+    uint64_t frame = ioTree.enter("Frame");
+    
+    uint64_t mix = ioTree.enter("Mix");
+    ioTree.exit(mix, iMix);
+    
+    uint64_t meter = ioTree.enter("Meter");
+    ioTree.exit(meter, iMeter);
+    
+    ioTree.exit(frame, iMix + iMeter + iSelf);
+}
+
+TEST(PerfCallTreeTest, PerfCallTreeTest_MergedAcrossThreads)
+{
+    PerfCallTree tree;
+    
+    // Nothing is recorded before start
+    //
+    EXPECT_EQ(tree.enter("Frame"), PerfCallTree::sNoScope);
+    
+    tree.start();
+    
+    frame(tree, 1000, 100, 10);
+    frame(tree, 2000, 200, 20);
+    
+    std::thread thread([&tree]()
+    {
+        frame(tree, 3000, 300, 30);
+        
+        // Same label, different path
+        //
+        uint64_t mix = tree.enter("Mix");
+        tree.exit(mix, 50);
+    });
+    thread.join();
+    
+    tree.stop();
+    EXPECT_EQ(tree.enter("Frame"), PerfCallTree::sNoScope);
+    
+    PerfCallTree::Node root = tree.snapshot();
+    ASSERT_EQ(root.children.size(), 2u);
+    EXPECT_EQ(root.inclusive, 6660u + 50u);
+    
+    const PerfCallTree::Node& frameNode = root.children[0];
+    EXPECT_EQ(frameNode.label, "Frame");
+    EXPECT_EQ(frameNode.calls, 3u);
+    EXPECT_EQ(frameNode.inclusive, 6660u);
+    EXPECT_EQ(frameNode.self, 60u);
+    
+    ASSERT_EQ(frameNode.children.size(), 2u);
+    EXPECT_EQ(frameNode.children[0].label, "Mix");
+    EXPECT_EQ(frameNode.children[0].calls, 3u);
+    EXPECT_EQ(frameNode.children[0].inclusive, 6000u);
+    EXPECT_EQ(frameNode.children[0].self, 6000u);
+    EXPECT_EQ(frameNode.children[1].label, "Meter");
+    EXPECT_EQ(frameNode.children[1].inclusive, 600u);
+    
+    EXPECT_EQ(root.children[1].label, "Mix");
+    EXPECT_EQ(root.children[1].calls, 1u);
+    EXPECT_TRUE(root.children[1].children.empty());
+    
+    std::ostringstream folded;
+    tree.writeFolded(folded);
+    EXPECT_EQ(folded.str(), "Frame 60\nFrame;Mix 6000\nFrame;Meter 600\nMix 50\n");
+    
+    std::ostringstream text;
+    tree.writeText(text);
+    EXPECT_NE(text.str().find("       6.660        0.060          3  Frame\n"), std::string::npos) << text.str();
+    EXPECT_NE(text.str().find("       6.000        6.000          3    Mix\n"), std::string::npos) << text.str();
+    
+    // A new profile starts empty
+    //
+    tree.start();
+    EXPECT_TRUE(tree.snapshot().children.empty());
+    
+    uint64_t meter = tree.enter("Meter");
+    tree.exit(meter, 5);
+    EXPECT_EQ(tree.snapshot().children.size(), 1u);
+}
+
+TEST(PerfCallTreeTest, PerfCallTreeTest_FoldedLabels)
+{
+    PerfCallTree tree;
+    tree.start();
+    
+    uint64_t outer = tree.enter("a;b c");
+    uint64_t inner = tree.enter("d");
+    tree.exit(inner, 7);
+    
+    // Restarted while a scope is open, the scope is ignored
+    //
+    tree.start();
+    tree.exit(outer, 10);
+    EXPECT_TRUE(tree.snapshot().children.empty());
+    
+    outer = tree.enter("a;b c");
+    tree.exit(outer, 10);
+    
+    std::ostringstream folded;
+    tree.writeFolded(folded);
+    EXPECT_EQ(folded.str(), "a_b_c 10\n");
+}
+
+TEST(PerfCallTreeTest, PerfCallTreeTest_PerfLogger)
+{
+    PerfControl::setEnabled(true);
+    
+    PerfCallTree& tree = PerfCallTree::instance();
+    tree.start();
+    
+    for (int i = 0; i < 2; i++)
+    {
+        PerfLogger frame("Frame");
+        
+        {
+            PerfLogger mix("Mix");
+        }
+    }
+    
+    tree.stop();
+    
+    {
+        PerfLogger ignored("Ignored");
+    }
+    
+    PerfCallTree::Node root = tree.snapshot();
+    ASSERT_EQ(root.children.size(), 1u);
+    EXPECT_EQ(root.children[0].label, "Frame");
+    EXPECT_EQ(root.children[0].calls, 2u);
+    ASSERT_EQ(root.children[0].children.size(), 1u);
+    EXPECT_EQ(root.children[0].children[0].label, "Mix");
+    EXPECT_EQ(root.children[0].children[0].calls, 2u);
+    EXPECT_LE(root.children[0].children[0].inclusive, root.children[0].inclusive);
+    
+    PerfControl::setEnabled(false);
+}
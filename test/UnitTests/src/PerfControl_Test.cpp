@@ -0,0 +1,123 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "PerfLogger.h"
+#include "PerfControl.h"
+#include "PerfCallTree.h"
+
+#include <atomic>
+#include <thread>
+
+TEST(PerfControlTest, PerfControlTest_Configure)
+{
+    PerfControl::setEnabled(true);
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_On);
+    EXPECT_TRUE(PerfControl::enabled("Frame", Trace::kCategory_Perf));
+    EXPECT_TRUE(PerfControl::enabled(nullptr, Trace::kCategory_UI));
+    
+    PerfControl::setEnabled(false);
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_Off);
+    EXPECT_FALSE(PerfControl::enabled("Frame", Trace::kCategory_Perf));
+    
+    EXPECT_TRUE(PerfControl::configure(" Mix , Frame,kCategory_UI "));
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_Filtered);
+    EXPECT_TRUE(PerfControl::enabled("Frame", Trace::kCategory_Perf));
+    EXPECT_TRUE(PerfControl::enabled("Mix", Trace::kCategory_Perf));
+    EXPECT_TRUE(PerfControl::enabled("Draw", Trace::kCategory_UI));
+    EXPECT_FALSE(PerfControl::enabled("Draw", Trace::kCategory_Perf));
+    EXPECT_FALSE(PerfControl::enabled("Frames", Trace::kCategory_Perf));
+    EXPECT_FALSE(PerfControl::enabled(nullptr, Trace::kCategory_Perf));
+    
+    EXPECT_TRUE(PerfControl::configure("on"));
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_On);
+    EXPECT_TRUE(PerfControl::enabled("Draw", Trace::kCategory_Perf));
+    
+    EXPECT_TRUE(PerfControl::configure(""));
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_Off);
+}
+
+TEST(PerfControlTest, PerfControlTest_Reconfigure)
+{
+    // Scopes keep starting while the filters they read are replaced and deleted
+    //
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> checks{0};
+    
+    std::thread scopes([&]()
+    {
+        while (!done.load())
+        {
+            EXPECT_FALSE(PerfControl::enabled("Draw", Trace::kCategory_Perf));
+            PerfControl::enabled("Frame", Trace::kCategory_Perf);
+            checks++;
+        }
+    });
+    
+    while (checks.load() == 0)
+        std::this_thread::yield();
+    
+    for (int i = 0; i < 200; i++)
+    {
+        EXPECT_TRUE(PerfControl::configure(i % 2 ? "Frame" : "Mix,kCategory_UI"));
+        
+        if (i % 50 == 0)
+            PerfControl::setEnabled(false);
+    }
+    
+    done = true;
+    scopes.join();
+    
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_Filtered);
+    EXPECT_TRUE(PerfControl::enabled("Frame", Trace::kCategory_Perf));
+    EXPECT_FALSE(PerfControl::enabled("Mix", Trace::kCategory_Perf));
+    
+    PerfControl::setEnabled(false);
+}
+
+TEST(PerfControlTest, PerfControlTest_TraceOption)
+{
+    Trace::instance().reset();
+    ASSERT_TRUE(Trace::instance().initializeWithBuffer("kCategory_Perf@kPriority_Low\nperf=Mix\n", [](const char*) {}));
+    
+    EXPECT_EQ(PerfControl::state(), PerfControl::kState_Filtered);
+    EXPECT_TRUE(PerfControl::enabled("Mix", Trace::kCategory_Perf));
+    EXPECT_FALSE(PerfControl::enabled("Frame", Trace::kCategory_Perf));
+    
+    // Only the Mix scopes are measured
+    //
+    PerfCallTree& tree = PerfCallTree::instance();
+    tree.start();
+    
+    {
+        PerfLogger frame("Frame");
+        PerfLogger mix("Mix");
+        PerfLogger draw("Draw", Trace::kCategory_UI);
+    }
+    
+    tree.stop();
+    Trace::instance().reset();
+    
+    PerfCallTree::Node root = tree.snapshot();
+    ASSERT_EQ(root.children.size(), 1u);
+    EXPECT_EQ(root.children[0].label, "Mix");
+    EXPECT_TRUE(root.children[0].children.empty());
+    
+    PerfControl::setEnabled(false);
+}
@@ -0,0 +1,195 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "PerfLogger.h"
+#include "PerfStats.h"
+#include "PerfHistogram.h"
+
+#include <mutex>
+#include <random>
+#include <thread>
+#include <algorithm>
+
+static std::mutex sPerfMutex;
+static std::vector<std::string> sPerfMessages;
+
+static void TestPerfCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sPerfMutex);
+    sPerfMessages.push_back(iMessage);
+}
+
+TEST(PerfStatsTest, PerfStatsTest_HistogramBuckets)
+{
+    // Contiguous, and within 1 / sSubBuckets of the value
+    //
+    for (uint32_t i = 1; i < PerfHistogram::bucketCount(); i++)
+        EXPECT_EQ(PerfHistogram::bucketLow(i), PerfHistogram::bucketHigh(i - 1) + 1) << i;
+    
+    for (uint64_t value : std::vector<uint64_t>({0, 1, 63, 64, 65, 1000, 123456789, PerfHistogram::sMaxValue}))
+    {
+        uint32_t bucket = PerfHistogram::bucket(value);
+        EXPECT_LE(PerfHistogram::bucketLow(bucket), value);
+        EXPECT_GE(PerfHistogram::bucketHigh(bucket), value);
+        EXPECT_LE(PerfHistogram::bucketHigh(bucket) - PerfHistogram::bucketLow(bucket), value / PerfHistogram::sSubBuckets);
+    }
+    
+    EXPECT_EQ(PerfHistogram::bucket(UINT64_MAX), PerfHistogram::bucketCount() - 1);
+}
+
+TEST(PerfStatsTest, PerfStatsTest_HistogramPercentiles)
+{
+    PerfHistogram histogram;
+    EXPECT_EQ(histogram.percentile(50.0), 0u);
+    EXPECT_EQ(histogram.min(), 0u);
+    
+    // 1 to 100000 ns shuffled, every percentile is known
+    //
+    std::vector<uint64_t> values;
+    for (uint64_t i = 1; i <= 100000; i++)
+        values.push_back(i);
+    
+    std::mt19937 random(7);
+    std::shuffle(values.begin(), values.end(), random);
+    
+    for (uint64_t value : values)
+        histogram.record(value);
+    
+    EXPECT_EQ(histogram.count(), 100000u);
+    EXPECT_EQ(histogram.min(), 1u);
+    EXPECT_EQ(histogram.max(), 100000u);
+    
+    for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9})
+    {
+        double expected = percentile * 1000.0;
+        EXPECT_NEAR(static_cast<double>(histogram.percentile(percentile)), expected, expected / PerfHistogram::sSubBuckets) << percentile;
+    }
+    
+    EXPECT_EQ(histogram.percentile(100.0), 100000u);
+    
+    PerfHistogram other;
+    other.record(500000);
+    histogram.merge(other);
+    EXPECT_EQ(histogram.count(), 100001u);
+    EXPECT_EQ(histogram.max(), 500000u);
+    
+    histogram.clear();
+    EXPECT_EQ(histogram.count(), 0u);
+    EXPECT_EQ(histogram.max(), 0u);
+}
+
+TEST(PerfStatsTest, PerfStatsTest_Shards)
+{
+    PerfStats stats;
+    
+    const int threads = 4;
+    std::vector<std::thread> recorders;
+    
+    for (int t = 0; t < threads; t++)
+    {
+        recorders.emplace_back([&stats, t]()
+        {
+            for (uint64_t i = 1; i <= 1000; i++)
+            {
+                stats.record("Shared", i);
+                stats.record(t ? "Worker" : "Main", i * 1000);
+            }
+        });
+    }
+    
+    for (auto& recorder : recorders)
+        recorder.join();
+    
+    std::vector<PerfStats::Summary> summaries = stats.snapshot(true);
+    ASSERT_EQ(summaries.size(), 3u);
+    
+    EXPECT_EQ(summaries[0].label, "Main");
+    EXPECT_EQ(summaries[0].histogram.count(), 1000u);
+    EXPECT_EQ(summaries[0].histogram.max(), 1000000u);
+    
+    EXPECT_EQ(summaries[1].label, "Shared");
+    EXPECT_EQ(summaries[1].histogram.count(), 4000u);
+    EXPECT_EQ(summaries[1].histogram.min(), 1u);
+    EXPECT_NEAR(static_cast<double>(summaries[1].histogram.percentile(50.0)), 500.0, 500.0 / PerfHistogram::sSubBuckets);
+    
+    EXPECT_EQ(summaries[2].label, "Worker");
+    EXPECT_EQ(summaries[2].histogram.count(), 3000u);
+    
+    // Reset, and the shards of the exited threads are gone
+    //
+    EXPECT_TRUE(stats.snapshot(true).empty());
+    
+    stats.record("Again", 5);
+    summaries = stats.snapshot(false);
+    ASSERT_EQ(summaries.size(), 1u);
+    EXPECT_EQ(summaries[0].histogram.count(), 1u);
+    EXPECT_EQ(stats.snapshot(false).size(), 1u);
+}
+
+TEST(PerfStatsTest, PerfStatsTest_PerfLogger)
+{
+    PerfControl::setEnabled(true);
+    
+    Trace::instance().reset();
+    sPerfMessages.clear();
+    ASSERT_TRUE(Trace::instance().initializeWithBuffer("kCategory_Perf@kPriority_Low", TestPerfCallback));
+    
+    PerfStats::instance().start(std::chrono::milliseconds(60000));
+    ASSERT_TRUE(PerfStats::instance().aggregating());
+    
+    for (int i = 0; i < 100; i++)
+    {
+        PerfLogger perf("Frame");
+        perf.checkPoint("mix");
+    }
+    
+    // Nothing is traced per scope
+    //
+    {
+        std::lock_guard<std::mutex> lock(sPerfMutex);
+        EXPECT_TRUE(sPerfMessages.empty());
+    }
+    
+    PerfStats::instance().stop();
+    EXPECT_FALSE(PerfStats::instance().aggregating());
+    
+    Trace::instance().reset();
+    
+    ASSERT_EQ(sPerfMessages.size(), 2u);
+    EXPECT_NE(sPerfMessages[0].find("PerfStats - Frame count 100 min "), std::string::npos) << sPerfMessages[0];
+    EXPECT_NE(sPerfMessages[0].find(" p999 "), std::string::npos) << sPerfMessages[0];
+    EXPECT_NE(sPerfMessages[1].find("PerfStats - Frame checkpoint mix count 100 "), std::string::npos) << sPerfMessages[1];
+    
+    // Back to a statement per scope
+    //
+    sPerfMessages.clear();
+    ASSERT_TRUE(Trace::instance().initializeWithBuffer("kCategory_Perf@kPriority_Low", TestPerfCallback));
+    
+    {
+        PerfLogger perf("Single");
+    }
+    
+    Trace::instance().reset();
+    
+    ASSERT_EQ(sPerfMessages.size(), 1u);
+    EXPECT_NE(sPerfMessages[0].find("PerfLogger - Single "), std::string::npos) << sPerfMessages[0];
+    
+    PerfControl::setEnabled(false);
+}
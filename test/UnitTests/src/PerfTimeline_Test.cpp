@@ -0,0 +1,137 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "PerfLogger.h"
+#include "PerfTimeline.h"
+
+#include <thread>
+#include <sstream>
+
+static size_t countOf(const std::string& iText, const std::string& iPattern)
+{
+    size_t count = 0;
+    for (size_t position = iText.find(iPattern); position != std::string::npos; position = iText.find(iPattern, position + 1))
+        count++;
+    
+    return count;
+}
+
+TEST(PerfTimelineTest, PerfTimelineTest_CompleteEvents)
+{
+    PerfTimeline timeline;
+    timeline.start();
+    
+    std::thread thread([&timeline]()
+    {
+        Trace::setThreadName("audio \"main\"");
+        
+        timeline.record("Mix", 2000000, 1500);
+        timeline.record("Mix", 3000000, 1250);
+        timeline.record("Meter", 3001250, 10);
+    });
+    thread.join();
+    
+    timeline.record("Frame", 1000001, 999999);
+    timeline.stop();
+    
+    // Not captured once stopped
+    //
+    EXPECT_FALSE(timeline.capturing());
+    EXPECT_EQ(timeline.eventCount(), 4u);
+    
+    std::ostringstream stream;
+    timeline.write(stream);
+    std::string json = stream.str();
+    
+    EXPECT_EQ(json.compare(0, 16, "{\"traceEvents\":["), 0) << json;
+    EXPECT_NE(json.find("],\"displayTimeUnit\":\"ns\"}"), std::string::npos) << json;
+    
+    EXPECT_EQ(countOf(json, "\"ph\":\"X\""), 4u);
+    EXPECT_EQ(countOf(json, "\"ph\":\"M\""), 2u);
+    EXPECT_EQ(countOf(json, "\"name\":\"Mix\""), 2u);
+    
+    EXPECT_NE(json.find("\"args\":{\"name\":\"audio \\\"main\\\"\"}"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"name\":\"Frame\",\"cat\":\"perf\",\"ph\":\"X\",\"ts\":1000.001,\"dur\":999.999,"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"name\":\"Mix\",\"cat\":\"perf\",\"ph\":\"X\",\"ts\":2000.000,\"dur\":1.500,"), std::string::npos) << json;
+    
+    // The thread of Frame is numbered after the audio thread
+    //
+    EXPECT_NE(json.find("\"args\":{\"name\":\"Thread 2\"}"), std::string::npos) << json;
+    
+    // A new capture starts empty
+    //
+    timeline.start();
+    EXPECT_EQ(timeline.eventCount(), 0u);
+    
+    std::ostringstream empty;
+    timeline.write(empty);
+    EXPECT_EQ(empty.str(), "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+TEST(PerfTimelineTest, PerfTimelineTest_Drops)
+{
+    PerfTimeline timeline;
+    timeline.start(10);
+    
+    for (uint64_t i = 0; i < 25; i++)
+        timeline.record("Event", i * 1000, 500);
+    
+    EXPECT_EQ(timeline.eventCount(), 10u);
+    EXPECT_EQ(timeline.dropCount(), 15u);
+    
+    timeline.start(10);
+    EXPECT_EQ(timeline.dropCount(), 0u);
+}
+
+TEST(PerfTimelineTest, PerfTimelineTest_PerfLogger)
+{
+    PerfControl::setEnabled(true);
+    
+    PerfTimeline& timeline = PerfTimeline::instance();
+    timeline.start();
+    
+    {
+        PerfLogger frame("Frame");
+        
+        {
+            PerfLogger mix("Mix");
+        }
+        
+        frame.checkPoint("mixed");
+    }
+    
+    timeline.stop();
+    
+    {
+        PerfLogger ignored("Ignored");
+    }
+    
+    std::ostringstream stream;
+    timeline.write(stream);
+    std::string json = stream.str();
+    
+    EXPECT_EQ(timeline.eventCount(), 3u);
+    EXPECT_EQ(countOf(json, "\"name\":\"Frame\""), 1u);
+    EXPECT_EQ(countOf(json, "\"name\":\"Mix\""), 1u);
+    EXPECT_EQ(countOf(json, "\"name\":\"Frame checkpoint mixed\""), 1u);
+    EXPECT_EQ(countOf(json, "Ignored"), 0u);
+    
+    PerfControl::setEnabled(false);
+}
@@ -0,0 +1,136 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceBackend.h"
+
+#include <mutex>
+#include <fstream>
+
+static std::mutex sBackendMutex;
+static std::vector<std::string> sBackendMessages;
+
+static void TestBackendCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sBackendMutex);
+    
+    if (strstr(iMessage, "Backend"))
+        sBackendMessages.push_back(iMessage);
+}
+
+static std::vector<std::string> readBackendLog(const std::string& iPath)
+{
+    std::vector<std::string> result;
+    std::ifstream file(iPath);
+    std::string line;
+    
+    while (std::getline(file, line))
+    {
+        if (line.find("Backend") != std::string::npos)
+            result.push_back(line);
+    }
+    
+    return result;
+}
+
+TEST(TraceBackendTest, TraceBackendTest_Create)
+{
+    std::vector<std::string> names = TraceBackend::available();
+    ASSERT_FALSE(names.empty());
+    EXPECT_EQ(names[0], "native");
+    EXPECT_NE(std::find(names.begin(), names.end(), TraceBackend::defaultName()), names.end());
+    
+    for (const std::string& name : names)
+        EXPECT_TRUE(TraceBackend::create(name) != nullptr) << name;
+    
+    EXPECT_TRUE(TraceBackend::create("unknown") == nullptr);
+}
+
+TEST(TraceBackendTest, TraceBackendTest_Callback)
+{
+    for (const std::string& name : TraceBackend::available())
+    {
+        {
+            std::lock_guard<std::mutex> lock(sBackendMutex);
+            sBackendMessages.clear();
+        }
+        
+        Trace::instance().initializeWithBuffer("backend=" + name + "\nkCategory_Basic@kPriority_Medium"
+                                               , TestBackendCallback);
+        
+        for (int i = 0; i < 100; i++)
+        {
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Backend %d {}", i);
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Backend filtered %d", i);
+        }
+        
+        // Resetting drains the backend
+        //
+        Trace::instance().reset();
+        
+        std::lock_guard<std::mutex> lock(sBackendMutex);
+        ASSERT_EQ(sBackendMessages.size(), 100u) << name;
+        
+        for (int i = 0; i < 100; i++)
+            EXPECT_NE(sBackendMessages[i].find("Backend " + std::to_string(i) + " {}"), std::string::npos) << name;
+    }
+}
+
+TEST(TraceBackendTest, TraceBackendTest_File)
+{
+    for (const std::string& name : TraceBackend::available())
+    {
+        std::string path = "TraceBackend_" + name + ".log";
+        remove(path.c_str());
+        
+        Trace::instance().initializeWithBuffer("backend=" + name + "\nkCategory_Basic@kPriority_Medium"
+                                               , path);
+        
+        for (int i = 0; i < 100; i++)
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Backend %d", i);
+        
+        Trace::instance().reset();
+        
+        std::vector<std::string> lines = readBackendLog(path);
+        ASSERT_EQ(lines.size(), 100u) << name;
+        EXPECT_NE(lines[99].find("Backend 99"), std::string::npos) << name;
+        
+        remove(path.c_str());
+    }
+}
+
+TEST(TraceBackendTest, TraceBackendTest_Unknown)
+{
+    {
+        std::lock_guard<std::mutex> lock(sBackendMutex);
+        sBackendMessages.clear();
+    }
+    
+    Trace::instance().initializeWithBuffer("backend=unknown\nkCategory_Basic@kPriority_Low"
+                                           , TestBackendCallback);
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Backend %d", 1);
+    
+    Trace::instance().reset();
+    
+    std::lock_guard<std::mutex> lock(sBackendMutex);
+    EXPECT_TRUE(sBackendMessages.empty());
+}
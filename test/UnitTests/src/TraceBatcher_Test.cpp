@@ -0,0 +1,161 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceBatcher.h"
+
+#include <mutex>
+#include <thread>
+
+static std::mutex sBatchMutex;
+static std::vector<std::string> sBatchMessages;
+static std::vector<uint64_t> sBatchMasks;
+static std::vector<size_t> sBatchSizes;
+
+static void TestBatchCallback(const TraceRecord* iRecords, size_t iCount)
+{
+    std::lock_guard<std::mutex> lock(sBatchMutex);
+    
+    sBatchSizes.push_back(iCount);
+    
+    for (size_t i = 0; i < iCount; i++)
+    {
+        EXPECT_EQ(strlen(iRecords[i].message), iRecords[i].length);
+        sBatchMessages.push_back(iRecords[i].message);
+        sBatchMasks.push_back(iRecords[i].mask);
+    }
+}
+
+static void clearBatches()
+{
+    std::lock_guard<std::mutex> lock(sBatchMutex);
+    
+    sBatchMessages.clear();
+    sBatchMasks.clear();
+    sBatchSizes.clear();
+}
+
+static void waitForMessages(size_t iCount)
+{
+    for (int i = 0; i < 200; i++)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sBatchMutex);
+            if (sBatchMessages.size() >= iCount)
+                return;
+        }
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+static TraceRecord testRecord(const std::string& iMessage)
+{
+    TraceRecord record;
+    record.mask = Trace::kCategory_Basic | Trace::kPriority_High;
+    record.message = iMessage.c_str();
+    record.length = static_cast<uint32_t>(iMessage.length());
+    
+    return record;
+}
+
+TEST(TraceBatcherTest, TraceBatcherTest_Count)
+{
+    clearBatches();
+    
+    {
+        // The interval is long enough for only the count to trigger deliveries
+        //
+        TraceBatcher batcher(TestBatchCallback, 4, std::chrono::milliseconds(60000));
+        
+        for (int i = 0; i < 8; i++)
+            batcher.write(testRecord("Message " + std::to_string(i)));
+        
+        waitForMessages(8);
+        
+        std::lock_guard<std::mutex> lock(sBatchMutex);
+        ASSERT_EQ(sBatchMessages.size(), 8u);
+    }
+    
+    std::lock_guard<std::mutex> lock(sBatchMutex);
+    for (int i = 0; i < 8; i++)
+        EXPECT_EQ(sBatchMessages[i], "Message " + std::to_string(i));
+}
+
+TEST(TraceBatcherTest, TraceBatcherTest_Interval)
+{
+    clearBatches();
+    
+    TraceBatcher batcher(TestBatchCallback, 1000, std::chrono::milliseconds(10));
+    batcher.write(testRecord("Lonely"));
+    
+    waitForMessages(1);
+    
+    std::lock_guard<std::mutex> lock(sBatchMutex);
+    ASSERT_EQ(sBatchMessages.size(), 1u);
+    EXPECT_EQ(sBatchMessages[0], "Lonely");
+}
+
+TEST(TraceBatcherTest, TraceBatcherTest_Flush)
+{
+    clearBatches();
+    
+    TraceBatcher batcher(TestBatchCallback, 1000, std::chrono::milliseconds(60000));
+    batcher.write(testRecord("One"));
+    batcher.write(testRecord(""));
+    batcher.write(testRecord("Three"));
+    batcher.flush();
+    
+    std::lock_guard<std::mutex> lock(sBatchMutex);
+    ASSERT_EQ(sBatchSizes.size(), 1u);
+    ASSERT_EQ(sBatchMessages.size(), 3u);
+    EXPECT_EQ(sBatchMessages[0], "One");
+    EXPECT_EQ(sBatchMessages[1], "");
+    EXPECT_EQ(sBatchMessages[2], "Three");
+    EXPECT_EQ(batcher.dropCount(), 0u);
+}
+
+TEST(TraceBatcherTest, TraceBatcherTest_Trace)
+{
+    clearBatches();
+    
+    Trace::instance().initializeBatchedWithBuffer("kCategory_Basic@kPriority_Medium\nbatchSize=16\nbatchIntervalMs=60000"
+                                                  , TestBatchCallback);
+    
+    for (int i = 0; i < 40; i++)
+    {
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Batched %d", i);
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Filtered %d", i);
+    }
+    
+    // Resetting delivers the rest
+    //
+    Trace::instance().reset();
+    
+    std::lock_guard<std::mutex> lock(sBatchMutex);
+    ASSERT_EQ(sBatchMessages.size(), 40u);
+    
+    for (int i = 0; i < 40; i++)
+    {
+        EXPECT_EQ(sBatchMessages[i], "Batched " + std::to_string(i));
+        EXPECT_EQ(sBatchMasks[i], Trace::kCategory_Basic | Trace::kPriority_High);
+    }
+}
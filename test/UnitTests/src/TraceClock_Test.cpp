@@ -0,0 +1,198 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "TraceClock.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+static int64_t wallClockOffset()
+{
+    int64_t wallClock = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return static_cast<int64_t>(TraceClock::now()) - wallClock;
+}
+
+static void expectSource(TraceClock::Source iSource)
+{
+    ASSERT_TRUE(TraceClock::select(iSource)) << TraceClock::sourceName(iSource);
+    EXPECT_EQ(TraceClock::source(), iSource);
+    
+    // Anchored to the wall clock, never going back
+    //
+    EXPECT_LT(std::abs(wallClockOffset()), 50000000) << TraceClock::sourceName(iSource);
+    
+    uint64_t previous = TraceClock::now();
+    for (int i = 0; i < 10000; i++)
+    {
+        uint64_t now = TraceClock::now();
+        ASSERT_GE(now, previous) << TraceClock::sourceName(iSource);
+        previous = now;
+    }
+    
+    uint64_t start = TraceClock::monotonic();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t elapsed = TraceClock::monotonic() - start;
+    
+    EXPECT_GE(elapsed, 19000000u) << TraceClock::sourceName(iSource);
+    EXPECT_LT(elapsed, 500000000u) << TraceClock::sourceName(iSource);
+    
+    EXPECT_NEAR(static_cast<double>(TraceClock::toTime(start)), static_cast<double>(TraceClock::now() - elapsed), 5000000.0);
+}
+
+TEST(TraceClockTest, TraceClockTest_Sources)
+{
+    TraceClock::Source selected = TraceClock::source();
+    
+    expectSource(TraceClock::kSource_System);
+    expectSource(TraceClock::kSource_Steady);
+    EXPECT_EQ(TraceClock::nanosecondsPerTick(), 1.0);
+    
+#ifdef __linux__
+    expectSource(TraceClock::kSource_MonotonicRaw);
+#else
+    EXPECT_FALSE(TraceClock::select(TraceClock::kSource_MonotonicRaw));
+#endif
+    
+#ifdef TRACE_CLOCK_HAS_TSC
+    expectSource(TraceClock::kSource_Tsc);
+    EXPECT_GT(TraceClock::nanosecondsPerTick(), 0.0);
+    expectSource(TraceClock::kSource_Tscp);
+#else
+    EXPECT_FALSE(TraceClock::select(TraceClock::kSource_Tsc));
+#endif
+    
+    // The default follows the TSC detection
+    //
+    ASSERT_TRUE(TraceClock::select(TraceClock::kSource_Auto));
+    if (TraceClock::invariantTsc())
+        EXPECT_EQ(TraceClock::source(), TraceClock::kSource_Tsc);
+    else
+        EXPECT_NE(TraceClock::source(), TraceClock::kSource_Tsc);
+    
+    TraceClock::select(selected);
+}
+
+TEST(TraceClockTest, TraceClockTest_SourceChange)
+{
+    TraceClock::Source selected = TraceClock::source();
+    
+    // A duration measured across a change of source stays right
+    //
+    ASSERT_TRUE(TraceClock::select(TraceClock::kSource_Steady));
+    uint64_t start = TraceClock::monotonic();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    
+#ifdef TRACE_CLOCK_HAS_TSC
+    ASSERT_TRUE(TraceClock::select(TraceClock::kSource_Tsc));
+#else
+    ASSERT_TRUE(TraceClock::select(TraceClock::kSource_System));
+#endif
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t elapsed = TraceClock::monotonic() - start;
+    
+    EXPECT_GE(elapsed, 39000000u);
+    EXPECT_LT(elapsed, 500000000u);
+    
+    TraceClock::select(selected);
+}
+
+TEST(TraceClockTest, TraceClockTest_Update)
+{
+    TraceClock::Source selected = TraceClock::source();
+    ASSERT_TRUE(TraceClock::select(TraceClock::kSource_Auto));
+    
+    // Crossing the update re-anchors to the wall clock without stepping monotonic
+    //
+    uint64_t start = TraceClock::monotonic();
+    std::this_thread::sleep_for(std::chrono::milliseconds(TraceClock::sUpdateMs + 50));
+    TraceClock::now();
+    uint64_t elapsed = TraceClock::monotonic() - start;
+    
+    EXPECT_GE(elapsed, (TraceClock::sUpdateMs + 49) * 1000000ull);
+    EXPECT_LT(elapsed, (TraceClock::sUpdateMs + 500) * 1000000ull);
+    EXPECT_LT(std::abs(wallClockOffset()), 1000000);
+    
+    TraceClock::select(selected);
+}
+
+/**
+ * Exits with 0 when the first reading of the clock does not wait for the calibration
+ * of the TSC, and the clock switches to the TSC once it has been measured long enough.
+ */
+static void firstReading()
+{
+    auto start = std::chrono::steady_clock::now();
+    TraceClock::now();
+    auto first = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    
+    if (first >= static_cast<int64_t>(TraceClock::sCalibrationMs) * 1000 / 2)
+    {
+        fprintf(stderr, "First reading took %lld us\n", static_cast<long long>(first));
+        exit(1);
+    }
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(TraceClock::sCalibrationMs + 5));
+    TraceClock::now();
+    
+    if (TraceClock::invariantTsc() && TraceClock::source() != TraceClock::kSource_Tsc)
+    {
+        fprintf(stderr, "Still reading %s\n", TraceClock::sourceName(TraceClock::source()));
+        exit(2);
+    }
+    
+    exit(0);
+}
+
+TEST(TraceClockTest, TraceClockTest_FirstReading)
+{
+    // Run in a process of its own, where the clock was never read
+    //
+    GTEST_FLAG_SET(death_test_style, "threadsafe");
+    EXPECT_EXIT(firstReading(), ::testing::ExitedWithCode(0), "");
+}
+
+TEST(TraceClockTest, TraceClockTest_Names)
+{
+    TraceClock::Source source = TraceClock::kSource_Auto;
+    
+    EXPECT_TRUE(TraceClock::parseSource("monotonic_raw", source));
+    EXPECT_EQ(source, TraceClock::kSource_MonotonicRaw);
+    EXPECT_TRUE(TraceClock::parseSource("tscp", source));
+    EXPECT_EQ(source, TraceClock::kSource_Tscp);
+    EXPECT_FALSE(TraceClock::parseSource("hpet", source));
+    
+    EXPECT_STREQ(TraceClock::sourceName(TraceClock::kSource_Steady), "steady");
+}
+
+TEST(TraceClockTest, TraceClockTest_Option)
+{
+    TraceClock::Source selected = TraceClock::source();
+    
+    Trace::instance().reset();
+    ASSERT_TRUE(Trace::instance().initializeWithBuffer("clock=steady\nkCategory_Basic@kPriority_Low", [](const char*) {}));
+    EXPECT_EQ(TraceClock::source(), TraceClock::kSource_Steady);
+    Trace::instance().reset();
+    
+    TraceClock::select(selected);
+}
@@ -0,0 +1,198 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceCoalescer.h"
+
+#include <mutex>
+#include <thread>
+
+static const uint64_t sTestWindow{1000};
+
+struct TestSummaries
+{
+    void operator()(const void* iSite, const std::string& iSummary)
+    {
+        sites.push_back(iSite);
+        summaries.push_back(iSummary);
+    }
+    
+    std::vector<const void*> sites;
+    std::vector<std::string> summaries;
+};
+
+static bool testProcess(TraceCoalescer& ioCoalescer, const void* iSite, const std::string& iMessage, uint64_t iTimestamp, TestSummaries& oSummaries)
+{
+    return ioCoalescer.process(iSite, iMessage.c_str(), iMessage.length(), iTimestamp, std::ref(oSummaries));
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Repeated)
+{
+    TraceCoalescer coalescer(sTestWindow);
+    TestSummaries summaries;
+    int site;
+    
+    EXPECT_TRUE(testProcess(coalescer, &site, "Connection lost", 1, summaries));
+    
+    for (uint64_t i = 2; i < 6; i++)
+        EXPECT_FALSE(testProcess(coalescer, &site, "Connection lost", i, summaries));
+    
+    EXPECT_TRUE(summaries.summaries.empty());
+    
+    // Same statement after the window, the summary comes first
+    //
+    EXPECT_TRUE(testProcess(coalescer, &site, "Connection lost", 1 + sTestWindow, summaries));
+    ASSERT_EQ(summaries.summaries.size(), 1u);
+    EXPECT_EQ(summaries.summaries[0], "last message repeated 4 times: Connection lost");
+    EXPECT_EQ(summaries.sites[0], &site);
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Distinct)
+{
+    TraceCoalescer coalescer(sTestWindow);
+    TestSummaries summaries;
+    int site1;
+    int site2;
+    
+    // Different payloads and different call sites are never coalesced
+    //
+    EXPECT_TRUE(testProcess(coalescer, &site1, "Retry 1", 1, summaries));
+    EXPECT_TRUE(testProcess(coalescer, &site1, "Retry 2", 2, summaries));
+    EXPECT_TRUE(testProcess(coalescer, &site2, "Retry 1", 3, summaries));
+    EXPECT_FALSE(testProcess(coalescer, &site1, "Retry 1", 4, summaries));
+    EXPECT_EQ(coalescer.size(), 3u);
+    
+    coalescer.flush(std::ref(summaries));
+    ASSERT_EQ(summaries.summaries.size(), 1u);
+    EXPECT_EQ(summaries.summaries[0], "last message repeated 1 times: Retry 1");
+    EXPECT_EQ(coalescer.size(), 0u);
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Sweep)
+{
+    TraceCoalescer coalescer(sTestWindow);
+    TestSummaries summaries;
+    int site;
+    
+    EXPECT_TRUE(testProcess(coalescer, &site, "Burst", 1, summaries));
+    EXPECT_FALSE(testProcess(coalescer, &site, "Burst", 2, summaries));
+    
+    // Any later statement reports the burst once its window ended
+    //
+    EXPECT_TRUE(testProcess(coalescer, &site, "Other", 2 * sTestWindow, summaries));
+    ASSERT_EQ(summaries.summaries.size(), 1u);
+    EXPECT_EQ(summaries.summaries[0], "last message repeated 1 times: Burst");
+    EXPECT_EQ(coalescer.size(), 1u);
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_OutOfOrder)
+{
+    TraceCoalescer coalescer(sTestWindow);
+    TestSummaries summaries;
+    int site;
+    int other;
+    
+    // Statements stamped slightly before the previous ones, like the ones
+    // of the shared queue or those TraceTail holds back, stay in the window
+    //
+    EXPECT_TRUE(testProcess(coalescer, &site, "Connection lost", 5000, summaries));
+    EXPECT_TRUE(testProcess(coalescer, &other, "Retrying", 5002, summaries));
+    EXPECT_FALSE(testProcess(coalescer, &site, "Connection lost", 4990, summaries));
+    EXPECT_FALSE(testProcess(coalescer, &other, "Retrying", 4995, summaries));
+    EXPECT_FALSE(testProcess(coalescer, &site, "Connection lost", 5001, summaries));
+    
+    EXPECT_TRUE(summaries.summaries.empty());
+    EXPECT_EQ(coalescer.size(), 2u);
+    
+    coalescer.flush(std::ref(summaries));
+    ASSERT_EQ(summaries.summaries.size(), 2u);
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Bounded)
+{
+    TraceCoalescer coalescer(sTestWindow, 4);
+    TestSummaries summaries;
+    int site;
+    
+    for (int i = 0; i < 16; i++)
+    {
+        EXPECT_TRUE(testProcess(coalescer, &site, std::to_string(i), 1, summaries));
+        EXPECT_LE(coalescer.size(), 4u);
+    }
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Disabled)
+{
+    TraceCoalescer coalescer(0);
+    TestSummaries summaries;
+    int site;
+    
+    for (uint64_t i = 0; i < 4; i++)
+        EXPECT_TRUE(testProcess(coalescer, &site, "Connection lost", i, summaries));
+    
+    EXPECT_EQ(coalescer.size(), 0u);
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Options)
+{
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low\ncoalesceWindowMs = 250\n#name=ignored"
+                                           , "");
+    
+    EXPECT_EQ(Trace::instance().optionInt("coalesceWindowMs"), 250);
+    EXPECT_EQ(Trace::instance().option("name", "none"), "none");
+    EXPECT_EQ(Trace::instance().optionInt("missing", 7), 7);
+    
+    Trace::instance().reset();
+    
+    EXPECT_EQ(Trace::instance().optionInt("coalesceWindowMs"), 0);
+}
+
+static std::mutex sCoalescedMutex;
+static std::vector<std::string> sCoalescedMessages;
+
+static void TestCoalescedCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sCoalescedMutex);
+    
+    if (strstr(iMessage, "Coalesced"))
+        sCoalescedMessages.push_back(iMessage);
+}
+
+TEST(TraceCoalescerTest, TraceCoalescerTest_Trace)
+{
+    sCoalescedMessages.clear();
+    
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low\ncoalesceWindowMs=60000"
+                                           , TestCoalescedCallback);
+    
+    for (int i = 0; i < 100; i++)
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Coalesced %d", 1);
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Coalesced %d", 2);
+    
+    Trace::instance().reset();
+    
+    std::lock_guard<std::mutex> lock(sCoalescedMutex);
+    ASSERT_EQ(sCoalescedMessages.size(), 3u);
+    EXPECT_NE(sCoalescedMessages[0].find("Coalesced 1"), std::string::npos);
+    EXPECT_NE(sCoalescedMessages[1].find("Coalesced 2"), std::string::npos);
+    EXPECT_NE(sCoalescedMessages[2].find("last message repeated 99 times: "), std::string::npos);
+}
@@ -0,0 +1,183 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceConsoleSink.h"
+
+#include <thread>
+#include <vector>
+
+static TraceRecord testRecord(const std::string& iMessage)
+{
+    TraceRecord record;
+    record.message = iMessage.c_str();
+    record.length = static_cast<uint32_t>(iMessage.length());
+    
+    return record;
+}
+
+static std::string readStream(FILE* iStream)
+{
+    std::string result;
+    
+    fflush(iStream);
+    rewind(iStream);
+    
+    char buffer[4096];
+    size_t count = 0;
+    while ((count = fread(buffer, 1, sizeof(buffer), iStream)) > 0)
+        result.append(buffer, count);
+    
+    return result;
+}
+
+TEST(TraceConsoleSinkTest, TraceConsoleSinkTest_Unbuffered)
+{
+    FILE* stream = tmpfile();
+    ASSERT_NE(stream, nullptr);
+    
+    TraceConsoleSink sink(stream, std::chrono::milliseconds(0));
+    
+    sink.write(testRecord("First"));
+    EXPECT_EQ(readStream(stream), "First\n");
+    
+    sink.write(testRecord("Second"));
+    EXPECT_EQ(readStream(stream), "First\nSecond\n");
+    
+    fclose(stream);
+}
+
+TEST(TraceConsoleSinkTest, TraceConsoleSinkTest_Buffered)
+{
+    FILE* stream = tmpfile();
+    ASSERT_NE(stream, nullptr);
+    
+    {
+        TraceConsoleSink sink(stream, std::chrono::milliseconds(60000), 16);
+        
+        sink.write(testRecord("First"));
+        sink.write(testRecord("Second"));
+        EXPECT_EQ(readStream(stream), "");
+        
+        // Reaching the buffer size writes everything
+        //
+        sink.write(testRecord("Third"));
+        EXPECT_EQ(readStream(stream), "First\nSecond\nThird\n");
+        
+        sink.write(testRecord("Fourth"));
+        sink.flush();
+        EXPECT_EQ(readStream(stream), "First\nSecond\nThird\nFourth\n");
+        
+        sink.write(testRecord("Fifth"));
+    }
+    
+    // The destructor writes what is left
+    //
+    EXPECT_EQ(readStream(stream), "First\nSecond\nThird\nFourth\nFifth\n");
+    
+    fclose(stream);
+}
+
+TEST(TraceConsoleSinkTest, TraceConsoleSinkTest_Interval)
+{
+    FILE* stream = tmpfile();
+    ASSERT_NE(stream, nullptr);
+    
+    TraceConsoleSink sink(stream, std::chrono::milliseconds(10));
+    sink.write(testRecord("Waiting"));
+    
+    std::string output;
+    for (int i = 0; i < 500 && output.empty(); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        output = readStream(stream);
+    }
+    
+    EXPECT_EQ(output, "Waiting\n");
+    
+    fclose(stream);
+}
+
+TEST(TraceConsoleSinkTest, TraceConsoleSinkTest_Threads)
+{
+    FILE* stream = tmpfile();
+    ASSERT_NE(stream, nullptr);
+    
+    const int threadCount = 4;
+    const int lineCount = 2000;
+    
+    {
+        TraceConsoleSink sink(stream, std::chrono::milliseconds(1), 512);
+        
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&sink, t]()
+            {
+                for (int i = 0; i < lineCount; i++)
+                    sink.write(testRecord("Thread " + std::to_string(t) + " line " + std::to_string(i)));
+            });
+        }
+        
+        for (auto& thread : threads)
+            thread.join();
+    }
+    
+    // Every line is intact and the lines of each thread are in order
+    //
+    std::vector<int> next(threadCount, 0);
+    std::stringstream lines(readStream(stream));
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        int thread = -1;
+        int index = -1;
+        ASSERT_EQ(sscanf(line.c_str(), "Thread %d line %d", &thread, &index), 2) << line;
+        ASSERT_GE(thread, 0);
+        ASSERT_LT(thread, threadCount);
+        EXPECT_EQ(index, next[thread]);
+        next[thread] = index + 1;
+    }
+    
+    for (int t = 0; t < threadCount; t++)
+        EXPECT_EQ(next[t], lineCount);
+    
+    fclose(stream);
+}
+
+static void TestConsoleCallback(const char*)
+{
+}
+
+TEST(TraceConsoleSinkTest, TraceConsoleSinkTest_Trace)
+{
+    testing::internal::CaptureStdout();
+    
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low\nconsole=on\nconsoleFlushMs=0", TestConsoleCallback);
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Console statement %d", 1);
+    Trace::instance().reset();
+    
+    std::string output = testing::internal::GetCapturedStdout();
+    
+    // The configuration echo followed by the statement
+    //
+    EXPECT_NE(output.find("kCategory_Basic@kPriority_Low\nconsole=on\nconsoleFlushMs=0\n"), std::string::npos);
+    EXPECT_NE(output.find("Console statement 1\n"), std::string::npos);
+}
@@ -0,0 +1,144 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceContentFilter.h"
+
+#include <mutex>
+#include <thread>
+
+static bool passes(const TraceContentFilter& iFilter, uint64_t iMask, const char* iThreadName, const std::string& iMessage)
+{
+    return iFilter.pass(iMask, iThreadName, iMessage.c_str(), iMessage.length());
+}
+
+TEST(TraceContentFilterTest, TraceContentFilterTest_Contains)
+{
+    TraceContentFilter filter;
+    EXPECT_TRUE(filter.empty());
+    
+    EXPECT_TRUE(filter.addContent(Trace::kCategory_Network, "contains:10.0.0.7"));
+    EXPECT_FALSE(filter.empty());
+    EXPECT_FALSE(filter.usesThreadNames());
+    
+    EXPECT_TRUE(passes(filter, Trace::kCategory_Network | Trace::kPriority_Low, nullptr, "Connected to peer 10.0.0.7"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Network | Trace::kPriority_Low, nullptr, "Connected to peer 10.0.0.8"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Network | Trace::kPriority_Low, nullptr, ""));
+    
+    // Other categories are not filtered
+    //
+    EXPECT_TRUE(passes(filter, Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, "Connected to peer 10.0.0.8"));
+    
+    // Without a prefix the text is contained
+    //
+    TraceContentFilter plain;
+    EXPECT_TRUE(plain.addContent(Trace::kCategory_Always, "peer"));
+    EXPECT_TRUE(passes(plain, Trace::kCategory_Basic, nullptr, "peer 1"));
+    EXPECT_FALSE(passes(plain, Trace::kCategory_Perf, nullptr, "client 1"));
+}
+
+TEST(TraceContentFilterTest, TraceContentFilterTest_Regex)
+{
+    TraceContentFilter filter;
+    EXPECT_TRUE(filter.addContent(Trace::kCategory_Always, "regex:peer [0-9]+ (up|down)"));
+    EXPECT_FALSE(filter.addContent(Trace::kCategory_Always, "regex:peer ([0-9]+"));
+    
+    EXPECT_TRUE(passes(filter, Trace::kCategory_Basic, nullptr, "Link to peer 12 down"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Basic, nullptr, "Link to peer 12 flapping"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Basic, nullptr, "Link to peer x down"));
+}
+
+TEST(TraceContentFilterTest, TraceContentFilterTest_Thread)
+{
+    TraceContentFilter filter;
+    EXPECT_TRUE(filter.addThread(Trace::kCategory_Network, "net.*"));
+    EXPECT_TRUE(filter.addContent(Trace::kCategory_Network, "send"));
+    EXPECT_TRUE(filter.usesThreadNames());
+    
+    // Every rule of the category has to match
+    //
+    EXPECT_TRUE(passes(filter, Trace::kCategory_Network, "network", "send 1"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Network, "network", "receive 1"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Network, "ui", "send 1"));
+    EXPECT_FALSE(passes(filter, Trace::kCategory_Network, nullptr, "send 1"));
+    
+    std::string name;
+    std::thread other([&name]()
+    {
+        Trace::setThreadName("worker");
+        name = TraceThreadName::get();
+    });
+    other.join();
+    
+    EXPECT_EQ(name, "worker");
+}
+
+static std::mutex sFilterMutex;
+static std::vector<std::string> sFilterMessages;
+
+static void TestFilterCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sFilterMutex);
+    
+    if (strstr(iMessage, "Filter"))
+        sFilterMessages.push_back(iMessage);
+}
+
+TEST(TraceContentFilterTest, TraceContentFilterTest_Trace)
+{
+    for (const std::string& name : TraceBackend::available())
+    {
+        // Boost.Log filters run on the writing thread
+        //
+        if (name == "boost")
+            continue;
+        
+        {
+            std::lock_guard<std::mutex> lock(sFilterMutex);
+            sFilterMessages.clear();
+        }
+        
+        Trace::instance().initializeWithBuffer("backend=" + name + "\n"
+                                               "kCategory_Always@kPriority_Low\n"
+                                               "filter.kCategory_Network=contains:10.0.0.7\n"
+                                               "filterThread.kCategory_Perf=perf.*"
+                                               , TestFilterCallback);
+        
+        BBC_TRACE(Trace::kCategory_Network | Trace::kPriority_Low, "Filter peer %s", "10.0.0.7");
+        BBC_TRACE(Trace::kCategory_Network | Trace::kPriority_Low, "Filter peer %s", "10.0.0.8");
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Filter basic %s", "10.0.0.8");
+        BBC_TRACE(Trace::kCategory_Perf | Trace::kPriority_Low, "Filter unnamed %d", 1);
+        
+        std::thread perf([]()
+        {
+            Trace::setThreadName("perf-sampler");
+            BBC_TRACE(Trace::kCategory_Perf | Trace::kPriority_Low, "Filter named %d", 2);
+        });
+        perf.join();
+        
+        Trace::instance().reset();
+        
+        std::lock_guard<std::mutex> lock(sFilterMutex);
+        ASSERT_EQ(sFilterMessages.size(), 3u) << name;
+        EXPECT_NE(sFilterMessages[0].find("Filter peer 10.0.0.7"), std::string::npos) << name;
+        EXPECT_NE(sFilterMessages[1].find("Filter basic"), std::string::npos) << name;
+        EXPECT_NE(sFilterMessages[2].find("Filter named 2"), std::string::npos) << name;
+    }
+}
@@ -0,0 +1,266 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceFileWriter.h"
+
+#ifndef _WIN32
+
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::string readFile(const std::string& iPath)
+{
+    std::ifstream file(iPath, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    
+    return content.str();
+}
+
+static uint64_t fileSize(const std::string& iPath)
+{
+    struct stat info;
+    return stat(iPath.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+static uint64_t fileAllocated(const std::string& iPath)
+{
+    struct stat info;
+    return stat(iPath.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_blocks) * 512 : 0;
+}
+
+static std::string testLine(int iIndex)
+{
+    return "Statement " + std::to_string(iIndex) + " of the file writer test\n";
+}
+
+TEST(TraceFileWriterTest, TraceFileWriterTest_Write)
+{
+    const std::string path = "TraceFileWriter_write.log";
+    remove(path.c_str());
+    
+    std::string expected;
+    
+    {
+        TraceFileWriter writer;
+        ASSERT_TRUE(writer.open(path, 0, false));
+        
+        // Spans several buffers
+        //
+        for (int i = 0; i < 20000; i++)
+        {
+            std::string line = testLine(i);
+            writer.write(line.data(), line.length());
+            expected += line;
+            
+            if (i % 1000 == 0)
+                writer.flush();
+        }
+        
+        EXPECT_EQ(writer.size(), expected.length());
+    }
+    
+    EXPECT_EQ(readFile(path), expected);
+    
+    remove(path.c_str());
+}
+
+TEST(TraceFileWriterTest, TraceFileWriterTest_Append)
+{
+    const std::string path = "TraceFileWriter_append.log";
+    remove(path.c_str());
+    
+    std::string expected;
+    
+    // Every reopen continues from a partial block
+    //
+    for (int round = 0; round < 3; round++)
+    {
+        TraceFileWriter writer;
+        ASSERT_TRUE(writer.open(path, 0, false));
+        EXPECT_EQ(writer.size(), expected.length());
+        
+        for (int i = 0; i < 100; i++)
+        {
+            std::string line = testLine((round * 100) + i);
+            writer.write(line.data(), line.length());
+            expected += line;
+        }
+    }
+    
+    EXPECT_EQ(readFile(path), expected);
+    
+    remove(path.c_str());
+}
+
+TEST(TraceFileWriterTest, TraceFileWriterTest_Preallocate)
+{
+    const std::string path = "TraceFileWriter_preallocate.log";
+    remove(path.c_str());
+    
+    const uint64_t extent = 1024 * 1024;
+    std::string line = testLine(0);
+    
+    {
+        TraceFileWriter writer;
+        ASSERT_TRUE(writer.open(path, extent, false));
+        
+        writer.write(line.data(), line.length());
+        writer.flush();
+        
+        // The whole extent is reserved at once, readers only see what was written
+        //
+        EXPECT_EQ(fileSize(path), line.length());
+        EXPECT_EQ(readFile(path), line);
+#ifdef __linux__
+        EXPECT_GE(fileAllocated(path), extent);
+#endif
+    }
+    
+    // and trimmed on close
+    //
+    EXPECT_EQ(fileSize(path), line.length());
+    EXPECT_EQ(readFile(path), line);
+    
+    remove(path.c_str());
+}
+
+TEST(TraceFileWriterTest, TraceFileWriterTest_NotClosed)
+{
+    const std::string path = "TraceFileWriter_not_closed.log";
+    const std::string first = testLine(0);
+    const std::string second = testLine(1);
+    
+    for (bool direct : { false, true })
+    {
+        remove(path.c_str());
+        
+        // A writer that never gets to close, as in a crash
+        //
+        pid_t child = fork();
+        ASSERT_GE(child, 0);
+        
+        if (!child)
+        {
+            TraceFileWriter* writer = new TraceFileWriter();
+            writer->open(path, 1024 * 1024, direct);
+            writer->write(first.data(), first.length());
+            writer->flush();
+            _exit(0);
+        }
+        
+        int status = 0;
+        waitpid(child, &status, 0);
+        
+        // Nothing but the statement is visible, padding included
+        //
+        if (!direct)
+            EXPECT_EQ(readFile(path), first);
+        
+        {
+            TraceFileWriter writer;
+            ASSERT_TRUE(writer.open(path, 1024 * 1024, direct));
+            EXPECT_EQ(writer.size(), first.length()) << direct;
+            
+            writer.write(second.data(), second.length());
+        }
+        
+        EXPECT_EQ(readFile(path), first + second) << direct;
+    }
+    
+    // Files padded with zeros by an older writer continue after the statements
+    //
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << first << std::string(1024 * 1024, '\0');
+    }
+    
+    {
+        TraceFileWriter writer;
+        ASSERT_TRUE(writer.open(path, 0, false));
+        writer.write(second.data(), second.length());
+    }
+    
+    EXPECT_EQ(readFile(path), first + second);
+    
+    remove(path.c_str());
+}
+
+TEST(TraceFileWriterTest, TraceFileWriterTest_Direct)
+{
+    const std::string path = "TraceFileWriter_direct.log";
+    remove(path.c_str());
+    
+    std::string expected;
+    
+    {
+        // Falls back to the page cache when O_DIRECT is not supported
+        //
+        TraceFileWriter writer;
+        ASSERT_TRUE(writer.open(path, 1024 * 1024, true));
+        
+        for (int i = 0; i < 10000; i++)
+        {
+            std::string line = testLine(i);
+            writer.write(line.data(), line.length());
+            expected += line;
+            
+            if (i % 777 == 0)
+                writer.flush();
+        }
+    }
+    
+    EXPECT_EQ(readFile(path), expected);
+    
+    remove(path.c_str());
+}
+
+TEST(TraceFileWriterTest, TraceFileWriterTest_Trace)
+{
+    const std::string path = "TraceFileWriter_trace.log";
+    remove(path.c_str());
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low\nfilePreallocateMb=4\nfileDirectIO=on", path);
+    
+    for (int i = 0; i < 1000; i++)
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Preallocated %d", i);
+    
+    Trace::instance().reset();
+    
+    std::stringstream content(readFile(path));
+    std::string line;
+    int count = 0;
+    
+    while (std::getline(content, line))
+    {
+        EXPECT_NE(line.find("Preallocated " + std::to_string(count)), std::string::npos) << line;
+        count++;
+    }
+    
+    EXPECT_EQ(count, 1000);
+    EXPECT_LT(fileSize(path), 4u * 1024 * 1024);
+    
+    remove(path.c_str());
+}
+
+#endif // _WIN32
@@ -0,0 +1,170 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceFormat.h"
+
+#include <limits.h>
+#include <float.h>
+
+/// Formats with TraceFormat and vsnprintf and expects the same result
+static void expectSame(size_t iSize, const char* iFormat, ...)
+{
+    va_list args;
+    va_list copy;
+    va_start(args, iFormat);
+    va_copy(copy, args);
+    
+    char expected[512];
+    char actual[512];
+    memset(expected, 'E', sizeof(expected));
+    memset(actual, 'E', sizeof(actual));
+    
+    int expectedCount = vsnprintf(expected, iSize, iFormat, args);
+    
+    TraceFormat format(iFormat);
+    ASSERT_TRUE(format.valid()) << iFormat;
+    int actualCount = format.format(actual, iSize, copy);
+    
+    va_end(copy);
+    va_end(args);
+    
+    EXPECT_EQ(actualCount, expectedCount) << iFormat;
+    EXPECT_EQ(memcmp(actual, expected, sizeof(expected)), 0) << iFormat << ": \"" << actual << "\" != \"" << expected << "\"";
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Integers)
+{
+    expectSame(512, "Backend %d", 42);
+    expectSame(512, "Route %02d", 7);
+    expectSame(512, "producer %d %d", -1, INT_MAX);
+    expectSame(512, "%d %i %d", 0, INT_MIN, -123456789);
+    expectSame(512, "[%5d] [%-5d] [%05d] [%+d] [% d] [%+05d]", 42, 42, -42, 42, 42, -42);
+    expectSame(512, "[%.3d] [%8.3d] [%-8.3d] [%08.3d] [%.0d] [%5.0d]", 7, -7, 7, 7, 0, 0);
+    expectSame(512, "%u %u %lu %llu", 0u, UINT_MAX, ULONG_MAX, ULLONG_MAX);
+    expectSame(512, "%ld %lld %lld", LONG_MIN, LLONG_MIN, LLONG_MAX);
+    expectSame(512, "%hd %hhd %hu %hhu", 70000, 300, 70000, 300);
+    expectSame(512, "%zu %zd %jd %ju %td", static_cast<size_t>(12345), static_cast<ptrdiff_t>(-5), static_cast<intmax_t>(-77), static_cast<uintmax_t>(88), static_cast<ptrdiff_t>(-99));
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Hex)
+{
+    expectSame(512, "0x%jX", static_cast<uintmax_t>(0xDEADBEEFCAFEull));
+    expectSame(512, "%x %X %#x %#X %#x", 0xabcu, 0xabcu, 0xabcu, 0xabcu, 0u);
+    expectSame(512, "%02X %08x %#018llx %#018llX", 0x5u, 0x1234u, 0x1234ull, ULLONG_MAX);
+    expectSame(512, "[%-8x] [%8.4x] [%#10.6x] [%.0x]", 0xffu, 0xffu, 0xffu, 0u);
+    expectSame(512, "%hhx %hx %lx", 0x1ffu, 0x1ffffu, ULONG_MAX);
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Strings)
+{
+    expectSame(512, "Hello %s!", "world");
+    expectSame(512, "%s != %s", "a", "");
+    expectSame(512, "[%10s] [%-10s] [%.3s] [%10.2s] [%-6.10s]", "abc", "abc", "abcdef", "abcdef", "abc");
+    expectSame(512, "%c%c%c [%3c] [%-3c]", 'a', 'b', 'c', 'd', 'e');
+    expectSame(512, "100%% %s %%%d%%", "done", 5);
+    expectSame(512, "Hello world!");
+    expectSame(512, "");
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Float)
+{
+    expectSame(512, "Hello %s - %d %f!", "world", 1, 2.5);
+    expectSame(512, "%f %.2f %10.3f %-10.1f| %+f %08.2f", 3.14159, -2.675, 1e6, 0.05, 0.0, -1.5);
+    expectSame(512, "%.0f %.0f %.0f %#.0f %F", 0.5, 1.5, 2.5, 3.0, 1.0 / 0.0);
+    expectSame(512, "%lf %f", DBL_MIN, -DBL_MAX);
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Truncate)
+{
+    for (size_t size = 0; size < 24; size++)
+    {
+        expectSame(size, "Route %02d and %s %x", 3, "some text", 0xbeefu);
+        expectSame(size, "%-12d|%12s|", -5, "right");
+    }
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Unsupported)
+{
+    // These are left to vsnprintf
+    //
+    const char* formats[] = { "%*d", "%.*s", "%p", "%n", "%e", "%g", "%a", "%o", "%Lf", "%ls", "%05s", "%#d", "%.2c", "%", "%5" };
+    
+    for (const char* format : formats)
+    {
+        EXPECT_FALSE(TraceFormat(format).valid()) << format;
+        EXPECT_EQ(TraceFormat::find(format), nullptr) << format;
+    }
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Find)
+{
+    static const char* sFormat = "Find %d";
+    
+    const TraceFormat* format = TraceFormat::find(sFormat);
+    ASSERT_NE(format, nullptr);
+    EXPECT_EQ(TraceFormat::find(sFormat), format);
+    
+    // Format strings that may be rewritten in place are never compiled
+    //
+    char dynamic[32];
+    strcpy(dynamic, "Dynamic %d");
+    EXPECT_FALSE(TraceFormat::isLiteral(dynamic));
+    EXPECT_EQ(TraceFormat::find(dynamic), nullptr);
+    
+    std::string copy(sFormat);
+    EXPECT_FALSE(TraceFormat::isLiteral(copy.c_str()));
+    EXPECT_EQ(TraceFormat::find(copy.c_str()), nullptr);
+    
+    static char sBuffer[32] = "Static %d";
+    EXPECT_FALSE(TraceFormat::isLiteral(sBuffer));
+    EXPECT_EQ(TraceFormat::find(sBuffer), nullptr);
+}
+
+static std::vector<std::string> sFormatMessages;
+
+static void TestFormatCallback(const char* iMessage)
+{
+    sFormatMessages.push_back(iMessage);
+}
+
+TEST(TraceFormatTest, TraceFormatTest_Trace)
+{
+    sFormatMessages.clear();
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low", TestFormatCallback);
+    
+    for (int i = 0; i < 3; i++)
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Format %s %05d 0x%jX %.2f", "run", i, static_cast<uintmax_t>(0xABCD), 0.125 * i);
+    
+    Trace::instance().reset();
+    
+    ASSERT_EQ(sFormatMessages.size(), 3u);
+    EXPECT_NE(sFormatMessages[0].find("Format run 00000 0xABCD 0.00"), std::string::npos);
+    EXPECT_NE(sFormatMessages[2].find("Format run 00002 0xABCD 0.25"), std::string::npos);
+}
+
+TEST(TraceFormatTest, TraceFormatTest_FloatFields)
+{
+    expectSame(512, "[%12.3f] [%-12.3f] [%012.3f] [%+012.3f] [% .2f] [%+.0f]", -12.3456, -12.3456, -12.3456, 12.3456, 0.125, -0.4);
+    expectSame(512, "[%#.0f] [%#8.0f] [%-#8.0f] [%.19f] [%.20f]", 7.0, -7.0, 7.0, 0.1, 0.1);
+    expectSame(512, "[%8f] [%-8F] [%08f] [%f] [%.3f]", 0.0 / 0.0, 1.0 / 0.0, -1.0 / 0.0, 1e300, 18446744073709551616.0);
+    expectSame(512, "Meter peak %.2f rms %.1f dB lufs %+.1f samples %llu gain %.3f", -0.005, -3.05, -14.25, 123456789012ull, 0.7071);
+}
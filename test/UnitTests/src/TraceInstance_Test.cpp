@@ -0,0 +1,142 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+
+#include <mutex>
+#include <thread>
+
+static std::mutex sInstanceMutex;
+static std::vector<std::string> sEngineMessages;
+static std::vector<std::string> sUIMessages;
+
+static void TestEngineCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sInstanceMutex);
+    sEngineMessages.push_back(iMessage);
+}
+
+static void TestUICallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sInstanceMutex);
+    sUIMessages.push_back(iMessage);
+}
+
+static void traceTo(Trace& iTrace, Trace::TraceMask iMask, int iValue)
+{
+    BBC_TRACE_TO_R(iTrace, iMask, "Instance %d", iValue);
+}
+
+TEST(TraceInstanceTest, TraceInstanceTest_Independent)
+{
+    sEngineMessages.clear();
+    sUIMessages.clear();
+    
+    Trace engine;
+    Trace ui;
+    
+    ASSERT_TRUE(engine.initializeWithBuffer("backend=native\nkCategory_Dante@kPriority_Low", TestEngineCallback));
+    ASSERT_TRUE(ui.initializeWithBuffer("backend=native\nkCategory_UI@kPriority_High", TestUICallback));
+    EXPECT_NE(engine.generation(), ui.generation());
+    
+    BBC_TRACE_TO(engine, Trace::kCategory_Dante | Trace::kPriority_Low, "Instance engine %d", 1);
+    BBC_TRACE_TO(engine, Trace::kCategory_UI | Trace::kPriority_High, "Instance engine %d", 2);
+    BBC_TRACE_TO(ui, Trace::kCategory_UI | Trace::kPriority_High, "Instance ui %d", 3);
+    BBC_TRACE_TO(ui, Trace::kCategory_UI | Trace::kPriority_Low, "Instance ui %d", 4);
+    
+    // The global instance is not initialized
+    //
+    BBC_TRACE(Trace::kCategory_Dante | Trace::kPriority_Low, "Instance global %d", 5);
+    
+    engine.reset();
+    ui.reset();
+    
+    ASSERT_EQ(sEngineMessages.size(), 1u);
+    EXPECT_NE(sEngineMessages[0].find("Instance engine 1"), std::string::npos);
+    ASSERT_EQ(sUIMessages.size(), 1u);
+    EXPECT_NE(sUIMessages[0].find("Instance ui 3"), std::string::npos);
+}
+
+TEST(TraceInstanceTest, TraceInstanceTest_SharedSite)
+{
+    sEngineMessages.clear();
+    sUIMessages.clear();
+    
+    Trace engine;
+    Trace ui;
+    
+    engine.initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low", TestEngineCallback);
+    ui.initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_High", TestUICallback);
+    
+    // One call site alternating between the instances follows the masks of each
+    //
+    for (int i = 0; i < 10; i++)
+    {
+        traceTo(engine, Trace::kCategory_Basic | Trace::kPriority_Medium, i);
+        traceTo(ui, Trace::kCategory_Basic | Trace::kPriority_Medium, i);
+    }
+    
+    engine.reset();
+    ui.reset();
+    
+    EXPECT_EQ(sEngineMessages.size(), 10u);
+    EXPECT_EQ(sUIMessages.size(), 0u);
+}
+
+TEST(TraceInstanceTest, TraceInstanceTest_Destroyed)
+{
+    sEngineMessages.clear();
+    
+    {
+        Trace engine;
+        engine.initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low", TestEngineCallback);
+        
+        std::thread writer([&engine]()
+        {
+            for (int i = 0; i < 100; i++)
+                traceTo(engine, Trace::kCategory_Basic | Trace::kPriority_Low, i);
+        });
+        
+        writer.join();
+    }
+    
+    // Destroying the instance drains its backend
+    //
+    EXPECT_EQ(sEngineMessages.size(), 100u);
+}
+
+TEST(TraceInstanceTest, TraceInstanceTest_GlobalOptions)
+{
+    const TraceClock::Source source = TraceClock::source();
+    const PerfControl::State state = PerfControl::state();
+    
+    // The process wide options are ignored by the other instances
+    //
+    Trace engine;
+    ASSERT_TRUE(engine.initializeWithBuffer(std::string("backend=native\nkCategory_Basic@kPriority_Low\n")
+                                            + "clock=" + (source == TraceClock::kSource_System ? "steady" : "system") + "\n"
+                                            + "perf=" + (state == PerfControl::kState_Off ? "on" : "off")
+                                            , TestEngineCallback));
+    
+    EXPECT_EQ(TraceClock::source(), source);
+    EXPECT_EQ(PerfControl::state(), state);
+    
+    engine.reset();
+}
@@ -0,0 +1,222 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceLazyBackend.h"
+#include "TraceClock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <fstream>
+
+static std::mutex sLazyMutex;
+static std::vector<std::string> sLazyMessages;
+
+static void TestLazyCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sLazyMutex);
+    
+    if (strstr(iMessage, "Lazy"))
+        sLazyMessages.push_back(iMessage);
+}
+
+static bool fileExists(const std::string& iPath)
+{
+    std::ifstream file(iPath);
+    return file.is_open();
+}
+
+TEST(TraceLazyBackendTest, TraceLazyBackendTest_FirstWrite)
+{
+    const std::string path = "TraceLazy.log";
+    remove(path.c_str());
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low\nstartup=lazy", path);
+    
+    // Nothing is opened until something is written
+    //
+    BBC_TRACE(Trace::kCategory_Network | Trace::kPriority_Low, "Lazy filtered");
+    EXPECT_FALSE(fileExists(path));
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Lazy first");
+    EXPECT_TRUE(fileExists(path));
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Lazy second");
+    Trace::instance().reset();
+    
+    std::ifstream file(path);
+    std::string line;
+    std::vector<std::string> lines;
+    
+    while (std::getline(file, line))
+        lines.push_back(line);
+    
+    ASSERT_EQ(lines.size(), 2u);
+    EXPECT_NE(lines[0].find("Lazy first"), std::string::npos);
+    EXPECT_NE(lines[1].find("Lazy second"), std::string::npos);
+    
+    remove(path.c_str());
+}
+
+TEST(TraceLazyBackendTest, TraceLazyBackendTest_NeverWritten)
+{
+    const std::string path = "TraceLazy_unused.log";
+    remove(path.c_str());
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low\nstartup=lazy", path);
+    Trace::instance().reset();
+    
+    EXPECT_FALSE(fileExists(path));
+}
+
+TEST(TraceLazyBackendTest, TraceLazyBackendTest_Background)
+{
+    for (const std::string& name : TraceBackend::available())
+    {
+        sLazyMessages.clear();
+        
+        Trace::instance().initializeWithBuffer("backend=" + name + "\nkCategory_Basic@kPriority_Low\nstartup=background", TestLazyCallback);
+        
+        // Written while the backend may still be opening, kept in order
+        //
+        for (int i = 0; i < 100; i++)
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Lazy %03d", i);
+        
+        Trace::instance().reset();
+        
+        ASSERT_EQ(sLazyMessages.size(), 100u) << name;
+        
+        for (int i = 0; i < 100; i++)
+        {
+            char expected[16];
+            snprintf(expected, sizeof(expected), "Lazy %03d", i);
+            EXPECT_NE(sLazyMessages[i].find(expected), std::string::npos) << name << " " << sLazyMessages[i];
+        }
+    }
+}
+
+TEST(TraceLazyBackendTest, TraceLazyBackendTest_Failed)
+{
+    TraceBackendConfig config;
+    config.logFilePath = "TraceLazyMissingDirectory/TraceLazy.log";
+    
+    TraceLazyBackend backend(TraceBackend::create("native"), TraceLazyBackend::kStart_FirstWrite);
+    ASSERT_TRUE(backend.open(config));
+    EXPECT_FALSE(backend.started());
+    
+    backend.write(Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, "Lazy lost");
+    backend.write(Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, "Lazy dropped");
+    
+    EXPECT_FALSE(backend.started());
+    EXPECT_EQ(backend.dropCount(), 2u);
+    
+    backend.close();
+}
+
+TEST(TraceLazyBackendTest, TraceLazyBackendTest_Threads)
+{
+    sLazyMessages.clear();
+    
+    TraceBackendConfig config;
+    config.callback = TestLazyCallback;
+    
+    TraceLazyBackend backend(TraceBackend::create("native"), TraceLazyBackend::kStart_FirstWrite);
+    ASSERT_TRUE(backend.open(config));
+    
+    // Racing to start the backend, exactly one of them opens it
+    //
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++)
+    {
+        writers.emplace_back([&backend]()
+        {
+            for (int i = 0; i < 250; i++)
+                backend.write(Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, "Lazy racing");
+        });
+    }
+    
+    for (auto& writer : writers)
+        writer.join();
+    
+    EXPECT_TRUE(backend.started());
+    backend.close();
+    
+    EXPECT_EQ(sLazyMessages.size(), 1000u);
+}
+
+TEST(TraceLazyBackendTest, TraceLazyBackendTest_EarlyTimestamps)
+{
+    sLazyMessages.clear();
+    
+    TraceBackendConfig config;
+    config.callback = TestLazyCallback;
+    config.preciseTimestamps = true;
+    
+    // The backend is held opening while the statements are written
+    //
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool release = false;
+    
+    TraceLazyBackend backend(TraceBackend::create("native"), TraceLazyBackend::kStart_Background, [&]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&release]() { return release; });
+    });
+    ASSERT_TRUE(backend.open(config));
+    
+    for (int i = 0; i < 3; i++)
+    {
+        backend.write(Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, ("Lazy early " + std::to_string(i)).c_str());
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const uint64_t released = TraceClock::now() % (86400ull * 1000000000ull);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    condition.notify_one();
+    
+    backend.close();
+    
+    // Written once the backend is open, with the time they were written at
+    //
+    ASSERT_EQ(sLazyMessages.size(), 3u);
+    
+    uint64_t previous = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_NE(sLazyMessages[i].find("Lazy early " + std::to_string(i)), std::string::npos);
+        
+        unsigned hours = 0, minutes = 0, seconds = 0, nanoseconds = 0;
+        sscanf(sLazyMessages[i].c_str(), "[%*4d-%*2d-%*2dT%2u:%2u:%2u.%9uZ]", &hours, &minutes, &seconds, &nanoseconds);
+        uint64_t time = ((hours * 3600ull + minutes * 60ull + seconds) * 1000000000ull) + nanoseconds;
+        
+        EXPECT_GT(time, previous);
+        EXPECT_LE(time + 20000000u, released);
+        previous = time;
+    }
+}
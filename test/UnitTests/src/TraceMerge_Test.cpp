@@ -0,0 +1,159 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceNativeBackend.h"
+
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <fstream>
+
+static std::mutex sMergeMutex;
+static std::vector<std::string> sMergeMessages;
+
+static void TestMergeCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sMergeMutex);
+    sMergeMessages.push_back(iMessage);
+}
+
+static void testOrder(TraceBackendConfig::Buffering iBuffering)
+{
+    sMergeMessages.clear();
+    
+    TraceBackendConfig config;
+    config.callback = TestMergeCallback;
+    config.preciseTimestamps = true;
+    config.buffering = iBuffering;
+    config.mergeWindow = 20000000;
+    
+    TraceNativeBackend backend;
+    ASSERT_TRUE(backend.open(config));
+    
+    const int threads = 4;
+    const int count = 500;
+    std::vector<std::thread> producers;
+    
+    for (int t = 0; t < threads; t++)
+    {
+        producers.emplace_back([&backend, t]()
+        {
+            for (int i = 0; i < count; i++)
+            {
+                char message[32];
+                snprintf(message, sizeof(message), "Merge %d %04d", t, i);
+                backend.write(Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, message);
+            }
+        });
+    }
+    
+    for (auto& producer : producers)
+        producer.join();
+    
+    backend.close();
+    
+    TraceNativeBackend::MergeStats stats = backend.mergeStats();
+    EXPECT_EQ(stats.statements, static_cast<uint64_t>(threads * count));
+    
+    if (iBuffering == TraceBackendConfig::kBuffering_Thread)
+        EXPECT_EQ(stats.buffers, static_cast<uint32_t>(threads));
+    else
+        EXPECT_EQ(stats.buffers, std::max(std::thread::hardware_concurrency(), 1u));
+    
+    EXPECT_GT(stats.peakBytes, 0u);
+    EXPECT_GE(stats.maxDelay, stats.totalDelay / stats.statements);
+    
+    ASSERT_EQ(sMergeMessages.size(), static_cast<size_t>((threads * count) + 1));
+    EXPECT_NE(sMergeMessages.back().find("Trace merge: 2000 statements from"), std::string::npos) << sMergeMessages.back();
+    
+    // Every thread in its own order, all of them in time order
+    // except for the statements reported late
+    //
+    int next[threads] = {};
+    uint64_t inversions = 0;
+    
+    for (size_t i = 0; i + 1 < sMergeMessages.size(); i++)
+    {
+        const std::string& message = sMergeMessages[i];
+        
+        int thread = -1;
+        int index = -1;
+        ASSERT_EQ(sscanf(message.c_str() + message.find("Merge"), "Merge %d %d", &thread, &index), 2) << message;
+        ASSERT_GE(thread, 0);
+        ASSERT_LT(thread, threads);
+        EXPECT_EQ(index, next[thread]++) << message;
+        
+        // [YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ] sorts as text
+        //
+        if (i && message.compare(0, 32, sMergeMessages[i - 1], 0, 32) < 0)
+            inversions++;
+    }
+    
+    EXPECT_LE(inversions, stats.late);
+}
+
+TEST(TraceMergeTest, TraceMergeTest_Thread)
+{
+    testOrder(TraceBackendConfig::kBuffering_Thread);
+}
+
+TEST(TraceMergeTest, TraceMergeTest_Cpu)
+{
+    testOrder(TraceBackendConfig::kBuffering_Cpu);
+}
+
+TEST(TraceMergeTest, TraceMergeTest_Option)
+{
+    const std::string path = "TraceMerge.log";
+    remove(path.c_str());
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low\nbuffering=thread\nmergeWindowMs=1", path);
+    
+    std::thread other([]()
+    {
+        for (int i = 0; i < 10; i++)
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Merge other %d", i);
+    });
+    
+    for (int i = 0; i < 10; i++)
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Merge main %d", i);
+    
+    other.join();
+    Trace::instance().reset();
+    
+    std::ifstream file(path);
+    std::string line;
+    int statements = 0;
+    int summaries = 0;
+    
+    while (std::getline(file, line))
+    {
+        if (line.find("Merge ") != std::string::npos)
+            statements++;
+        if (line.find("Trace merge: 20 statements from 2 buffers") != std::string::npos)
+            summaries++;
+    }
+    
+    EXPECT_EQ(statements, 20);
+    EXPECT_EQ(summaries, 1);
+    
+    remove(path.c_str());
+}
@@ -0,0 +1,104 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "TraceNumber.h"
+
+#include <math.h>
+#include <float.h>
+#include <random>
+#include <string>
+
+/// Expects formatFixed to match printf for the magnitude of iValue
+static void expectFixed(double iValue, int32_t iPrecision, bool iPoint = false)
+{
+    char expected[512];
+    snprintf(expected, sizeof(expected), iPoint ? "%#.*f" : "%.*f", iPrecision, fabs(iValue));
+    
+    char actual[TraceNumber::sFixedBufferSize];
+    size_t count = TraceNumber::formatFixed(iValue, iPrecision, iPoint, actual);
+    
+    ASSERT_NE(count, 0u) << expected;
+    EXPECT_EQ(std::string(actual, count), expected) << iValue << " %." << iPrecision << "f";
+}
+
+TEST(TraceNumberTest, TraceNumberTest_Decimal)
+{
+    const uint64_t values[] = { 0, 1, 9, 10, 99, 100, 101, 999, 1000, 12345, 4294967295ull, 10000000000000000000ull, UINT64_MAX };
+    
+    for (uint64_t value : values)
+    {
+        char buffer[24];
+        char* end = buffer + sizeof(buffer);
+        char* first = TraceNumber::formatDecimal(value, end);
+        
+        EXPECT_EQ(std::string(first, end), std::to_string(value));
+    }
+}
+
+TEST(TraceNumberTest, TraceNumberTest_Fixed)
+{
+    // Ties round to even on the exact binary value, like printf
+    //
+    expectFixed(0.125, 2);
+    expectFixed(0.375, 2);
+    expectFixed(2.5, 0);
+    expectFixed(3.5, 0);
+    expectFixed(0.5, 0);
+    expectFixed(2.675, 2);
+    expectFixed(1.005, 2);
+    expectFixed(0.0, 6);
+    expectFixed(-0.0, 3);
+    expectFixed(-1.5, 1);
+    expectFixed(9.9999999, 6);
+    expectFixed(0.9999999999, 3);
+    expectFixed(3.0, 0, true);
+    expectFixed(DBL_MIN, 6);
+    expectFixed(5e-324, 19);
+    expectFixed(0.1, 19);
+    expectFixed(123456789.123456789, 9);
+    expectFixed(9007199254740993.0, 2);
+    expectFixed(ldexp(1.0, 63), 6);
+    expectFixed(18446744073709549568.0, 1);
+}
+
+TEST(TraceNumberTest, TraceNumberTest_FixedRandom)
+{
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> levels(-120.0, 24.0);
+    std::uniform_int_distribution<int32_t> exponents(-40, 56);
+    std::uniform_int_distribution<int32_t> precisions(0, TraceNumber::sMaxFixedPrecision);
+    
+    for (int i = 0; i < 20000; i++)
+    {
+        expectFixed(levels(random), precisions(random));
+        expectFixed(ldexp(levels(random), exponents(random) - 5), precisions(random));
+    }
+}
+
+TEST(TraceNumberTest, TraceNumberTest_FixedUnsupported)
+{
+    char buffer[TraceNumber::sFixedBufferSize];
+    
+    EXPECT_EQ(TraceNumber::formatFixed(1.0 / 0.0, 2, false, buffer), 0u);
+    EXPECT_EQ(TraceNumber::formatFixed(nan(""), 2, false, buffer), 0u);
+    EXPECT_EQ(TraceNumber::formatFixed(1e20, 2, false, buffer), 0u);
+    EXPECT_EQ(TraceNumber::formatFixed(-DBL_MAX, 6, false, buffer), 0u);
+    EXPECT_EQ(TraceNumber::formatFixed(1.0, TraceNumber::sMaxFixedPrecision + 1, false, buffer), 0u);
+}
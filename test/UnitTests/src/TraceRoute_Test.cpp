@@ -0,0 +1,146 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+
+#include <thread>
+
+static std::vector<std::string> readRouteLog(const std::string& iPath)
+{
+    std::vector<std::string> result;
+    std::ifstream file(iPath);
+    std::string line;
+    
+    while (std::getline(file, line))
+    {
+        if (line.find("Route") != std::string::npos)
+            result.push_back(line);
+    }
+    
+    return result;
+}
+
+static void testRoutes(const std::string& iBackend, const std::string& iRouteThreads)
+{
+    const std::string mainPath = "TraceRoute_main.log";
+    const std::string networkPath = "TraceRoute_network.log";
+    const std::string messagePath = "TraceRoute_message.log";
+    
+    remove(mainPath.c_str());
+    remove(networkPath.c_str());
+    remove(messagePath.c_str());
+    
+    Trace::instance().initializeWithBuffer("backend=" + iBackend + "\n"
+                                           "kCategory_Always@kPriority_Low\n"
+                                           "route.kCategory_Network=" + networkPath + "\n"
+                                           "route.kCategory_MessageProcessing=" + messagePath + "\n"
+                                           "routeThreads=" + iRouteThreads
+                                           , mainPath);
+    
+    const int count = 30;
+    for (int i = 0; i < count; i++)
+    {
+        BBC_TRACE((i % 3 == 0 ? Trace::kCategory_Basic : (i % 3 == 1 ? Trace::kCategory_Network : Trace::kCategory_MessageProcessing)) | Trace::kPriority_Low
+                  , "Route %02d", i);
+        
+        // Keep the timestamps distinct so the merged order is unambiguous
+        //
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+    
+    Trace::instance().reset();
+    
+    // Every category only went to its own file
+    //
+    std::vector<std::string> lines[3] = { readRouteLog(mainPath), readRouteLog(networkPath), readRouteLog(messagePath) };
+    std::vector<std::string> merged;
+    
+    for (int file = 0; file < 3; file++)
+    {
+        ASSERT_EQ(lines[file].size(), static_cast<size_t>(count / 3)) << iBackend;
+        
+        for (const auto& line : lines[file])
+        {
+            int index = -1;
+            ASSERT_EQ(sscanf(line.c_str() + line.find("Route"), "Route %d", &index), 1) << line;
+            EXPECT_EQ(index % 3, file) << line;
+            
+            // [YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ]
+            //
+            ASSERT_GT(line.length(), 32u);
+            EXPECT_EQ(line[0], '[') << line;
+            EXPECT_EQ(line[30], 'Z') << line;
+            EXPECT_EQ(line[31], ']') << line;
+            
+            merged.push_back(line);
+        }
+    }
+    
+    // Sorting on the timestamps gives back the order they were written in
+    //
+    std::sort(merged.begin(), merged.end());
+    
+    for (int i = 0; i < count; i++)
+    {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "Route %02d", i);
+        EXPECT_NE(merged[i].find(expected), std::string::npos) << iBackend << " " << merged[i];
+    }
+    
+    remove(mainPath.c_str());
+    remove(networkPath.c_str());
+    remove(messagePath.c_str());
+}
+
+TEST(TraceRouteTest, TraceRouteTest_Threads)
+{
+    for (const std::string& name : TraceBackend::available())
+    {
+        // Boost.Log output has no timestamps to merge on
+        //
+        if (name != "boost")
+            testRoutes(name, "on");
+    }
+}
+
+TEST(TraceRouteTest, TraceRouteTest_NoThreads)
+{
+    testRoutes("native", "off");
+}
+
+TEST(TraceRouteTest, TraceRouteTest_Invalid)
+{
+    const std::string mainPath = "TraceRoute_invalid.log";
+    remove(mainPath.c_str());
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Always@kPriority_Low\nroute.kCategory_Network="
+                                           , mainPath);
+    
+    BBC_TRACE(Trace::kCategory_Network | Trace::kPriority_Low, "Route unrouted");
+    Trace::instance().reset();
+    
+    // Routes without a file are ignored and the statements keep going to the log file
+    //
+    std::vector<std::string> lines = readRouteLog(mainPath);
+    ASSERT_EQ(lines.size(), 1u);
+    EXPECT_NE(lines[0].find("Route unrouted"), std::string::npos);
+    
+    remove(mainPath.c_str());
+}
@@ -0,0 +1,186 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceSharedMemory.h"
+
+#ifndef _WIN32
+
+#include <thread>
+#include <unistd.h>
+
+static std::string testSharedMemoryName()
+{
+    return "/BBCTraceTest" + std::to_string(getpid());
+}
+
+static TraceRecord testRecord(const char* iMessage, uint64_t iMask = 0)
+{
+    TraceRecord record;
+    record.mask = iMask;
+    record.timestamp = 1234;
+    record.threadId = 5678;
+    record.message = iMessage;
+    record.length = static_cast<uint32_t>(strlen(iMessage));
+    
+    return record;
+}
+
+TEST(TraceSharedMemoryTest, TraceSharedMemoryTest_ReadWrite)
+{
+    TraceSharedMemorySink sink;
+    ASSERT_TRUE(sink.create(testSharedMemoryName(), 128, 8));
+    
+    TraceSharedMemoryReader reader;
+    ASSERT_TRUE(reader.open(testSharedMemoryName()));
+    
+    TraceSharedMemoryRecord record;
+    EXPECT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Empty);
+    
+    sink.write(testRecord("Hello world!", Trace::kCategory_Basic | Trace::kPriority_High));
+    
+    ASSERT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Record);
+    EXPECT_EQ(std::string(record.message, record.length), "Hello world!");
+    EXPECT_EQ(record.mask, Trace::kCategory_Basic | Trace::kPriority_High);
+    EXPECT_EQ(record.timestamp, 1234u);
+    EXPECT_EQ(record.threadId, 5678u);
+    EXPECT_FALSE(record.truncated);
+    EXPECT_TRUE(reader.valid(record));
+    
+    EXPECT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Empty);
+}
+
+TEST(TraceSharedMemoryTest, TraceSharedMemoryTest_Truncated)
+{
+    TraceSharedMemorySink sink;
+    ASSERT_TRUE(sink.create(testSharedMemoryName(), 64, 8));
+    
+    TraceSharedMemoryReader reader;
+    ASSERT_TRUE(reader.open(testSharedMemoryName()));
+    
+    std::string longMessage(200, 'x');
+    sink.write(testRecord(longMessage.c_str()));
+    
+    TraceSharedMemoryRecord record;
+    ASSERT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Record);
+    EXPECT_TRUE(record.truncated);
+    EXPECT_EQ(record.length, 64u - sTraceSharedMemorySlotMessageOffset - 1);
+    EXPECT_EQ(record.message[record.length], 0);
+}
+
+TEST(TraceSharedMemoryTest, TraceSharedMemoryTest_Overrun)
+{
+    TraceSharedMemorySink sink;
+    ASSERT_TRUE(sink.create(testSharedMemoryName(), 128, 8));
+    
+    TraceSharedMemoryReader reader;
+    ASSERT_TRUE(reader.open(testSharedMemoryName()));
+    
+    // Lap the reader, only the last 8 statements remain
+    //
+    for (int i = 0; i < 20; i++)
+    {
+        std::string message = std::to_string(i);
+        sink.write(testRecord(message.c_str()));
+    }
+    
+    TraceSharedMemoryRecord record;
+    std::vector<std::string> messages;
+    while (reader.next(record) == TraceSharedMemoryReader::kResult_Record)
+        messages.push_back(std::string(record.message, record.length));
+    
+    ASSERT_EQ(messages.size(), 8u);
+    EXPECT_EQ(messages.front(), "12");
+    EXPECT_EQ(messages.back(), "19");
+    EXPECT_EQ(reader.lostCount(), 12u);
+    EXPECT_EQ(sink.dropCount(), 0u);
+}
+
+TEST(TraceSharedMemoryTest, TraceSharedMemoryTest_FromOldest)
+{
+    TraceSharedMemorySink sink;
+    ASSERT_TRUE(sink.create(testSharedMemoryName(), 128, 8));
+    
+    sink.write(testRecord("first"));
+    sink.write(testRecord("second"));
+    
+    TraceSharedMemoryReader reader;
+    ASSERT_TRUE(reader.open(testSharedMemoryName(), true));
+    
+    TraceSharedMemoryRecord record;
+    ASSERT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Record);
+    EXPECT_EQ(std::string(record.message, record.length), "first");
+    ASSERT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Record);
+    EXPECT_EQ(std::string(record.message, record.length), "second");
+}
+
+TEST(TraceSharedMemoryTest, TraceSharedMemoryTest_NoWriter)
+{
+    TraceSharedMemoryReader reader;
+    EXPECT_FALSE(reader.open("/BBCTraceTestMissing"));
+    
+    TraceSharedMemoryRecord record;
+    EXPECT_EQ(reader.next(record), TraceSharedMemoryReader::kResult_Closed);
+}
+
+TEST(TraceSharedMemoryTest, TraceSharedMemoryTest_Producers)
+{
+    auto sink = std::make_shared<TraceSharedMemorySink>();
+    ASSERT_TRUE(sink->create(testSharedMemoryName(), 128, 1024));
+    
+    TraceSharedMemoryReader reader;
+    ASSERT_TRUE(reader.open(testSharedMemoryName()));
+    
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low", [](const char* iMessage) {});
+    Trace::instance().addSink(sink);
+    
+    const int threads = 4;
+    const int perThread = 200;
+    
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; t++)
+    {
+        producers.emplace_back([t]()
+        {
+            for (int i = 0; i < perThread; i++)
+                BBC_TRACE_R(Trace::kCategory_Basic | Trace::kPriority_High, "producer %d %d", t, i);
+        });
+    }
+    
+    for (auto& producer : producers)
+        producer.join();
+    
+    Trace::instance().reset();
+    
+    TraceSharedMemoryRecord record;
+    int count = 0;
+    while (reader.next(record) == TraceSharedMemoryReader::kResult_Record)
+    {
+        EXPECT_EQ(record.mask, Trace::kCategory_Basic | Trace::kPriority_High);
+        EXPECT_EQ(strncmp(record.message, "producer ", 9), 0);
+        count++;
+    }
+    
+    EXPECT_EQ(count, threads * perThread);
+    EXPECT_EQ(reader.lostCount(), 0u);
+}
+
+#endif // _WIN32
@@ -0,0 +1,236 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceSinkRegistry.h"
+
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    /// Counts its statements, and those written after it was removed
+    class CountingSink : public TraceSink
+    {
+    public:
+        
+        void write(const TraceRecord&) override
+        {
+            count.fetch_add(1, std::memory_order_relaxed);
+            
+            if (removed.load(std::memory_order_relaxed))
+                late.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> late{0};
+        std::atomic<bool> removed{false};
+    };
+}
+
+TEST(TraceSinkRegistryTest, TraceSinkRegistryTest_AddRemove)
+{
+    TraceSinkRegistry registry;
+    EXPECT_TRUE(registry.empty());
+    
+    auto first = std::make_shared<CountingSink>();
+    auto second = std::make_shared<CountingSink>();
+    
+    EXPECT_TRUE(registry.add(first));
+    EXPECT_FALSE(registry.add(first));
+    EXPECT_FALSE(registry.add(nullptr));
+    EXPECT_TRUE(registry.add(second));
+    EXPECT_FALSE(registry.empty());
+    
+    TraceRecord record;
+    registry.forEach([&record](TraceSink& iSink) { iSink.write(record); });
+    
+    EXPECT_TRUE(registry.remove(first));
+    EXPECT_FALSE(registry.remove(first));
+    registry.forEach([&record](TraceSink& iSink) { iSink.write(record); });
+    
+    EXPECT_EQ(first->count.load(), 1u);
+    EXPECT_EQ(second->count.load(), 2u);
+    
+    TraceSinkRegistry::List removed = registry.clear();
+    ASSERT_EQ(removed.size(), 1u);
+    EXPECT_EQ(removed[0], second);
+    EXPECT_TRUE(registry.empty());
+}
+
+TEST(TraceSinkRegistryTest, TraceSinkRegistryTest_Concurrent)
+{
+    TraceSinkRegistry registry;
+    auto permanent = std::make_shared<CountingSink>();
+    registry.add(permanent);
+    
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers;
+    
+    for (int t = 0; t < 4; t++)
+    {
+        writers.emplace_back([&registry, &stop]()
+        {
+            TraceRecord record;
+            while (!stop.load(std::memory_order_relaxed))
+                registry.forEach([&record](TraceSink& iSink) { iSink.write(record); });
+        });
+    }
+    
+    // Sinks come and go while the writers keep writing,
+    // none of them is written to once removed
+    //
+    std::vector<std::shared_ptr<CountingSink>> sinks;
+    
+    for (int i = 0; i < 500; i++)
+    {
+        auto sink = std::make_shared<CountingSink>();
+        ASSERT_TRUE(registry.add(sink));
+        
+        std::this_thread::yield();
+        
+        ASSERT_TRUE(registry.remove(sink));
+        sink->removed = true;
+        sinks.push_back(sink);
+    }
+    
+    stop = true;
+    for (auto& writer : writers)
+        writer.join();
+    
+    EXPECT_GT(permanent->count.load(), 0u);
+    
+    for (const auto& sink : sinks)
+        EXPECT_EQ(sink->late.load(), 0u);
+}
+
+static std::mutex sSubscriberMutex;
+static std::vector<std::string> sFirstSubscriber;
+static std::vector<std::string> sSecondSubscriber;
+
+static void TestFirstSubscriber(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sSubscriberMutex);
+    sFirstSubscriber.push_back(iMessage);
+}
+
+static void TestSecondSubscriber(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sSubscriberMutex);
+    sSecondSubscriber.push_back(iMessage);
+}
+
+TEST(TraceSinkRegistryTest, TraceSinkRegistryTest_Subscribe)
+{
+    sFirstSubscriber.clear();
+    sSecondSubscriber.clear();
+    
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low", TestFirstSubscriber);
+    
+    std::shared_ptr<TraceSink> first = Trace::instance().subscribe(TestFirstSubscriber);
+    std::shared_ptr<TraceSink> second = Trace::instance().subscribe(TestSecondSubscriber);
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Subscriber %d", 1);
+    
+    Trace::instance().unsubscribe(first);
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Subscriber %d", 2);
+    
+    Trace::instance().reset();
+    
+    // The initialization callback gets both with timestamps,
+    // the first subscriber only the first one without
+    //
+    std::lock_guard<std::mutex> lock(sSubscriberMutex);
+    ASSERT_EQ(sFirstSubscriber.size(), 3u);
+    EXPECT_EQ(std::count(sFirstSubscriber.begin(), sFirstSubscriber.end(), "Subscriber 1"), 1);
+    EXPECT_EQ(std::count(sFirstSubscriber.begin(), sFirstSubscriber.end(), "Subscriber 2"), 0);
+    
+    ASSERT_EQ(sSecondSubscriber.size(), 2u);
+    EXPECT_EQ(sSecondSubscriber[0], "Subscriber 1");
+    EXPECT_EQ(sSecondSubscriber[1], "Subscriber 2");
+}
+
+static std::atomic<uint64_t> sReconfigureCount{0};
+static std::atomic<uint64_t> sReconfigureLate{0};
+static std::atomic<bool> sReconfigureDone{false};
+
+static void TestReconfigureCallback(const char*)
+{
+    sReconfigureCount.fetch_add(1, std::memory_order_relaxed);
+    
+    if (sReconfigureDone.load(std::memory_order_relaxed))
+        sReconfigureLate.fetch_add(1, std::memory_order_relaxed);
+}
+
+TEST(TraceSinkRegistryTest, TraceSinkRegistryTest_ReconfigureWhileTracing)
+{
+    const std::string routePath = "TraceSinkRegistry_route.log";
+    
+    Trace::instance().reset();
+    sReconfigureCount = 0;
+    sReconfigureLate = 0;
+    sReconfigureDone = false;
+    
+    // The callback, the routed backend and the tail are all torn down by every reset
+    //
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&stop, t]()
+        {
+            for (int i = 0; !stop.load(std::memory_order_relaxed); i++)
+            {
+                Trace::Category category = (i + t) % 2 ? Trace::kCategory_Network : Trace::kCategory_Basic;
+                BBC_TRACE_R(category | Trace::kPriority_Medium, "Reconfigure %d %d", t, i);
+            }
+        });
+    }
+    
+    for (int cycle = 0; cycle < 50; cycle++)
+    {
+        Trace::instance().initializeWithBuffer("backend=native\n"
+                                               "kCategory_Basic@kPriority_Low\n"
+                                               "kCategory_Network@kPriority_Low\n"
+                                               "route.kCategory_Network=" + routePath + "\n"
+                                               "tailThreshold=kPriority_Medium\n"
+                                               , TestReconfigureCallback);
+        
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        
+        Trace::instance().reset();
+    }
+    
+    // Nothing reaches the callback once reset returned
+    //
+    sReconfigureDone = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    
+    EXPECT_GT(sReconfigureCount.load(), 0u);
+    EXPECT_EQ(sReconfigureLate.load(), 0u);
+    
+    remove(routePath.c_str());
+}
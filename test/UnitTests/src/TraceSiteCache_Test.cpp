@@ -0,0 +1,109 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Trace.h"
+
+#include <mutex>
+
+static std::mutex sSiteMutex;
+static int32_t sSiteCount{0};
+
+static void TestSiteCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sSiteMutex);
+    
+    if (strstr(iMessage, "Site"))
+        sSiteCount++;
+}
+
+/// A single call site shared by all of the tests
+static void traceSite(Trace::TraceMask iMask)
+{
+    BBC_TRACE_R(iMask, "Site %d", 1);
+}
+
+static int32_t countSite(const std::string& iTraceConfig, Trace::TraceMask iMask)
+{
+    {
+        std::lock_guard<std::mutex> lock(sSiteMutex);
+        sSiteCount = 0;
+    }
+    
+    Trace::instance().initializeWithBuffer(iTraceConfig, TestSiteCallback);
+    
+    for (int i = 0; i < 10; i++)
+        traceSite(iMask);
+    
+    Trace::instance().reset();
+    
+    std::lock_guard<std::mutex> lock(sSiteMutex);
+    return sSiteCount;
+}
+
+TEST(TraceSiteCacheTest, TraceSiteCacheTest_Reconfigure)
+{
+    // The decision cached by the call site follows the configuration
+    //
+    EXPECT_EQ(countSite("kCategory_Basic@kPriority_Low", Trace::kCategory_Basic | Trace::kPriority_Medium), 10);
+    EXPECT_EQ(countSite("kCategory_Basic@kPriority_High", Trace::kCategory_Basic | Trace::kPriority_Medium), 0);
+    EXPECT_EQ(countSite("kCategory_Basic@kPriority_Medium", Trace::kCategory_Basic | Trace::kPriority_Medium), 10);
+    
+    // Nothing is traced once reset
+    //
+    traceSite(Trace::kCategory_Basic | Trace::kPriority_Medium);
+    EXPECT_EQ(sSiteCount, 10);
+}
+
+TEST(TraceSiteCacheTest, TraceSiteCacheTest_Mask)
+{
+    {
+        std::lock_guard<std::mutex> lock(sSiteMutex);
+        sSiteCount = 0;
+    }
+    
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_High", TestSiteCallback);
+    
+    // A different mask at the same call site is not served from the cache
+    //
+    for (int i = 0; i < 10; i++)
+    {
+        traceSite(Trace::kCategory_Basic | Trace::kPriority_High);
+        traceSite(Trace::kCategory_Basic | Trace::kPriority_Low);
+        traceSite(Trace::kCategory_Network | Trace::kPriority_High);
+    }
+    
+    Trace::instance().reset();
+    
+    std::lock_guard<std::mutex> lock(sSiteMutex);
+    EXPECT_EQ(sSiteCount, 10);
+}
+
+TEST(TraceSiteCacheTest, TraceSiteCacheTest_Generation)
+{
+    uint32_t generation = Trace::instance().generation();
+    
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low", TestSiteCallback);
+    EXPECT_NE(Trace::instance().generation(), generation);
+    
+    generation = Trace::instance().generation();
+    Trace::instance().reset();
+    EXPECT_NE(Trace::instance().generation(), generation);
+}
@@ -0,0 +1,265 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceStore.h"
+
+#include <atomic>
+#include <thread>
+
+static TraceRecord testRecord(const std::string& iMessage, uint64_t iMask, uint64_t iTimestamp, uint64_t iThreadId = 1)
+{
+    TraceRecord record;
+    record.mask = iMask;
+    record.timestamp = iTimestamp;
+    record.threadId = iThreadId;
+    record.message = iMessage.c_str();
+    record.length = static_cast<uint32_t>(iMessage.length());
+    
+    return record;
+}
+
+static std::vector<std::string> queryMessages(const TraceStore& iStore, const TraceStoreQuery& iQuery)
+{
+    std::vector<TraceStoreRecord> records;
+    iStore.query(iQuery, records);
+    
+    std::vector<std::string> messages;
+    for (const auto& record : records)
+        messages.push_back(record.message);
+    
+    return messages;
+}
+
+TEST(TraceStoreTest, TraceStoreTest_Time)
+{
+    TraceStore store(1024 * 1024);
+    
+    for (int i = 0; i < 10; i++)
+        store.write(testRecord("Statement " + std::to_string(i), Trace::kCategory_Basic | Trace::kPriority_Low, 100 + (i * 10)));
+    
+    EXPECT_EQ(store.size(), 10u);
+    
+    TraceStoreQuery query;
+    query.from = 120;
+    query.to = 150;
+    
+    std::vector<std::string> messages = queryMessages(store, query);
+    ASSERT_EQ(messages.size(), 4u);
+    EXPECT_EQ(messages[0], "Statement 2");
+    EXPECT_EQ(messages[3], "Statement 5");
+    
+    // The most recent statements are kept, oldest first
+    //
+    query.limit = 2;
+    messages = queryMessages(store, query);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], "Statement 4");
+    EXPECT_EQ(messages[1], "Statement 5");
+    
+    query.from = 200;
+    query.to = 300;
+    EXPECT_TRUE(queryMessages(store, query).empty());
+}
+
+TEST(TraceStoreTest, TraceStoreTest_Filters)
+{
+    TraceStore store(1024 * 1024);
+    
+    store.write(testRecord("Basic low", Trace::kCategory_Basic | Trace::kPriority_Low, 1, 1));
+    store.write(testRecord("Network high", Trace::kCategory_Network | Trace::kPriority_High, 2, 1));
+    store.write(testRecord("Basic high", Trace::kCategory_Basic | Trace::kPriority_High, 3, 2));
+    store.write(testRecord("Network low", Trace::kCategory_Network | Trace::kPriority_Low, 4, 2));
+    
+    TraceStoreQuery query;
+    query.mask = Trace::kCategory_Basic;
+    
+    std::vector<std::string> messages = queryMessages(store, query);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], "Basic low");
+    EXPECT_EQ(messages[1], "Basic high");
+    
+    query.mask = Trace::kCategory_Always | Trace::kPriority_Medium;
+    messages = queryMessages(store, query);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], "Network high");
+    EXPECT_EQ(messages[1], "Basic high");
+    
+    query.mask = Trace::kCategory_Network | Trace::kPriority_High;
+    messages = queryMessages(store, query);
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0], "Network high");
+    
+    query.mask = Trace::kCategory_Always;
+    query.filterThread = true;
+    query.threadId = 2;
+    messages = queryMessages(store, query);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], "Basic high");
+    EXPECT_EQ(messages[1], "Network low");
+    
+    query.mask = Trace::kCategory_Perf;
+    EXPECT_TRUE(queryMessages(store, query).empty());
+}
+
+TEST(TraceStoreTest, TraceStoreTest_Evict)
+{
+    TraceStore store(64 * 1024);
+    
+    const size_t count = store.capacity() * 3;
+    for (size_t i = 0; i < count; i++)
+        store.write(testRecord("Statement " + std::to_string(i), (i % 2 ? Trace::kCategory_Basic : Trace::kCategory_Network) | Trace::kPriority_Low, i, i % 5));
+    
+    // Only the most recent statements fit
+    //
+    EXPECT_LE(store.size(), store.capacity());
+    
+    TraceStoreQuery query;
+    query.limit = count;
+    
+    std::vector<TraceStoreRecord> records;
+    store.query(query, records);
+    ASSERT_EQ(records.size(), store.size());
+    EXPECT_EQ(records.back().message, "Statement " + std::to_string(count - 1));
+    
+    for (const auto& record : records)
+        EXPECT_EQ(record.message, "Statement " + std::to_string(record.timestamp));
+    
+    query.mask = Trace::kCategory_Basic;
+    query.filterThread = true;
+    query.threadId = 3;
+    store.query(query, records);
+    ASSERT_FALSE(records.empty());
+    
+    for (const auto& record : records)
+        EXPECT_EQ(record.timestamp % 10, 3u);
+}
+
+TEST(TraceStoreTest, TraceStoreTest_Concurrent)
+{
+    TraceStore store(256 * 1024);
+    
+    std::thread writer([&store]()
+    {
+        for (int i = 0; i < 50000; i++)
+            store.write(testRecord("Statement " + std::to_string(i), Trace::kCategory_Basic | Trace::kPriority_Low, i));
+    });
+    
+    TraceStoreQuery query;
+    query.limit = 16;
+    
+    std::vector<TraceStoreRecord> records;
+    for (int i = 0; i < 1000; i++)
+    {
+        store.query(query, records);
+        
+        for (size_t j = 1; j < records.size(); j++)
+            EXPECT_LT(records[j - 1].timestamp, records[j].timestamp);
+    }
+    
+    writer.join();
+    
+    store.query(query, records);
+    ASSERT_EQ(records.size(), 16u);
+    EXPECT_EQ(records.back().message, "Statement 49999");
+}
+
+TEST(TraceStoreTest, TraceStoreTest_ConcurrentLarge)
+{
+    TraceStore store(256 * 1024);
+    
+    std::thread writer([&store]()
+    {
+        for (int i = 0; i < 50000; i++)
+            store.write(testRecord("Statement " + std::to_string(i), Trace::kCategory_Basic | Trace::kPriority_Low, i));
+    });
+    
+    // Results as large as the store, copied while the writer keeps evicting
+    //
+    TraceStoreQuery query;
+    query.limit = store.capacity();
+    
+    std::vector<TraceStoreRecord> records;
+    for (int i = 0; i < 200; i++)
+    {
+        store.query(query, records);
+        
+        for (const auto& record : records)
+            EXPECT_EQ(record.message, "Statement " + std::to_string(record.timestamp));
+    }
+    
+    writer.join();
+}
+
+static void TestStoreCallback(const char*)
+{
+}
+
+TEST(TraceStoreTest, TraceStoreTest_Trace)
+{
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low\nkCategory_Network@kPriority_Low\nstoreSizeMb=1", TestStoreCallback);
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Store basic %d", 1);
+    BBC_TRACE(Trace::kCategory_Network | Trace::kPriority_High, "Store network %d", 2);
+    BBC_TRACE(Trace::kCategory_Perf | Trace::kPriority_High, "Store disabled %d", 3);
+    
+    std::vector<TraceStoreRecord> records = Trace::instance().query(0, UINT64_MAX, Trace::kCategory_Always, 10);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_NE(records[0].message.find("Store basic 1"), std::string::npos);
+    EXPECT_NE(records[1].message.find("Store network 2"), std::string::npos);
+    EXPECT_LE(records[0].timestamp, records[1].timestamp);
+    
+    records = Trace::instance().query(0, UINT64_MAX, Trace::kCategory_Network, 10);
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].mask, Trace::kCategory_Network | Trace::kPriority_High);
+    
+    Trace::instance().reset();
+    
+    EXPECT_TRUE(Trace::instance().query(0, UINT64_MAX, Trace::kCategory_Always, 10).empty());
+}
+
+TEST(TraceStoreTest, TraceStoreTest_QueryWhileReconfiguring)
+{
+    std::atomic<bool> done{false};
+    
+    // A diagnostics view polling while tracing is reconfigured
+    //
+    std::thread poller([&done]()
+    {
+        while (!done.load())
+        {
+            for (const auto& record : Trace::instance().query(0, UINT64_MAX, Trace::kCategory_Always, 100))
+                EXPECT_NE(record.message.find("Store cycle"), std::string::npos);
+        }
+    });
+    
+    for (int cycle = 0; cycle < 50; cycle++)
+    {
+        Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low\nstoreSizeMb=1", TestStoreCallback);
+        
+        for (int i = 0; i < 20; i++)
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Store cycle %d %d", cycle, i);
+        
+        Trace::instance().reset();
+    }
+    
+    done = true;
+    poller.join();
+}
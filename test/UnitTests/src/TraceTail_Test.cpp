@@ -0,0 +1,201 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceTail.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+static TraceRecord testRecord(const std::string& iMessage, uint64_t iMask, uint64_t iTimestamp)
+{
+    TraceRecord record;
+    record.mask = iMask;
+    record.timestamp = iTimestamp;
+    record.message = iMessage.c_str();
+    record.length = static_cast<uint32_t>(iMessage.length());
+    
+    return record;
+}
+
+static std::vector<std::string> dumpMessages(TraceTail& iTail)
+{
+    std::vector<std::string> messages;
+    iTail.dump([&messages](const TraceRecord& iRecord) { messages.push_back(std::string(iRecord.message, iRecord.length)); });
+    
+    return messages;
+}
+
+TEST(TraceTailTest, TraceTailTest_Capture)
+{
+    TraceTail tail(Trace::kPriority_High, 4, false);
+    
+    EXPECT_TRUE(tail.capture(testRecord("Low", Trace::kCategory_Basic | Trace::kPriority_Low, 1)));
+    EXPECT_TRUE(tail.capture(testRecord("Medium", Trace::kCategory_Basic | Trace::kPriority_Medium, 2)));
+    EXPECT_FALSE(tail.capture(testRecord("High", Trace::kCategory_Basic | Trace::kPriority_High, 3)));
+    EXPECT_FALSE(tail.capture(testRecord("Always", Trace::kCategory_Basic | Trace::kPriority_Always, 4)));
+    
+    std::vector<std::string> messages = dumpMessages(tail);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], "Low");
+    EXPECT_EQ(messages[1], "Medium");
+    
+    // Dumped statements are forgotten
+    //
+    EXPECT_TRUE(dumpMessages(tail).empty());
+}
+
+TEST(TraceTailTest, TraceTailTest_Wrap)
+{
+    TraceTail tail(Trace::kPriority_High, 4, false);
+    
+    for (int i = 0; i < 10; i++)
+        tail.capture(testRecord("Low " + std::to_string(i), Trace::kCategory_Basic | Trace::kPriority_Low, i));
+    
+    // Only the most recent statements are kept
+    //
+    std::vector<std::string> messages = dumpMessages(tail);
+    ASSERT_EQ(messages.size(), 4u);
+    
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(messages[i], "Low " + std::to_string(i + 6));
+}
+
+TEST(TraceTailTest, TraceTailTest_Threads)
+{
+    TraceTail threadTail(Trace::kPriority_High, 8, false);
+    TraceTail allTail(Trace::kPriority_High, 8, true);
+    
+    std::thread other([&]()
+    {
+        threadTail.capture(testRecord("Other", Trace::kCategory_Basic | Trace::kPriority_Low, 2));
+        allTail.capture(testRecord("Other", Trace::kCategory_Basic | Trace::kPriority_Low, 2));
+    });
+    other.join();
+    
+    threadTail.capture(testRecord("Mine", Trace::kCategory_Basic | Trace::kPriority_Low, 1));
+    allTail.capture(testRecord("Mine", Trace::kCategory_Basic | Trace::kPriority_Low, 1));
+    
+    // Only the statements of the calling thread
+    //
+    std::vector<std::string> messages = dumpMessages(threadTail);
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0], "Mine");
+    
+    // The statements of all threads ordered by time,
+    // including the threads that exited
+    //
+    messages = dumpMessages(allTail);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0], "Mine");
+    EXPECT_EQ(messages[1], "Other");
+}
+
+static std::mutex sTailMutex;
+static std::vector<std::string> sTailMessages;
+
+static void TestTailCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sTailMutex);
+    
+    if (strstr(iMessage, "Tail"))
+        sTailMessages.push_back(iMessage);
+}
+
+TEST(TraceTailTest, TraceTailTest_Trace)
+{
+    {
+        std::lock_guard<std::mutex> lock(sTailMutex);
+        sTailMessages.clear();
+    }
+    
+    Trace::instance().initializeWithBuffer("kCategory_Basic@kPriority_Low\ntailThreshold=kPriority_High\ntailSize=3"
+                                           , TestTailCallback);
+    
+    for (int i = 0; i < 5; i++)
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Tail context %d", i);
+    
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Tail error");
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Medium, "Tail after");
+    
+    Trace::instance().reset();
+    
+    std::lock_guard<std::mutex> lock(sTailMutex);
+    ASSERT_EQ(sTailMessages.size(), 4u);
+    EXPECT_NE(sTailMessages[0].find("Tail context 2"), std::string::npos);
+    EXPECT_NE(sTailMessages[1].find("Tail context 3"), std::string::npos);
+    EXPECT_NE(sTailMessages[2].find("Tail context 4"), std::string::npos);
+    EXPECT_NE(sTailMessages[3].find("Tail error"), std::string::npos);
+}
+
+/**
+ * @return the nanoseconds of the day of the "[YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ]" prefix of iLine
+ */
+static uint64_t lineTime(const std::string& iLine)
+{
+    unsigned hours = 0, minutes = 0, seconds = 0, nanoseconds = 0;
+    sscanf(iLine.c_str(), "[%*4d-%*2d-%*2dT%2u:%2u:%2u.%9uZ]", &hours, &minutes, &seconds, &nanoseconds);
+    
+    return ((hours * 3600ull + minutes * 60ull + seconds) * 1000000000ull) + nanoseconds;
+}
+
+TEST(TraceTailTest, TraceTailTest_Timestamps)
+{
+    {
+        std::lock_guard<std::mutex> lock(sTailMutex);
+        sTailMessages.clear();
+    }
+    
+    // A route turns on the precise timestamps of the native backend
+    //
+    const std::string routePath = "TraceTail_route.log";
+    Trace::instance().initializeWithBuffer("backend=native\nkCategory_Basic@kPriority_Low\ntailThreshold=kPriority_High\ntailSize=3\n"
+                                           "route.kCategory_Network=" + routePath
+                                           , TestTailCallback);
+    
+    for (int i = 0; i < 3; i++)
+    {
+        BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Tail context %d", i);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_High, "Tail error");
+    
+    Trace::instance().reset();
+    remove(routePath.c_str());
+    
+    // The dumped statements keep their order and the time they were written,
+    // not the time of the dump
+    //
+    std::lock_guard<std::mutex> lock(sTailMutex);
+    ASSERT_EQ(sTailMessages.size(), 4u);
+    
+    for (int i = 0; i < 3; i++)
+        EXPECT_NE(sTailMessages[i].find("Tail context " + std::to_string(i)), std::string::npos);
+    EXPECT_NE(sTailMessages[3].find("Tail error"), std::string::npos);
+    
+    EXPECT_LT(lineTime(sTailMessages[0]), lineTime(sTailMessages[1]));
+    EXPECT_LT(lineTime(sTailMessages[1]), lineTime(sTailMessages[2]));
+    EXPECT_GE(lineTime(sTailMessages[3]) - lineTime(sTailMessages[2]), 20000000u);
+}
@@ -0,0 +1,249 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "Trace.h"
+#include "TraceNativeBackend.h"
+#include "TraceThreadTuning.h"
+
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+static std::mutex sTuningMutex;
+static std::vector<std::string> sTuningMessages;
+
+/// Affinity and nice level of the thread calling TestTuningCallback
+static int sTuningCpuCount{0};
+static bool sTuningOnCpu0{false};
+static int sTuningNice{0};
+
+static void captureThread()
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+    
+    sTuningCpuCount = CPU_COUNT(&set);
+    sTuningOnCpu0 = CPU_ISSET(0, &set);
+    sTuningNice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+#endif
+}
+
+static void TestTuningCallback(const char* iMessage)
+{
+    std::lock_guard<std::mutex> lock(sTuningMutex);
+    
+    if (sTuningMessages.empty())
+        captureThread();
+    
+    sTuningMessages.push_back(iMessage);
+}
+
+static uint64_t writeWithWakeup(const TraceThreadTuning& iConsumer, int iCount)
+{
+    sTuningMessages.clear();
+    
+    TraceBackendConfig config;
+    config.callback = TestTuningCallback;
+    config.consumer = iConsumer;
+    
+    TraceNativeBackend backend;
+    EXPECT_TRUE(backend.open(config));
+    
+    for (int i = 0; i < iCount; i++)
+    {
+        char message[32];
+        snprintf(message, sizeof(message), "Wakeup %04d", i);
+        backend.write(Trace::kCategory_Basic | Trace::kPriority_Low, nullptr, message);
+    }
+    
+    backend.close();
+    
+    EXPECT_EQ(sTuningMessages.size(), static_cast<size_t>(iCount));
+    for (size_t i = 0; i < sTuningMessages.size(); i++)
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "Wakeup %04d", static_cast<int>(i));
+        EXPECT_NE(sTuningMessages[i].find(expected), std::string::npos) << sTuningMessages[i];
+    }
+    
+    return backend.wakeupCount();
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_ParseCpus)
+{
+    std::vector<uint32_t> cpus;
+    
+    ASSERT_TRUE(TraceThreadTuning::parseCpus("2,3", cpus));
+    EXPECT_EQ(cpus, std::vector<uint32_t>({2, 3}));
+    
+    ASSERT_TRUE(TraceThreadTuning::parseCpus("4-6,1", cpus));
+    EXPECT_EQ(cpus, std::vector<uint32_t>({4, 5, 6, 1}));
+    
+    ASSERT_TRUE(TraceThreadTuning::parseCpus("0", cpus));
+    EXPECT_EQ(cpus, std::vector<uint32_t>({0}));
+    
+    EXPECT_FALSE(TraceThreadTuning::parseCpus("", cpus));
+    EXPECT_FALSE(TraceThreadTuning::parseCpus("a", cpus));
+    EXPECT_FALSE(TraceThreadTuning::parseCpus("3-1", cpus));
+    EXPECT_FALSE(TraceThreadTuning::parseCpus("1,", cpus));
+    EXPECT_FALSE(TraceThreadTuning::parseCpus("1;2", cpus));
+    EXPECT_FALSE(TraceThreadTuning::parseCpus("0-5000", cpus));
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_ParseNames)
+{
+    TraceThreadTuning::Policy policy = TraceThreadTuning::kPolicy_Default;
+    EXPECT_TRUE(TraceThreadTuning::parsePolicy("idle", policy));
+    EXPECT_EQ(policy, TraceThreadTuning::kPolicy_Idle);
+    EXPECT_TRUE(TraceThreadTuning::parsePolicy("rr", policy));
+    EXPECT_EQ(policy, TraceThreadTuning::kPolicy_RoundRobin);
+    EXPECT_FALSE(TraceThreadTuning::parsePolicy("realtime", policy));
+    
+    TraceThreadTuning::Wakeup wakeup = TraceThreadTuning::kWakeup_Notify;
+    EXPECT_TRUE(TraceThreadTuning::parseWakeup("poll", wakeup));
+    EXPECT_EQ(wakeup, TraceThreadTuning::kWakeup_Poll);
+    EXPECT_TRUE(TraceThreadTuning::parseWakeup("spin", wakeup));
+    EXPECT_EQ(wakeup, TraceThreadTuning::kWakeup_Spin);
+    EXPECT_FALSE(TraceThreadTuning::parseWakeup("futex", wakeup));
+}
+
+#ifdef __linux__
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_Apply)
+{
+    // Lowering the priority of a thread never needs privileges
+    //
+    TraceThreadTuning tuning;
+    tuning.cpus = {0};
+    tuning.policy = TraceThreadTuning::kPolicy_Batch;
+    tuning.setNice = true;
+    tuning.nice = 5;
+    
+    std::thread thread([&tuning]()
+    {
+        EXPECT_TRUE(tuning.apply());
+        
+        int policy = 0;
+        struct sched_param param;
+        pthread_getschedparam(pthread_self(), &policy, &param);
+        EXPECT_EQ(policy, SCHED_BATCH);
+        
+        captureThread();
+    });
+    
+    thread.join();
+    
+    EXPECT_EQ(sTuningCpuCount, 1);
+    EXPECT_TRUE(sTuningOnCpu0);
+    EXPECT_EQ(sTuningNice, 5);
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_NativeWriterThread)
+{
+    TraceThreadTuning tuning;
+    tuning.cpus = {0};
+    tuning.setNice = true;
+    tuning.nice = 7;
+    
+    writeWithWakeup(tuning, 10);
+    
+    EXPECT_EQ(sTuningCpuCount, 1);
+    EXPECT_TRUE(sTuningOnCpu0);
+    EXPECT_EQ(sTuningNice, 7);
+}
+#endif
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_WakeupNotify)
+{
+    writeWithWakeup(TraceThreadTuning(), 100);
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_WakeupSpin)
+{
+    TraceThreadTuning tuning;
+    tuning.wakeup = TraceThreadTuning::kWakeup_Spin;
+    tuning.spinUs = 200;
+    
+    writeWithWakeup(tuning, 1000);
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_WakeupBatch)
+{
+    TraceThreadTuning tuning;
+    tuning.wakeup = TraceThreadTuning::kWakeup_Batch;
+    tuning.batchSize = 100;
+    tuning.intervalUs = 1000000;
+    
+    // Every wakeup needs a full batch pending
+    //
+    EXPECT_LE(writeWithWakeup(tuning, 250), 2u);
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_WakeupPoll)
+{
+    TraceThreadTuning tuning;
+    tuning.wakeup = TraceThreadTuning::kWakeup_Poll;
+    tuning.intervalUs = 500;
+    
+    EXPECT_EQ(writeWithWakeup(tuning, 1000), 0u);
+}
+
+TEST(TraceThreadTuningTest, TraceThreadTuningTest_Options)
+{
+    // Every backend feeds the callback from its consumer thread
+    //
+    for (const std::string& name : TraceBackend::available())
+    {
+        Trace::instance().reset();
+        sTuningMessages.clear();
+        sTuningCpuCount = 0;
+        
+        std::string config =
+        "kCategory_Basic@kPriority_Low\n"
+        "backend=" + name + "\n"
+        "consumerWakeup=poll\n"
+        "consumerIntervalUs=200\n"
+        "consumerCpus=0\n";
+        
+        ASSERT_TRUE(Trace::instance().initializeWithBuffer(config, TestTuningCallback)) << name;
+        
+        for (int i = 0; i < 20; i++)
+            BBC_TRACE(Trace::kCategory_Basic | Trace::kPriority_Low, "Polled %d", i);
+        
+        Trace::instance().reset();
+        
+        std::lock_guard<std::mutex> lock(sTuningMutex);
+        ASSERT_EQ(sTuningMessages.size(), 20u) << name;
+        EXPECT_NE(sTuningMessages.back().find("Polled 19"), std::string::npos) << name;
+        
+#ifdef __linux__
+        EXPECT_EQ(sTuningCpuCount, 1) << name;
+        EXPECT_TRUE(sTuningOnCpu0) << name;
+#endif
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+///
+/// Prints the trace statements written to shared memory by TraceSharedMemorySink.
+///
+/// Reference consumer for out of process viewers, see TraceSharedMemory.h for the layout.
+///
+/// Usage:
+///
+///       TraceSharedMemoryCat [--name NAME] [--oldest] [--exit]
+///
+///       --name      name of the shared memory object, defaults to TRACE_SHARED_MEMORY_DEFAULT_NAME
+///       --oldest    start with the oldest statement still in the ring instead of new statements
+///       --exit      exit once all available statements are printed instead of following
+///
+
+#include "TraceSharedMemory.h"
+
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+
+int main(int argc, char* argv[])
+{
+    std::string name = TRACE_SHARED_MEMORY_DEFAULT_NAME;
+    bool fromOldest = false;
+    bool follow = true;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        
+        if (arg == "--name" && i + 1 < argc)
+            name = argv[++i];
+        else if (arg == "--oldest")
+            fromOldest = true;
+        else if (arg == "--exit")
+            follow = false;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--name NAME] [--oldest] [--exit]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    TraceSharedMemoryReader reader;
+    
+    // Wait for the traced process to create the ring
+    //
+    while (!reader.open(name, fromOldest))
+    {
+        if (!follow)
+        {
+            fprintf(stderr, "Failed to open %s\n", name.c_str());
+            return 1;
+        }
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    
+    TraceSharedMemoryRecord record;
+    std::vector<char> message;
+    uint64_t lost = 0;
+    
+    while (true)
+    {
+        TraceSharedMemoryReader::Result result = reader.next(record);
+        
+        if (result == TraceSharedMemoryReader::kResult_Empty)
+        {
+            if (!follow)
+                break;
+            
+            fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        
+        if (result != TraceSharedMemoryReader::kResult_Record)
+            break;
+        
+        // Copy the message out before validating it
+        //
+        message.assign(record.message, record.message + record.length);
+        message.push_back(0);
+        
+        if (!reader.valid(record))
+            continue;
+        
+        if (reader.lostCount() != lost)
+        {
+            printf("--- %llu statements lost ---\n", static_cast<unsigned long long>(reader.lostCount() - lost));
+            lost = reader.lostCount();
+        }
+        
+        time_t seconds = static_cast<time_t>(record.timestamp / 1000000000ull);
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        
+        printf("[%02d:%02d:%02d.%03dZ] [%016llX] [%llx] %s%s\n"
+               , utc.tm_hour
+               , utc.tm_min
+               , utc.tm_sec
+               , static_cast<int>((record.timestamp / 1000000ull) % 1000)
+               , static_cast<unsigned long long>(record.mask)
+               , static_cast<unsigned long long>(record.threadId)
+               , message.data()
+               , record.truncated ? "..." : ""
+               );
+    }
+    
+    fflush(stdout);
+    
+    return 0;
+}